@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file codec_bench.cpp
+ * Measure encode and decode throughput of netbuffer and of every message in
+ * the sensor, aggregator, solver, and world model protocols.
+ *
+ * Every case is run until it has taken at least the minimum time and the
+ * results are written as CSV (the default) or JSON so that they can be
+ * compared across releases. Heap allocations are counted by replacing the
+ * global operator new.
+ *
+ * Usage: owl-bench [--json] [--min-time=SECONDS] [--filter=SUBSTRING]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "aggregator_solver_protocol.hpp"
+#include "arena.hpp"
+#include "netbuffer.hpp"
+#include "sample_batch.hpp"
+#include "sample_data.hpp"
+#include "sensor_aggregator_protocol.hpp"
+#include "string_interner.hpp"
+#include "world_model_protocol.hpp"
+
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+using namespace world_model;
+
+//Count every heap allocation made by the benchmark and by the library.
+//The replacements are not inlined so that the compiler does not mistake
+//the free calls for mismatched deallocations.
+static std::atomic<size_t> allocations(0);
+
+__attribute__((noinline)) void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size == 0 ? 1 : size);
+  if (nullptr == p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+__attribute__((noinline)) void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+//A sink so that the compiler cannot drop the work.
+static size_t sink = 0;
+
+struct BenchCase {
+  std::string name;
+  //"encode" or "decode"
+  std::string operation;
+  //Encoded size of one message, used for the bytes per second figure
+  size_t bytes;
+  std::function<void ()> fn;
+};
+
+struct BenchResult {
+  size_t iterations;
+  double ns_per_msg;
+  double allocs_per_msg;
+};
+
+//Run a case with doubling iteration counts until it takes min_seconds.
+static BenchResult runCase(const BenchCase& bc, double min_seconds) {
+  //Warm up caches and any lazily initialized state.
+  for (size_t i = 0; i < 100; ++i) {
+    bc.fn();
+  }
+  size_t iterations = 100;
+  while (true) {
+    size_t start_allocs = allocations.load();
+    steady_clock::time_point start = steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+      bc.fn();
+    }
+    steady_clock::time_point end = steady_clock::now();
+    size_t allocs = allocations.load() - start_allocs;
+    double ns = duration_cast<nanoseconds>(end - start).count();
+    if (ns >= min_seconds * 1e9 or iterations >= (size_t(1) << 30)) {
+      return BenchResult{iterations, ns / iterations, allocs / (double)iterations};
+    }
+    iterations *= 2;
+  }
+}
+
+//Add an encode case and, if a decoder is given, a decode case of the
+//message that the encoder produces.
+template<typename Make, typename Decode>
+static void addPair(std::vector<BenchCase>& cases, const std::string& name, Make make, Decode decode) {
+  std::shared_ptr<Buffer> encoded = std::make_shared<Buffer>(make());
+  cases.push_back(BenchCase{name, "encode", encoded->size(), [make]() mutable {
+      sink += make().size();
+    }});
+  cases.push_back(BenchCase{name, "decode", encoded->size(), [encoded, decode]() {
+      sink += decode(BuffView(*encoded));
+    }});
+}
+
+//Add a decode case that decodes into an arena, resetting it after every
+//message as a receiver would after every batch.
+template<typename Make, typename Decode>
+static void addArenaDecode(std::vector<BenchCase>& cases, const std::string& name, Make make, Decode decode) {
+  std::shared_ptr<Buffer> encoded = std::make_shared<Buffer>(make());
+  std::shared_ptr<Arena> arena = std::make_shared<Arena>();
+  cases.push_back(BenchCase{name, "decode", encoded->size(), [encoded, arena, decode]() {
+      sink += decode(BuffView(*encoded), *arena);
+      arena->reset();
+    }});
+}
+
+//Add a decode case that interns strings, as a receiver that has already
+//seen the strings in the message would.
+template<typename Make, typename Decode>
+static void addInternedDecode(std::vector<BenchCase>& cases, const std::string& name, Make make, Decode decode) {
+  std::shared_ptr<Buffer> encoded = std::make_shared<Buffer>(make());
+  std::shared_ptr<StringInterner> interner = std::make_shared<StringInterner>();
+  cases.push_back(BenchCase{name, "decode", encoded->size(), [encoded, interner, decode]() {
+      sink += decode(BuffView(*encoded), *interner);
+    }});
+}
+
+//Add an encode case that appends into one buffer which is cleared after
+//every message, as a sender reusing a scratch buffer would.
+template<typename Append>
+static void addReusedEncode(std::vector<BenchCase>& cases, const std::string& name, Append append) {
+  std::shared_ptr<Buffer> scratch = std::make_shared<Buffer>();
+  size_t bytes = append(*scratch);
+  cases.push_back(BenchCase{name, "encode", bytes, [scratch, append]() mutable {
+      scratch->clear();
+      sink += append(*scratch);
+    }});
+}
+
+template<typename Make>
+static void addEncode(std::vector<BenchCase>& cases, const std::string& name, Make make) {
+  size_t bytes = make().size();
+  cases.push_back(BenchCase{name, "encode", bytes, [make]() mutable {
+      sink += make().size();
+    }});
+}
+
+//A 40 character URI with a numeric suffix.
+static URI makeURI(size_t n) {
+  std::u16string num = to_u16string(uint128_t(n));
+  URI uri = u"winlab.building.floor3.room.sensor.";
+  while (uri.size() + num.size() < 40) {
+    uri.push_back(u'0');
+  }
+  return uri + num;
+}
+
+//A 128 bit id with bits set in both halves.
+static uint128_t makeID(uint64_t n) {
+  uint128_t id(n);
+  id.upper = 0x0123456789abcdefULL ^ n;
+  return id;
+}
+
+static Buffer makeData(size_t size, size_t seed) {
+  Buffer data(size);
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = (unsigned char)(seed + i);
+  }
+  return data;
+}
+
+static std::vector<BenchCase> makeCases() {
+  std::vector<BenchCase> cases;
+
+  //Shared payloads: 20 attributes, 40 character URIs, 128 bit ids
+  const size_t num_attributes = 20;
+  std::vector<std::u16string> attr_names;
+  for (size_t i = 0; i < num_attributes; ++i) {
+    attr_names.push_back(u"location.attribute." + to_u16string(uint128_t(i)));
+  }
+  const std::u16string origin = u"grail/localization_solver v1.2";
+
+  //netbuffer primitives, 64 values per iteration
+  {
+    std::shared_ptr<std::vector<unsigned char>> values =
+      std::make_shared<std::vector<unsigned char>>();
+    for (uint64_t i = 0; i < 64; ++i) {
+      pushBackVal<uint64_t>(i * 0x0101010101ULL, *values);
+    }
+    cases.push_back(BenchCase{"netbuffer.pushBackVal_u64x64", "encode", values->size(), []() {
+        std::vector<unsigned char> buff;
+        for (uint64_t i = 0; i < 64; ++i) {
+          pushBackVal<uint64_t>(i, buff);
+        }
+        sink += buff.size();
+      }});
+    cases.push_back(BenchCase{"netbuffer.BuffReader_u64x64", "decode", values->size(), [values]() {
+        BuffReader reader(*values);
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < 64; ++i) {
+          total += reader.readPrimitive<uint64_t>();
+        }
+        sink += total;
+      }});
+    cases.push_back(BenchCase{"netbuffer.BuffView_u64x64", "decode", values->size(), [values]() {
+        BuffView view(*values);
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < 64; ++i) {
+          total += view.readPrimitive<uint64_t>();
+        }
+        sink += total;
+      }});
+    std::u16string str = makeURI(7);
+    std::shared_ptr<std::vector<unsigned char>> encoded =
+      std::make_shared<std::vector<unsigned char>>();
+    pushBackSizedUTF16(*encoded, str);
+    cases.push_back(BenchCase{"netbuffer.pushBackSizedUTF16_40", "encode", encoded->size(), [str]() {
+        std::vector<unsigned char> buff;
+        pushBackSizedUTF16(buff, str);
+        sink += buff.size();
+      }});
+    cases.push_back(BenchCase{"netbuffer.readSizedUTF16_40", "decode", encoded->size(), [encoded]() {
+        BuffView view(*encoded);
+        sink += view.readSizedUTF16().size();
+      }});
+  }
+
+  //Sensor to aggregator and aggregator to solver samples
+  SampleData sample;
+  sample.physical_layer = 1;
+  sample.tx_id = makeID(12345);
+  sample.rx_id = makeID(678);
+  sample.rx_timestamp = 1350000000000LL;
+  sample.rss = -67.5;
+  sample.sense_data = makeData(8, 3);
+  sample.valid = true;
+  addArenaDecode(cases, "sensor_aggregator.sample_arena", [sample]() mutable {
+      return sensor_aggregator::makeSampleMsg(sample);
+    }, [](BuffView view, Arena& arena) {
+      return sensor_aggregator::decodeSampleMsg(view, arena).sense_data.size();
+    });
+  addEncode(cases, "sensor_aggregator.handshake", []() {
+      return sensor_aggregator::makeHandshakeMsg();
+    });
+  addPair(cases, "sensor_aggregator.sample", [sample]() mutable {
+      return sensor_aggregator::makeSampleMsg(sample);
+    }, [](BuffView view) {
+      return sensor_aggregator::decodeSampleMsg(view).sense_data.size();
+    });
+  addArenaDecode(cases, "aggregator_solver.sample_arena", [sample]() mutable {
+      return aggregator_solver::makeSampleMsg(sample);
+    }, [](BuffView view, Arena& arena) {
+      return aggregator_solver::decodeSampleMsg(view, arena).sense_data.size();
+    });
+  addEncode(cases, "aggregator_solver.handshake", []() {
+      return aggregator_solver::makeHandshakeMsg();
+    });
+  addPair(cases, "aggregator_solver.sample", [sample]() mutable {
+      return aggregator_solver::makeSampleMsg(sample);
+    }, [](BuffView view) {
+      return aggregator_solver::decodeSampleMsg(view).sense_data.size();
+    });
+  addReusedEncode(cases, "aggregator_solver.sample_reused", [sample](Buffer& out) {
+      return aggregator_solver::makeSampleMsg(sample, out);
+    });
+  //One receiver's samples from many transmitters in a single batch
+  std::vector<SampleData> batch(64, sample);
+  for (size_t i = 0; i < batch.size(); ++i) {
+    batch[i].tx_id = makeID(12345 + i);
+    batch[i].rx_timestamp += i;
+  }
+  addPair(cases, "aggregator_solver.sample_batch64", [batch]() {
+      return aggregator_solver::makeSampleBatchMsg(batch);
+    }, [](BuffView view) {
+      return aggregator_solver::decodeSampleBatchMsg(view).size();
+    });
+  addReusedEncode(cases, "aggregator_solver.sample_batch64_reused", [batch](Buffer& out) {
+      return aggregator_solver::makeSampleBatchMsg(batch, out);
+    });
+  {
+    //Decode the same batch into reused columns
+    std::shared_ptr<Buffer> encoded = std::make_shared<Buffer>(aggregator_solver::makeSampleBatchMsg(batch));
+    std::shared_ptr<SampleBatch> columns = std::make_shared<SampleBatch>();
+    cases.push_back(BenchCase{"aggregator_solver.sample_batch64_columnar", "decode", encoded->size(),
+        [encoded, columns]() {
+          columns->clear();
+          aggregator_solver::decodeSampleBatchMsg(BuffView(*encoded), *columns);
+          sink += columns->size();
+        }});
+  }
+  aggregator_solver::Subscription sub;
+  for (unsigned char phy = 1; phy <= 4; ++phy) {
+    aggregator_solver::Rule rule;
+    rule.physical_layer = phy;
+    for (size_t i = 0; i < 5; ++i) {
+      aggregator_solver::Transmitter tx;
+      tx.base_id = makeID(1000 * phy + i);
+      tx.mask = makeID(~0ULL);
+      rule.txers.push_back(tx);
+    }
+    rule.update_interval = 1000;
+    sub.push_back(rule);
+  }
+  addPair(cases, "aggregator_solver.subscribe_request", [sub]() mutable {
+      return aggregator_solver::makeSubscribeReqMsg(sub);
+    }, [](BuffView view) {
+      return aggregator_solver::decodeSubscribeMsg(view).size();
+    });
+
+  //Client to world model
+  client::Request request;
+  request.object_uri = u"winlab\\.building\\.floor3\\..*";
+  request.attributes.assign(attr_names.begin(), attr_names.begin() + 5);
+  request.start = 1350000000000LL;
+  request.stop_period = 1000;
+  std::vector<client::AliasType> client_aliases;
+  for (uint32_t i = 0; i < num_attributes; ++i) {
+    client_aliases.push_back(client::AliasType{i + 1, attr_names[i]});
+  }
+  AliasedWorldData wd;
+  wd.object_uri = makeURI(42);
+  for (uint32_t i = 0; i < num_attributes; ++i) {
+    AliasedAttribute attr;
+    attr.name_alias = i + 1;
+    attr.creation_date = 1350000000000LL + i;
+    attr.expiration_date = 0;
+    attr.origin_alias = 1;
+    attr.data = makeData(8 + (i % 4) * 8, i);
+    wd.attributes.push_back(attr);
+  }
+  std::vector<URI> uris;
+  for (size_t i = 0; i < 20; ++i) {
+    uris.push_back(makeURI(i));
+  }
+  std::vector<std::pair<std::u16string, int32_t>> weights;
+  for (int32_t i = 0; i < 5; ++i) {
+    weights.push_back(std::make_pair(origin + to_u16string(uint128_t(i)), i - 2));
+  }
+
+  addEncode(cases, "client.handshake", []() {
+      return client::makeHandshakeMsg();
+    });
+  addEncode(cases, "client.keep_alive", []() {
+      return client::makeKeepAlive();
+    });
+  addPair(cases, "client.snapshot_request", [request]() {
+      return client::makeSnapshotRequest(request, 7);
+    }, [](BuffView view) {
+      return std::get<0>(client::decodeSnapshotRequest(view)).attributes.size();
+    });
+  addPair(cases, "client.range_request", [request]() {
+      return client::makeRangeRequest(request, 7);
+    }, [](BuffView view) {
+      return std::get<0>(client::decodeRangeRequest(view)).attributes.size();
+    });
+  addPair(cases, "client.stream_request", [request]() {
+      return client::makeStreamRequest(request, 7);
+    }, [](BuffView view) {
+      return std::get<0>(client::decodeStreamRequest(view)).attributes.size();
+    });
+  addPair(cases, "client.attribute_alias", [client_aliases]() {
+      return client::makeAttrAliasMsg(client_aliases);
+    }, [](BuffView view) {
+      return client::decodeAttrAliasMsg(view).size();
+    });
+  addPair(cases, "client.origin_alias", [client_aliases]() {
+      return client::makeOriginAliasMsg(client_aliases);
+    }, [](BuffView view) {
+      return client::decodeOriginAliasMsg(view).size();
+    });
+  addPair(cases, "client.request_complete", []() {
+      return client::makeRequestComplete(7);
+    }, [](BuffView view) {
+      return client::decodeRequestComplete(view);
+    });
+  addPair(cases, "client.cancel_request", []() {
+      return client::makeCancelRequest(7);
+    }, [](BuffView view) {
+      return client::decodeCancelRequest(view);
+    });
+  addPair(cases, "client.data_response", [wd]() {
+      return client::makeDataMessage(wd, 7);
+    }, [](BuffView view) {
+      return std::get<0>(client::decodeDataMessage(view)).attributes.size();
+    });
+  addReusedEncode(cases, "client.data_response_reused", [wd](Buffer& out) {
+      return client::makeDataMessage(wd, 7, out);
+    });
+  addArenaDecode(cases, "client.data_response_arena", [wd]() {
+      return client::makeDataMessage(wd, 7);
+    }, [](BuffView view, Arena& arena) {
+      return std::get<0>(client::decodeDataMessage(view, arena)).attributes.size();
+    });
+  addInternedDecode(cases, "client.data_response_interned", [wd]() {
+      return client::makeDataMessage(wd, 7);
+    }, [](BuffView view, StringInterner& interner) {
+      return std::get<0>(client::decodeDataMessage(view, interner)).attributes.size();
+    });
+  addPair(cases, "client.uri_search", []() {
+      return client::makeURISearch(u"winlab\\.building\\..*");
+    }, [](BuffView view) {
+      return client::decodeURISearch(view).size();
+    });
+  addPair(cases, "client.uri_response", [uris]() {
+      return client::makeURISearchResponse(uris);
+    }, [](BuffView view) {
+      return client::decodeURISearchResponse(view).size();
+    });
+  addPair(cases, "client.origin_preference", [weights]() {
+      return client::makeOriginPreference(weights);
+    }, [](BuffView view) {
+      return client::decodeOriginPreference(view).size();
+    });
+
+  //Solver to world model
+  std::vector<solver::AliasType> solver_aliases;
+  for (uint32_t i = 0; i < num_attributes; ++i) {
+    solver_aliases.push_back(solver::AliasType{i + 1, attr_names[i], 0 == i % 5});
+  }
+  std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> on_demand;
+  for (uint32_t i = 0; i < 4; ++i) {
+    on_demand.push_back(std::make_tuple(i + 1, std::vector<std::u16string>(uris.begin(), uris.begin() + 5)));
+  }
+  std::vector<solver::SolutionData> solutions;
+  for (uint32_t i = 0; i < num_attributes; ++i) {
+    solutions.push_back(solver::SolutionData{i + 1, 1350000000000LL + i, makeURI(i), makeData(16, i)});
+  }
+  URI uri = makeURI(42);
+  std::u16string attr = attr_names[0];
+
+  addEncode(cases, "solver.handshake", []() {
+      return solver::makeHandshakeMsg();
+    });
+  addEncode(cases, "solver.keep_alive", []() {
+      return solver::makeKeepAlive();
+    });
+  addPair(cases, "solver.type_announce", [solver_aliases, origin]() {
+      return solver::makeTypeAnnounceMsg(solver_aliases, origin);
+    }, [](BuffView view) {
+      return solver::decodeTypeAnnounceMsg(view).first.size();
+    });
+  addPair(cases, "solver.start_on_demand", [on_demand]() {
+      return solver::makeStartOnDemand(on_demand);
+    }, [](BuffView view) {
+      return solver::decodeStartOnDemand(view).size();
+    });
+  addPair(cases, "solver.stop_on_demand", [on_demand]() {
+      return solver::makeStopOnDemand(on_demand);
+    }, [](BuffView view) {
+      return solver::decodeStopOnDemand(view).size();
+    });
+  addPair(cases, "solver.solver_data", [solutions]() {
+      return solver::makeSolutionMsg(true, solutions);
+    }, [](BuffView view) {
+      return std::get<1>(solver::decodeSolutionMsg(view)).size();
+    });
+  addReusedEncode(cases, "solver.solver_data_reused", [solutions](Buffer& out) {
+      return solver::makeSolutionMsg(true, solutions, out);
+    });
+  addInternedDecode(cases, "solver.solver_data_interned", [solutions]() {
+      return solver::makeSolutionMsg(true, solutions);
+    }, [](BuffView view, StringInterner& interner) {
+      return std::get<1>(solver::decodeSolutionMsg(view, interner)).size();
+    });
+  addPair(cases, "solver.create_uri", [uri, origin]() {
+      return solver::makeCreateURI(uri, 1350000000000LL, origin);
+    }, [](BuffView view) {
+      return std::get<0>(solver::decodeCreateURI(view)).size();
+    });
+  addPair(cases, "solver.expire_uri", [uri, origin]() {
+      return solver::makeExpireURI(uri, 1350000000000LL, origin);
+    }, [](BuffView view) {
+      return std::get<0>(solver::decodeExpireURI(view)).size();
+    });
+  addPair(cases, "solver.expire_attribute", [uri, attr, origin]() {
+      return solver::makeExpireAttribute(uri, attr, origin, 1350000000000LL);
+    }, [](BuffView view) {
+      return std::get<0>(solver::decodeExpireAttribute(view)).size();
+    });
+  addPair(cases, "solver.delete_uri", [uri, origin]() {
+      return solver::makeDeleteURI(uri, origin);
+    }, [](BuffView view) {
+      return solver::decodeDeleteURI(view).first.size();
+    });
+  addPair(cases, "solver.delete_attribute", [uri, attr, origin]() {
+      return solver::makeDeleteAttribute(uri, attr, origin);
+    }, [](BuffView view) {
+      return std::get<0>(solver::decodeDeleteAttribute(view)).size();
+    });
+
+  return cases;
+}
+
+static std::string jsonEscape(const std::string& str) {
+  std::string out;
+  for (char c : str) {
+    if ('"' == c or '\\' == c) {
+      out.push_back('\\');
+    }
+    out.push_back(c);
+  }
+  return out;
+}
+
+int main(int argc, char** argv) {
+  bool json = false;
+  double min_seconds = 0.2;
+  std::string filter;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--json") {
+      json = true;
+    }
+    else if (0 == arg.find("--min-time=")) {
+      min_seconds = std::stod(arg.substr(11));
+    }
+    else if (0 == arg.find("--filter=")) {
+      filter = arg.substr(9);
+    }
+    else {
+      std::cerr<<"Usage: "<<argv[0]<<" [--json] [--min-time=SECONDS] [--filter=SUBSTRING]\n";
+      return 1;
+    }
+  }
+
+  std::vector<BenchCase> cases = makeCases();
+  if (json) {
+    std::cout<<"{\"benchmarks\": [";
+  }
+  else {
+    std::cout<<"benchmark,operation,bytes,iterations,ns_per_msg,msgs_per_sec,bytes_per_sec,allocs_per_msg\n";
+  }
+  bool first = true;
+  for (const BenchCase& bc : cases) {
+    if (not filter.empty() and std::string::npos == bc.name.find(filter)) {
+      continue;
+    }
+    BenchResult result = runCase(bc, min_seconds);
+    double msgs_per_sec = 1e9 / result.ns_per_msg;
+    if (json) {
+      std::cout<<(first ? "\n" : ",\n")<<"  {\"name\": \""<<jsonEscape(bc.name)<<"\", "<<
+        "\"operation\": \""<<bc.operation<<"\", "<<
+        "\"bytes\": "<<bc.bytes<<", "<<
+        "\"iterations\": "<<result.iterations<<", "<<
+        "\"ns_per_msg\": "<<result.ns_per_msg<<", "<<
+        "\"msgs_per_sec\": "<<msgs_per_sec<<", "<<
+        "\"bytes_per_sec\": "<<msgs_per_sec * bc.bytes<<", "<<
+        "\"allocs_per_msg\": "<<result.allocs_per_msg<<"}";
+    }
+    else {
+      std::cout<<bc.name<<','<<bc.operation<<','<<bc.bytes<<','<<result.iterations<<','<<
+        result.ns_per_msg<<','<<msgs_per_sec<<','<<msgs_per_sec * bc.bytes<<','<<
+        result.allocs_per_msg<<'\n';
+    }
+    first = false;
+  }
+  if (json) {
+    std::cout<<"\n]}\n";
+  }
+  return sink == 0;
+}
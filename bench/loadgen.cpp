@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file loadgen.cpp
+ * Drive a whole GRAIL pipeline over loopback and measure how the sockets,
+ * receivers, and event loops hold up under load.
+ *
+ * Sensors send samples to an aggregator at a fixed rate. The aggregator
+ * forwards them to every subscribed solver. Each solver turns its samples
+ * into solutions for a world model, and the world model stores them and
+ * streams them to every client. Every role runs in its own threads and
+ * only talks to the others through sockets with the real protocol
+ * messages. Samples carry their send time through the pipeline so that
+ * clients can measure end to end latency.
+ *
+ * Handshakes are skipped, connections start with the first data message.
+ *
+ * Usage: owl-loadgen [--sensors=N] [--solvers=N] [--clients=N] [--rate=SAMPLES_PER_SEC]
+ *                    [--seconds=S] [--transport=tcp|unix|unixpacket] [--port=P]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "aggregator_solver_protocol.hpp"
+#include "event_loop.hpp"
+#include "message_receiver.hpp"
+#include "metrics.hpp"
+#include "sample_data.hpp"
+#include "sensor_aggregator_protocol.hpp"
+#include "simple_sockets.hpp"
+#include "subscription_index.hpp"
+#include "world_model_protocol.hpp"
+#include "world_store.hpp"
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+using namespace world_model;
+
+struct Options {
+  size_t sensors = 4;
+  size_t solvers = 2;
+  size_t clients = 2;
+  //Samples per second from each sensor
+  double rate = 1000;
+  double seconds = 5;
+  std::string transport = "tcp";
+  uint32_t port = 7400;
+};
+
+//Every thread measures time from the same origin
+static const steady_clock::time_point origin = steady_clock::now();
+
+static int64_t nowNs() {
+  return duration_cast<nanoseconds>(steady_clock::now() - origin).count();
+}
+
+//CPU time used by the calling thread, in microseconds
+static double threadCPU() {
+  rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  return usage.ru_utime.tv_sec * 1e6 + usage.ru_utime.tv_usec +
+    usage.ru_stime.tv_sec * 1e6 + usage.ru_stime.tv_usec;
+}
+
+//How long sensors wait for the solvers to subscribe before sending anyway
+static const std::chrono::seconds subscribe_timeout(10);
+
+//Totals from every thread of each role
+struct Results {
+  std::mutex mutex;
+  //Sensors start sending once the aggregator has every solver's
+  //subscription, otherwise the first samples have nowhere to go.
+  std::condition_variable subscribed_cond;
+  size_t subscribed = 0;
+  std::atomic<uint64_t> samples_sent{0};
+  std::atomic<uint64_t> samples_forwarded{0};
+  std::atomic<uint64_t> solutions_sent{0};
+  std::atomic<uint64_t> data_received{0};
+  double sensor_cpu = 0;
+  double aggregator_cpu = 0;
+  double solver_cpu = 0;
+  double world_model_cpu = 0;
+  double client_cpu = 0;
+  std::vector<int64_t> latencies;
+
+  void addCPU(double& total) {
+    std::unique_lock<std::mutex> lck(mutex);
+    total += threadCPU();
+  }
+
+  void addSubscription() {
+    std::unique_lock<std::mutex> lck(mutex);
+    ++subscribed;
+    subscribed_cond.notify_all();
+  }
+
+  //Returns false if fewer than @solvers subscribed in time
+  bool waitForSubscriptions(size_t solvers) {
+    std::unique_lock<std::mutex> lck(mutex);
+    return subscribed_cond.wait_for(lck, subscribe_timeout, [&]() { return solvers <= subscribed; });
+  }
+};
+
+static std::string endpoint(const Options& opts, const std::string& name, uint32_t offset) {
+  if ("tcp" == opts.transport) {
+    return "tcp:localhost:" + std::to_string(opts.port + offset);
+  }
+  return opts.transport + ":/tmp/owl-loadgen-" + std::to_string(getpid()) + "-" + name + ".sock";
+}
+
+//Send samples at the configured rate for the configured time
+static void runSensor(const Options& opts, std::string ep, size_t sensor, Results& results) {
+  ClientSocket sock(ep);
+  if (not sock) {
+    std::cerr<<"Sensor "<<sensor<<" could not connect to "<<ep<<'\n';
+    return;
+  }
+  //Connect first, since the aggregator accepts every sensor before it
+  //reads any subscriptions
+  if (not results.waitForSubscriptions(opts.solvers)) {
+    std::cerr<<"Sensor "<<sensor<<" is starting before every solver subscribed\n";
+  }
+  SampleData sample;
+  sample.physical_layer = 1;
+  sample.rx_id = sensor;
+  sample.rss = -50;
+  sample.sense_data = std::vector<unsigned char>(8, 0);
+  sample.valid = true;
+  //Samples that are due at the same time are sent together
+  std::vector<unsigned char> scratch;
+  const size_t max_burst = 256;
+  uint64_t sent = 0;
+  steady_clock::time_point start = steady_clock::now();
+  uint64_t total = opts.rate * opts.seconds;
+  try {
+    while (sent < total) {
+      double elapsed = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+      uint64_t due = std::min<uint64_t>(total, elapsed * opts.rate);
+      if (due <= sent) {
+        std::this_thread::sleep_until(start + nanoseconds(uint64_t((sent + 1) * 1e9 / opts.rate)));
+        continue;
+      }
+      scratch.clear();
+      for (size_t burst = 0; sent < due and burst < max_burst; ++burst, ++sent) {
+        sample.tx_id = sent % 100;
+        sample.rx_timestamp = nowNs();
+        sensor_aggregator::makeSampleMsg(sample, scratch);
+      }
+      sock.send(scratch);
+    }
+  }
+  catch (std::exception& err) {
+    std::cerr<<"Sensor "<<sensor<<" stopped: "<<err.what()<<'\n';
+  }
+  results.samples_sent += sent;
+  results.addCPU(results.sensor_cpu);
+}
+
+//One event loop that forwards sensor samples to subscribed solvers
+static void runAggregator(const Options& opts, ServerSocket& from_solvers, ServerSocket& from_sensors,
+                          Results& results) {
+  std::set<uint64_t> solvers;
+  size_t sensors_closed = 0;
+  aggregator_solver::SubscriptionIndex subscriptions;
+  std::vector<aggregator_solver::SubscriptionIndex::Match> matches;
+  std::vector<unsigned char> scratch;
+  uint64_t forwarded = 0;
+  EventLoop* loop_ptr = nullptr;
+  EventLoop loop([&](EventLoop::Connection& conn, const FrameView& frame) {
+      if (solvers.count(conn.id)) {
+        subscriptions.add(conn.id, aggregator_solver::decodeSubscribeMsg(BuffView(frame)));
+        results.addSubscription();
+        return;
+      }
+      SampleData sample = sensor_aggregator::decodeSampleMsg(BuffView(frame));
+      if (not sample.valid) {
+        return;
+      }
+      subscriptions.match(sample.physical_layer, sample.tx_id, matches);
+      for (const aggregator_solver::SubscriptionIndex::Match& match : matches) {
+        scratch.clear();
+        aggregator_solver::makeSampleMsg(sample, scratch);
+        loop_ptr->send(match.subscriber, scratch);
+        ++forwarded;
+      }
+    });
+  loop_ptr = &loop;
+  loop.onClose([&](EventLoop::Connection& conn) {
+      if (not solvers.count(conn.id)) {
+        ++sensors_closed;
+      }
+    });
+  //Every peer is accepted before the run so that each connection's role is known
+  for (size_t i = 0; i < opts.solvers; ++i) {
+    solvers.insert(loop.add(from_solvers.next()));
+  }
+  for (size_t i = 0; i < opts.sensors; ++i) {
+    loop.add(from_sensors.next());
+  }
+  //Run until the sensors are done and everything was passed on
+  while (true) {
+    loop.runOnce(10);
+    bool drained = sensors_closed == opts.sensors;
+    for (uint64_t id : solvers) {
+      EventLoop::Connection* conn = loop.find(id);
+      drained = drained and (nullptr == conn or conn->output.empty());
+    }
+    if (drained) {
+      break;
+    }
+  }
+  results.samples_forwarded += forwarded;
+  results.addCPU(results.aggregator_cpu);
+}
+
+//Turn every sample into a solution for the world model
+static void runSolver(std::string aggregator_ep, std::string world_model_ep, size_t solver, Results& results) {
+  ClientSocket aggregator(aggregator_ep);
+  ClientSocket world_model(world_model_ep);
+  if (not aggregator or not world_model) {
+    std::cerr<<"Solver "<<solver<<" could not connect\n";
+    return;
+  }
+  uint64_t solutions = 0;
+  try {
+    //Every transmitter on physical layer 1
+    aggregator_solver::Rule rule;
+    rule.physical_layer = 1;
+    rule.txers.push_back(aggregator_solver::Transmitter{0, 0});
+    rule.update_interval = 0;
+    aggregator_solver::Subscription sub{rule};
+    aggregator.send(aggregator_solver::makeSubscribeReqMsg(sub));
+    world_model.send(solver::makeTypeAnnounceMsg({solver::AliasType{0, u"location", false}},
+          u"loadgen.solver" + to_u16string(uint128_t(solver))));
+
+    MessageReceiver receiver(aggregator);
+    bool interrupted = false;
+    std::vector<solver::SolutionData> solution(1);
+    std::vector<unsigned char> scratch;
+    while (true) {
+      //Throws once the aggregator closes the connection
+      FrameView frame = receiver.getNextFrame(interrupted);
+      SampleData sample = aggregator_solver::decodeSampleMsg(BuffView(frame));
+      if (not sample.valid) {
+        continue;
+      }
+      solution[0].type_alias = 0;
+      solution[0].time = sample.rx_timestamp;
+      solution[0].target = u"loadgen.transmitter." + to_u16string(sample.tx_id);
+      solution[0].data.assign(sample.sense_data.begin(), sample.sense_data.end());
+      scratch.clear();
+      solver::makeSolutionMsg(true, solution, scratch);
+      world_model.send(scratch);
+      ++solutions;
+    }
+  }
+  catch (std::exception& err) {
+    //The aggregator closing the connection ends the run
+  }
+  results.solutions_sent += solutions;
+  results.addCPU(results.solver_cpu);
+}
+
+//Store every solution and stream it to every client
+static void runWorldModel(const Options& opts, ServerSocket& from_clients, ServerSocket& from_solvers,
+                          Results& results) {
+  std::set<uint64_t> clients;
+  size_t solvers_closed = 0;
+  WorldStore store;
+  std::vector<std::u16string> names(1, u"location");
+  std::vector<unsigned char> scratch;
+  AliasedWorldData wd;
+  wd.attributes.resize(1);
+  EventLoop* loop_ptr = nullptr;
+  EventLoop loop([&](EventLoop::Connection&, const FrameView& frame) {
+      if (frame.size <= 4 or
+          solver::MessageID::solver_data != solver::MessageID(frame.data[4])) {
+        return;
+      }
+      std::tuple<bool, std::vector<solver::SolutionData>> solutions =
+        solver::decodeSolutionMsg(BuffView(frame));
+      for (const solver::SolutionData& soln : std::get<1>(solutions)) {
+        store.insert(soln.target, names.at(soln.type_alias), u"loadgen", soln.time, soln.data);
+        wd.object_uri = soln.target;
+        wd.attributes[0] = AliasedAttribute{soln.type_alias, soln.time, 0, 0, soln.data};
+        scratch.clear();
+        client::makeDataMessage(wd, 0, scratch);
+        for (uint64_t id : clients) {
+          loop_ptr->send(id, scratch);
+        }
+      }
+    });
+  loop_ptr = &loop;
+  loop.onClose([&](EventLoop::Connection& conn) {
+      if (not clients.count(conn.id)) {
+        ++solvers_closed;
+      }
+    });
+  for (size_t i = 0; i < opts.clients; ++i) {
+    clients.insert(loop.add(from_clients.next()));
+  }
+  for (size_t i = 0; i < opts.solvers; ++i) {
+    loop.add(from_solvers.next());
+  }
+  while (true) {
+    loop.runOnce(10);
+    bool drained = solvers_closed == opts.solvers;
+    for (uint64_t id : clients) {
+      EventLoop::Connection* conn = loop.find(id);
+      drained = drained and (nullptr == conn or conn->output.empty());
+    }
+    if (drained) {
+      break;
+    }
+  }
+  results.addCPU(results.world_model_cpu);
+}
+
+//Receive streamed data and record how long each value took to arrive
+static void runClient(std::string ep, size_t client, Results& results) {
+  ClientSocket sock(ep);
+  if (not sock) {
+    std::cerr<<"Client "<<client<<" could not connect to "<<ep<<'\n';
+    return;
+  }
+  std::vector<int64_t> latencies;
+  try {
+    MessageReceiver receiver(sock);
+    bool interrupted = false;
+    Arena arena;
+    while (true) {
+      FrameView frame = receiver.getNextFrame(interrupted);
+      std::tuple<ArenaAliasedWorldData, uint32_t> data = client::decodeDataMessage(BuffView(frame), arena);
+      int64_t now = nowNs();
+      for (const ArenaAliasedAttribute& attr : std::get<0>(data).attributes) {
+        latencies.push_back(now - attr.creation_date);
+      }
+      arena.reset();
+    }
+  }
+  catch (std::exception& err) {
+    //The world model closing the connection ends the run
+  }
+  results.data_received += latencies.size();
+  results.addCPU(results.client_cpu);
+  std::unique_lock<std::mutex> lck(results.mutex);
+  results.latencies.insert(results.latencies.end(), latencies.begin(), latencies.end());
+}
+
+static double percentile(const std::vector<int64_t>& sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = std::min<size_t>(sorted.size() - 1, fraction * sorted.size());
+  return sorted[index] / 1000.0;
+}
+
+int main(int argc, char** argv) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (0 == arg.find("--sensors=")) {
+      opts.sensors = std::stoul(arg.substr(10));
+    }
+    else if (0 == arg.find("--solvers=")) {
+      opts.solvers = std::stoul(arg.substr(10));
+    }
+    else if (0 == arg.find("--clients=")) {
+      opts.clients = std::stoul(arg.substr(10));
+    }
+    else if (0 == arg.find("--rate=")) {
+      opts.rate = std::stod(arg.substr(7));
+    }
+    else if (0 == arg.find("--seconds=")) {
+      opts.seconds = std::stod(arg.substr(10));
+    }
+    else if (0 == arg.find("--transport=")) {
+      opts.transport = arg.substr(12);
+    }
+    else if (0 == arg.find("--port=")) {
+      opts.port = std::stoul(arg.substr(7));
+    }
+    else {
+      std::cerr<<"Usage: "<<argv[0]<<" [--sensors=N] [--solvers=N] [--clients=N] [--rate=SAMPLES_PER_SEC]\n"<<
+        "       [--seconds=S] [--transport=tcp|unix|unixpacket] [--port=P]\n";
+      return 1;
+    }
+  }
+  if ("tcp" != opts.transport and "unix" != opts.transport and "unixpacket" != opts.transport) {
+    std::cerr<<"Unknown transport "<<opts.transport<<'\n';
+    return 1;
+  }
+  if (0 == opts.sensors or 0 == opts.solvers or 0 == opts.clients or opts.rate <= 0) {
+    std::cerr<<"Every role needs at least one thread and the rate must be positive\n";
+    return 1;
+  }
+
+  std::string sensor_ep = endpoint(opts, "sensors", 0);
+  std::string agg_solver_ep = endpoint(opts, "aggregator", 1);
+  std::string wm_solver_ep = endpoint(opts, "solvers", 2);
+  std::string wm_client_ep = endpoint(opts, "clients", 3);
+  ServerSocket sensor_listener(sensor_ep);
+  ServerSocket agg_solver_listener(agg_solver_ep);
+  ServerSocket wm_solver_listener(wm_solver_ep);
+  ServerSocket wm_client_listener(wm_client_ep);
+  if (not sensor_listener or not agg_solver_listener or not wm_solver_listener or not wm_client_listener) {
+    std::cerr<<"Could not listen on every endpoint\n";
+    return 1;
+  }
+
+  Results results;
+  rusage start_usage;
+  getrusage(RUSAGE_SELF, &start_usage);
+  steady_clock::time_point start = steady_clock::now();
+
+  std::vector<std::thread> threads;
+  threads.emplace_back([&]() { runAggregator(opts, agg_solver_listener, sensor_listener, results); });
+  threads.emplace_back([&]() { runWorldModel(opts, wm_client_listener, wm_solver_listener, results); });
+  for (size_t i = 0; i < opts.clients; ++i) {
+    threads.emplace_back([&, i]() { runClient(wm_client_ep, i, results); });
+  }
+  for (size_t i = 0; i < opts.solvers; ++i) {
+    threads.emplace_back([&, i]() { runSolver(agg_solver_ep, wm_solver_ep, i, results); });
+  }
+  for (size_t i = 0; i < opts.sensors; ++i) {
+    threads.emplace_back([&, i]() { runSensor(opts, sensor_ep, i, results); });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  double elapsed = duration_cast<microseconds>(steady_clock::now() - start).count() / 1e6;
+  rusage end_usage;
+  getrusage(RUSAGE_SELF, &end_usage);
+  double cpu = (end_usage.ru_utime.tv_sec - start_usage.ru_utime.tv_sec) * 1e6 +
+    (end_usage.ru_utime.tv_usec - start_usage.ru_utime.tv_usec) +
+    (end_usage.ru_stime.tv_sec - start_usage.ru_stime.tv_sec) * 1e6 +
+    (end_usage.ru_stime.tv_usec - start_usage.ru_stime.tv_usec);
+
+  std::sort(results.latencies.begin(), results.latencies.end());
+  uint64_t sent = results.samples_sent;
+  uint64_t received = results.data_received;
+  uint64_t expected = sent * opts.solvers * opts.clients;
+  std::cout<<"transport "<<opts.transport<<", "<<opts.sensors<<" sensors at "<<opts.rate<<
+    " samples/sec, "<<opts.solvers<<" solvers, "<<opts.clients<<" clients, "<<elapsed<<" seconds\n";
+  std::cout<<"samples sent "<<sent<<", forwarded "<<results.samples_forwarded<<
+    ", solutions "<<results.solutions_sent<<", client values "<<received<<" of "<<expected<<
+    " ("<<(expected > received ? expected - received : 0)<<" dropped)\n";
+  std::cout<<"throughput "<<sent / elapsed<<" samples/sec, "<<received / elapsed<<" client values/sec\n";
+  std::cout<<"latency usec p50 "<<percentile(results.latencies, 0.5)<<
+    " p99 "<<percentile(results.latencies, 0.99)<<
+    " p999 "<<percentile(results.latencies, 0.999)<<
+    " max "<<percentile(results.latencies, 1.0)<<'\n';
+  if (0 < sent) {
+    std::cout<<"cpu usec per sample "<<cpu / sent<<" (sensors "<<results.sensor_cpu / sent<<
+      ", aggregator "<<results.aggregator_cpu / sent<<", solvers "<<results.solver_cpu / sent<<
+      ", world model "<<results.world_model_cpu / sent<<", clients "<<results.client_cpu / sent<<")\n";
+  }
+  if (metrics::enabled()) {
+    metrics::Snapshot snap = metrics::snapshot();
+    std::cout<<"system calls per frame "<<snap.syscallsPerFrame()<<'\n';
+  }
+  return expected == received ? 0 : 1;
+}
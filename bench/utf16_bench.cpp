@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file utf16_bench.cpp
+ * Compare the one pass UTF16 conversion in netbuffer against the previous
+ * implementation that moved one character at a time through readPrimitive
+ * and pushBackVal.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "netbuffer.hpp"
+
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+//The previous implementation: one endian switch and one push_back per character.
+static void legacyPush(std::vector<unsigned char>& buff, const std::u16string& str) {
+  for (auto I = str.begin(); I != str.end(); ++I) {
+    unsigned char* in = (unsigned char*)&(*I);
+    unsigned char bytes[2] = {in[0], in[1]};
+    toNetworkEndian(bytes, sizeof(char16_t));
+    buff.push_back(bytes[0]);
+    buff.push_back(bytes[1]);
+  }
+}
+
+static std::u16string legacyRead(const std::vector<unsigned char>& buff, size_t size) {
+  std::u16string str;
+  for (size_t index = 0; index < size; ++index) {
+    unsigned char bytes[2] = {buff[2*index], buff[2*index+1]};
+    fromNetworkEndian(bytes, sizeof(char16_t));
+    char16_t c;
+    std::copy(bytes, bytes+2, (unsigned char*)&c);
+    str.push_back(c);
+  }
+  return str;
+}
+
+//Run fn the given number of times and return nanoseconds per iteration.
+template<typename F>
+double timeIt(size_t iterations, F fn) {
+  steady_clock::time_point start = steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    fn();
+  }
+  steady_clock::time_point end = steady_clock::now();
+  return duration_cast<nanoseconds>(end - start).count() / (double)iterations;
+}
+
+int main(int argc, char** argv) {
+  size_t iterations = 200000;
+  if (argc > 1) {
+    iterations = std::stoul(argv[1]);
+  }
+  //Lengths cover attribute names, typical URIs, and long URIs.
+  std::vector<size_t> lengths{8, 40, 200, 4000};
+  //A sink so that the compiler cannot drop the work.
+  size_t sink = 0;
+
+  std::cout<<"benchmark,chars,legacy_ns,current_ns,speedup\n";
+  for (size_t length : lengths) {
+    std::u16string str;
+    for (size_t i = 0; i < length; ++i) {
+      str.push_back(u'a' + (i % 26));
+    }
+    size_t reps = iterations * 40 / (length + 40);
+
+    double legacy = timeIt(reps, [&]() {
+        std::vector<unsigned char> buff;
+        legacyPush(buff, str);
+        sink += buff.size();
+      });
+    double current = timeIt(reps, [&]() {
+        std::vector<unsigned char> buff;
+        pushBackUTF16(buff, str);
+        sink += buff.size();
+      });
+    std::cout<<"encode,"<<length<<','<<legacy<<','<<current<<','<<legacy/current<<'\n';
+
+    std::vector<unsigned char> encoded;
+    pushBackUTF16(encoded, str);
+    legacy = timeIt(reps, [&]() {
+        sink += legacyRead(encoded, length).size();
+      });
+    current = timeIt(reps, [&]() {
+        BuffView view(encoded);
+        sink += view.readUTF16(length).size();
+      });
+    std::cout<<"decode,"<<length<<','<<legacy<<','<<current<<','<<legacy/current<<'\n';
+  }
+  return sink == 0;
+}
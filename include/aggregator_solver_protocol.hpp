@@ -33,6 +33,9 @@
 #include <vector>
 #include <iostream>
 
+#include "handshake.hpp"
+#include "netbuffer.hpp"
+#include "sample_batch.hpp"
 #include "sample_data.hpp"
 
 namespace aggregator_solver {
@@ -44,7 +47,9 @@ namespace aggregator_solver {
                   subscription_response = 4,
                   device_position       = 5,
                   server_sample         = 6,
-                  buffer_overrun        = 7};
+                  buffer_overrun        = 7,
+                  //Only sent if handshake::sample_batching was negotiated
+                  sample_batch          = 8};
 
   //Requests for transmitters are made up of a base ID and a mask (to specify ranges)
   struct Transmitter {
@@ -62,19 +67,72 @@ namespace aggregator_solver {
 
   typedef std::vector<Rule> Subscription;
 
+  /*
+   * Each make function has a matching size function that returns the
+   * encoded size of the message in bytes, including its length field.
+   *
+   * Make functions that take an output buffer append the message to it
+   * and return the number of bytes added. Reusing one buffer, clearing it
+   * after each send, avoids allocating a new buffer for every message.
+   */
   std::vector<unsigned char> makeHandshakeMsg();
+  ///Make a handshake that advertises the given capabilities.
+  std::vector<unsigned char> makeHandshakeMsg(handshake::Capabilities capabilities);
+  size_t handshakeMsgSize();
 
-  std::vector<unsigned char>&& makeCertMsg();
+  ///Decode a peer's handshake, which is only valid for this protocol.
+  handshake::Handshake decodeHandshakeMsg(BuffView buff);
 
-  std::vector<unsigned char>&& ackCertMsg();
+  ///Certificates were never defined so these messages have no body.
+  std::vector<unsigned char> makeCertMsg();
+
+  std::vector<unsigned char> ackCertMsg();
 
   std::vector<unsigned char> makeSubscribeReqMsg(Subscription& sub);
+  size_t makeSubscribeReqMsg(const Subscription& sub, std::vector<unsigned char>& out);
+  size_t subscribeReqMsgSize(const Subscription& sub);
 
   Subscription decodeSubscribeMsg(std::vector<unsigned char>& buff, unsigned int length);
+  ///Decode a subscription message in place, the view must hold one whole message.
+  Subscription decodeSubscribeMsg(BuffView buff);
 
   std::vector<unsigned char> makeSampleMsg(SampleData& sample);
+  std::vector<unsigned char> makeSampleMsg(const ArenaSampleData& sample);
+  size_t makeSampleMsg(const SampleData& sample, std::vector<unsigned char>& out);
+  size_t makeSampleMsg(const ArenaSampleData& sample, std::vector<unsigned char>& out);
+  size_t sampleMsgSize(const SampleData& sample);
+  size_t sampleMsgSize(const ArenaSampleData& sample);
 
   SampleData decodeSampleMsg(std::vector<unsigned char>& buff, unsigned int length);
+  ///Decode a sample message in place, the view must hold one whole message.
+  SampleData decodeSampleMsg(BuffView buff);
+
+  /**
+   * Decode a sample whose sense data is allocated from the arena, so that
+   * a batch of samples is freed with one Arena::reset.
+   */
+  ArenaSampleData decodeSampleMsg(BuffView buff, Arena& arena);
+
+  /**
+   * Pack many samples into one sample_batch message. Consecutive samples
+   * from the same receiver and physical layer share a group header with
+   * the receiver ID and a base timestamp, and each sample in the group only
+   * carries its transmitter, a 32 bit timestamp offset, rss, and sense data.
+   * Sample order is preserved.
+   */
+  std::vector<unsigned char> makeSampleBatchMsg(const std::vector<SampleData>& samples);
+  size_t makeSampleBatchMsg(const std::vector<SampleData>& samples, std::vector<unsigned char>& out);
+  size_t sampleBatchMsgSize(const std::vector<SampleData>& samples);
+
+  ///Decode a sample_batch message. An invalid message yields no samples.
+  std::vector<SampleData> decodeSampleBatchMsg(BuffView buff);
+
+  /**
+   * Decode a sample_batch message straight into the columns of @out,
+   * appending to any samples already there. Returns false, leaving @out as
+   * it was, if the message is invalid.
+   */
+  bool decodeSampleBatchMsg(BuffView buff, SampleBatch& out);
 
 };
 
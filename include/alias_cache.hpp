@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file alias_cache.hpp
+ * Defines the AliasCache class that clients use to turn the aliased
+ * attributes sent by a world model back into names and origins.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __ALIAS_CACHE_HPP__
+#define __ALIAS_CACHE_HPP__
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "world_model_protocol.hpp"
+
+namespace world_model {
+  namespace client {
+
+    /**
+     * Remembers the attribute and origin aliases that a world model sends
+     * and resolves aliased world data with them. World models hand out
+     * small consecutive aliases so names are kept in vectors indexed by
+     * alias; unusually large aliases fall back to a map.
+     *
+     * Aliased world data can either be turned into WorldData, moving the
+     * attribute data instead of copying it, or read through views that
+     * refer to the cached names without copying anything.
+     */
+    class AliasCache {
+      public:
+        ///An attribute with its aliases resolved. Valid while the cache and attribute are.
+        struct AttributeView {
+          const std::u16string* name;
+          const std::u16string* origin;
+          const AliasedAttribute* attribute;
+          //False if either alias has not been defined yet
+          bool resolved() const { return nullptr != name and nullptr != origin; }
+        };
+
+      private:
+        struct Table {
+          std::vector<std::u16string> names;
+          std::vector<bool> defined;
+          std::unordered_map<uint32_t, std::u16string> sparse;
+
+          void define(uint32_t alias, const std::u16string& name);
+          const std::u16string* find(uint32_t alias) const;
+          void clear();
+        };
+
+        Table attributes;
+        Table origins;
+
+      public:
+        /**
+         * If @msg is an attribute or origin alias message then remember
+         * its aliases and return true. Any other message returns false so
+         * that every received message can be passed here first.
+         */
+        bool update(BuffView msg);
+
+        void addAttributeAliases(const std::vector<AliasType>& aliases);
+        void addOriginAliases(const std::vector<AliasType>& aliases);
+
+        ///The name for an alias, or nullptr if it is not known.
+        const std::u16string* attributeName(uint32_t alias) const;
+        const std::u16string* originName(uint32_t alias) const;
+
+        ///Look up the names of an attribute without copying them.
+        AttributeView view(const AliasedAttribute& attribute) const;
+
+        /**
+         * Turn aliased data into world data. The attribute data is moved out
+         * of @aliased so only the names are copied. Returns false if any
+         * alias was unknown, in which case its name or origin is empty.
+         */
+        bool resolve(AliasedWorldData&& aliased, WorldData& out) const;
+
+        /**
+         * Decode a data message and resolve it into @out in one step.
+         * Returns false if the message is invalid or uses unknown aliases.
+         */
+        bool decodeData(BuffView msg, WorldData& out, uint32_t& ticket_number) const;
+
+        ///Forget every alias, such as after reconnecting to a world model.
+        void clear();
+    };
+  }
+}
+
+#endif
+
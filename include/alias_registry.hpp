@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file alias_registry.hpp
+ * Defines the AliasRegistry class that a world model keeps for each client
+ * connection to decide which aliases still have to be sent.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __ALIAS_REGISTRY_HPP__
+#define __ALIAS_REGISTRY_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#include "string_interner.hpp"
+#include "world_model_protocol.hpp"
+
+namespace world_model {
+  namespace client {
+
+    /**
+     * Tracks the attribute and origin aliases that were already sent on one
+     * connection. Aliases are handed out consecutively starting at 1 and
+     * are found with the interned ID of the name, so with interned
+     * attributes aliasing is a vector lookup per attribute. The interner is
+     * normally shared by every connection of a world model; the names
+     * should be interned once, outside of the loop over clients.
+     */
+    class AliasRegistry {
+      private:
+        StringInterner& interner;
+        //Alias of each interned string, or 0 if it has not been sent
+        std::vector<uint32_t> attribute_aliases;
+        std::vector<uint32_t> origin_aliases;
+        uint32_t next_attribute;
+        uint32_t next_origin;
+        //Reused to build messages without allocating for every call
+        AliasedWorldData scratch;
+        std::vector<AliasType> new_attributes;
+        std::vector<AliasType> new_origins;
+
+        //Find or assign an alias, adding new ones to @added
+        static uint32_t aliasFor(std::vector<uint32_t>& table, uint32_t& next,
+            const InternedString& name, std::vector<AliasType>& added);
+
+      public:
+        ///The interner must outlive the registry.
+        AliasRegistry(StringInterner& interner);
+
+        /**
+         * Alias the attributes of @uri into @out. Aliases that are new to this
+         * connection are appended to @added_attributes and
+         * @added_origins; they must reach the client before @out does.
+         */
+        void alias(const InternedString& uri, const std::vector<InternedAttribute>& attributes,
+            AliasedWorldData& out, std::vector<AliasType>& added_attributes,
+            std::vector<AliasType>& added_origins);
+
+        ///Alias world data with string names by interning them first.
+        void alias(const WorldData& wd, AliasedWorldData& out,
+            std::vector<AliasType>& added_attributes, std::vector<AliasType>& added_origins);
+
+        /**
+         * Append the messages that send the attributes to this client:
+         * alias messages for any new aliases followed by the data message.
+         */
+        void makeMessages(const InternedString& uri, const std::vector<InternedAttribute>& attributes,
+            uint32_t ticket_number, std::vector<Buffer>& out);
+        void makeMessages(const WorldData& wd, uint32_t ticket_number, std::vector<Buffer>& out);
+
+        ///The alias sent for a name, or 0 if it has not been sent.
+        uint32_t attributeAlias(const InternedString& name) const;
+        uint32_t originAlias(const InternedString& origin) const;
+
+        ///Forget every alias, such as when the client reconnects.
+        void clear();
+    };
+  }
+}
+
+#endif
+
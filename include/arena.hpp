@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file arena.hpp
+ * Defines a bump allocator (the Arena) and an STL allocator that uses it so
+ * that a batch of decoded messages can be released all at once.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __ARENA_HPP__
+#define __ARENA_HPP__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Memory is handed out from large blocks by moving a pointer forward and
+ * is never freed individually. Calling reset makes all of the memory
+ * available again (without returning the blocks to the system) so decoding
+ * a batch of messages into an arena costs a few allocations for the first
+ * batch and none afterwards.
+ *
+ * An Arena is not thread safe. Objects allocated from it must not be used
+ * after reset is called.
+ */
+class Arena {
+  private:
+    struct Block {
+      unsigned char* data;
+      size_t size;
+    };
+    std::vector<Block> blocks;
+    //Block that allocations are currently made from
+    size_t current;
+    //Offset of the free space in the current block
+    size_t offset;
+    size_t block_size;
+    //Bytes handed out since the last reset
+    size_t used;
+
+    //No copying or assignment.
+    Arena& operator=(const Arena&) = delete;
+    Arena(const Arena&) = delete;
+
+  public:
+    ///Create an arena that allocates memory in blocks of @block_size bytes.
+    Arena(size_t block_size = 64 * 1024);
+
+    ///Free all of the blocks.
+    ~Arena();
+
+    /**
+     * Allocate @bytes bytes with the given alignment, which must be a power
+     * of two. Allocations larger than the block size get their own block.
+     */
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    ///Release everything allocated from the arena, keeping its blocks.
+    void reset();
+
+    ///Bytes allocated since the last reset.
+    size_t bytesUsed() const;
+
+    ///Total size of the blocks owned by the arena.
+    size_t capacity() const;
+};
+
+/**
+ * An STL allocator that takes memory from an Arena. Deallocation does
+ * nothing; the memory is reclaimed when the arena is reset. A default
+ * constructed allocator has no arena and uses the global operator new, so
+ * containers with this allocator still work without one.
+ *
+ * The allocator propagates on assignment, so an empty container made with
+ * an arena can be assigned to a member to make that member use the arena.
+ */
+template<typename T>
+struct ArenaAllocator {
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  template<typename U>
+  struct rebind {
+    typedef ArenaAllocator<U> other;
+  };
+
+  Arena* arena;
+
+  ArenaAllocator() : arena(nullptr) {}
+  ArenaAllocator(Arena& arena) : arena(&arena) {}
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+  T* allocate(size_t n) {
+    if (nullptr == arena) {
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, size_t) {
+    if (nullptr == arena) {
+      ::operator delete(p);
+    }
+  }
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena == b.arena;
+}
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena != b.arena;
+}
+
+#endif
+
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file compression.hpp
+ * Compressed envelopes that carry a batch of already encoded messages in a
+ * single frame, such as the many data messages of a large range request.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __COMPRESSION_HPP__
+#define __COMPRESSION_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#include "frame_buffer.hpp"
+#include "handshake.hpp"
+#include "netbuffer.hpp"
+
+namespace compression {
+
+  /*
+   * An envelope is a normal length prefixed frame whose message type is
+   * envelope_type, followed by the codec, the size of the messages after
+   * decompression, and the compressed messages. No protocol uses message
+   * type 255 for anything else. Envelopes may only be sent to peers that
+   * negotiated the matching handshake capability, and an envelope never
+   * holds another envelope.
+   */
+  const uint8_t envelope_type = 255;
+
+  enum Codec : uint8_t {deflate = 1, lz4 = 2, zstd = 3};
+
+  ///Envelopes larger than this after decompression are rejected.
+  const uint32_t max_unpacked_size = 1 << 26;
+
+  ///The handshake capability bits for each codec in this build.
+  handshake::Capabilities supported();
+
+  ///True if this build can compress and decompress with @codec.
+  bool available(Codec codec);
+
+  ///The handshake capability that permits sending @codec.
+  handshake::Capability capability(Codec codec);
+
+  /**
+   * Choose the codec to use with a peer given the negotiated capabilities,
+   * preferring zstd, then lz4, then deflate. Returns false if no codec was
+   * negotiated.
+   */
+  bool choose(handshake::Capabilities negotiated, Codec& codec);
+
+  /**
+   * Compress @messages, which are whole encoded frames, into one envelope.
+   * Throws a std::runtime_error if the codec is not available.
+   */
+  std::vector<unsigned char> makeEnvelope(const std::vector<std::vector<unsigned char>>& messages, Codec codec);
+
+  ///Compress @length bytes of consecutive encoded frames into one envelope.
+  std::vector<unsigned char> makeEnvelope(const unsigned char* frames, size_t length, Codec codec);
+
+  ///True if the frame is an envelope.
+  bool isEnvelope(const FrameView& frame);
+
+  /**
+   * Decompress an envelope and append the messages it holds to @out.
+   * Returns false, leaving @out unchanged, if the envelope is corrupt, too
+   * large, holds another envelope, or uses a codec that is not available.
+   */
+  bool openEnvelope(const FrameView& envelope, FrameBuffer& out);
+  bool openEnvelope(const FrameView& envelope, std::vector<unsigned char>& out);
+}
+
+#endif
+
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file event_loop.hpp
+ * Defines the EventLoop class that serves many owl/grail connections from
+ * a single thread with epoll.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __EVENT_LOOP_HPP__
+#define __EVENT_LOOP_HPP__
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "frame_buffer.hpp"
+#include "frame_queue.hpp"
+#include "send_buffer.hpp"
+#include "simple_sockets.hpp"
+
+/**
+ * An epoll based reactor. Listening sockets and connected sockets are
+ * registered with a single epoll descriptor in edge triggered mode. New
+ * connections are accepted in a batch whenever a listener becomes ready
+ * and each connection receives into its own FrameBuffer. Every complete
+ * message is passed to the frame handler as soon as it arrives, so one
+ * thread can serve thousands of solvers and clients.
+ *
+ * Data sent with EventLoop::send never blocks. Whatever the socket cannot
+ * take right away waits in the connection's SendBuffer and is written when
+ * epoll reports that the socket is writable.
+ *
+ * All handlers are called from the thread that calls runOnce or run.
+ * Other than wakeup the EventLoop is not thread safe.
+ */
+class EventLoop {
+  public:
+    /**
+     * A connection owned by the event loop.
+     */
+    struct Connection {
+      ///Identifier of this connection, unique within one EventLoop.
+      uint64_t id;
+      ClientSocket sock;
+      ///Received data that has not yet been dispatched as a frame.
+      FrameBuffer frames;
+      ///Outgoing data that the socket has not accepted yet.
+      SendBuffer output;
+      ///True once close has been called for this connection.
+      bool closing;
+      ///True while epoll is watching for the socket to become writable.
+      bool watching_output;
+
+      Connection(uint64_t id, ClientSocket&& sock);
+    };
+
+    /**
+     * Called with each complete message. The frame is only valid for the
+     * duration of the call.
+     */
+    typedef std::function<void (Connection&, const FrameView&)> FrameHandler;
+
+    ///Called when a connection is added or removed.
+    typedef std::function<void (Connection&)> ConnectionHandler;
+
+  private:
+    int epoll_fd;
+    //eventfd used to interrupt epoll_wait from another thread
+    int wake_fd;
+    //Listening sockets are not owned by the loop
+    std::vector<ServerSocket*> listeners;
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+    uint64_t next_id;
+    //Connections that reached their read budget before their socket was
+    //drained. Edge triggered epoll will not report them again so they are
+    //read again on the next call to runOnce.
+    std::vector<uint64_t> pending;
+    //Connections that should be removed after the current events
+    std::vector<uint64_t> closed;
+
+    FrameHandler frame_handler;
+    ConnectionHandler connect_handler;
+    ConnectionHandler close_handler;
+    ConnectionHandler high_water_handler;
+    ConnectionHandler low_water_handler;
+
+    //Queue that received frames are copied into instead of calling the
+    //frame handler, and frames that did not fit into it yet. No more frames
+    //are dispatched while the backlog holds max_forward_backlog of them.
+    SPSCQueue<QueuedFrame>* forward_queue;
+    std::deque<QueuedFrame> forward_backlog;
+    size_t max_forward_backlog;
+    //Connections that send a message larger than this are closed
+    size_t max_frame_size;
+    //Queues of outgoing messages filled by other threads
+    std::vector<MPSCQueue<QueuedFrame>*> send_queues;
+
+    //No copying or assignment.
+    EventLoop& operator=(const EventLoop&) = delete;
+    EventLoop(const EventLoop&) = delete;
+
+    //Accept connections from the listener until none remain.
+    void acceptAll(ServerSocket& listener);
+
+    //Receive data and dispatch frames. Returns true if the read budget ran
+    //out or the forward backlog filled up before the socket was drained.
+    bool readConnection(Connection& conn);
+
+    //Dispatch the complete frames in the connection's buffer, closing the
+    //connection if the next one is over the maximum frame size. Returns
+    //false if some were left because the forward backlog is full.
+    bool dispatchFrames(Connection& conn);
+
+    //True if the forward backlog has reached its bound.
+    bool forwardFull() const;
+
+    //Register a descriptor with epoll under the given key.
+    void watch(int fd, uint64_t key);
+
+    //Write the connection's backlog and watch for writability only while
+    //data is left over.
+    void flushOutput(Connection& conn);
+
+    //Remove connections that were closed.
+    void reapClosed();
+
+    //Copy a frame into the forward queue, or the backlog if it is full.
+    void forwardFrame(uint64_t id, const FrameView& frame);
+
+    //Move as much of the forward backlog as fits into the forward queue.
+    void drainBacklog();
+
+    //Send the messages waiting in the send queues.
+    void drainSendQueues();
+
+  public:
+    /**
+     * Create an event loop that passes every received message to
+     * @handler.
+     * Throws a std::runtime_error if epoll cannot be initialized.
+     */
+    EventLoop(FrameHandler handler);
+
+    ///Close all remaining connections. Close handlers are not called.
+    ~EventLoop();
+
+    ///Set the handler called when a connection is accepted or added.
+    void onConnect(ConnectionHandler handler);
+
+    ///Set the handler called just before a connection is destroyed.
+    void onClose(ConnectionHandler handler);
+
+    /**
+     * Set the handler called when a connection's send backlog reaches its
+     * high water mark, for instance to stop sending to a slow peer or to
+     * close it.
+     */
+    void onHighWater(ConnectionHandler handler);
+
+    ///Set the handler called when a congested backlog drains again.
+    void onLowWater(ConnectionHandler handler);
+
+    /**
+     * Close connections that send a message larger than @bytes, including
+     * its length field, instead of buffering it. Receive buffers only grow
+     * as a message's data arrives, never to its declared length at once.
+     * The default is default_max_frame_size.
+     */
+    void setMaxFrameSize(size_t bytes);
+
+    /**
+     * Accept connections from this listening socket. The socket is switched
+     * to nonblocking mode and must outlive the event loop.
+     */
+    void listen(ServerSocket& listener);
+
+    /**
+     * Take ownership of a connected socket. The socket is switched to
+     * nonblocking mode. Returns the id of the new connection.
+     */
+    uint64_t add(ClientSocket&& sock);
+
+    /**
+     * Close a connection. No further frames are dispatched for it and it is
+     * removed, calling the close handler, once the current events have been
+     * handled. This is safe to call from inside a handler.
+     */
+    void close(uint64_t id);
+
+    /**
+     * Send a message without blocking. Unsent data is kept in the
+     * connection's SendBuffer and written when the socket is writable.
+     * Returns false if the message was dropped because the backlog is full
+     * or the connection is closing. A connection whose socket fails is
+     * closed.
+     */
+    bool send(Connection& conn, std::vector<unsigned char> buff);
+
+    ///Send to the connection with the given id, as above.
+    bool send(uint64_t id, std::vector<unsigned char> buff);
+
+    ///Find a connection by id, returning nullptr if it does not exist.
+    Connection* find(uint64_t id);
+
+    ///Number of connections, including those that are being closed.
+    size_t size() const;
+
+    /**
+     * Copy every received message into @queue instead of passing it to the
+     * frame handler, so that a worker thread can decode and handle messages
+     * while this thread keeps serving sockets. The loop is the queue's only
+     * producer and the worker should be its only consumer, and the worker
+     * can sleep in SPSCQueue::waitForItems while the queue is empty.
+     *
+     * Messages that do not fit are kept, in order, until the worker makes
+     * room, so nothing is lost. Once @max_backlog messages are waiting the
+     * loop stops reading from its connections until the worker catches up,
+     * so senders are held back by TCP flow control instead of the loop's
+     * memory growing without bound. While messages are waiting the loop
+     * checks for room every millisecond.
+     *
+     * Pass nullptr to go back to calling the frame handler.
+     * The queue must outlive the event loop or be detached first.
+     */
+    void forwardTo(SPSCQueue<QueuedFrame>* queue, size_t max_backlog = 4096);
+
+    ///Number of forwarded messages waiting for room in the forward queue.
+    size_t forwardBacklog() const;
+
+    /**
+     * Send the messages that other threads push into @queue. Every call to
+     * runOnce sends what is waiting in the queue, so a producer should call
+     * wakeup after pushing. Messages for connections that no longer exist
+     * are dropped. The queue must outlive the event loop.
+     */
+    void sendFrom(MPSCQueue<QueuedFrame>* queue);
+
+    ///Make a blocked runOnce call return. This may be called from any thread.
+    void wakeup();
+
+    /**
+     * Wait up to @msec_timeout milliseconds (-1 to wait forever) for
+     * socket events and handle them. Returns the number of events handled.
+     * Throws a std::runtime_error if epoll fails.
+     */
+    size_t runOnce(int msec_timeout);
+
+    ///Handle events until @interrupted becomes true.
+    void run(bool& interrupted);
+};
+
+#endif
+
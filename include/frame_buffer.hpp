@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file frame_buffer.hpp
+ * Defines the FrameBuffer class that splits a stream of bytes into
+ * length prefixed owl/grail messages without copying them.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __FRAME_BUFFER_HPP__
+#define __FRAME_BUFFER_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#include "netbuffer.hpp"
+
+/**
+ * A view of one complete message (including its four byte length field)
+ * inside of a FrameBuffer. The view is only valid until more data is
+ * written into the buffer that it came from.
+ */
+typedef ByteSpan FrameView;
+
+/**
+ * Messages larger than this, including their length field, are rejected by
+ * default. Receivers can raise or lower the limit.
+ */
+const size_t default_max_frame_size = 1 << 26;
+
+/**
+ * A growable receive buffer. Data is written directly into the free space
+ * at the end of the buffer and whole messages are handed out as views from
+ * the front. The unread bytes are only moved back to the start of the
+ * storage when the free space runs out, and the storage only grows when a
+ * single message is larger than it, so once the buffer has reached the size
+ * of the largest message no further allocations or copies of whole
+ * messages are made.
+ */
+class FrameBuffer {
+  private:
+    std::vector<unsigned char> storage;
+    //Index of the first byte that has not been handed out in a frame
+    size_t head;
+    //Index one past the last byte that was written
+    size_t tail;
+
+  public:
+    /**
+     * Create a buffer with the given initial capacity.
+     */
+    FrameBuffer(size_t capacity = 10000);
+
+    ///Number of bytes that have been written but not handed out in a frame
+    size_t buffered() const;
+
+    ///Number of bytes that can be written without calling reserve
+    size_t writable() const;
+
+    ///Total capacity of the buffer
+    size_t capacity() const;
+
+    /**
+     * Make sure that at least @bytes bytes can be written, first by moving
+     * unread data to the start of the buffer and then by growing it.
+     * This invalidates any frames that were previously returned.
+     */
+    void reserve(size_t bytes);
+
+    /**
+     * Pointer to the free space where new data should be written.
+     * Call commit after writing to make the data available to nextFrame.
+     */
+    unsigned char* writePtr();
+
+    ///Mark @bytes bytes written at writePtr as available.
+    void commit(size_t bytes);
+
+    ///Copy data into the buffer, growing it if necessary.
+    void append(const unsigned char* data, size_t bytes);
+
+    /**
+     * Number of bytes that are still missing from the message at the front
+     * of the buffer, or 0 if a whole message is available. If the length
+     * of the message is not known yet this is the number of bytes needed to
+     * read the length field.
+     */
+    size_t frameNeed() const;
+
+    /**
+     * Size of the message at the front of the buffer including its length
+     * field, or 0 if the length field has not arrived yet.
+     */
+    size_t frameSize() const;
+
+    /**
+     * How much space to reserve before the next receive: the rest of the
+     * message at the front, but no more than twice the current capacity
+     * (or 64 KiB if that is larger), and no less than @minimum. The length
+     * field alone comes from the peer so the buffer only grows as the data
+     * of a large message actually arrives.
+     */
+    size_t receiveNeed(size_t minimum) const;
+
+    ///True if a whole message is buffered.
+    bool frameAvailable() const;
+
+    /**
+     * If a whole message is buffered then set frame to a view of it,
+     * remove it from the buffer, and return true. Otherwise return false.
+     */
+    bool nextFrame(FrameView& frame);
+
+    ///Like nextFrame but leave the message in the buffer.
+    bool peekFrame(FrameView& frame) const;
+
+    ///Discard all buffered data.
+    void clear();
+};
+
+#endif
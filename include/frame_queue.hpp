@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file frame_queue.hpp
+ * Defines bounded lock free queues used to hand messages between I/O
+ * threads and worker threads without either side blocking the other, and
+ * a wait that lets an idle consumer sleep until something is pushed.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __FRAME_QUEUE_HPP__
+#define __FRAME_QUEUE_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+//Size of a cache line. The indices written by the producer and the consumer
+//are kept on separate lines so that they do not invalidate one another.
+static const size_t queue_cache_line = 64;
+
+///Round @n up to a power of two, with a minimum of 2.
+inline size_t queueCapacity(size_t n) {
+  size_t capacity = 2;
+  while (capacity < n) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+/**
+ * Lets a queue's consumer sleep until a producer pushes something. The
+ * producer only takes the lock when the consumer is actually asleep, so a
+ * busy queue pays one memory fence per push and nothing else.
+ */
+class QueueWait {
+  private:
+    std::mutex lock;
+    std::condition_variable cond;
+    std::atomic<bool> sleeping;
+
+  public:
+    QueueWait() : sleeping(false) {
+    }
+
+    ///Called by a producer after it has published new items.
+    void notify() {
+      //Order the publish before reading sleeping. The consumer does the
+      //opposite in wait so at least one side sees the other.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> guard(lock);
+        cond.notify_one();
+      }
+    }
+
+    /**
+     * Called by the consumer to wait until @ready returns true or
+     * @msec_timeout milliseconds have passed (-1 waits forever). Returns
+     * the last result of @ready.
+     */
+    template<typename Ready>
+    bool wait(Ready ready, int msec_timeout) {
+      if (ready()) {
+        return true;
+      }
+      std::unique_lock<std::mutex> guard(lock);
+      sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      bool result = true;
+      if (msec_timeout < 0) {
+        cond.wait(guard, ready);
+      }
+      else {
+        result = cond.wait_for(guard, std::chrono::milliseconds(msec_timeout), ready);
+      }
+      sleeping.store(false, std::memory_order_relaxed);
+      return result;
+    }
+};
+
+/**
+ * A bounded queue for exactly one producer thread and one consumer thread.
+ * Neither side ever blocks: tryPush fails when the queue is full and tryPop
+ * fails when it is empty. A consumer with nothing else to do can sleep in
+ * waitForItems instead of polling. The capacity is rounded up to a power of
+ * two.
+ *
+ * The batch calls read the other side's index once for the whole batch so
+ * moving many items costs about as much synchronization as moving one.
+ */
+template<typename T>
+class SPSCQueue {
+  private:
+    std::vector<T> slots;
+    size_t mask;
+    char pad0[queue_cache_line];
+    //Next slot to pop, written only by the consumer
+    std::atomic<size_t> head;
+    //The consumer's last view of tail
+    size_t cached_tail;
+    char pad1[queue_cache_line];
+    //Next slot to push, written only by the producer
+    std::atomic<size_t> tail;
+    //The producer's last view of head
+    size_t cached_head;
+    char pad2[queue_cache_line];
+    QueueWait waiter;
+
+    //No copying or assignment.
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+    SPSCQueue(const SPSCQueue&) = delete;
+
+  public:
+    ///Create a queue that holds at least @capacity items.
+    SPSCQueue(size_t capacity) : slots(queueCapacity(capacity)), mask(slots.size() - 1),
+      head(0), cached_tail(0), tail(0), cached_head(0) {
+    }
+
+    ///Push one item. Returns false, leaving @item untouched, if the queue is full.
+    bool tryPush(T&& item) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      if (t - cached_head == slots.size()) {
+        cached_head = head.load(std::memory_order_acquire);
+        if (t - cached_head == slots.size()) {
+          return false;
+        }
+      }
+      slots[t & mask] = std::move(item);
+      tail.store(t + 1, std::memory_order_release);
+      waiter.notify();
+      return true;
+    }
+
+    /**
+     * Push up to @count items from @items, in order. Returns the number
+     * pushed, which is less than @count if the queue filled up. Pushed items
+     * are moved from.
+     */
+    size_t pushBatch(T* items, size_t count) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      if (slots.size() - (t - cached_head) < count) {
+        cached_head = head.load(std::memory_order_acquire);
+      }
+      size_t space = slots.size() - (t - cached_head);
+      size_t total = count < space ? count : space;
+      for (size_t i = 0; i < total; ++i) {
+        slots[(t + i) & mask] = std::move(items[i]);
+      }
+      tail.store(t + total, std::memory_order_release);
+      if (0 < total) {
+        waiter.notify();
+      }
+      return total;
+    }
+
+    ///Pop one item into @item. Returns false if the queue is empty.
+    bool tryPop(T& item) {
+      size_t h = head.load(std::memory_order_relaxed);
+      if (h == cached_tail) {
+        cached_tail = tail.load(std::memory_order_acquire);
+        if (h == cached_tail) {
+          return false;
+        }
+      }
+      item = std::move(slots[h & mask]);
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * Append up to @max items to @out. Returns the number of items popped.
+     */
+    size_t popBatch(std::vector<T>& out, size_t max) {
+      size_t h = head.load(std::memory_order_relaxed);
+      if (cached_tail - h < max) {
+        cached_tail = tail.load(std::memory_order_acquire);
+      }
+      size_t available = cached_tail - h;
+      size_t total = max < available ? max : available;
+      for (size_t i = 0; i < total; ++i) {
+        out.push_back(std::move(slots[(h + i) & mask]));
+      }
+      head.store(h + total, std::memory_order_release);
+      return total;
+    }
+
+    /**
+     * Sleep until an item has been pushed or @msec_timeout milliseconds
+     * have passed (-1 waits forever). Returns true if an item is waiting.
+     * Only the consumer may call this.
+     */
+    bool waitForItems(int msec_timeout) {
+      return waiter.wait([this]() {
+          return head.load(std::memory_order_relaxed) != tail.load(std::memory_order_acquire);},
+          msec_timeout);
+    }
+
+    ///Approximate number of queued items, exact when called by either side.
+    size_t size() const {
+      return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+      return slots.size();
+    }
+};
+
+/**
+ * A bounded queue for any number of producer threads and one consumer
+ * thread. Each slot carries a sequence number that tells producers when it
+ * is free and the consumer when it is filled, so producers only contend on
+ * a single compare and swap and never wait for each other.
+ *
+ * An item becomes visible to the consumer once every item pushed before it
+ * has been written, so a producer that is interrupted in the middle of a
+ * push briefly holds up the items behind it. As with the SPSCQueue the
+ * consumer can sleep in waitForItems.
+ */
+template<typename T>
+class MPSCQueue {
+  private:
+    struct Cell {
+      std::atomic<size_t> sequence;
+      T value;
+    };
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    char pad0[queue_cache_line];
+    //Next cell to push, shared by the producers
+    std::atomic<size_t> tail;
+    char pad1[queue_cache_line];
+    //Next cell to pop, written only by the consumer
+    std::atomic<size_t> head;
+    char pad2[queue_cache_line];
+    QueueWait waiter;
+
+    //No copying or assignment.
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+    MPSCQueue(const MPSCQueue&) = delete;
+
+    //A cell is free for position pos once its sequence equals pos and it
+    //holds the value for pos once its sequence is pos + 1.
+    bool cellFree(size_t pos) const {
+      return cells[pos & mask].sequence.load(std::memory_order_acquire) == pos;
+    }
+
+  public:
+    ///Create a queue that holds at least @capacity items.
+    MPSCQueue(size_t capacity) : cells(new Cell[queueCapacity(capacity)]),
+      mask(queueCapacity(capacity) - 1), tail(0), head(0) {
+      for (size_t i = 0; i <= mask; ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    ///Push one item. Returns false, leaving @item untouched, if the queue is full.
+    bool tryPush(T&& item) {
+      return 1 == pushBatch(&item, 1);
+    }
+
+    /**
+     * Push up to @count items from @items. The items that are pushed take
+     * consecutive positions so they are never interleaved with items from
+     * other producers. Returns the number pushed, which is less than @count
+     * if the queue does not have room for all of them. Pushed items are
+     * moved from.
+     */
+    size_t pushBatch(T* items, size_t count) {
+      if (0 == count) {
+        return 0;
+      }
+      size_t pos = tail.load(std::memory_order_relaxed);
+      size_t total = count < mask + 1 ? count : mask + 1;
+      while (true) {
+        //Cells are freed in order, so if the last cell of the range is free
+        //then so are the ones before it.
+        while (0 < total and not cellFree(pos + total - 1)) {
+          total /= 2;
+        }
+        if (0 == total) {
+          //Full, unless another producer moved tail in the meantime
+          size_t now = tail.load(std::memory_order_relaxed);
+          if (now == pos) {
+            return 0;
+          }
+          pos = now;
+          total = count < mask + 1 ? count : mask + 1;
+        }
+        else if (tail.compare_exchange_weak(pos, pos + total, std::memory_order_relaxed)) {
+          break;
+        }
+        else {
+          //pos now holds the current tail
+          total = count < mask + 1 ? count : mask + 1;
+        }
+      }
+      for (size_t i = 0; i < total; ++i) {
+        Cell& cell = cells[(pos + i) & mask];
+        cell.value = std::move(items[i]);
+        cell.sequence.store(pos + i + 1, std::memory_order_release);
+      }
+      waiter.notify();
+      return total;
+    }
+
+    ///Pop one item into @item. Returns false if the queue is empty.
+    bool tryPop(T& item) {
+      size_t h = head.load(std::memory_order_relaxed);
+      Cell& cell = cells[h & mask];
+      if (cell.sequence.load(std::memory_order_acquire) != h + 1) {
+        return false;
+      }
+      item = std::move(cell.value);
+      cell.sequence.store(h + mask + 1, std::memory_order_release);
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    ///Append up to @max items to @out. Returns the number of items popped.
+    size_t popBatch(std::vector<T>& out, size_t max) {
+      size_t h = head.load(std::memory_order_relaxed);
+      size_t total = 0;
+      while (total < max) {
+        Cell& cell = cells[(h + total) & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != h + total + 1) {
+          break;
+        }
+        out.push_back(std::move(cell.value));
+        cell.sequence.store(h + total + mask + 1, std::memory_order_release);
+        ++total;
+      }
+      head.store(h + total, std::memory_order_release);
+      return total;
+    }
+
+    /**
+     * Sleep until the next item has been pushed or @msec_timeout
+     * milliseconds have passed (-1 waits forever). Returns true if an item
+     * is waiting. Only the consumer may call this.
+     */
+    bool waitForItems(int msec_timeout) {
+      return waiter.wait([this]() {
+          size_t h = head.load(std::memory_order_relaxed);
+          return cells[h & mask].sequence.load(std::memory_order_acquire) == h + 1;},
+          msec_timeout);
+    }
+
+    ///Approximate number of queued items.
+    size_t size() const {
+      size_t t = tail.load(std::memory_order_acquire);
+      size_t h = head.load(std::memory_order_acquire);
+      return t < h ? 0 : t - h;
+    }
+
+    size_t capacity() const {
+      return mask + 1;
+    }
+};
+
+/**
+ * A complete message and the EventLoop connection it came from or should
+ * be sent to.
+ */
+struct QueuedFrame {
+  uint64_t connection;
+  std::vector<unsigned char> data;
+};
+
+#endif
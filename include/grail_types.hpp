@@ -16,10 +16,12 @@
 namespace grail_types {
 
   //A transmitter entry holds a physical layer and id.
+  //The structure is not packed so that the id stays aligned; it is never
+  //copied directly to or from the network.
   struct transmitter {
     uint8_t phy;
     uint128_t id;
-  } __attribute__((packed));
+  };
 
   bool operator<(const transmitter& a, const transmitter& b);
   bool operator==(const transmitter& a, const transmitter& b);
@@ -27,6 +29,7 @@ namespace grail_types {
   std::ostream& operator<<(std::ostream& out, const transmitter& t);
 
   transmitter readTransmitterFromBuffer(BuffReader& reader);
+  transmitter readTransmitterFromBuffer(BuffView& reader);
   transmitter readTransmitter(const std::vector<unsigned char>& buff);
   //Write the transmitter to a buffer and return the bytes written
   uint32_t writeTransmitter(transmitter t, std::vector<unsigned char>& buff);
@@ -44,5 +47,15 @@ namespace grail_types {
 
 };
 
+namespace std {
+  template<>
+  struct hash<grail_types::transmitter> {
+    size_t operator()(const grail_types::transmitter& t) const {
+      return mixHash64(t.id.lower ^ (t.id.upper * 0x9e3779b97f4a7c15ULL) ^
+          ((uint64_t)t.phy * 0xc2b2ae3d27d4eb4fULL));
+    }
+  };
+}
+
 #endif
 
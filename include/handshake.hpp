@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file handshake.hpp
+ * Encoding, decoding, and negotiation of the handshake messages that open
+ * every owl connection.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __HANDSHAKE_HPP__
+#define __HANDSHAKE_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "netbuffer.hpp"
+
+namespace handshake {
+
+  /*
+   * All handshakes are the length of the protocol string, the string, a
+   * version byte, and an extension byte. The extension byte holds the
+   * capabilities that the sender supports. Peers that predate
+   * capabilities send 0 for both bytes, so they never get a feature that
+   * they did not ask for.
+   */
+  typedef uint8_t Capabilities;
+
+  enum Capability : uint8_t {
+    //aggregator_solver::sample_batch messages
+    sample_batching    = 0x01,
+    //Compressed envelopes (see compression.hpp), one bit for each codec
+    deflate_envelopes  = 0x02,
+    lz4_envelopes      = 0x04,
+    zstd_envelopes     = 0x08
+  };
+
+  /**
+   * Every capability this build of the library supports. The compression
+   * bits depend on which compression libraries were found when it was built.
+   */
+  Capabilities supported();
+
+  struct Handshake {
+    std::string protocol;
+    uint8_t version;
+    Capabilities capabilities;
+    //False if the message was not a well formed handshake
+    bool valid;
+  };
+
+  ///Size of the handshake for the given protocol string.
+  size_t encodedSize(const std::string& protocol);
+
+  std::vector<unsigned char> encode(const std::string& protocol, uint8_t version, Capabilities capabilities);
+
+  /**
+   * Decode a handshake. The view must hold exactly one handshake. If
+   * @expected_protocol is not empty the handshake is only valid if its
+   * protocol string matches.
+   */
+  Handshake decode(BuffView buff, const std::string& expected_protocol = "");
+
+  /**
+   * Return the capabilities both sides can use: the bits that are set in
+   * @ours and in the peer's handshake, or none if the peer's handshake is
+   * invalid.
+   */
+  Capabilities negotiate(Capabilities ours, const Handshake& theirs);
+}
+
+#endif
+
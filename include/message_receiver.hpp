@@ -29,7 +29,9 @@
 #ifndef __MESSAGE_RECEIVER_HPP__
 #define __MESSAGE_RECEIVER_HPP__
 
+#include <functional>
 #include <vector>
+#include "frame_buffer.hpp"
 #include "simple_sockets.hpp"
 #include <mutex>
 
@@ -37,23 +39,59 @@ class MessageReceiver {
   private:
     std::mutex sock_mutex;
 
-  public:
     /**
-     * Hold a buffer for a unfinished message sent in the last packet that
-     * needs a new TCP packet to be processed completely.
+     * Buffer for received data. Messages are split out of this buffer
+     * without copying, and an unfinished message sent in the last packet
+     * stays here until a new TCP packet completes it.
      */
-    std::vector<unsigned char> previous_unfinished;
+    FrameBuffer frames;
 
     /**
-     * Receiving socket.
+     * Messages unpacked from the last compressed envelope. These are
+     * handed out before any more frames are taken from the socket buffer.
      */
-    ClientSocket& sock;
+    FrameBuffer unpacked;
+
+    ///Messages larger than this are rejected.
+    size_t max_frame_size;
 
     /**
-     * Create a buffer for receiving messages so that this is not constantly
-     * allocating and deallocating memory.
+     * Take the next message, opening compressed envelopes when the socket
+     * negotiated compression. If @open_envelope is false this stops at an
+     * envelope instead of opening it, so that views of previously unpacked
+     * messages remain valid. Throws a std::runtime_error if an envelope
+     * is corrupt.
      */
-    std::vector<unsigned char> raw_messages;
+    bool nextMessage(FrameView& frame, bool open_envelope = true);
+
+    ///True if a whole message is waiting in either buffer.
+    bool messageBuffered() const;
+
+    /**
+     * Receive once from the socket directly into the free space of the
+     * frame buffer. Returns false if a nonblocking socket had no data.
+     * Throws a std::runtime_error if the connection was closed or failed,
+     * or if the next message is larger than the maximum frame size.
+     */
+    bool receiveMore();
+
+    /**
+     * Block until a whole message is buffered and return a view of it.
+     * The socket mutex must be held by the caller.
+     */
+    FrameView waitForFrame(bool& interrupted);
+
+    /**
+     * Receive once if data is waiting, waiting up to 10ms for it if no
+     * whole message is buffered. The socket mutex must be held by the caller.
+     */
+    void receiveAvailable(bool& interrupted);
+
+  public:
+    /**
+     * Receiving socket.
+     */
+    ClientSocket& sock;
 
     /**
      * Constructor that takes in reference to a socket for packet reception.
@@ -61,6 +99,13 @@ class MessageReceiver {
      */
     MessageReceiver(ClientSocket& s);
 
+    /**
+     * Reject messages larger than @bytes, including their length field.
+     * Receiving one throws a std::runtime_error, since the stream cannot be
+     * trusted after that. The default is default_max_frame_size.
+     */
+    void setMaxFrameSize(size_t bytes);
+
     /**
      * Nonblocking call that checks if a message is ready
      * to be read. If this returns true then the getNextMessage
@@ -71,12 +116,39 @@ class MessageReceiver {
     /**
      * Blocking call that returns the next message in a vector.
      * This always returns whole single messages regardless of how
-     * packets are combined or split in transit.
+     * packets are combined or split in transit. If the socket negotiated
+     * compressed envelopes (see compression.hpp) then the messages inside
+     * of them are returned instead of the envelopes.
      * If interrupted becomes true this will return an empty buffer.
      * This is most effective when the ClientSocket is non-blocking.
      */
     std::vector<unsigned char> getNextMessage(bool& interrupted);
+
+    /**
+     * Blocking call like getNextMessage that returns a view of the message
+     * inside of the receive buffer instead of copying it. The view is valid
+     * until the next call to any function of this receiver.
+     * If interrupted becomes true this will return an empty view.
+     */
+    FrameView getNextFrame(bool& interrupted);
+
+    /**
+     * Nonblocking call that returns every whole message that is available
+     * after at most one receive from the socket. If no whole message is
+     * buffered this waits up to 10ms for data like messageAvailable.
+     * Views of up to @max messages are stored in @out (which is cleared
+     * first) and the number of messages is returned. The socket mutex is
+     * taken once for the whole batch. The views are valid until the next
+     * call to any function of this receiver.
+     */
+    size_t getAvailableMessages(std::vector<FrameView>& out, size_t max, bool& interrupted);
+
+    /**
+     * Like getAvailableMessages but calls @handler with each message while
+     * the socket mutex is held instead of storing views. The handler must
+     * not call back into this receiver. Returns the number of messages.
+     */
+    size_t forEachMessage(const std::function<void (const FrameView&)>& handler, size_t max, bool& interrupted);
 };
 
 #endif
-
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file message_schema.hpp
+ * Templates that describe a message as a list of field types and generate
+ * its size function, encoder, and decoder from that description.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __MESSAGE_SCHEMA_HPP__
+#define __MESSAGE_SCHEMA_HPP__
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "netbuffer.hpp"
+
+/**
+ * Most owl/grail messages are a four byte length, a one byte message type,
+ * and a flat list of fields. A schema such as
+ *
+ *   typedef schema::Message<MessageID, MessageID::request_complete, uint32_t> RequestComplete;
+ *
+ * gives RequestComplete::size, encode, and decode for that layout. The
+ * size of every fixed width field is known at compile time, so a message
+ * made only of primitives has a constant size, encodes with one allocation
+ * and a few stores, and decodes after checking its length and type once
+ * with no per field bounds checks.
+ *
+ * Fields are primitive types (integers, enums, floats, and uint128_t),
+ * written in network byte order, or one of the tags below for variable
+ * length data. A Rest tag takes everything up to the end of the message and
+ * so must be the last field.
+ */
+namespace schema {
+
+  ///A UTF16 string preceded by its size in bytes as a uint32_t.
+  struct SizedUTF16 {};
+  ///A UTF16 string that fills the rest of the message.
+  struct UTF16Rest {};
+  ///Bytes preceded by their size as a uint32_t, decoded without copying.
+  struct SizedBytes {};
+  ///Bytes that fill the rest of the message, decoded without copying.
+  struct BytesRest {};
+
+  /**
+   * How one field is sized, written, and read. The default handles
+   * primitive types.
+   */
+  template<typename T>
+  struct Field {
+    typedef T value_type;
+    static constexpr bool fixed = true;
+    //Bytes taken by the field, or by its fixed part if it is variable
+    static constexpr size_t fixed_size = sizeof(T);
+
+    static size_t size(const T&) {
+      return sizeof(T);
+    }
+
+    static unsigned char* write(unsigned char* out, const T& value) {
+      storeNetworkValue(value, out);
+      return out + sizeof(T);
+    }
+
+    static void read(BuffView& reader, T& value) {
+      value = reader.readPrimitive<T>();
+    }
+
+    //Read without a bounds check, for messages whose size was checked
+    static const unsigned char* load(const unsigned char* in, T& value) {
+      value = loadNetworkValue<T>(in);
+      return in + sizeof(T);
+    }
+  };
+
+  template<>
+  struct Field<UTF16Rest> {
+    typedef std::u16string value_type;
+    static constexpr bool fixed = false;
+    static constexpr size_t fixed_size = 0;
+
+    static size_t size(const std::u16string& value) {
+      return value.size() * sizeof(char16_t);
+    }
+
+    static unsigned char* write(unsigned char* out, const std::u16string& value) {
+      utf16ToNetwork(value.data(), out, value.size());
+      return out + value.size() * sizeof(char16_t);
+    }
+
+    static void read(BuffView& reader, std::u16string& value) {
+      value = reader.readUTF16(reader.remaining() / sizeof(char16_t));
+    }
+  };
+
+  template<>
+  struct Field<SizedUTF16> {
+    typedef std::u16string value_type;
+    static constexpr bool fixed = false;
+    static constexpr size_t fixed_size = sizeof(uint32_t);
+
+    static size_t size(const std::u16string& value) {
+      return sizeof(uint32_t) + value.size() * sizeof(char16_t);
+    }
+
+    static unsigned char* write(unsigned char* out, const std::u16string& value) {
+      storeNetworkValue<uint32_t>(value.size() * sizeof(char16_t), out);
+      return Field<UTF16Rest>::write(out + sizeof(uint32_t), value);
+    }
+
+    static void read(BuffView& reader, std::u16string& value) {
+      reader.readSizedUTF16(value);
+    }
+  };
+
+  template<>
+  struct Field<BytesRest> {
+    typedef ByteSpan value_type;
+    static constexpr bool fixed = false;
+    static constexpr size_t fixed_size = 0;
+
+    static size_t size(const ByteSpan& value) {
+      return value.size;
+    }
+
+    static unsigned char* write(unsigned char* out, const ByteSpan& value) {
+      if (not value.empty()) {
+        std::memcpy(out, value.data, value.size);
+      }
+      return out + value.size;
+    }
+
+    static void read(BuffView& reader, ByteSpan& value) {
+      value = reader.readRemaining();
+    }
+  };
+
+  template<>
+  struct Field<SizedBytes> {
+    typedef ByteSpan value_type;
+    static constexpr bool fixed = false;
+    static constexpr size_t fixed_size = sizeof(uint32_t);
+
+    static size_t size(const ByteSpan& value) {
+      return sizeof(uint32_t) + value.size;
+    }
+
+    static unsigned char* write(unsigned char* out, const ByteSpan& value) {
+      storeNetworkValue<uint32_t>(value.size, out);
+      return Field<BytesRest>::write(out + sizeof(uint32_t), value);
+    }
+
+    static void read(BuffView& reader, ByteSpan& value) {
+      value = reader.readSizedSpan();
+    }
+  };
+
+  ///Operations over a list of fields, applied in order.
+  template<typename... Fields>
+  struct FieldList;
+
+  template<>
+  struct FieldList<> {
+    static constexpr bool fixed = true;
+    static constexpr size_t fixed_size = 0;
+
+    static size_t size() {
+      return 0;
+    }
+
+    static unsigned char* write(unsigned char* out) {
+      return out;
+    }
+
+    static void read(BuffView&) {
+    }
+
+    static void load(const unsigned char*) {
+    }
+  };
+
+  template<typename First, typename... Rest>
+  struct FieldList<First, Rest...> {
+    typedef Field<First> Head;
+    typedef FieldList<Rest...> Tail;
+    static constexpr bool fixed = Head::fixed and Tail::fixed;
+    static constexpr size_t fixed_size = Head::fixed_size + Tail::fixed_size;
+
+    static size_t size(const typename Head::value_type& value,
+        const typename Field<Rest>::value_type&... rest) {
+      return Head::size(value) + Tail::size(rest...);
+    }
+
+    static unsigned char* write(unsigned char* out, const typename Head::value_type& value,
+        const typename Field<Rest>::value_type&... rest) {
+      return Tail::write(Head::write(out, value), rest...);
+    }
+
+    static void read(BuffView& reader, typename Head::value_type& value,
+        typename Field<Rest>::value_type&... rest) {
+      Head::read(reader, value);
+      Tail::read(reader, rest...);
+    }
+
+    static void load(const unsigned char* in, typename Head::value_type& value,
+        typename Field<Rest>::value_type&... rest) {
+      Tail::load(Head::load(in, value), rest...);
+    }
+  };
+
+  /**
+   * A message with the type @Type, an enum of type @ID, followed by the
+   * given fields.
+   */
+  template<typename ID, ID Type, typename... Fields>
+  struct Message {
+    typedef FieldList<Fields...> List;
+
+    ///The length field and message type.
+    static constexpr size_t header_size = sizeof(uint32_t) + sizeof(ID);
+
+    ///True if every field has a fixed width.
+    static constexpr bool fixed = List::fixed;
+
+    ///Size of the message with every variable length field empty.
+    static constexpr size_t min_size = header_size + List::fixed_size;
+
+    ///Encoded size of the message, including its length field.
+    static size_t size(const typename Field<Fields>::value_type&... values) {
+      return header_size + List::size(values...);
+    }
+
+    ///Append the encoded message to @out and return its size.
+    static size_t encode(std::vector<unsigned char>& out, const typename Field<Fields>::value_type&... values) {
+      size_t start = out.size();
+      size_t total = size(values...);
+      out.resize(start + total);
+      unsigned char* data = &out[start];
+      storeNetworkValue<uint32_t>(total - sizeof(uint32_t), data);
+      storeNetworkValue(Type, data + sizeof(uint32_t));
+      List::write(data + header_size, values...);
+      return total;
+    }
+
+    static std::vector<unsigned char> encode(const typename Field<Fields>::value_type&... values) {
+      std::vector<unsigned char> buff;
+      encode(buff, values...);
+      return buff;
+    }
+
+    /**
+     * Decode a whole message into @values. Returns false if the length
+     * field does not match the size of @reader, the message type is wrong,
+     * or a field runs past the end of the message, in which case @values
+     * may have been partly overwritten.
+     */
+    static bool decode(BuffView reader, typename Field<Fields>::value_type&... values) {
+      if (reader.size() < min_size) {
+        return false;
+      }
+      const unsigned char* data = reader.data();
+      if (loadNetworkValue<uint32_t>(data) + size_t(4) != reader.size() or
+          loadNetworkValue<ID>(data + sizeof(uint32_t)) != Type) {
+        return false;
+      }
+      return decodeFields(reader, std::integral_constant<bool, fixed>(), values...);
+    }
+
+    private:
+      //The size check above covers every field of a fixed message
+      static bool decodeFields(BuffView reader, std::true_type, typename Field<Fields>::value_type&... values) {
+        List::load(reader.data() + header_size, values...);
+        return true;
+      }
+
+      static bool decodeFields(BuffView reader, std::false_type, typename Field<Fields>::value_type&... values) {
+        reader.discard(header_size);
+        List::read(reader, values...);
+        return not reader.outOfRange();
+      }
+  };
+}
+
+#endif
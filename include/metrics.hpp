@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file metrics.hpp
+ * Optional counters and latency histograms for the library's hot paths.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Metrics are only collected when the library is built with the OWL_METRICS
+ * cmake option. Otherwise the recording macros below expand to nothing, so
+ * the hot paths are unchanged, and snapshot returns all zeros.
+ *
+ * Each thread records into its own counters, without locks or atomic read
+ * modify write instructions, and snapshot adds up the counters of every
+ * thread when it is called. Counters of threads that have exited are kept.
+ */
+namespace metrics {
+
+  enum Counter {
+    ///Bytes received from and sent to sockets
+    bytes_in = 0,
+    bytes_out,
+    ///Messages handed out by a MessageReceiver or EventLoop
+    frames_in,
+    ///Messages given to ClientSocket::send or EventLoop::send
+    frames_out,
+    ///recv and sendmsg calls
+    receive_calls,
+    send_calls,
+    ///Time a blocking send spent waiting for the socket to become writable
+    send_blocked_usec,
+    ///Number of temporarily_unavailable exceptions thrown by sends
+    send_unavailable,
+    num_counters
+  };
+
+  /**
+   * The protocol whose message types a latency histogram is indexed by.
+   * Sensor to aggregator samples have no message type and use type 0.
+   */
+  enum class Protocol : uint8_t {client = 0,
+                                 solver,
+                                 aggregator_solver,
+                                 sensor_aggregator};
+  const size_t num_protocols = 4;
+
+  enum Operation {encode = 0, decode = 1};
+
+  ///Message types of this value or more share the last histogram.
+  const size_t max_message_types = 32;
+
+  /**
+   * Bucket i counts durations from 2^i to 2^(i+1) - 1 nanoseconds, with
+   * bucket 0 also holding 0 and the last bucket holding everything larger.
+   */
+  const size_t histogram_buckets = 32;
+
+  struct Histogram {
+    uint64_t buckets[histogram_buckets];
+
+    ///Total number of recorded durations.
+    uint64_t count() const;
+
+    /**
+     * Upper bound, in nanoseconds, of the bucket that holds the given
+     * fraction (0 to 1) of the recorded durations. Returns 0 if the
+     * histogram is empty.
+     */
+    uint64_t percentile(double fraction) const;
+  };
+
+  struct Snapshot {
+    uint64_t counters[num_counters];
+    ///Largest amount of data a MessageReceiver has had buffered, in bytes
+    uint64_t receive_buffer_high_water;
+    Histogram latency[2][num_protocols][max_message_types];
+
+    uint64_t operator[](Counter counter) const;
+
+    ///System calls made per message sent or received.
+    double syscallsPerFrame() const;
+
+    const Histogram& encodeLatency(Protocol protocol, uint8_t message_type) const;
+    const Histogram& decodeLatency(Protocol protocol, uint8_t message_type) const;
+  };
+
+  ///True if the library was built with OWL_METRICS.
+  bool enabled();
+
+  ///Add up the metrics of every thread.
+  Snapshot snapshot();
+
+  /**
+   * Set every metric back to zero. Values that threads record while this
+   * runs may be lost.
+   */
+  void reset();
+
+  /*
+   * Recording functions, used through the macros below.
+   */
+  void add(Counter counter, uint64_t amount);
+  void highWater(uint64_t receive_buffered);
+  void recordLatency(Operation op, Protocol protocol, uint8_t message_type, uint64_t nsec);
+
+  ///Add the microseconds from construction to destruction to a counter.
+  class ScopedTime {
+    private:
+      Counter counter;
+      std::chrono::steady_clock::time_point start;
+
+    public:
+      ScopedTime(Counter counter) : counter(counter), start(std::chrono::steady_clock::now()) {}
+
+      ~ScopedTime() {
+        add(counter, std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start).count());
+      }
+  };
+
+  ///Record the time from construction to destruction in a latency histogram.
+  class ScopedLatency {
+    private:
+      Operation op;
+      Protocol protocol;
+      uint8_t message_type;
+      std::chrono::steady_clock::time_point start;
+
+    public:
+      ScopedLatency(Operation op, Protocol protocol, uint8_t message_type) :
+        op(op), protocol(protocol), message_type(message_type),
+        start(std::chrono::steady_clock::now()) {}
+
+      ~ScopedLatency() {
+        recordLatency(op, protocol, message_type, std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start).count());
+      }
+  };
+}
+
+#ifdef OWL_METRICS
+#define OWL_METRIC_ADD(counter, amount) metrics::add(metrics::counter, (amount))
+#define OWL_METRIC_HIGH_WATER(bytes) metrics::highWater(bytes)
+#define OWL_METRIC_TIME(counter) metrics::ScopedTime owl_metric_time(metrics::counter)
+#define OWL_METRIC_LATENCY(op, protocol, message_type) \
+  metrics::ScopedLatency owl_metric_latency(metrics::op, metrics::Protocol::protocol, uint8_t(message_type))
+#else
+#define OWL_METRIC_ADD(counter, amount) do {} while (false)
+#define OWL_METRIC_HIGH_WATER(bytes) do {} while (false)
+#define OWL_METRIC_TIME(counter) do {} while (false)
+#define OWL_METRIC_LATENCY(op, protocol, message_type) do {} while (false)
+#endif
+
+#endif
@@ -30,6 +30,8 @@
 #ifndef __NETBUFFER_HPP__
 #define __NETBUFFER_HPP__
 
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include <string>
 
@@ -47,6 +49,91 @@ void fromNetworkEndian(unsigned char* in, int size);
 uint64_t ntohll(uint64_t val);
 uint64_t htonll(uint64_t val);
 
+/**
+ * Compile time conversion between host and network byte order.
+ * The size of the primitive selects the swap so there is no run time
+ * switch as there is in toNetworkEndian and fromNetworkEndian. As with
+ * those functions 16 byte values are treated as two 64 bit halves and
+ * sizes other than 2, 4, 8, and 16 are left alone.
+ */
+template<size_t Size>
+struct NetworkOrder {
+  static void convert(unsigned char*) {}
+};
+
+//Network order is big endian so big endian hosts do not need to swap bytes.
+#if not (defined(__BYTE_ORDER__) and __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+template<>
+struct NetworkOrder<2> {
+  static void convert(unsigned char* in) {
+    uint16_t val;
+    std::memcpy(&val, in, sizeof(val));
+    val = __builtin_bswap16(val);
+    std::memcpy(in, &val, sizeof(val));
+  }
+};
+
+template<>
+struct NetworkOrder<4> {
+  static void convert(unsigned char* in) {
+    uint32_t val;
+    std::memcpy(&val, in, sizeof(val));
+    val = __builtin_bswap32(val);
+    std::memcpy(in, &val, sizeof(val));
+  }
+};
+
+template<>
+struct NetworkOrder<8> {
+  static void convert(unsigned char* in) {
+    uint64_t val;
+    std::memcpy(&val, in, sizeof(val));
+    val = __builtin_bswap64(val);
+    std::memcpy(in, &val, sizeof(val));
+  }
+};
+
+template<>
+struct NetworkOrder<16> {
+  static void convert(unsigned char* in) {
+    NetworkOrder<8>::convert(in);
+    NetworkOrder<8>::convert(in+8);
+  }
+};
+#endif
+
+/**
+ * Load a primitive value in network byte order from a possibly unaligned
+ * location. The caller must make sure that sizeof(T) bytes are available.
+ */
+template<typename T>
+T loadNetworkValue(const unsigned char* in) {
+  T value;
+  std::memcpy((void*)&value, in, sizeof(T));
+  NetworkOrder<sizeof(T)>::convert((unsigned char*)&value);
+  return value;
+}
+
+/**
+ * Store a primitive value in network byte order to a possibly unaligned
+ * location. The caller must make sure that sizeof(T) bytes are available.
+ */
+template<typename T>
+void storeNetworkValue(T value, unsigned char* out) {
+  NetworkOrder<sizeof(T)>::convert((unsigned char*)&value);
+  std::memcpy(out, (const void*)&value, sizeof(T));
+}
+
+/**
+ * Convert @count UTF16 characters between big endian network order and host
+ * order in one pass. The input and output must not overlap.
+ * The fastest available kernel is chosen the first time this is called:
+ * AVX2 if the CPU supports it, otherwise SSE2 or NEON if the compiler
+ * targets them, and a scalar loop everywhere else.
+ */
+void utf16FromNetwork(const unsigned char* in, char16_t* out, size_t count);
+void utf16ToNetwork(const char16_t* in, unsigned char* out, size_t count);
+
 /**
  * A function to read a primitive value from a byte buffer
  * at the specified index.
@@ -103,15 +190,11 @@ struct BuffReader {
     template<typename T>
     T readPrimitive() {
       T value = (T)0;
-      //Treat the given type as an array of bytes and push the bytes
-      //into it one byte at a time
-      unsigned char* out = (unsigned char*)&value;
       if ( cur_index + sizeof(T) <= buff.size() ) {
-        std::copy(buff_i, buff_i + sizeof(T), out);
+        //Copy the bytes out and convert to host endian from network endian
+        value = loadNetworkValue<T>(buff.data() + cur_index);
         cur_index += sizeof(T);
         std::advance(buff_i, sizeof(T));
-        //Convert to host endian from network endian
-        fromNetworkEndian(out, sizeof(T));
       }
       else {
         _out_of_range = true;
@@ -167,6 +250,176 @@ struct BuffReader {
     std::u16string readSizedUTF16();
 };
 
+/**
+ * A borrowed range of bytes inside some other buffer. The span does not
+ * own its memory and is only valid as long as the underlying buffer is.
+ */
+struct ByteSpan {
+  const unsigned char* data;
+  size_t size;
+
+  const unsigned char* begin() const { return data; }
+  const unsigned char* end() const { return data + size; }
+  bool empty() const { return 0 == size; }
+
+  ///Copy the bytes into a new vector.
+  std::vector<unsigned char> toVector() const {
+    return std::vector<unsigned char>(begin(), end());
+  }
+};
+
+/**
+ * Structure to simplify reading multiple data types from a borrowed span of
+ * bytes. Unlike BuffReader this does not need a mutable vector so it can be
+ * used to decode messages where they sit, such as inside of a receive buffer.
+ * Reads are bounds checked; a read that would go past the end of the span
+ * returns a zero value and sets the out of range flag.
+ */
+class BuffView {
+  private:
+    const unsigned char* _data;
+    size_t _size;
+    //Remember if the user tried to read more than was in the buffer
+    bool _out_of_range;
+
+  public:
+    size_t cur_index;
+
+    BuffView(const unsigned char* data, size_t size);
+    BuffView(const std::vector<unsigned char>& buffer);
+    BuffView(const ByteSpan& span);
+
+    //Return true if read commands tried to go beyond the buffer's size
+    bool outOfRange() const;
+
+    ///Total size of the viewed bytes
+    size_t size() const;
+
+    ///Number of bytes that have not been read yet
+    size_t remaining() const;
+
+    ///Pointer to the start of the viewed bytes
+    const unsigned char* data() const;
+
+    //Discard the specified number of bytes.
+    void discard(size_t bytes);
+
+    template<typename T>
+    T readPrimitive() {
+      if ( sizeof(T) <= _size - cur_index ) {
+        T value = loadNetworkValue<T>(_data + cur_index);
+        cur_index += sizeof(T);
+        return value;
+      }
+      _out_of_range = true;
+      return (T)0;
+    }
+
+    template<typename T>
+    void convertPrimitive(T& value) {
+      value = this->readPrimitive<T>();
+    }
+
+    /**
+     * Return a span over the next @bytes bytes without copying them.
+     * An empty span is returned if there are not enough bytes left.
+     */
+    ByteSpan readSpan(size_t bytes);
+
+    /**
+     * Return a span over a sized byte container. The next 4 bytes of the
+     * buffer should be the size (in bytes) of the container.
+     */
+    ByteSpan readSizedSpan();
+
+    ///Return a span over everything that has not been read yet.
+    ByteSpan readRemaining();
+
+    ///Reassemble a utf16 string given the number of characters the string contains.
+    std::u16string readUTF16(size_t size);
+
+    /**
+     * Reassemble a utf16 string. The next 4 bytes of the buffer should
+     * be the size (in bytes) of the string.
+     */
+    std::u16string readSizedUTF16();
+
+    /**
+     * Read a sized utf16 string into any std::basic_string of char16_t, such
+     * as one that uses an ArenaAllocator.
+     */
+    template<typename String>
+    void readSizedUTF16(String& str) {
+      size_t size = this->readPrimitive<uint32_t>() / sizeof(char16_t);
+      ByteSpan span = readSpan(size * sizeof(char16_t));
+      str.resize(span.size / sizeof(char16_t));
+      if ( not str.empty() ) {
+        utf16FromNetwork(span.data, &str[0], str.size());
+      }
+    }
+};
+
+/**
+ * Structure to simplify writing a message into storage that was already
+ * sized for it, so that encoding a message costs a single allocation.
+ * Writes are bounds checked; a write that does not fit is skipped and sets
+ * the out of range flag.
+ */
+class BuffWriter {
+  private:
+    unsigned char* _data;
+    size_t _size;
+    //Remember if the user tried to write more than was in the buffer
+    bool _out_of_range;
+
+  public:
+    size_t cur_index;
+
+    ///Write into buffer starting at the given index
+    BuffWriter(std::vector<unsigned char>& buffer, size_t start = 0);
+    BuffWriter(unsigned char* data, size_t size);
+
+    //Return true if write commands tried to go beyond the buffer's size
+    bool outOfRange() const;
+
+    ///Number of bytes that can still be written
+    size_t remaining() const;
+
+    /**
+     * Write a value in network byte order.
+     * Return the total number of bytes written.
+     */
+    template<typename T>
+    uint32_t writePrimitive(T val) {
+      if ( sizeof(T) <= _size - cur_index ) {
+        storeNetworkValue(val, _data + cur_index);
+        cur_index += sizeof(T);
+        return sizeof(T);
+      }
+      _out_of_range = true;
+      return 0;
+    }
+
+    ///Copy raw bytes and return the number of bytes written.
+    uint32_t writeBytes(const unsigned char* bytes, size_t length);
+
+    ///Copy raw bytes preceded by their size as a uint32_t.
+    uint32_t writeSizedBytes(const unsigned char* bytes, size_t length);
+
+    ///Write a UTF16 string and return the number of bytes written.
+    uint32_t writeUTF16(const std::u16string& str);
+
+    ///Write a UTF16 string preceded by its size (in bytes) as a uint32_t.
+    uint32_t writeSizedUTF16(const std::u16string& str);
+};
+
+/**
+ * Grow @buffer by @length bytes and return a writer for the new space at
+ * its end. Messages are appended this way so that a reused buffer does
+ * not allocate once its capacity is large enough.
+ */
+BuffWriter appendWriter(std::vector<unsigned char>& buffer, size_t length);
+
 /**
  * Push a container onto the given buffer. The first four bytes pushed
  * are a uint32_t that indicate the size of the container, in
@@ -208,19 +461,11 @@ uint32_t pushBackVal(T val, std::vector<unsigned char>& buff);
 
 template<typename T>
 T readPrimitive(const std::vector<unsigned char>& buff, size_t index) {
-  T value = 0;
-  //Treat the given type as an array of bytes and push the bytes
-  //into it one byte at a time
-  unsigned char* out = (unsigned char*)&value;
-  size_t max_shift = sizeof(T) - 1;
-  if ( (index + max_shift) < buff.size() ) {
-    for (size_t shift = 0; shift <= max_shift; ++shift) {
-      out[shift] = buff[index + shift];
-    }
+  if ( (index + sizeof(T)) <= buff.size() ) {
+    //Copy the bytes out and convert to host endian from network endian
+    return loadNetworkValue<T>(buff.data() + index);
   }
-  //Convert to host endian from network endian
-  fromNetworkEndian(out, sizeof(T));
-  return value;
+  return T(0);
 }
 
 template<typename T>
@@ -274,14 +519,9 @@ uint32_t pushContainer(T container, std::vector<unsigned char>& buff) {
  */
 template<typename T>
 uint32_t pushBackVal(T val, std::vector<unsigned char>& buff, size_t index) {
-  //Treat the given value as an array of bytes and push the bytes
-  //into the buff one at a time
-  unsigned char* in = (unsigned char*)&val;
   //Change the order of the bytes if this machine architecture does not
   //store data in network byte order (big endian).
-  //
-  toNetworkEndian(in, sizeof(T));
-  std::copy(in, in+sizeof(T), buff.begin()+index);
+  storeNetworkValue(val, buff.data()+index);
   return sizeof(T);
 }
 
@@ -291,15 +531,12 @@ uint32_t pushBackVal(T val, std::vector<unsigned char>& buff, size_t index) {
  */
 template<typename T>
 uint32_t pushBackVal(T val, std::vector<unsigned char>& buff) {
-  //Treat the given value as an array of bytes and push the bytes
-  //into the buff one at a time
-  unsigned char* in = (unsigned char*)&val;
+  //Grow the buffer once and write all of the value's bytes together
+  size_t index = buff.size();
+  buff.resize(index + sizeof(T));
   //Change the order of the bytes if this machine architecture does not
   //store data in network byte order (big endian).
-  toNetworkEndian(in, sizeof(T));
-  for (size_t shift = 0; shift < sizeof(T); ++shift) {
-    buff.push_back(in[shift]);
-  }
+  storeNetworkValue(val, buff.data()+index);
   return sizeof(T);
 }
 
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file reactor_pool.hpp
+ * Defines the ReactorPool class that spreads connections on one port
+ * across several EventLoop threads.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __REACTOR_POOL_HPP__
+#define __REACTOR_POOL_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "event_loop.hpp"
+#include "simple_sockets.hpp"
+
+/**
+ * A set of worker threads that each run their own EventLoop with their
+ * own listening socket. All of the listening sockets are bound to the same
+ * port with SO_REUSEPORT so the kernel spreads new connections across the
+ * workers, and a connection stays on the worker that accepted it. This
+ * avoids sharing an accept queue or epoll set between threads.
+ *
+ * The same frame handler is used by every worker so it will be called
+ * concurrently and must be thread safe. Connection ids are only unique
+ * within one worker's EventLoop.
+ */
+class ReactorPool {
+  private:
+    struct Worker {
+      std::unique_ptr<ServerSocket> listener;
+      std::unique_ptr<EventLoop> loop;
+      std::thread thread;
+    };
+    std::vector<Worker> workers;
+    std::atomic<bool> stopping;
+    bool pin_cpus;
+
+    //No copying or assignment.
+    ReactorPool& operator=(const ReactorPool&) = delete;
+    ReactorPool(const ReactorPool&) = delete;
+
+    void runWorker(size_t index);
+
+  public:
+    /**
+     * Open one listening socket per worker on @port. If @num_workers is 0
+     * one worker is made for each hardware thread. If @pin_cpus is true
+     * then worker i is pinned to cpu i (modulo the number of cpus).
+     * Throws a std::runtime_error if a listening socket cannot be opened.
+     */
+    ReactorPool(int domain, uint32_t port, size_t num_workers,
+        EventLoop::FrameHandler handler, bool pin_cpus = false);
+
+    ///Stop the workers if they are still running.
+    ~ReactorPool();
+
+    ///Number of worker threads.
+    size_t size() const;
+
+    /**
+     * The EventLoop of a worker, so that connect and close handlers can be
+     * set. Only modify loops before start is called.
+     */
+    EventLoop& loop(size_t index);
+
+    ///Start the worker threads.
+    void start();
+
+    ///Stop the worker threads and wait for them to finish.
+    void stop();
+};
+
+#endif
+
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file sample_batch.hpp
+ * Defines the SampleBatch class, which stores many samples column by
+ * column, and the batch operations that solvers commonly run over them.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __SAMPLE_BATCH_HPP__
+#define __SAMPLE_BATCH_HPP__
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "arena.hpp"
+#include "netbuffer.hpp"
+#include "sample_data.hpp"
+
+/**
+ * An STL allocator whose memory starts on a cache line so that loops over
+ * a column begin on an aligned address for vector loads.
+ */
+template<typename T>
+struct ColumnAllocator {
+  typedef T value_type;
+  static const size_t alignment = 64;
+
+  template<typename U>
+  struct rebind {
+    typedef ColumnAllocator<U> other;
+  };
+
+  ColumnAllocator() {}
+  template<typename U>
+  ColumnAllocator(const ColumnAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    void* p = nullptr;
+    if (0 != posix_memalign(&p, alignment, n * sizeof(T))) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T* p, size_t) {
+    free(p);
+  }
+};
+
+template<typename T, typename U>
+bool operator==(const ColumnAllocator<T>&, const ColumnAllocator<U>&) {
+  return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const ColumnAllocator<T>&, const ColumnAllocator<U>&) {
+  return false;
+}
+
+/**
+ * Samples stored as separate columns of physical layers, ids, timestamps,
+ * and rss values, with all sense data in one arena. A pass that only needs
+ * timestamps or rss values reads nothing else, with no per sample
+ * allocations and no invalid samples to skip.
+ *
+ * The filter operations keep the samples that match, in order. They set a
+ * keep flag per sample with an AVX2, SSE2 or NEON kernel chosen at run time
+ * (or a branchless scalar loop) and then compact the columns.
+ *
+ * A SampleBatch is not thread safe and is reused by calling clear, which
+ * keeps its memory.
+ */
+class SampleBatch {
+  public:
+    template<typename T>
+    using Column = std::vector<T, ColumnAllocator<T>>;
+
+    ///Average rss of the samples between one transmitter and one receiver.
+    struct LinkRSS {
+      unsigned char physical_layer;
+      TransmitterID tx_id;
+      ReceiverID rx_id;
+      float average;
+      uint32_t count;
+    };
+
+  private:
+    Column<unsigned char> phy;
+    Column<TransmitterID> tx;
+    Column<ReceiverID> rx;
+    Column<Timestamp> time;
+    Column<float> rss;
+    Column<ByteSpan> sense;
+    Arena sense_arena;
+    //Scratch space for filters
+    Column<unsigned char> keep;
+
+    //No copying or assignment.
+    SampleBatch& operator=(const SampleBatch&) = delete;
+    SampleBatch(const SampleBatch&) = delete;
+
+    //Remove every sample whose keep flag is 0.
+    size_t compact();
+
+  public:
+    SampleBatch();
+
+    ///Number of samples.
+    size_t size() const;
+
+    bool empty() const;
+
+    ///Reserve space for @samples samples.
+    void reserve(size_t samples);
+
+    ///Remove all samples, keeping the memory of the columns and the arena.
+    void clear();
+
+    /**
+     * Remove samples from the end so that at most @samples remain. Their
+     * sense data stays in the arena until clear is called.
+     */
+    void truncate(size_t samples);
+
+    /**
+     * Add a sample, copying its sense data into the batch's arena.
+     * Invalid samples are not added.
+     */
+    void push_back(const SampleData& sample);
+
+    /**
+     * Add a sample from its parts. The sense data is copied.
+     */
+    void push_back(unsigned char physical_layer, const TransmitterID& tx_id, const ReceiverID& rx_id,
+        Timestamp rx_timestamp, float sample_rss, ByteSpan sense_data);
+
+    ///Copy the sample at @index out of the batch.
+    SampleData sample(size_t index) const;
+
+    ///The columns, one entry per sample.
+    const Column<unsigned char>& physicalLayers() const;
+    const Column<TransmitterID>& transmitters() const;
+    const Column<ReceiverID>& receivers() const;
+    const Column<Timestamp>& timestamps() const;
+    const Column<float>& rssValues() const;
+    ///Sense data, which points into the batch's arena until clear is called.
+    const Column<ByteSpan>& senseData() const;
+
+    /**
+     * Keep only samples from the physical layer @physical_layer whose
+     * transmitter id, masked with @tx_mask, equals @tx_base masked the same
+     * way, as in a solver's subscription rules. Returns the number of
+     * samples left.
+     */
+    size_t filterTransmitters(unsigned char physical_layer, const TransmitterID& tx_base,
+        const TransmitterID& tx_mask);
+
+    /**
+     * Keep only samples with @begin <= rx_timestamp < @end.
+     * Returns the number of samples left.
+     */
+    size_t filterWindow(Timestamp begin, Timestamp end);
+
+    /**
+     * Find the average rss of each transmitter and receiver pair, in the
+     * order that each pair first appears in the batch.
+     */
+    std::vector<LinkRSS> averageRSS() const;
+};
+
+#endif
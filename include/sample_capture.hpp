@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file sample_capture.hpp
+ * Defines a file format for recording sensor_aggregator sample messages and
+ * classes that write captures and replay them from a memory map.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __SAMPLE_CAPTURE_HPP__
+#define __SAMPLE_CAPTURE_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "frame_buffer.hpp"
+#include "netbuffer.hpp"
+#include "sample_data.hpp"
+
+namespace sensor_aggregator {
+
+  /*
+   * A capture file is an eight byte header followed by sample messages
+   * exactly as they are sent on the wire, each starting with its length.
+   * Since nothing is written after the frames a capture can be appended to
+   * at any time and a frame cut short by a crash is simply ignored.
+   */
+  extern const char capture_magic[8];
+
+  /**
+   * Appends sample messages to a capture file. Writes are buffered so that
+   * recording costs one system call per block rather than one per sample.
+   */
+  class CaptureWriter {
+    private:
+      int fd;
+      std::vector<unsigned char> pending;
+      size_t buffer_size;
+      size_t discarded;
+
+      //No copying or assignment.
+      CaptureWriter& operator=(const CaptureWriter&) = delete;
+      CaptureWriter(const CaptureWriter&) = delete;
+
+    public:
+      /**
+       * Open @path for appending, creating it and writing the header if it
+       * is empty. Data is written whenever @buffer_size bytes are waiting.
+       * Throws a std::runtime_error if the file cannot be opened or is not
+       * a capture file.
+       */
+      CaptureWriter(const std::string& path, size_t buffer_size = 64 * 1024);
+
+      ///Flush and close the file.
+      ~CaptureWriter();
+
+      /**
+       * Append one message, including its length field, such as the result
+       * of makeSampleMsg. Returns false if @frame is not a whole message.
+       * Throws a std::runtime_error if writing fails.
+       */
+      bool append(const unsigned char* frame, size_t length);
+      bool append(const std::vector<unsigned char>& frame);
+
+      ///Encode and append a sample.
+      void append(const SampleData& sample);
+
+      ///Write any buffered data. Throws a std::runtime_error on failure.
+      void flush();
+
+      /**
+       * Number of bytes of an incomplete frame that were truncated from the
+       * end of the file when it was opened, or 0 if it ended cleanly.
+       */
+      size_t discardedBytes() const;
+  };
+
+  /**
+   * Replays a capture file from a read only memory map so frames are never
+   * copied: each FrameView points into the mapping and can be decoded in
+   * place with decodeSampleMsg, which is valid as long as the reader exists.
+   *
+   * Opening the file walks the length fields once and records the offset of
+   * every index_interval'th frame along with the largest rx_timestamp seen
+   * so far. Because that running maximum never decreases, seek can binary
+   * search it even if samples from different receivers are slightly out of
+   * order.
+   */
+  class CaptureReader {
+    public:
+      ///Frames between entries of the timestamp index.
+      static const size_t index_interval = 256;
+
+    private:
+      struct IndexEntry {
+        //Largest timestamp in this block and all earlier blocks
+        Timestamp max_time;
+        size_t offset;
+      };
+      const unsigned char* map;
+      size_t map_size;
+      //End of the last whole frame
+      size_t data_end;
+      size_t cursor;
+      size_t frames;
+      std::vector<IndexEntry> index;
+
+      //No copying or assignment.
+      CaptureReader& operator=(const CaptureReader&) = delete;
+      CaptureReader(const CaptureReader&) = delete;
+
+      //Length of the frame at offset, or 0 if no whole frame starts there.
+      size_t frameLength(size_t offset) const;
+
+    public:
+      /**
+       * Map the capture file at @path and build its index.
+       * Throws a std::runtime_error if the file cannot be mapped or is not a
+       * capture file.
+       */
+      CaptureReader(const std::string& path);
+
+      ///Unmap the file.
+      ~CaptureReader();
+
+      ///Number of whole frames in the capture.
+      size_t size() const;
+
+      ///Bytes of frame data, not counting the header.
+      size_t bytes() const;
+
+      /**
+       * Get the frame at the current position and move past it. Returns
+       * false at the end of the capture.
+       */
+      bool next(FrameView& frame);
+
+      /**
+       * Decode the next frame into @sample. Returns false at the end of the
+       * capture. A frame that is not a valid sample gives an invalid sample.
+       */
+      bool nextSample(SampleData& sample);
+
+      ///As above with the sense data allocated from @arena.
+      bool nextSample(ArenaSampleData& sample, Arena& arena);
+
+      ///Go back to the first frame.
+      void rewind();
+
+      /**
+       * Move to the first frame with an rx_timestamp of at least @time,
+       * starting from the index entry before it, so every later sample with
+       * that timestamp or larger is replayed. Returns false, leaving the
+       * position at the end, if no sample is that recent.
+       */
+      bool seek(Timestamp time);
+
+      ///Time of the sample in @frame, or 0 if it is too short to hold one.
+      static Timestamp frameTimestamp(const FrameView& frame);
+  };
+}
+
+#endif
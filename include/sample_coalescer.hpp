@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file sample_coalescer.hpp
+ * Defines the SampleCoalescer class that enforces the update interval that
+ * solvers request in their subscription rules.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __SAMPLE_COALESCER_HPP__
+#define __SAMPLE_COALESCER_HPP__
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "sample_data.hpp"
+#include "subscription_index.hpp"
+
+namespace aggregator_solver {
+
+  /**
+   * Decides whether a sample should be forwarded to a subscriber given the
+   * subscriber's update interval. Samples are tracked per (subscriber,
+   * physical layer, transmitter, receiver).
+   *
+   * In forward_first mode the first sample of each interval is forwarded
+   * and the rest are dropped. In keep_latest mode the first sample is also
+   * forwarded right away, but later samples in the interval replace each
+   * other and the latest one is released by advance when the interval
+   * ends, so a subscriber always ends up with the newest data.
+   *
+   * Each decision is one hash lookup. Interval ends are tracked with a
+   * timer wheel so that advance only touches keys that are due. A key that
+   * keeps receiving samples stays in the table, and one that has been quiet
+   * for a whole interval is forgotten.
+   */
+  class SampleCoalescer {
+    public:
+      typedef SubscriptionIndex::SubscriberID SubscriberID;
+
+      enum Mode {forward_first, keep_latest};
+
+      ///Called with samples that were held back in keep_latest mode.
+      typedef std::function<void (SubscriberID, const SampleData&)> ForwardHandler;
+
+    private:
+      struct Key {
+        SubscriberID subscriber;
+        unsigned char physical_layer;
+        TransmitterID tx_id;
+        ReceiverID rx_id;
+        bool operator==(const Key& other) const;
+      };
+
+      struct KeyHash {
+        size_t operator()(const Key& key) const;
+      };
+
+      struct State {
+        //Time when the current interval ends
+        uint64_t deadline;
+        uint64_t interval;
+        //True if a sample arrived since advance last handled this key
+        bool seen;
+        bool has_pending;
+        SampleData pending;
+      };
+
+      Mode mode;
+      uint64_t tick_msec;
+      std::unordered_map<Key, State, KeyHash> states;
+      //Keys that are due in each tick, modulo the number of slots
+      std::vector<std::vector<Key>> wheel;
+      //The last tick that advance processed
+      uint64_t current_tick;
+
+      //Place a key in the wheel slot for its deadline
+      void schedule(const Key& key, uint64_t deadline);
+
+    public:
+      /**
+       * Create a coalescer. Deadlines are rounded to @tick_msec and the wheel
+       * has @slots slots; longer intervals simply go around the wheel more
+       * than once.
+       */
+      SampleCoalescer(Mode mode = forward_first, uint64_t tick_msec = 10, size_t slots = 1024);
+
+      /**
+       * Return true if @sample should be forwarded to @subscriber now. An
+       * interval of 0 forwards everything. In keep_latest mode a sample that
+       * is not forwarded is kept to be released by advance.
+       * @now is the current time in milliseconds, as from msecTime.
+       */
+      bool offer(SubscriberID subscriber, uint64_t interval, const SampleData& sample, uint64_t now);
+
+      ///Offer a sample to a subscriber found by a SubscriptionIndex.
+      bool offer(const SubscriptionIndex::Match& match, const SampleData& sample, uint64_t now);
+
+      /**
+       * Handle intervals that have ended by @now. Samples held in
+       * keep_latest mode are passed to @forward. Keys that saw samples are
+       * checked again an interval later and keys that saw none since they
+       * were last checked are forgotten.
+       */
+      void advance(uint64_t now, const ForwardHandler& forward);
+
+      ///Forget everything about a subscriber, such as when it disconnects.
+      void remove(SubscriberID subscriber);
+
+      ///Number of keys being tracked.
+      size_t size() const;
+  };
+}
+
+#endif
+
@@ -24,63 +24,163 @@
 #ifndef __SAMPLE_DATA_HPP__
 #define __SAMPLE_DATA_HPP__
 
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <type_traits>
 #include <vector>
 #include <string>
 
+#include "arena.hpp"
+
 //Get the time in milliseconds
 uint64_t msecTime();
 
-struct uint128_t {
+/**
+ * A 128 bit unsigned integer, used for transmitter and receiver ids.
+ * The type is trivially copyable and naturally (16 byte) aligned so that it
+ * can be copied with memcpy, stored in flat arrays, and used as a key in
+ * open addressing hash tables. The upper half comes first, as it does on
+ * the network, so loading one from a buffer is just a byte swap of each
+ * half (see NetworkOrder<16> in netbuffer.hpp).
+ * If the compiler supports unsigned __int128 the value can be converted to
+ * and from it with native and fromNative.
+ */
+struct alignas(16) uint128_t {
   uint64_t upper;
   uint64_t lower;
 
   //Default constructor
   uint128_t() = default;
   //Constructor that just takes in an unsigned integer.
-  uint128_t(uint64_t val);
-  uint128_t(const uint128_t& val);
+  uint128_t(uint64_t val) : upper(0), lower(val) {}
+  uint128_t(uint64_t upper, uint64_t lower) : upper(upper), lower(lower) {}
   template <typename T>
   uint128_t& operator=(const T& val) {
     upper = 0;
     lower = val;
     return *this;
   }
-} __attribute__((packed));
 
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 native() const {
+    return ((unsigned __int128)upper << 64) | lower;
+  }
+
+  static uint128_t fromNative(unsigned __int128 val) {
+    return uint128_t((uint64_t)(val >> 64), (uint64_t)val);
+  }
+#endif
+};
+
+static_assert(sizeof(uint128_t) == 16, "uint128_t must be exactly 16 bytes");
+static_assert(std::is_trivially_copyable<uint128_t>::value, "uint128_t must be trivially copyable");
 
-//Define an equality operator for the 128 bit type
-bool operator==(const uint128_t& a, const uint128_t& b);
+//Comparison and bitwise operators for the 128 bit type
+inline bool operator==(const uint128_t& a, const uint128_t& b) {
+  return a.upper == b.upper and a.lower == b.lower;
+}
 
-//Define a print operator for the 128 bit type
-std::ostream& operator<<(std::ostream& os, const uint128_t& val);
-std::istream& operator>>(std::istream& is, uint128_t& val);
+inline bool operator!=(const uint128_t& a, const uint128_t& b) {
+  return not (a == b);
+}
+
+inline bool operator<(const uint128_t& a, const uint128_t& b) {
+  return a.upper < b.upper or (a.upper == b.upper and a.lower < b.lower);
+}
+
+inline bool operator>(const uint128_t& a, const uint128_t& b) {
+  return b < a;
+}
 
-//Define a binary & operator.
-uint128_t operator&(const uint128_t& a, const uint128_t& b);
+inline bool operator<=(const uint128_t& a, const uint128_t& b) {
+  return not (b < a);
+}
 
-//Define a less than operator
-bool operator<(const uint128_t& a, const uint128_t& b);
+inline bool operator>=(const uint128_t& a, const uint128_t& b) {
+  return not (a < b);
+}
 
-//To string functions for the 128 bit integer type
+inline uint128_t operator&(const uint128_t& a, const uint128_t& b) {
+  return uint128_t(a.upper & b.upper, a.lower & b.lower);
+}
+
+inline uint128_t operator|(const uint128_t& a, const uint128_t& b) {
+  return uint128_t(a.upper | b.upper, a.lower | b.lower);
+}
+
+inline uint128_t operator^(const uint128_t& a, const uint128_t& b) {
+  return uint128_t(a.upper ^ b.upper, a.lower ^ b.lower);
+}
+
+inline uint128_t operator~(const uint128_t& a) {
+  return uint128_t(~a.upper, ~a.lower);
+}
+
+//Define print and read operators for the 128 bit type. Values are printed
+//in hex with a 0x prefix. Reading follows the stream's base like the built
+//in integers (std::dec, std::hex, std::oct, or a 0/0x prefix if no base is
+//set), also accepts a 0x prefix unless reading octal, and stops at the
+//first character that is not a digit.
+std::ostream& operator<<(std::ostream& os, const uint128_t& val);
+std::istream& operator>>(std::istream& is, uint128_t& val);
+
+//To string functions (in decimal) for the 128 bit integer type
 std::string to_string(uint128_t val);
 std::u16string to_u16string(uint128_t val);
 
+/**
+ * Scramble the bits of a 64 bit value (the murmur3 finalizer) so that every
+ * input bit affects every output bit. Hashes built with this can be used
+ * in tables that index with the low bits of the hash.
+ */
+inline uint64_t mixHash64(uint64_t val) {
+  val ^= val >> 33;
+  val *= 0xff51afd7ed558ccdULL;
+  val ^= val >> 33;
+  val *= 0xc4ceb9fe1a85ec53ULL;
+  val ^= val >> 33;
+  return val;
+}
+
+//Hash a 128 bit value into 64 bits.
+inline uint64_t hash128(const uint128_t& val) {
+  return mixHash64(val.lower ^ (val.upper * 0x9e3779b97f4a7c15ULL));
+}
+
+namespace std {
+  template<>
+  struct hash<uint128_t> {
+    size_t operator()(const uint128_t& val) const {
+      return hash128(val);
+    }
+  };
+}
+
 typedef uint128_t TransmitterID;
 typedef uint128_t ReceiverID;
 typedef int64_t Timestamp;
 
-//Sample data with details about a packet from a transmitter to a receiver.
-struct SampleData {
+/**
+ * Sample data with details about a packet from a transmitter to a receiver.
+ * The allocator is used for the sense data. SampleData uses the standard
+ * allocator and ArenaSampleData keeps its sense data in an Arena.
+ */
+template<typename Alloc>
+struct BasicSampleData {
   unsigned char physical_layer;
   TransmitterID tx_id;
   ReceiverID rx_id;
   Timestamp rx_timestamp;
   float rss;
-  std::vector<unsigned char> sense_data;
+  std::vector<unsigned char, Alloc> sense_data;
   bool valid;
 };
 
+typedef BasicSampleData<std::allocator<unsigned char>> SampleData;
+typedef BasicSampleData<ArenaAllocator<unsigned char>> ArenaSampleData;
+
 //Device position
 struct DevicePosition {
   unsigned char physical_layer;
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file send_buffer.hpp
+ * Defines the SendBuffer class that holds outgoing data for a nonblocking
+ * socket until the socket can accept it.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __SEND_BUFFER_HPP__
+#define __SEND_BUFFER_HPP__
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "simple_sockets.hpp"
+
+/**
+ * A bounded backlog of outgoing messages for one connection. Messages are
+ * sent immediately when nothing is waiting and the socket has room and
+ * are otherwise kept until flush is called, usually when the event loop
+ * sees that the socket is writable. Nothing ever blocks.
+ *
+ * The high water handler is called when the backlog grows to the high
+ * water mark and the low water handler is called when it has drained back
+ * down to the low water mark, so an application can stop producing data
+ * for (or drop) a slow peer without stalling the others. Messages that
+ * would grow the backlog past its limit are rejected whole so that the
+ * stream of messages is never cut in the middle of one.
+ */
+class SendBuffer {
+  public:
+    typedef std::function<void ()> WatermarkHandler;
+
+  private:
+    std::deque<std::vector<unsigned char>> pending;
+    //Bytes of the first pending buffer that were already sent
+    size_t head_offset;
+    //Unsent bytes in the backlog
+    size_t bytes;
+    size_t high_water;
+    size_t low_water;
+    size_t limit;
+    //True between reaching the high water mark and draining to the low
+    bool above_high;
+    WatermarkHandler high_handler;
+    WatermarkHandler low_handler;
+
+    //Call the watermark handlers if the backlog crossed a mark
+    void checkWatermarks();
+
+  public:
+    /**
+     * Create an empty backlog. A @limit of 0 means there is no limit.
+     */
+    SendBuffer(size_t high_water = 1 << 20, size_t low_water = 1 << 18, size_t limit = 1 << 23);
+
+    ///Set the handler called when the backlog reaches the high water mark.
+    void onHighWater(WatermarkHandler handler);
+
+    ///Set the handler called when the backlog drains to the low water mark.
+    void onLowWater(WatermarkHandler handler);
+
+    /**
+     * Send @buff if possible, and add whatever was not sent to the backlog.
+     * Returns false, without sending anything, if the message would grow
+     * the backlog past its limit.
+     * Throws a std::runtime_error if the socket fails.
+     */
+    bool write(ClientSocket& sock, std::vector<unsigned char> buff);
+
+    /**
+     * Send as much of the backlog as the socket will accept. Returns true if
+     * the backlog is now empty.
+     * Throws a std::runtime_error if the socket fails.
+     */
+    bool flush(ClientSocket& sock);
+
+    ///Number of bytes waiting to be sent.
+    size_t size() const;
+
+    ///True if nothing is waiting to be sent.
+    bool empty() const;
+
+    ///True after the high water mark was reached until the backlog drains.
+    bool congested() const;
+
+    ///Discard the backlog.
+    void clear();
+};
+
+#endif
+
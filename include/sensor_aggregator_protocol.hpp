@@ -24,14 +24,41 @@
 #include <array>
 #include <vector>
 
+#include "handshake.hpp"
+#include "netbuffer.hpp"
 #include "sample_data.hpp"
 
 namespace sensor_aggregator {
+  /*
+   * Each make function has a matching size function that returns the
+   * encoded size of the message in bytes, including its length field.
+   * The versions that take an output buffer append the message to it
+   * and return the number of bytes added.
+   */
   std::vector<unsigned char> makeHandshakeMsg();
+  ///Make a handshake that advertises the given capabilities.
+  std::vector<unsigned char> makeHandshakeMsg(handshake::Capabilities capabilities);
+  size_t handshakeMsgSize();
+
+  ///Decode a peer's handshake, which is only valid for this protocol.
+  handshake::Handshake decodeHandshakeMsg(BuffView buff);
 
   std::vector<unsigned char> makeSampleMsg(SampleData& sample);
+  std::vector<unsigned char> makeSampleMsg(const ArenaSampleData& sample);
+  size_t makeSampleMsg(const SampleData& sample, std::vector<unsigned char>& out);
+  size_t makeSampleMsg(const ArenaSampleData& sample, std::vector<unsigned char>& out);
+  size_t sampleMsgSize(const SampleData& sample);
+  size_t sampleMsgSize(const ArenaSampleData& sample);
 
   SampleData decodeSampleMsg(std::vector<unsigned char>& buff, unsigned int length);
+  ///Decode a sample message in place, the view must hold one whole message.
+  SampleData decodeSampleMsg(BuffView buff);
+
+  /**
+   * Decode a sample whose sense data is allocated from the arena, so that
+   * a batch of samples is freed with one Arena::reset.
+   */
+  ArenaSampleData decodeSampleMsg(BuffView buff, Arena& arena);
 }
 
 #endif
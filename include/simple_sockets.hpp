@@ -31,6 +31,38 @@
 #include <string>
 #include <vector>
 
+#include "handshake.hpp"
+
+struct iovec;
+
+/**
+ * A place to connect to or listen on, written as a string so that the
+ * transport can be chosen in configuration without changing code:
+ *   tcp:host:port         TCP over IPv4 (also just host:port)
+ *   unix:/path            a Unix domain stream socket
+ *   unixpacket:/path      a Unix domain SOCK_SEQPACKET socket
+ * A ServerSocket listens on every interface so its host may be left out,
+ * as in tcp::7009 or :7009.
+ * Every transport carries the same length prefixed messages so a
+ * MessageReceiver or EventLoop works the same way with any of them. Unix
+ * sockets skip the TCP stack when both sides run on one host and packet
+ * sockets also keep each send in a single record.
+ */
+struct Endpoint {
+  enum Transport {tcp, unix_stream, unix_packet};
+  Transport transport;
+  ///Host name or address and port for tcp
+  std::string host;
+  uint32_t port;
+  ///File system path for unix sockets
+  std::string path;
+  ///False if the string could not be parsed
+  bool valid;
+
+  ///Parse an endpoint string. The result is invalid if it is malformed.
+  static Endpoint parse(const std::string& endpoint);
+};
+
 /**
  * Simple abstraction for a socket that makes it easier to setup
  * the socket and send and receive messages.
@@ -44,6 +76,23 @@ class ClientSocket {
     //Hide the socket to make sure it isn't misused
     int sock_fd;
 
+    //Messages waiting to be sent by flush
+    std::vector<std::vector<unsigned char>> send_queue;
+    size_t queued_bytes;
+
+    //Capabilities negotiated with the peer during the handshake
+    handshake::Capabilities _capabilities;
+
+    //True for SOCK_SEQPACKET sockets, which send and receive whole records
+    bool _packet;
+
+    //Connect to a Unix domain socket at path.
+    void connectUnix(const std::string& path, int type, int sock_flags);
+
+    //Send everything in the given buffers, modifying the iovec array as
+    //data is sent. Throws like send.
+    void sendAll(struct iovec* iov, size_t count);
+
     //No copying or assignment. Deleting the copy constructor prevents passing
     //by value. This makes sure the socket is used in one place and deleted
     //only once.
@@ -57,8 +106,14 @@ class ClientSocket {
      */
     ClientSocket(int domain, int type, int protocol, uint32_t port, const std::string& ip_address, int sock_flags = 0);
 
+    /**
+     * Connect to an endpoint string (see Endpoint). As with the other
+     * constructor errors are printed and leave the socket invalid.
+     */
+    ClientSocket(const std::string& endpoint, int sock_flags = 0);
+
     ///Constructor to take in a preexisting socket
-    ClientSocket(uint32_t port, const std::string& ip_address, int sock);
+    ClientSocket(uint32_t port, const std::string& ip_address, int sock, bool packet = false);
 
     ///Destructor - close the socket if it is open
     ~ClientSocket();
@@ -89,17 +144,89 @@ class ClientSocket {
      */
     ssize_t receive(std::vector<unsigned char>& buff);
 
+    /**
+     * Receive up to @size bytes into the memory at @buff.
+     */
+    ssize_t receive(unsigned char* buff, size_t size);
+
+    /**
+     * Smallest buffer that receive can be given without losing data. Packet
+     * sockets discard whatever part of a record does not fit.
+     */
+    size_t receiveSize() const;
+
+    ///True if this is a SOCK_SEQPACKET socket.
+    bool packet() const;
+
     /**
      * Sends data in the provided buffer.
+     * If the socket stays full for one second a temporarily_unavailable
+     * exception is thrown.
      * Throws a std::runtime_error upon failure.
      */
     void send(const std::vector<unsigned char>& buff);
 
+    ///Send @length bytes from @data, as with the vector version of send.
+    void send(const unsigned char* data, size_t length);
+
+    /**
+     * Send several buffers, in order, with as few system calls as possible
+     * by using sendmsg with one iovec per buffer. The buffers are not
+     * copied. Failures are handled as with the single buffer version.
+     */
+    void send(const std::vector<std::vector<unsigned char>>& buffs);
+
+    /**
+     * Add a message to the outgoing queue instead of sending it right away.
+     * Queued messages are sent together by flush. The queue is flushed
+     * automatically once it holds 64KB, so this may throw like send.
+     */
+    void queue(std::vector<unsigned char>&& buff);
+
+    /**
+     * Send as much of the given buffers as the socket will accept right
+     * now, without blocking. Returns the number of bytes sent, which is 0
+     * when the socket is full.
+     * Throws a std::runtime_error upon failure.
+     */
+    size_t trySend(const struct iovec* iov, size_t count);
+
+    ///Queue a copy of @buff.
+    void queue(const std::vector<unsigned char>& buff);
+
+    ///Number of bytes waiting in the outgoing queue.
+    size_t queued() const;
+
+    /**
+     * Send all queued messages with vectored writes. The queue is empty
+     * afterwards, even if sending failed and this throws.
+     */
+    void flush();
+
     ///Return the port number for this socket
     uint32_t port();
 
     ///Return the ip address endpoint of the socket
     std::string ip_address();
+
+    /**
+     * Return the file descriptor so that the socket can be registered with
+     * poll or epoll. The descriptor is still owned by this object and must
+     * not be closed by the caller.
+     */
+    int fd() const;
+
+    /**
+     * Remember the capabilities negotiated with the peer, usually the
+     * result of handshake::negotiate. A new socket has none.
+     */
+    void setCapabilities(handshake::Capabilities capabilities);
+
+    ///Return the negotiated capabilities.
+    handshake::Capabilities capabilities() const;
+
+    ///Return true if the capability was negotiated with the peer.
+    bool hasCapability(handshake::Capability capability) const;
 };
 
 
@@ -110,6 +237,15 @@ struct ServerSocket {
   private:
     uint32_t _port;
     int sock_fd;
+    //File system path of a Unix domain socket, removed when closing
+    std::string _path;
+    bool _packet;
+
+    //Bind and listen on a TCP port on every interface.
+    void listenTCP(int domain, int type, int sock_flags, bool reuse_port);
+
+    //Bind and listen on a Unix domain socket at path.
+    void listenUnix(const std::string& path, int type, int sock_flags);
 
     //No copying or assignment. Deleting the copy constructor prevents passing
     //by value. This makes sure the socket is used in one place and deleted
@@ -123,8 +259,18 @@ struct ServerSocket {
      * @domain - generally either AF_INET of AF_INET6, can be AF_UNSPEC for either.
      * @type - SOCK_STREAM for TCP and SOCK_DGRAM for UDP
      * @sock_flags - flags that be will bitwise ORed with the type when creating the socket
+     * @reuse_port - set SO_REUSEPORT so that several sockets (usually one per
+     *                thread) can listen on the same port
+     */
+    ServerSocket(int domain, int type, int sock_flags, uint32_t port, bool reuse_port = false);
+
+    /**
+     * Listen on an endpoint string (see Endpoint). A stale Unix domain
+     * socket file at the path is replaced and the file is removed again
+     * when the ServerSocket is destroyed. Errors are printed and leave the
+     * socket invalid.
      */
-    ServerSocket(int domain, int type, int sock_flags, uint32_t port);
+    ServerSocket(const std::string& endpoint, int sock_flags = 0, bool reuse_port = false);
 
     ///Close the socket in the destructor
     ~ServerSocket();
@@ -134,6 +280,20 @@ struct ServerSocket {
 
     //Accept a new socket connection and return a ClientSocket to talk through.
     ClientSocket next(int flags = 0);
+
+    /**
+     * Accept a pending connection without polling first. If the socket is
+     * nonblocking and no connection is waiting the returned ClientSocket
+     * is invalid. The flags are passed to accept4.
+     */
+    ClientSocket accept(int flags = 0);
+
+    /**
+     * Return the file descriptor so that the socket can be registered with
+     * poll or epoll. The descriptor is still owned by this object and must
+     * not be closed by the caller.
+     */
+    int fd() const;
 };
 
 #endif
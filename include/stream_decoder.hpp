@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file stream_decoder.hpp
+ * Defines the StreamDecoder class that decodes the large world model
+ * messages one element at a time as their bytes arrive.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __STREAM_DECODER_HPP__
+#define __STREAM_DECODER_HPP__
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "frame_buffer.hpp"
+#include "simple_sockets.hpp"
+#include "world_model_protocol.hpp"
+
+namespace world_model {
+
+  /**
+   * URI search responses, data responses, and solver data messages can be
+   * as large as their 32 bit length allows. Instead of waiting for a whole
+   * message this decoder hands out each URI, attribute, or solution as soon
+   * as its bytes have arrived, so memory use is bounded by the largest
+   * single element and the first results are available early.
+   *
+   * Every other message is buffered whole and passed to the message
+   * handler. Handlers that are not set are skipped. A malformed message is
+   * skipped up to the end of its frame so the rest of the stream is still
+   * decoded.
+   */
+  class StreamDecoder {
+    public:
+      ///Which side of the protocol the messages are coming from
+      enum Source {
+        //Messages a client receives from a world model
+        from_world_model,
+        //Messages a world model receives from a solver
+        from_solver
+      };
+
+      typedef std::function<void (const FrameView&)> MessageHandler;
+      typedef std::function<void (const URI&)> URIHandler;
+      typedef std::function<void (const URI&, uint32_t ticket, uint32_t num_attributes)> DataStartHandler;
+      typedef std::function<void (const AliasedAttribute&)> AttributeHandler;
+      typedef std::function<void (bool create_uris, uint32_t num_solutions)> SolutionStartHandler;
+      typedef std::function<void (const solver::SolutionData&)> SolutionHandler;
+      ///Called with the message type when a streamed message is finished.
+      typedef std::function<void (uint8_t)> EndHandler;
+
+      ///What a call to receive did
+      enum Received {
+        //A nonblocking socket had no data
+        nothing,
+        //Bytes arrived and everything complete was decoded
+        decoded,
+        //Bytes arrived but a malformed message was skipped
+        skipped_malformed
+      };
+
+    private:
+      enum State {frame_start, message_header, elements, skipping};
+
+      Source source;
+      State state;
+      //The type of the message being streamed
+      uint8_t msg_type;
+      //Bytes of the current frame that have not been decoded yet
+      size_t frame_left;
+
+      //Received bytes that have not been decoded yet are [head, tail). The
+      //buffer keeps its size so that receive does not clear new space for
+      //every call.
+      std::vector<unsigned char> buffer;
+      size_t head;
+      size_t tail;
+
+      //Make room for @length more bytes after tail
+      void makeRoom(size_t length);
+
+      //Reused for each element
+      URI uri;
+      AliasedAttribute attribute;
+      solver::SolutionData solution;
+
+      MessageHandler message_handler;
+      URIHandler uri_handler;
+      DataStartHandler data_start_handler;
+      AttributeHandler attribute_handler;
+      SolutionStartHandler solution_start_handler;
+      SolutionHandler solution_handler;
+      EndHandler end_handler;
+
+      //True if messages of this type are decoded one element at a time
+      bool streamed(uint8_t type) const;
+
+      //Decode the message header or one element from the view. Returns false
+      //if the view did not hold all of it.
+      bool decodeHeader(BuffView& view);
+      bool decodeElement(BuffView& view);
+
+      //Decode as much of the buffer as possible. Returns false if a
+      //malformed message was skipped.
+      bool process();
+
+    public:
+      StreamDecoder(Source source);
+
+      void onMessage(MessageHandler handler);
+      void onURI(URIHandler handler);
+      void onDataStart(DataStartHandler handler);
+      void onAttribute(AttributeHandler handler);
+      void onSolutionStart(SolutionStartHandler handler);
+      void onSolution(SolutionHandler handler);
+      void onEnd(EndHandler handler);
+
+      /**
+       * Decode @length more bytes of the stream, calling handlers for
+       * everything that is complete. Returns false if a malformed message
+       * was skipped.
+       */
+      bool feed(const unsigned char* data, size_t length);
+
+      /**
+       * Receive once from the socket and decode what arrived. Returns
+       * nothing if a nonblocking socket had no data and skipped_malformed if
+       * a malformed message was skipped. Throws a std::runtime_error if the
+       * connection was closed or failed.
+       */
+      Received receive(ClientSocket& sock);
+
+      ///Number of received bytes held until more of the stream arrives.
+      size_t buffered() const;
+
+      ///Discard buffered bytes and start over at a message boundary.
+      void reset();
+  };
+}
+
+#endif
+
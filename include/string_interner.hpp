@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file string_interner.hpp
+ * Defines a thread safe table of interned UTF16 strings so that the URIs,
+ * attribute names, and origins that appear over and over in world model
+ * traffic are stored once and compared as integers.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __STRING_INTERNER_HPP__
+#define __STRING_INTERNER_HPP__
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * A handle to a string stored in a StringInterner. The characters are not
+ * owned by the handle and stay valid as long as the interner does. Handles
+ * from the same interner are equal exactly when their strings are equal,
+ * so comparisons and hashing only look at the ID. The default handle is
+ * the empty string, which every interner stores as ID 0.
+ */
+struct InternedString {
+  uint32_t id;
+  const char16_t* data;
+  size_t size;
+
+  InternedString() : id(0), data(u""), size(0) {}
+  InternedString(uint32_t id, const char16_t* data, size_t size) : id(id), data(data), size(size) {}
+
+  bool empty() const { return 0 == size; }
+
+  ///Copy the characters into a new string.
+  std::u16string str() const { return std::u16string(data, size); }
+
+  bool operator==(const InternedString& other) const { return id == other.id; }
+  bool operator!=(const InternedString& other) const { return id != other.id; }
+  //Orders by ID, which is the order that strings were first interned
+  bool operator<(const InternedString& other) const { return id < other.id; }
+};
+
+namespace std {
+  template<>
+  struct hash<InternedString> {
+    size_t operator()(const InternedString& str) const {
+      return std::hash<uint32_t>()(str.id);
+    }
+  };
+}
+
+/**
+ * Strings are never removed from an interner, so it is meant for the
+ * limited vocabulary of URIs, attribute names, and origins that a process
+ * sees rather than for arbitrary data. All functions may be called from
+ * multiple threads.
+ */
+class StringInterner {
+  private:
+    //A view of a stored string, used as the lookup key
+    struct Key {
+      const char16_t* data;
+      size_t size;
+      bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash {
+      size_t operator()(const Key& key) const;
+    };
+
+    mutable std::mutex lock;
+    //A deque never moves its elements so keys and handles stay valid
+    std::deque<std::u16string> strings;
+    std::unordered_map<Key, uint32_t, KeyHash> ids;
+
+    //No copying, handles point into this object's storage
+    StringInterner& operator=(const StringInterner&) = delete;
+    StringInterner(const StringInterner&) = delete;
+
+  public:
+    StringInterner();
+
+    ///Return the handle for the string, storing it if it is new.
+    InternedString intern(const char16_t* data, size_t size);
+    InternedString intern(const std::u16string& str);
+
+    /**
+     * Find the handle of a string that was already interned without
+     * storing it. Returns false if the string is unknown.
+     */
+    bool find(const std::u16string& str, InternedString& found) const;
+
+    /**
+     * Return the handle for an ID given out by this interner.
+     * Throws a std::out_of_range exception for unknown IDs.
+     */
+    InternedString lookup(uint32_t id) const;
+
+    ///Number of strings stored, including the empty string.
+    size_t size() const;
+};
+
+#endif
+
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file subscription_index.hpp
+ * Defines the SubscriptionIndex class that finds the solvers interested in
+ * a sample without scanning every subscription rule.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __SUBSCRIPTION_INDEX_HPP__
+#define __SUBSCRIPTION_INDEX_HPP__
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "aggregator_solver_protocol.hpp"
+#include "sample_data.hpp"
+
+namespace aggregator_solver {
+
+  /**
+   * An index over the subscriptions of many solvers.
+   *
+   * A rule's transmitter entry matches an id when (id & mask) equals
+   * (base_id & mask). Entries are grouped by physical layer and then by
+   * mask, and each mask group is a hash table from the masked base id to
+   * the subscribers that asked for it. Matching an id costs one hash lookup
+   * per distinct mask used on that physical layer, no matter how many
+   * solvers or rules there are. Exact ids (a full mask) and ranges (any
+   * other mask, including 0 for every transmitter) are handled the same way
+   * and solvers tend to share a handful of masks, so this is close to
+   * constant time.
+   */
+  class SubscriptionIndex {
+    public:
+      ///Caller chosen identifier of a subscriber, such as a connection id.
+      typedef uint64_t SubscriberID;
+
+      struct Match {
+        SubscriberID subscriber;
+        /**
+         * The smallest update interval of the subscriber's matching rules,
+         * in milliseconds.
+         */
+        uint64_t update_interval;
+      };
+
+    private:
+      struct Entry {
+        SubscriberID subscriber;
+        uint64_t update_interval;
+      };
+
+      //All entries of one physical layer that share a mask
+      struct MaskGroup {
+        uint128_t mask;
+        std::unordered_map<uint128_t, std::vector<Entry>> ids;
+      };
+
+      //Mask groups for each physical layer
+      std::vector<MaskGroup> groups[256];
+      //The rules of each subscriber so that they can be removed
+      std::unordered_map<SubscriberID, Subscription> subscriptions;
+
+    public:
+      /**
+       * Add rules for a subscriber. The rules are added to any that the
+       * subscriber already has. Rules without any transmitters match
+       * nothing and are ignored.
+       */
+      void add(SubscriberID subscriber, const Subscription& rules);
+
+      ///Remove every rule of a subscriber.
+      void remove(SubscriberID subscriber);
+
+      ///Remove everything.
+      void clear();
+
+      ///Number of subscribers with rules in the index.
+      size_t size() const;
+
+      /**
+       * Find the subscribers interested in a transmitter. Each subscriber
+       * appears once in @out, which is cleared first. Returns the number of
+       * matches.
+       */
+      size_t match(unsigned char physical_layer, const uint128_t& tx_id, std::vector<Match>& out) const;
+
+      ///Find the subscribers interested in a sample.
+      std::vector<Match> match(const SampleData& sample) const;
+  };
+}
+
+#endif
+
@@ -28,7 +28,7 @@
 #ifndef __TEMPORARILY_UNAVAILABLE_HPP__
 #define __TEMPORARILY_UNAVAILABLE_HPP__
 
-#include <exception>
+#include <stdexcept>
 
 
 /**
@@ -37,6 +37,11 @@
 #include <utility>
 #include <vector>
 
+#include "arena.hpp"
+#include "handshake.hpp"
+#include "netbuffer.hpp"
+#include "string_interner.hpp"
+
 namespace world_model {
 
   //Special characters besides the period (.) are not permitted in URIs.
@@ -60,8 +65,13 @@ namespace world_model {
     Buffer data;
   };
 
-  //Each object URI has a set of attributes associated with it
-  struct AliasedAttribute {
+  /**
+   * Each object URI has a set of attributes associated with it.
+   * The allocator is used for the attribute data; AliasedAttribute uses the
+   * standard allocator and ArenaAliasedAttribute uses an Arena.
+   */
+  template<typename Alloc>
+  struct BasicAliasedAttribute {
     //The alias for the description of this attribute.
     //The attribute name indicates the data type.
     uint32_t name_alias;
@@ -70,9 +80,12 @@ namespace world_model {
     grail_time expiration_date;
     uint32_t origin_alias;
     //Data in the field.
-    Buffer data;
+    std::vector<uint8_t, typename std::allocator_traits<Alloc>::template rebind_alloc<uint8_t>> data;
   };
 
+  typedef BasicAliasedAttribute<std::allocator<uint8_t>> AliasedAttribute;
+  typedef BasicAliasedAttribute<ArenaAllocator<uint8_t>> ArenaAliasedAttribute;
+
   typedef std::map<URI, std::vector<Attribute>> WorldState;
 
   struct WorldData {
@@ -82,15 +95,60 @@ namespace world_model {
     std::vector<Attribute> attributes;
   };
 
-  struct AliasedWorldData {
+  /**
+   * The URI, the attribute list, and the attribute data all use the given
+   * allocator. AliasedWorldData uses the standard allocator and
+   * ArenaAliasedWorldData is decoded entirely into an Arena.
+   */
+  template<typename Alloc>
+  struct BasicAliasedWorldData {
+    typedef std::allocator_traits<Alloc> Traits;
     //The URI of an object in the world model.
-    URI object_uri;
+    std::basic_string<char16_t, std::char_traits<char16_t>,
+      typename Traits::template rebind_alloc<char16_t>> object_uri;
     //Attributes of this URI
+    std::vector<BasicAliasedAttribute<Alloc>,
+      typename Traits::template rebind_alloc<BasicAliasedAttribute<Alloc>>> attributes;
+  };
+
+  typedef BasicAliasedWorldData<std::allocator<uint8_t>> AliasedWorldData;
+  typedef BasicAliasedWorldData<ArenaAllocator<uint8_t>> ArenaAliasedWorldData;
+
+  /*
+   * Versions of the structures above whose strings are handles into a
+   * StringInterner, as returned by the decode functions that take an
+   * interner. Strings that repeat in every message are then stored once
+   * and compare as integers.
+   */
+  struct InternedAttribute {
+    InternedString name;
+    grail_time creation_date;
+    grail_time expiration_date;
+    InternedString origin;
+    Buffer data;
+  };
+
+  typedef std::map<InternedString, std::vector<InternedAttribute>> InternedWorldState;
+
+  struct InternedAliasedWorldData {
+    InternedString object_uri;
     std::vector<AliasedAttribute> attributes;
   };
 
   grail_time getGRAILTime();
 
+  /*
+   * Every decode function below also accepts a BuffView so that messages
+   * can be decoded where they sit (for instance inside of a receive buffer)
+   * without first copying them into a Buffer.
+   *
+   * Every make function has a matching size function that returns the
+   * encoded size of the message in bytes, including its length field.
+   * Messages are built by computing this size and then writing into a single
+   * allocation; callers can also use the sizes to reserve one buffer for a
+   * batch of messages.
+   */
+
   namespace client {
     enum class MessageID : uint8_t {keep_alive        = 0,
                                     snapshot_request  = 1,
@@ -103,7 +161,10 @@ namespace world_model {
                                     data_response     = 8,
                                     uri_search        = 9,
                                     uri_response      = 10,
-                                    origin_preference = 11};
+                                    origin_preference = 11,
+                                    //Messages packed by compression::makeEnvelope.
+                                    //Only sent after negotiating compression.
+                                    compressed_envelope = 255};
 
     //It is a waste of bandwidth to repeatedly send large strings over the
     //network so some strings are aliased with a number.
@@ -126,11 +187,18 @@ namespace world_model {
      * Make a handshake message.
      */
     std::vector<unsigned char> makeHandshakeMsg();
+    ///Make a handshake that advertises the given capabilities.
+    std::vector<unsigned char> makeHandshakeMsg(handshake::Capabilities capabilities);
+    size_t handshakeMsgSize();
+
+    ///Decode a peer's handshake, which is only valid for this protocol.
+    handshake::Handshake decodeHandshakeMsg(BuffView buff);
 
     /*
      * Make a keep alive message to test if a connection should be kept active.
      */
     Buffer makeKeepAlive();
+    size_t keepAliveSize();
 
     /**
      * There are three ways to query the world model.
@@ -159,9 +227,16 @@ namespace world_model {
     Buffer makeRangeRequest(const Request& request, uint32_t ticket);
     Buffer makeStreamRequest(const Request& request, uint32_t ticket);
 
+    size_t snapshotRequestSize(const Request& request);
+    size_t rangeRequestSize(const Request& request);
+    size_t streamRequestSize(const Request& request);
+
     std::tuple<client::Request, uint32_t> decodeSnapshotRequest(Buffer& buff);
+    std::tuple<client::Request, uint32_t> decodeSnapshotRequest(BuffView buff);
     std::tuple<client::Request, uint32_t> decodeRangeRequest(Buffer& buff);
+    std::tuple<client::Request, uint32_t> decodeRangeRequest(BuffView buff);
     std::tuple<client::Request, uint32_t> decodeStreamRequest(Buffer& buff);
+    std::tuple<client::Request, uint32_t> decodeStreamRequest(BuffView buff);
 
     /**
      * Each attribute has a UTF16 big endian name and alias.
@@ -175,8 +250,22 @@ namespace world_model {
     Buffer makeAttrAliasMsg(const std::vector<AliasType>& attribute_aliases);
     Buffer makeOriginAliasMsg(const std::vector<AliasType>& origin_aliases);
 
+    size_t attrAliasMsgSize(const std::vector<AliasType>& attribute_aliases);
+    size_t originAliasMsgSize(const std::vector<AliasType>& origin_aliases);
+
     std::vector<AliasType> decodeAttrAliasMsg(Buffer& buff);
+    std::vector<AliasType> decodeAttrAliasMsg(BuffView buff);
     std::vector<AliasType> decodeOriginAliasMsg(Buffer& buff);
+    std::vector<AliasType> decodeOriginAliasMsg(BuffView buff);
+
+    struct InternedAliasType {
+      uint32_t alias;
+      InternedString type;
+    };
+
+    ///Decode alias messages with their names interned.
+    std::vector<InternedAliasType> decodeAttrAliasMsg(BuffView buff, StringInterner& interner);
+    std::vector<InternedAliasType> decodeOriginAliasMsg(BuffView buff, StringInterner& interner);
 
     /**
      * After sending all of the data for a snapshot request or range request
@@ -184,29 +273,51 @@ namespace world_model {
      * that no more data will be sent for the request.
      */
     Buffer makeRequestComplete(uint32_t ticket_number);
+    size_t requestCompleteSize();
     uint32_t decodeRequestComplete(Buffer& buff);
+    uint32_t decodeRequestComplete(BuffView buff);
 
     /**
      * The cancel request message cancels an ongoing streaming request.
      * After cancellation a request complete message is sent.
      */
     Buffer makeCancelRequest(uint32_t ticket_number);
+    size_t cancelRequestSize();
     uint32_t decodeCancelRequest(Buffer& buff);
+    uint32_t decodeCancelRequest(BuffView buff);
 
     /**
      * Data for any request is sent in the same format.
+     * The version with an output buffer appends the message to @out and
+     * returns its size, so one buffer can be reused for every message.
      */
     Buffer makeDataMessage(const AliasedWorldData& wd, uint32_t ticket);
+    size_t makeDataMessage(const AliasedWorldData& wd, uint32_t ticket, Buffer& out);
+    size_t dataMessageSize(const AliasedWorldData& wd);
     std::tuple<AliasedWorldData, uint32_t> decodeDataMessage(Buffer& buff);
+    std::tuple<AliasedWorldData, uint32_t> decodeDataMessage(BuffView buff);
+    /**
+     * Decode into memory from the arena: the URI, the attribute list, and
+     * the attribute data. A whole batch of messages decoded this way is
+     * freed with one Arena::reset.
+     */
+    std::tuple<ArenaAliasedWorldData, uint32_t> decodeDataMessage(BuffView buff, Arena& arena);
+
+    ///Decode a data message with its URI interned.
+    std::tuple<InternedAliasedWorldData, uint32_t> decodeDataMessage(BuffView buff, StringInterner& interner);
 
     /**
      * Search for any URIs matching a regular expression string.
      */
     Buffer makeURISearch(const URI& uri);
+    size_t uriSearchSize(const URI& uri);
     URI decodeURISearch(Buffer& buff);
+    URI decodeURISearch(BuffView buff);
 
     Buffer makeURISearchResponse(const std::vector<URI>& uris);
+    size_t uriSearchResponseSize(const std::vector<URI>& uris);
     std::vector<URI> decodeURISearchResponse(Buffer& buff);
+    std::vector<URI> decodeURISearchResponse(BuffView buff);
 
     /**
      * A message used by a client to specify preferences for
@@ -231,7 +342,9 @@ namespace world_model {
      * regardless of origin.
      */
     Buffer makeOriginPreference(const std::vector<std::pair<std::u16string, int32_t>>& weights);
+    size_t originPreferenceSize(const std::vector<std::pair<std::u16string, int32_t>>& weights);
     std::vector<std::pair<std::u16string, int32_t>> decodeOriginPreference(Buffer& buff);
+    std::vector<std::pair<std::u16string, int32_t>> decodeOriginPreference(BuffView buff);
 
   }//End namespace world_model::client
 
@@ -259,6 +372,14 @@ namespace world_model {
       std::vector<uint8_t> data;
     };
 
+    ///SolutionData with an interned target URI
+    struct InternedSolutionData {
+      uint32_t type_alias;
+      grail_time time;
+      InternedString target;
+      std::vector<uint8_t> data;
+    };
+
     /**
      * The AliasType of the solver->world model protocol is different than
      * in the client->world model because it keeps track of on_demand information.
@@ -277,11 +398,18 @@ namespace world_model {
      * Make a handshake message.
      */
     std::vector<unsigned char> makeHandshakeMsg();
+    ///Make a handshake that advertises the given capabilities.
+    std::vector<unsigned char> makeHandshakeMsg(handshake::Capabilities capabilities);
+    size_t handshakeMsgSize();
+
+    ///Decode a peer's handshake, which is only valid for this protocol.
+    handshake::Handshake decodeHandshakeMsg(BuffView buff);
 
     /*
      * Make a keep alive message to test if a connection should be kept active.
      */
     Buffer makeKeepAlive();
+    size_t keepAliveSize();
 
     /**
      * Before a solver submits new kinds of data to the world model it must first
@@ -292,27 +420,42 @@ namespace world_model {
      * some time frame
      */
     Buffer makeTypeAnnounceMsg(const std::vector<AliasType>& type_alias, const std::u16string& origin);
+    size_t typeAnnounceMsgSize(const std::vector<AliasType>& type_alias, const std::u16string& origin);
     std::pair<std::vector<AliasType>, std::u16string> decodeTypeAnnounceMsg(Buffer& buff);
+    std::pair<std::vector<AliasType>, std::u16string> decodeTypeAnnounceMsg(BuffView buff);
 
     Buffer makeStartOnDemand(const std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>& aliases);
+    size_t startOnDemandSize(const std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>& aliases);
     std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> decodeStartOnDemand(Buffer& buff);
+    std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> decodeStartOnDemand(BuffView buff);
 
     Buffer makeStopOnDemand(const std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>& aliases);
+    size_t stopOnDemandSize(const std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>& aliases);
     std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> decodeStopOnDemand(Buffer& buff);
+    std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> decodeStopOnDemand(BuffView buff);
 
     /**
      * Data sent from the solver to modify an attribute in the world model.
      * The world model uses the previously announced origin and type aliases
      * when decoding this message.
+     * The version with an output buffer appends the message to @out and
+     * returns its size.
      */
     Buffer makeSolutionMsg(bool create_uris, const std::vector<SolutionData>& solutions);
+    size_t makeSolutionMsg(bool create_uris, const std::vector<SolutionData>& solutions, Buffer& out);
+    size_t solutionMsgSize(const std::vector<SolutionData>& solutions);
     std::tuple<bool, std::vector<SolutionData>> decodeSolutionMsg(Buffer& buff);
+    std::tuple<bool, std::vector<SolutionData>> decodeSolutionMsg(BuffView buff);
+    ///Decode solutions with their target URIs interned.
+    std::tuple<bool, std::vector<InternedSolutionData>> decodeSolutionMsg(BuffView buff, StringInterner& interner);
 
     /**
      * Solvers may also create new URIs in the world model.
      */
     Buffer makeCreateURI(const URI& new_uri, grail_time creation, std::u16string origin);
+    size_t createURISize(const URI& new_uri, const std::u16string& origin);
     std::tuple<URI, grail_time, std::u16string> decodeCreateURI(Buffer& buff);
+    std::tuple<URI, grail_time, std::u16string> decodeCreateURI(BuffView buff);
 
     /**
      * Expiring a URI or attribute will set the expiration time of the URI.
@@ -320,20 +463,28 @@ namespace world_model {
      * current time.
      */
     Buffer makeExpireURI(const URI& uri, grail_time expiration, std::u16string origin);
+    size_t expireURISize(const URI& uri, const std::u16string& origin);
     std::tuple<URI, grail_time, std::u16string> decodeExpireURI(Buffer& buff);
+    std::tuple<URI, grail_time, std::u16string> decodeExpireURI(BuffView buff);
 
     Buffer makeExpireAttribute(const URI& uri, std::u16string attribute, std::u16string origin, grail_time expiration);
+    size_t expireAttributeSize(const URI& uri, const std::u16string& attribute, const std::u16string& origin);
     std::tuple<URI, std::u16string, grail_time, std::u16string> decodeExpireAttribute(Buffer& buff);
+    std::tuple<URI, std::u16string, grail_time, std::u16string> decodeExpireAttribute(BuffView buff);
 
     /**
      * Deleting a URI or attribute will remove it from the world model
      * for any time period.
      */
     Buffer makeDeleteURI(const URI& uri, std::u16string origin);
+    size_t deleteURISize(const URI& uri, const std::u16string& origin);
     std::pair<URI, std::u16string> decodeDeleteURI(Buffer& buff);
+    std::pair<URI, std::u16string> decodeDeleteURI(BuffView buff);
 
     Buffer makeDeleteAttribute(const URI& uri, std::u16string attribute, std::u16string origin);
+    size_t deleteAttributeSize(const URI& uri, const std::u16string& attribute, const std::u16string& origin);
     std::tuple<URI, std::u16string, std::u16string> decodeDeleteAttribute(Buffer& buff);
+    std::tuple<URI, std::u16string, std::u16string> decodeDeleteAttribute(BuffView buff);
 
   }//End namespace world_model::solver
 }//End namespace world_model
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file world_store.hpp
+ * Defines the WorldStore class, an in memory world model that answers
+ * snapshot, range, and URI search requests without scanning every value.
+ *
+ * @author Bernhard Firner
+ */
+
+#ifndef __WORLD_STORE_HPP__
+#define __WORLD_STORE_HPP__
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "world_model_protocol.hpp"
+
+namespace world_model {
+
+  /**
+   * An indexed store of world model data.
+   *
+   * Objects are kept in an ordered map by URI. A URI search takes the
+   * literal prefix of its regular expression and only tests the URIs in
+   * that part of the map. Every attribute of an object is a log of values
+   * from one origin ordered by creation date. Finding the value current at
+   * some time, or the values created during a range, is a binary search of
+   * that log.
+   *
+   * Attribute names and origins are numbered from 1 when they are first
+   * seen and the numbers are used as their aliases in data messages, so
+   * that 0 is never a valid alias as with AliasRegistry. The alias
+   * tables for the attribute_alias and origin_alias messages come from
+   * attributeAliases and originAliases.
+   */
+  class WorldStore {
+    public:
+      ///Origin weights as sent in an origin_preference message.
+      typedef std::vector<std::pair<std::u16string, int32_t>> OriginWeights;
+
+      ///Called with the results for each object that a query matches.
+      typedef std::function<void(const AliasedWorldData&)> ResultHandler;
+
+    private:
+      struct Value {
+        grail_time creation;
+        //0 until the value is expired
+        grail_time expiration;
+        Buffer data;
+      };
+
+      //The values of one attribute from one origin, by creation date
+      struct Track {
+        uint32_t name;
+        uint32_t origin;
+        std::vector<Value> values;
+      };
+
+      struct Object {
+        grail_time creation;
+        //Tracks sorted by name and then origin
+        std::vector<Track> tracks;
+      };
+
+      std::map<URI, Object> objects;
+      std::vector<std::u16string> names;
+      std::vector<std::u16string> origins;
+      std::map<std::u16string, uint32_t> name_ids;
+      std::map<std::u16string, uint32_t> origin_ids;
+
+      static uint32_t intern(const std::u16string& str,
+                             std::vector<std::u16string>& strings,
+                             std::map<std::u16string, uint32_t>& ids);
+
+      //Add a value to the log of its track, in order of creation
+      void insertValue(const URI& uri, const std::u16string& name, const std::u16string& origin,
+                       Value&& value);
+
+      //Find a track, or the place where it belongs
+      static std::vector<Track>::iterator findTrack(Object& object, uint32_t name, uint32_t origin);
+
+      //Call visit with every object whose URI fully matches the pattern
+      void forMatches(const URI& pattern, const std::function<void(const URI&, const Object&)>& visit) const;
+
+      //Which attribute names (by alias) are matched by any of the patterns
+      std::vector<bool> matchNames(const std::vector<URI>& patterns) const;
+
+    public:
+      WorldStore() = default;
+      WorldStore(const WorldStore&) = delete;
+      WorldStore& operator=(const WorldStore&) = delete;
+
+      /**
+       * Add a URI to the store. Values can be added without this, which
+       * creates the URI with the creation time of its first value.
+       */
+      void createURI(const URI& uri, grail_time creation);
+
+      /**
+       * Add a value to the log of an attribute. Values usually arrive in
+       * order and are appended, one that is out of order is put in its
+       * place by creation date. The attribute's expiration date only
+       * applies to this value.
+       */
+      void insert(const URI& uri, const Attribute& attribute);
+
+      ///Add a value as decoded from a solver_data message.
+      void insert(const URI& uri, const std::u16string& name, const std::u16string& origin,
+                  grail_time creation, const Buffer& data);
+
+      /**
+       * Set the expiration time of the values of an attribute that were
+       * created before @expiration and are not already expired.
+       */
+      void expireAttribute(const URI& uri, const std::u16string& name,
+                           const std::u16string& origin, grail_time expiration);
+
+      ///Expire every attribute of a URI.
+      void expireURI(const URI& uri, grail_time expiration);
+
+      ///Remove a URI and all of its values.
+      void deleteURI(const URI& uri);
+
+      ///Remove all values of an attribute from one origin.
+      void deleteAttribute(const URI& uri, const std::u16string& name, const std::u16string& origin);
+
+      ///Number of URIs in the store.
+      size_t size() const;
+
+      /**
+       * URIs that fully match the regular expression, in order, as
+       * returned in a uri_response message.
+       */
+      std::vector<URI> searchURIs(const URI& pattern) const;
+
+      /**
+       * Answer a snapshot request. For each matching URI and attribute this
+       * gives the newest value created between the start and stop times
+       * of the request that was not expired at the stop time. A stop time
+       * of 0 means now. When several origins have such a value only those
+       * from the most preferred origins are given, following the rules of
+       * makeOriginPreference. URIs without a matching value are skipped.
+       */
+      void snapshot(const client::Request& request, const OriginWeights& weights,
+                    const ResultHandler& handler) const;
+
+      /**
+       * Answer a range request with every value of the matching attributes
+       * that was created at or after the start time and before the stop
+       * time, from any origin, in order of creation.
+       */
+      void range(const client::Request& request, const ResultHandler& handler) const;
+
+      /**
+       * Append a data_response message with @ticket to @out for each
+       * object in the snapshot or range result. Returns the number of
+       * messages added.
+       */
+      size_t snapshotMessages(const client::Request& request, const OriginWeights& weights,
+                              uint32_t ticket, Buffer& out) const;
+      size_t rangeMessages(const client::Request& request, uint32_t ticket, Buffer& out) const;
+
+      ///Aliases of the attribute names used in results.
+      std::vector<client::AliasType> attributeAliases() const;
+
+      ///Aliases of the origins used in results.
+      std::vector<client::AliasType> originAliases() const;
+  };
+}
+
+#endif
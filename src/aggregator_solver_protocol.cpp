@@ -27,6 +27,7 @@
  */
 
 #include "aggregator_solver_protocol.hpp"
+#include "metrics.hpp"
 #include "netbuffer.hpp"
 #include "sample_data.hpp"
 
@@ -40,76 +41,111 @@
 
 using namespace aggregator_solver;
 
+static const std::string protocol_string = "GRAIL solver protocol";
+
+size_t aggregator_solver::handshakeMsgSize() {
+  return handshake::encodedSize(protocol_string);
+}
+
 std::vector<unsigned char> aggregator_solver::makeHandshakeMsg() {
-  std::vector<unsigned char> buff(4);
-  std::string protocol_string = "GRAIL solver protocol";
-  buff.insert(buff.end(), protocol_string.begin(), protocol_string.end());
-  //Version number and extension are both currently zero
-  buff.push_back(0);
-  buff.push_back(0);
-  //Insert the length of the protocol string into the buffer
-  pushBackVal<uint32_t>(protocol_string.length(), buff, 0);
+  return makeHandshakeMsg(0);
+}
+
+std::vector<unsigned char> aggregator_solver::makeHandshakeMsg(handshake::Capabilities capabilities) {
+  //The version number is currently zero
+  return handshake::encode(protocol_string, 0, capabilities);
+}
+
+handshake::Handshake aggregator_solver::decodeHandshakeMsg(BuffView buff) {
+  return handshake::decode(buff, protocol_string);
+}
+
+//The protocol never defined the contents of a certificate so both
+//certificate messages are just a length and a message type.
+static std::vector<unsigned char> makeEmptyMsg(MessageID type) {
+  std::vector<unsigned char> buff(sizeof(uint32_t) + 1);
+  BuffWriter writer(buff);
+  writer.writePrimitive<uint32_t>(1);
+  writer.writePrimitive((unsigned char)type);
   return buff;
 }
 
-std::vector<unsigned char>&& aggregator_solver::makeCertMsg();
+std::vector<unsigned char> aggregator_solver::makeCertMsg() {
+  return makeEmptyMsg(certificate);
+}
 
-std::vector<unsigned char>&& aggregator_solver::ackCertMsg();
+std::vector<unsigned char> aggregator_solver::ackCertMsg() {
+  return makeEmptyMsg(ack_certificate);
+}
 
-std::vector<unsigned char> aggregator_solver::makeSubscribeReqMsg(Subscription& rules) {
-  //The total length starts out at one for the message type field.
-  //Each rule will add additional length.
-  uint32_t total_length = 1;
+size_t aggregator_solver::subscribeReqMsgSize(const Subscription& rules) {
+  //The length field, message type, and number of rules
+  size_t size = sizeof(uint32_t) + 1 + sizeof(uint32_t);
+  for (auto rule = rules.begin(); rule != rules.end(); ++rule) {
+    size += sizeof(rule->physical_layer) + sizeof(uint32_t) +
+      rule->txers.size() * 2 * sizeof(uint128_t) + sizeof(rule->update_interval);
+  }
+  return size;
+}
 
+std::vector<unsigned char> aggregator_solver::makeSubscribeReqMsg(Subscription& rules) {
   std::vector<unsigned char> buff;
+  makeSubscribeReqMsg(rules, buff);
+  return buff;
+}
+
+size_t aggregator_solver::makeSubscribeReqMsg(const Subscription& rules, std::vector<unsigned char>& out) {
+  OWL_METRIC_LATENCY(encode, aggregator_solver, subscription_request);
+  size_t size = subscribeReqMsgSize(rules);
+  BuffWriter writer = appendWriter(out, size);
 
-  buff.push_back(0);
-  buff.push_back(0);
-  buff.push_back(0);
-  buff.push_back(0);
-  buff.push_back((unsigned char)subscription_request);
+  //Store the message length (everything after the length field) and type
+  writer.writePrimitive<uint32_t>(size - sizeof(uint32_t));
+  writer.writePrimitive((unsigned char)subscription_request);
 
   //Push back the rules
   {
     //First push the number of rules onto the buffer
     uint32_t num_rules = rules.size();
-    total_length += pushBackVal(num_rules, buff);
+    writer.writePrimitive(num_rules);
 
     //For each rule push back the physical layer, the number of
     //tx rules and the tx rules, the number of boxes and the boxes,
     //and the number of FSM/TR rules and the FSM/TR rules.
     for (auto rule = rules.begin(); rule != rules.end(); ++rule) {
       //Push the physical layer
-      total_length += pushBackVal(rule->physical_layer, buff);
+      writer.writePrimitive(rule->physical_layer);
 
       //Push the transmitter information
       uint32_t num_txers = rule->txers.size();
-      total_length += pushBackVal(num_txers, buff);
+      writer.writePrimitive(num_txers);
       //Each transmitter is made of an ID and a MASK
       for (auto txer = rule->txers.begin(); txer != rule->txers.end(); ++txer) {
-        total_length += pushBackVal(txer->base_id, buff);
-        total_length += pushBackVal(txer->mask, buff);
+        writer.writePrimitive(txer->base_id);
+        writer.writePrimitive(txer->mask);
       }
 
       //Finish the rule with the update interval
-      total_length += pushBackVal(rule->update_interval, buff);
+      writer.writePrimitive(rule->update_interval);
     }
   }
 
-  //Store the message length in the first four bytes
-  pushBackVal<uint32_t>(total_length, buff, 0);
-
-  return buff;
+  return size;
 }
 
 Subscription aggregator_solver::decodeSubscribeMsg(std::vector<unsigned char>& buff, unsigned int length) {
+  return decodeSubscribeMsg(BuffView(buff.data(), std::min<size_t>(length, buff.size())));
+}
+
+Subscription aggregator_solver::decodeSubscribeMsg(BuffView reader) {
+  OWL_METRIC_LATENCY(decode, aggregator_solver, subscription_request);
   Subscription rules;
+  size_t length = reader.size();
 
   //Only process the message if its type matches one of the subscription ids
   //and if the message is large enough to be valid.
   if ( length > 4 ) {
 
-    BuffReader reader(buff);
     uint32_t entire_length = reader.readPrimitive<uint32_t>();
     MessageID msg_type = MessageID(reader.readPrimitive<uint8_t>());
     if (entire_length + 4 == length and
@@ -140,35 +176,72 @@ Subscription aggregator_solver::decodeSubscribeMsg(std::vector<unsigned char>& b
   return rules;
 }
 
+//The size and encoding of a sample does not depend on its allocator
+template<typename Sample>
+static size_t sampleSize(const Sample& sample) {
+  //The length field and message type followed by the sample
+  return sizeof(uint32_t) + 1 + sizeof(sample.physical_layer) +
+    sizeof(sample.tx_id) + sizeof(sample.rx_id) + sizeof(sample.rx_timestamp) +
+    sizeof(sample.rss) + sample.sense_data.size();
+}
+
+template<typename Sample>
+static size_t makeSample(const Sample& sample, std::vector<unsigned char>& out) {
+  OWL_METRIC_LATENCY(encode, aggregator_solver, aggregator_solver::server_sample);
+  size_t size = sampleSize(sample);
+  BuffWriter writer = appendWriter(out, size);
+
+  //Store the message length (everything after the length field) and type
+  writer.writePrimitive<uint32_t>(size - sizeof(uint32_t));
+  writer.writePrimitive((unsigned char)aggregator_solver::server_sample);
+
+  writer.writePrimitive(sample.physical_layer);
+  writer.writePrimitive(sample.tx_id);
+  writer.writePrimitive(sample.rx_id);
+  writer.writePrimitive(sample.rx_timestamp);
+  writer.writePrimitive(sample.rss);
+  writer.writeBytes(sample.sense_data.data(), sample.sense_data.size());
+
+  return size;
+}
+
+size_t aggregator_solver::sampleMsgSize(const SampleData& sample) {
+  return sampleSize(sample);
+}
+
+size_t aggregator_solver::sampleMsgSize(const ArenaSampleData& sample) {
+  return sampleSize(sample);
+}
+
 std::vector<unsigned char> aggregator_solver::makeSampleMsg(SampleData& sample) {
-  //The total length starts out at one for the message type field.
-  //Each rule will add additional length.
-  uint32_t total_length = 1;
+  std::vector<unsigned char> buff;
+  makeSample(sample, buff);
+  return buff;
+}
 
+std::vector<unsigned char> aggregator_solver::makeSampleMsg(const ArenaSampleData& sample) {
   std::vector<unsigned char> buff;
+  makeSample(sample, buff);
+  return buff;
+}
 
-  buff.push_back(0);
-  buff.push_back(0);
-  buff.push_back(0);
-  buff.push_back(0);
-  buff.push_back((unsigned char)server_sample);
-
-  total_length += pushBackVal(sample.physical_layer, buff);
-  total_length += pushBackVal(sample.tx_id, buff);
-  total_length += pushBackVal(sample.rx_id, buff);
-  total_length += pushBackVal(sample.rx_timestamp, buff);
-  total_length += pushBackVal(sample.rss, buff);
-  if (sample.sense_data.size() > 0) {
-    total_length += pushContainer(sample.sense_data, buff);
-  }
+size_t aggregator_solver::makeSampleMsg(const SampleData& sample, std::vector<unsigned char>& out) {
+  return makeSample(sample, out);
+}
 
-  pushBackVal<uint32_t>(total_length, buff, 0);
-  
-  return buff;
+size_t aggregator_solver::makeSampleMsg(const ArenaSampleData& sample, std::vector<unsigned char>& out) {
+  return makeSample(sample, out);
 }
 
 SampleData aggregator_solver::decodeSampleMsg(std::vector<unsigned char>& buff, unsigned int length) {
-  SampleData sample;
+  return decodeSampleMsg(BuffView(buff.data(), std::min<size_t>(length, buff.size())));
+}
+
+//Decode into a sample whose sense data already has its allocator
+template<typename Sample>
+static void decodeSampleInto(BuffView& reader, Sample& sample) {
+  OWL_METRIC_LATENCY(decode, aggregator_solver, aggregator_solver::server_sample);
+  size_t length = reader.size();
   //Assume that the sample is invalid until we manage to get data out of buff
   sample.valid = false;
 
@@ -176,13 +249,11 @@ SampleData aggregator_solver::decodeSampleMsg(std::vector<unsigned char>& buff,
   //and the length is sane.
   if ( length > 4 ) {
 
-    //Make a new buffer reader for this message and put the data into the
-    //sample structure.
-    BuffReader reader(buff);
+    //Put the data from the message into the sample structure.
     uint32_t entire_length = reader.readPrimitive<uint32_t>();
-    MessageID msg_type = MessageID(reader.readPrimitive<uint8_t>());
+    aggregator_solver::MessageID msg_type = aggregator_solver::MessageID(reader.readPrimitive<uint8_t>());
     if (entire_length + 4 == length and
-        server_sample == msg_type) {
+        aggregator_solver::server_sample == msg_type) {
       //Since we found data to read into the sample, mark it as valid.
       sample.valid = true;
       sample.physical_layer = reader.readPrimitive<decltype(sample.physical_layer)>();
@@ -190,14 +261,181 @@ SampleData aggregator_solver::decodeSampleMsg(std::vector<unsigned char>& buff,
       sample.rx_id = reader.readPrimitive<decltype(sample.rx_id)>();
       sample.rx_timestamp = reader.readPrimitive<decltype(sample.rx_timestamp)>();
       sample.rss = reader.readPrimitive<decltype(sample.rss)>();
-      //Get the size of the sense data
-      unsigned int left = length - reader.cur_index;
-      sample.sense_data = std::vector<unsigned char>(left);
-      reader.readPrimitiveContainer(sample.sense_data);
+      //The sense data is everything left in the message
+      ByteSpan sense_data = reader.readRemaining();
+      sample.sense_data.assign(sense_data.begin(), sense_data.end());
+      sample.valid = not reader.outOfRange();
     }
   }
+}
 
+SampleData aggregator_solver::decodeSampleMsg(BuffView reader) {
+  SampleData sample;
+  decodeSampleInto(reader, sample);
   return sample;
 }
 
+ArenaSampleData aggregator_solver::decodeSampleMsg(BuffView reader, Arena& arena) {
+  ArenaSampleData sample;
+  sample.sense_data = decltype(sample.sense_data)(ArenaAllocator<unsigned char>(arena));
+  decodeSampleInto(reader, sample);
+  return sample;
+}
+
+//Size of the group header: physical layer, receiver, base time, and count
+static const size_t batch_group_size = 1 + sizeof(uint128_t) + sizeof(Timestamp) + sizeof(uint32_t);
+//Size of each sample without its sense data: transmitter, time offset,
+//rss, and the size of the sense data.
+static const size_t batch_sample_size = sizeof(uint128_t) + sizeof(int32_t) + sizeof(float) + sizeof(uint32_t);
+
+//Return one past the last sample of the group that starts at first
+static size_t batchGroupEnd(const std::vector<SampleData>& samples, size_t first) {
+  const SampleData& base = samples[first];
+  size_t last = first + 1;
+  while (last < samples.size() and
+         samples[last].physical_layer == base.physical_layer and
+         samples[last].rx_id == base.rx_id and
+         samples[last].rx_timestamp - base.rx_timestamp >= INT32_MIN and
+         samples[last].rx_timestamp - base.rx_timestamp <= INT32_MAX) {
+    ++last;
+  }
+  return last;
+}
+
+size_t aggregator_solver::sampleBatchMsgSize(const std::vector<SampleData>& samples) {
+  //The length field, message type, and number of groups
+  size_t size = sizeof(uint32_t) + 1 + sizeof(uint32_t);
+  for (size_t first = 0; first < samples.size(); first = batchGroupEnd(samples, first)) {
+    size += batch_group_size;
+  }
+  for (const SampleData& sample : samples) {
+    size += batch_sample_size + sample.sense_data.size();
+  }
+  return size;
+}
+
+std::vector<unsigned char> aggregator_solver::makeSampleBatchMsg(const std::vector<SampleData>& samples) {
+  std::vector<unsigned char> buff;
+  makeSampleBatchMsg(samples, buff);
+  return buff;
+}
+
+size_t aggregator_solver::makeSampleBatchMsg(const std::vector<SampleData>& samples, std::vector<unsigned char>& out) {
+  OWL_METRIC_LATENCY(encode, aggregator_solver, sample_batch);
+  size_t start = out.size();
+  size_t size = sampleBatchMsgSize(samples);
+  BuffWriter writer = appendWriter(out, size);
+
+  //Store the message length (everything after the length field) and type
+  writer.writePrimitive<uint32_t>(size - sizeof(uint32_t));
+  writer.writePrimitive((unsigned char)sample_batch);
+
+  //The number of groups is filled in once they have been written
+  size_t groups_index = writer.cur_index;
+  writer.writePrimitive<uint32_t>(0);
+  uint32_t num_groups = 0;
+  for (size_t first = 0; first < samples.size(); ++num_groups) {
+    size_t last = batchGroupEnd(samples, first);
+    const SampleData& base = samples[first];
+    writer.writePrimitive(base.physical_layer);
+    writer.writePrimitive(base.rx_id);
+    writer.writePrimitive(base.rx_timestamp);
+    writer.writePrimitive<uint32_t>(last - first);
+    for (; first < last; ++first) {
+      const SampleData& sample = samples[first];
+      writer.writePrimitive(sample.tx_id);
+      writer.writePrimitive<int32_t>(sample.rx_timestamp - base.rx_timestamp);
+      writer.writePrimitive(sample.rss);
+      writer.writeSizedBytes(sample.sense_data.data(), sample.sense_data.size());
+    }
+  }
+  BuffWriter(out, groups_index).writePrimitive(num_groups);
 
+  return out.size() - start;
+}
+
+std::vector<SampleData> aggregator_solver::decodeSampleBatchMsg(BuffView reader) {
+  OWL_METRIC_LATENCY(decode, aggregator_solver, sample_batch);
+  std::vector<SampleData> samples;
+  size_t length = reader.size();
+  if ( length > 4 ) {
+    uint32_t entire_length = reader.readPrimitive<uint32_t>();
+    MessageID msg_type = MessageID(reader.readPrimitive<uint8_t>());
+    if (entire_length + 4 != length or sample_batch != msg_type) {
+      return samples;
+    }
+    uint32_t num_groups = reader.readPrimitive<uint32_t>();
+    //Every sample takes at least batch_sample_size bytes so this bounds the
+    //number of samples. Reserving once per group would defeat the vector's
+    //geometric growth and copy the samples again for every group.
+    samples.reserve(reader.remaining() / batch_sample_size);
+    for (uint32_t group = 0; group < num_groups and not reader.outOfRange(); ++group) {
+      SampleData base;
+      base.physical_layer = reader.readPrimitive<decltype(base.physical_layer)>();
+      base.rx_id = reader.readPrimitive<decltype(base.rx_id)>();
+      base.rx_timestamp = reader.readPrimitive<decltype(base.rx_timestamp)>();
+      uint32_t count = reader.readPrimitive<uint32_t>();
+      //Don't trust a count that could not fit in the rest of the message
+      if (count > reader.remaining() / batch_sample_size) {
+        return std::vector<SampleData>();
+      }
+      for (uint32_t i = 0; i < count; ++i) {
+        samples.push_back(SampleData());
+        SampleData& sample = samples.back();
+        sample.physical_layer = base.physical_layer;
+        sample.rx_id = base.rx_id;
+        sample.tx_id = reader.readPrimitive<decltype(sample.tx_id)>();
+        sample.rx_timestamp = base.rx_timestamp + reader.readPrimitive<int32_t>();
+        sample.rss = reader.readPrimitive<decltype(sample.rss)>();
+        ByteSpan sense_data = reader.readSizedSpan();
+        sample.sense_data.assign(sense_data.begin(), sense_data.end());
+        sample.valid = true;
+      }
+    }
+    if (reader.outOfRange()) {
+      samples.clear();
+    }
+  }
+  return samples;
+}
+
+bool aggregator_solver::decodeSampleBatchMsg(BuffView reader, SampleBatch& out) {
+  OWL_METRIC_LATENCY(decode, aggregator_solver, sample_batch);
+  size_t length = reader.size();
+  if ( length <= 4 ) {
+    return false;
+  }
+  uint32_t entire_length = reader.readPrimitive<uint32_t>();
+  MessageID msg_type = MessageID(reader.readPrimitive<uint8_t>());
+  if (entire_length + 4 != length or sample_batch != msg_type) {
+    return false;
+  }
+  size_t start = out.size();
+  uint32_t num_groups = reader.readPrimitive<uint32_t>();
+  //Reserve once for as many samples as could fit in the message, as in the
+  //vector version, so that the columns still grow geometrically.
+  out.reserve(out.size() + reader.remaining() / batch_sample_size);
+  for (uint32_t group = 0; group < num_groups and not reader.outOfRange(); ++group) {
+    unsigned char physical_layer = reader.readPrimitive<unsigned char>();
+    ReceiverID rx_id = reader.readPrimitive<ReceiverID>();
+    Timestamp base_time = reader.readPrimitive<Timestamp>();
+    uint32_t count = reader.readPrimitive<uint32_t>();
+    //Don't trust a count that could not fit in the rest of the message
+    if (count > reader.remaining() / batch_sample_size) {
+      out.truncate(start);
+      return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      TransmitterID tx_id = reader.readPrimitive<TransmitterID>();
+      Timestamp rx_timestamp = base_time + reader.readPrimitive<int32_t>();
+      float rss = reader.readPrimitive<float>();
+      ByteSpan sense_data = reader.readSizedSpan();
+      out.push_back(physical_layer, tx_id, rx_id, rx_timestamp, rss, sense_data);
+    }
+  }
+  if (reader.outOfRange()) {
+    out.truncate(start);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file alias_cache.cpp
+ * Implementation of the AliasCache class.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "alias_cache.hpp"
+
+#include <tuple>
+#include <utility>
+
+using namespace world_model;
+using namespace world_model::client;
+
+//Aliases at or above this are kept in a map rather than growing the vectors
+static const uint32_t max_dense_alias = 1 << 16;
+
+void AliasCache::Table::define(uint32_t alias, const std::u16string& name) {
+  if (alias >= max_dense_alias) {
+    sparse[alias] = name;
+    return;
+  }
+  if (alias >= names.size()) {
+    names.resize(alias + 1);
+    defined.resize(alias + 1, false);
+  }
+  names[alias] = name;
+  defined[alias] = true;
+}
+
+const std::u16string* AliasCache::Table::find(uint32_t alias) const {
+  if (alias < names.size()) {
+    return defined[alias] ? &names[alias] : nullptr;
+  }
+  if (sparse.empty()) {
+    return nullptr;
+  }
+  auto entry = sparse.find(alias);
+  return entry == sparse.end() ? nullptr : &entry->second;
+}
+
+void AliasCache::Table::clear() {
+  names.clear();
+  defined.clear();
+  sparse.clear();
+}
+
+bool AliasCache::update(BuffView msg) {
+  //The message type follows the length field
+  if (msg.size() <= sizeof(uint32_t)) {
+    return false;
+  }
+  MessageID type = MessageID(msg.data()[sizeof(uint32_t)]);
+  if (MessageID::attribute_alias == type) {
+    addAttributeAliases(decodeAttrAliasMsg(msg));
+    return true;
+  }
+  else if (MessageID::origin_alias == type) {
+    addOriginAliases(decodeOriginAliasMsg(msg));
+    return true;
+  }
+  return false;
+}
+
+void AliasCache::addAttributeAliases(const std::vector<AliasType>& aliases) {
+  for (const AliasType& alias : aliases) {
+    attributes.define(alias.alias, alias.type);
+  }
+}
+
+void AliasCache::addOriginAliases(const std::vector<AliasType>& aliases) {
+  for (const AliasType& alias : aliases) {
+    origins.define(alias.alias, alias.type);
+  }
+}
+
+const std::u16string* AliasCache::attributeName(uint32_t alias) const {
+  return attributes.find(alias);
+}
+
+const std::u16string* AliasCache::originName(uint32_t alias) const {
+  return origins.find(alias);
+}
+
+AliasCache::AttributeView AliasCache::view(const AliasedAttribute& attribute) const {
+  return AttributeView{attributes.find(attribute.name_alias),
+    origins.find(attribute.origin_alias), &attribute};
+}
+
+bool AliasCache::resolve(AliasedWorldData&& aliased, WorldData& out) const {
+  bool all_known = true;
+  out.object_uri = std::move(aliased.object_uri);
+  out.attributes.clear();
+  out.attributes.reserve(aliased.attributes.size());
+  for (AliasedAttribute& aa : aliased.attributes) {
+    out.attributes.push_back(Attribute());
+    Attribute& attr = out.attributes.back();
+    const std::u16string* name = attributes.find(aa.name_alias);
+    const std::u16string* origin = origins.find(aa.origin_alias);
+    if (nullptr == name or nullptr == origin) {
+      all_known = false;
+    }
+    if (nullptr != name) {
+      attr.name = *name;
+    }
+    if (nullptr != origin) {
+      attr.origin = *origin;
+    }
+    attr.creation_date = aa.creation_date;
+    attr.expiration_date = aa.expiration_date;
+    attr.data = std::move(aa.data);
+  }
+  aliased.attributes.clear();
+  return all_known;
+}
+
+bool AliasCache::decodeData(BuffView msg, WorldData& out, uint32_t& ticket_number) const {
+  AliasedWorldData aliased;
+  std::tie(aliased, ticket_number) = decodeDataMessage(msg);
+  //Failed decodes return empty data with a zero ticket
+  if (0 == ticket_number and aliased.object_uri.empty() and aliased.attributes.empty()) {
+    out = WorldData();
+    return false;
+  }
+  return resolve(std::move(aliased), out);
+}
+
+void AliasCache::clear() {
+  attributes.clear();
+  origins.clear();
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file alias_registry.cpp
+ * Implementation of the AliasRegistry class.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "alias_registry.hpp"
+
+using namespace world_model;
+using namespace world_model::client;
+
+AliasRegistry::AliasRegistry(StringInterner& interner) : interner(interner),
+  next_attribute(1), next_origin(1) {
+}
+
+uint32_t AliasRegistry::aliasFor(std::vector<uint32_t>& table, uint32_t& next,
+    const InternedString& name, std::vector<AliasType>& added) {
+  if (name.id >= table.size()) {
+    table.resize(name.id + 1, 0);
+  }
+  uint32_t& alias = table[name.id];
+  if (0 == alias) {
+    alias = next++;
+    added.push_back(AliasType{alias, name.str()});
+  }
+  return alias;
+}
+
+void AliasRegistry::alias(const InternedString& uri, const std::vector<InternedAttribute>& attributes,
+    AliasedWorldData& out, std::vector<AliasType>& added_attributes,
+    std::vector<AliasType>& added_origins) {
+  out.object_uri.assign(uri.data, uri.size);
+  //Reuse attributes already in out so that their data keeps its capacity
+  out.attributes.resize(attributes.size());
+  for (size_t i = 0; i < attributes.size(); ++i) {
+    const InternedAttribute& attr = attributes[i];
+    AliasedAttribute& aa = out.attributes[i];
+    aa.name_alias = aliasFor(attribute_aliases, next_attribute, attr.name, added_attributes);
+    aa.origin_alias = aliasFor(origin_aliases, next_origin, attr.origin, added_origins);
+    aa.creation_date = attr.creation_date;
+    aa.expiration_date = attr.expiration_date;
+    aa.data.assign(attr.data.begin(), attr.data.end());
+  }
+}
+
+void AliasRegistry::alias(const WorldData& wd, AliasedWorldData& out,
+    std::vector<AliasType>& added_attributes, std::vector<AliasType>& added_origins) {
+  out.object_uri = wd.object_uri;
+  out.attributes.resize(wd.attributes.size());
+  for (size_t i = 0; i < wd.attributes.size(); ++i) {
+    const Attribute& attr = wd.attributes[i];
+    AliasedAttribute& aa = out.attributes[i];
+    aa.name_alias = aliasFor(attribute_aliases, next_attribute, interner.intern(attr.name), added_attributes);
+    aa.origin_alias = aliasFor(origin_aliases, next_origin, interner.intern(attr.origin), added_origins);
+    aa.creation_date = attr.creation_date;
+    aa.expiration_date = attr.expiration_date;
+    aa.data.assign(attr.data.begin(), attr.data.end());
+  }
+}
+
+//Append alias messages for new aliases and then the data message
+static void appendMessages(const AliasedWorldData& aliased, uint32_t ticket_number,
+    std::vector<AliasType>& new_attributes, std::vector<AliasType>& new_origins,
+    std::vector<Buffer>& out) {
+  if (not new_attributes.empty()) {
+    out.push_back(makeAttrAliasMsg(new_attributes));
+    new_attributes.clear();
+  }
+  if (not new_origins.empty()) {
+    out.push_back(makeOriginAliasMsg(new_origins));
+    new_origins.clear();
+  }
+  out.push_back(makeDataMessage(aliased, ticket_number));
+}
+
+void AliasRegistry::makeMessages(const InternedString& uri, const std::vector<InternedAttribute>& attributes,
+    uint32_t ticket_number, std::vector<Buffer>& out) {
+  alias(uri, attributes, scratch, new_attributes, new_origins);
+  appendMessages(scratch, ticket_number, new_attributes, new_origins, out);
+}
+
+void AliasRegistry::makeMessages(const WorldData& wd, uint32_t ticket_number, std::vector<Buffer>& out) {
+  alias(wd, scratch, new_attributes, new_origins);
+  appendMessages(scratch, ticket_number, new_attributes, new_origins, out);
+}
+
+uint32_t AliasRegistry::attributeAlias(const InternedString& name) const {
+  return name.id < attribute_aliases.size() ? attribute_aliases[name.id] : 0;
+}
+
+uint32_t AliasRegistry::originAlias(const InternedString& origin) const {
+  return origin.id < origin_aliases.size() ? origin_aliases[origin.id] : 0;
+}
+
+void AliasRegistry::clear() {
+  attribute_aliases.clear();
+  origin_aliases.clear();
+  next_attribute = 1;
+  next_origin = 1;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file arena.cpp
+ * Implementation of the Arena bump allocator.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "arena.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+
+Arena::Arena(size_t block_size) : current(0), offset(0), block_size(block_size), used(0) {
+}
+
+Arena::~Arena() {
+  for (Block& block : blocks) {
+    free(block.data);
+  }
+}
+
+void* Arena::allocate(size_t bytes, size_t alignment) {
+  //Look for room in the current block and then in any blocks that were
+  //kept after a reset.
+  for (; current < blocks.size(); ++current, offset = 0) {
+    Block& block = blocks[current];
+    uintptr_t start = (uintptr_t)block.data + offset;
+    size_t padding = (alignment - (start & (alignment - 1))) & (alignment - 1);
+    if (offset + padding + bytes <= block.size) {
+      offset += padding + bytes;
+      used += bytes;
+      return (void*)(start + padding);
+    }
+  }
+  //Add a new block, large enough for this allocation. malloc returns
+  //memory aligned for any fundamental type; larger alignments are padded.
+  size_t size = bytes + alignment > block_size ? bytes + alignment : block_size;
+  unsigned char* data = (unsigned char*)malloc(size);
+  if (nullptr == data) {
+    throw std::bad_alloc();
+  }
+  blocks.push_back(Block{data, size});
+  current = blocks.size() - 1;
+  uintptr_t start = (uintptr_t)data;
+  size_t padding = (alignment - (start & (alignment - 1))) & (alignment - 1);
+  offset = padding + bytes;
+  used += bytes;
+  return (void*)(start + padding);
+}
+
+void Arena::reset() {
+  current = 0;
+  offset = 0;
+  used = 0;
+}
+
+size_t Arena::bytesUsed() const {
+  return used;
+}
+
+size_t Arena::capacity() const {
+  size_t total = 0;
+  for (const Block& block : blocks) {
+    total += block.size;
+  }
+  return total;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file compression.cpp
+ * Compression and decompression of message envelopes. Each codec is only
+ * built if its library was found, as noted by the OWL_HAVE_* definitions.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "compression.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#ifdef OWL_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef OWL_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef OWL_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace compression;
+
+//The length field, message type, codec, and unpacked size
+static const size_t header_size = sizeof(uint32_t) + 1 + 1 + sizeof(uint32_t);
+
+//Largest size that compressing @length bytes could produce
+static size_t compressBound(Codec codec, size_t length) {
+  switch (codec) {
+#ifdef OWL_HAVE_ZLIB
+    case compression::deflate:
+      return ::compressBound(length);
+#endif
+#ifdef OWL_HAVE_LZ4
+    case lz4:
+      return LZ4_compressBound(length);
+#endif
+#ifdef OWL_HAVE_ZSTD
+    case zstd:
+      return ZSTD_compressBound(length);
+#endif
+    default:
+      //Without any codecs the arguments go unused
+      (void)length;
+      return 0;
+  }
+}
+
+//Compress into @dest and return the compressed size, or 0 on failure
+static size_t compressInto(Codec codec, const unsigned char* src, size_t length,
+                           unsigned char* dest, size_t capacity) {
+  switch (codec) {
+#ifdef OWL_HAVE_ZLIB
+    case compression::deflate:
+      {
+        uLongf dest_len = capacity;
+        if (Z_OK != compress2(dest, &dest_len, src, length, Z_DEFAULT_COMPRESSION)) {
+          return 0;
+        }
+        return dest_len;
+      }
+#endif
+#ifdef OWL_HAVE_LZ4
+    case lz4:
+      {
+        int result = LZ4_compress_default((const char*)src, (char*)dest, length, capacity);
+        return result > 0 ? result : 0;
+      }
+#endif
+#ifdef OWL_HAVE_ZSTD
+    case zstd:
+      {
+        //Level 3 is zstd's default balance of speed and ratio
+        size_t result = ZSTD_compress(dest, capacity, src, length, 3);
+        return ZSTD_isError(result) ? 0 : result;
+      }
+#endif
+    default:
+      (void)src, (void)length, (void)dest, (void)capacity;
+      return 0;
+  }
+}
+
+//Decompress exactly @unpacked bytes into @dest
+static bool decompressInto(Codec codec, const unsigned char* src, size_t length,
+                           unsigned char* dest, size_t unpacked) {
+  switch (codec) {
+#ifdef OWL_HAVE_ZLIB
+    case compression::deflate:
+      {
+        uLongf dest_len = unpacked;
+        return Z_OK == uncompress(dest, &dest_len, src, length) and dest_len == unpacked;
+      }
+#endif
+#ifdef OWL_HAVE_LZ4
+    case lz4:
+      return LZ4_decompress_safe((const char*)src, (char*)dest, length, unpacked) == (int)unpacked;
+#endif
+#ifdef OWL_HAVE_ZSTD
+    case zstd:
+      {
+        size_t result = ZSTD_decompress(dest, unpacked, src, length);
+        return not ZSTD_isError(result) and result == unpacked;
+      }
+#endif
+    default:
+      (void)src, (void)length, (void)dest, (void)unpacked;
+      return false;
+  }
+}
+
+//True if the bytes are a sequence of whole length prefixed frames, so that
+//a corrupt envelope cannot leave a partial frame behind, and none of them
+//is another envelope.
+static bool wholeFrames(const unsigned char* data, size_t length) {
+  size_t index = 0;
+  while (index < length) {
+    if (length - index < sizeof(uint32_t)) {
+      return false;
+    }
+    size_t frame = (size_t)loadNetworkValue<uint32_t>(data + index) + sizeof(uint32_t);
+    if (frame > length - index) {
+      return false;
+    }
+    //Envelopes are never nested
+    if (isEnvelope(FrameView{data + index, frame})) {
+      return false;
+    }
+    index += frame;
+  }
+  return true;
+}
+
+handshake::Capabilities compression::supported() {
+  handshake::Capabilities caps = 0;
+  for (Codec codec : {compression::deflate, lz4, zstd}) {
+    if (available(codec)) {
+      caps |= capability(codec);
+    }
+  }
+  return caps;
+}
+
+bool compression::available(Codec codec) {
+  //Any codec that was built has a compression bound
+  return 0 < compressBound(codec, 1);
+}
+
+handshake::Capability compression::capability(Codec codec) {
+  switch (codec) {
+    case lz4:
+      return handshake::lz4_envelopes;
+    case zstd:
+      return handshake::zstd_envelopes;
+    default:
+      return handshake::deflate_envelopes;
+  }
+}
+
+bool compression::choose(handshake::Capabilities negotiated, Codec& codec) {
+  for (Codec preferred : {zstd, lz4, compression::deflate}) {
+    if (available(preferred) and (negotiated & capability(preferred))) {
+      codec = preferred;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<unsigned char> compression::makeEnvelope(const std::vector<std::vector<unsigned char>>& messages, Codec codec) {
+  //The codecs need the messages in one piece
+  std::vector<unsigned char> frames;
+  size_t total = 0;
+  for (const std::vector<unsigned char>& msg : messages) {
+    total += msg.size();
+  }
+  frames.reserve(total);
+  for (const std::vector<unsigned char>& msg : messages) {
+    frames.insert(frames.end(), msg.begin(), msg.end());
+  }
+  return makeEnvelope(frames.data(), frames.size(), codec);
+}
+
+std::vector<unsigned char> compression::makeEnvelope(const unsigned char* frames, size_t length, Codec codec) {
+  if (not available(codec)) {
+    throw std::runtime_error("Compression codec "+std::to_string((int)codec)+" is not available in this build.");
+  }
+  if (length > max_unpacked_size) {
+    throw std::runtime_error("Too much data for one compressed envelope.");
+  }
+  std::vector<unsigned char> buff(header_size + compressBound(codec, length));
+  size_t packed = compressInto(codec, frames, length, buff.data() + header_size, buff.size() - header_size);
+  if (0 == packed and 0 < length) {
+    throw std::runtime_error("Failed to compress envelope.");
+  }
+  buff.resize(header_size + packed);
+
+  BuffWriter writer(buff);
+  writer.writePrimitive<uint32_t>(buff.size() - sizeof(uint32_t));
+  writer.writePrimitive(envelope_type);
+  writer.writePrimitive<uint8_t>(codec);
+  writer.writePrimitive<uint32_t>(length);
+  return buff;
+}
+
+bool compression::isEnvelope(const FrameView& frame) {
+  return frame.size > sizeof(uint32_t) and envelope_type == frame.data[sizeof(uint32_t)];
+}
+
+//Read the codec and unpacked size from the envelope header. Returns false
+//if the envelope cannot be opened.
+static bool readHeader(const FrameView& envelope, Codec& codec, uint32_t& unpacked) {
+  if (envelope.size < header_size or not isEnvelope(envelope)) {
+    return false;
+  }
+  BuffView reader(envelope);
+  reader.discard(sizeof(uint32_t) + 1);
+  codec = Codec(reader.readPrimitive<uint8_t>());
+  unpacked = reader.readPrimitive<uint32_t>();
+  return available(codec) and unpacked <= max_unpacked_size;
+}
+
+bool compression::openEnvelope(const FrameView& envelope, FrameBuffer& out) {
+  Codec codec;
+  uint32_t unpacked;
+  if (not readHeader(envelope, codec, unpacked)) {
+    return false;
+  }
+  out.reserve(unpacked);
+  if (not decompressInto(codec, envelope.data + header_size, envelope.size - header_size,
+                         out.writePtr(), unpacked) or
+      not wholeFrames(out.writePtr(), unpacked)) {
+    return false;
+  }
+  out.commit(unpacked);
+  return true;
+}
+
+bool compression::openEnvelope(const FrameView& envelope, std::vector<unsigned char>& out) {
+  Codec codec;
+  uint32_t unpacked;
+  if (not readHeader(envelope, codec, unpacked)) {
+    return false;
+  }
+  size_t start = out.size();
+  out.resize(start + unpacked);
+  if (not decompressInto(codec, envelope.data + header_size, envelope.size - header_size,
+                         out.data() + start, unpacked) or
+      not wholeFrames(out.data() + start, unpacked)) {
+    out.resize(start);
+    return false;
+  }
+  return true;
+}
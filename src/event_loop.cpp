@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file event_loop.cpp
+ * Implementation of the epoll based EventLoop.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "event_loop.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//Event keys. Connection ids start at 1, 0 is the wakeup descriptor, and
+//listeners are tagged with the high bit and their index.
+static const uint64_t wake_key = 0;
+static const uint64_t listener_tag = uint64_t(1) << 63;
+
+//Maximum number of events handled per epoll_wait call.
+static const int max_events = 256;
+
+//Receive at least this many bytes per call, as in the MessageReceiver.
+static const size_t min_receive = 4096;
+
+//Number of receive calls on one connection before other connections are
+//given a turn.
+static const int read_budget = 16;
+
+//Number of queued messages moved per batch between the loop and its queues.
+static const size_t queue_batch = 256;
+
+//How long runOnce waits while forwarded messages are waiting for room in
+//the forward queue, since the worker does not wake the loop when it pops.
+static const int backlog_retry_msec = 1;
+
+static void setNonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (-1 == flags or -1 == fcntl(fd, F_SETFL, flags | O_NONBLOCK)) {
+    std::string err_str(strerror(errno));
+    throw std::runtime_error("Error making socket nonblocking: "+err_str);
+  }
+}
+
+EventLoop::Connection::Connection(uint64_t id, ClientSocket&& sock) :
+  id(id), sock(std::move(sock)), frames(min_receive), closing(false),
+  watching_output(false) {
+}
+
+EventLoop::EventLoop(FrameHandler handler) : next_id(1), frame_handler(handler),
+  forward_queue(nullptr), max_forward_backlog(0), max_frame_size(default_max_frame_size) {
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (-1 == epoll_fd) {
+    std::string err_str(strerror(errno));
+    throw std::runtime_error("Error creating epoll descriptor: "+err_str);
+  }
+  wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (-1 == wake_fd) {
+    std::string err_str(strerror(errno));
+    ::close(epoll_fd);
+    throw std::runtime_error("Error creating eventfd: "+err_str);
+  }
+  watch(wake_fd, wake_key);
+}
+
+EventLoop::~EventLoop() {
+  //Destroying the connections closes their sockets.
+  connections.clear();
+  ::close(wake_fd);
+  ::close(epoll_fd);
+}
+
+void EventLoop::watch(int fd, uint64_t key) {
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+  ev.data.u64 = key;
+  if (-1 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+    std::string err_str(strerror(errno));
+    throw std::runtime_error("Error adding socket to epoll: "+err_str);
+  }
+}
+
+void EventLoop::onConnect(ConnectionHandler handler) {
+  connect_handler = handler;
+}
+
+void EventLoop::onClose(ConnectionHandler handler) {
+  close_handler = handler;
+}
+
+void EventLoop::onHighWater(ConnectionHandler handler) {
+  high_water_handler = handler;
+}
+
+void EventLoop::onLowWater(ConnectionHandler handler) {
+  low_water_handler = handler;
+}
+
+void EventLoop::setMaxFrameSize(size_t bytes) {
+  max_frame_size = bytes;
+}
+
+void EventLoop::listen(ServerSocket& listener) {
+  setNonblocking(listener.fd());
+  //Connections already waiting are reported by epoll as soon as the
+  //listener is added.
+  watch(listener.fd(), listener_tag | listeners.size());
+  listeners.push_back(&listener);
+}
+
+uint64_t EventLoop::add(ClientSocket&& sock) {
+  if (not sock) {
+    throw std::runtime_error("Cannot add an invalid socket to an event loop.");
+  }
+  setNonblocking(sock.fd());
+  uint64_t id = next_id++;
+  Connection* conn = new Connection(id, std::move(sock));
+  connections[id] = std::unique_ptr<Connection>(conn);
+  //The handlers are looked up when called so that they can be set after
+  //connections are added.
+  conn->output.onHighWater([this, conn]() {
+      if (high_water_handler) {
+        high_water_handler(*conn);
+      }});
+  conn->output.onLowWater([this, conn]() {
+      if (low_water_handler) {
+        low_water_handler(*conn);
+      }});
+  //Data that has already arrived is reported when the socket is added.
+  watch(conn->sock.fd(), id);
+  if (connect_handler) {
+    connect_handler(*conn);
+  }
+  return id;
+}
+
+void EventLoop::close(uint64_t id) {
+  Connection* conn = find(id);
+  if (nullptr != conn and not conn->closing) {
+    conn->closing = true;
+    closed.push_back(id);
+  }
+}
+
+bool EventLoop::send(Connection& conn, std::vector<unsigned char> buff) {
+  if (conn.closing) {
+    return false;
+  }
+  OWL_METRIC_ADD(frames_out, 1);
+  try {
+    if (not conn.output.write(conn.sock, std::move(buff))) {
+      return false;
+    }
+  }
+  catch (std::runtime_error& err) {
+    std::cerr<<"Error sending to "<<conn.sock.ip_address()<<": "<<err.what()<<'\n';
+    close(conn.id);
+    return false;
+  }
+  if (not conn.output.empty() and not conn.watching_output) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u64 = conn.id;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.sock.fd(), &ev);
+    conn.watching_output = true;
+  }
+  return true;
+}
+
+bool EventLoop::send(uint64_t id, std::vector<unsigned char> buff) {
+  Connection* conn = find(id);
+  return nullptr != conn and send(*conn, std::move(buff));
+}
+
+void EventLoop::flushOutput(Connection& conn) {
+  try {
+    conn.output.flush(conn.sock);
+  }
+  catch (std::runtime_error& err) {
+    std::cerr<<"Error sending to "<<conn.sock.ip_address()<<": "<<err.what()<<'\n';
+    close(conn.id);
+    return;
+  }
+  if (conn.output.empty() and conn.watching_output) {
+    //Stop waking up for writability once there is nothing left to write
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.u64 = conn.id;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.sock.fd(), &ev);
+    conn.watching_output = false;
+  }
+}
+
+EventLoop::Connection* EventLoop::find(uint64_t id) {
+  auto I = connections.find(id);
+  return I == connections.end() ? nullptr : I->second.get();
+}
+
+size_t EventLoop::size() const {
+  return connections.size();
+}
+
+void EventLoop::wakeup() {
+  uint64_t one = 1;
+  //Failure means the counter is already nonzero, which is just as good.
+  ssize_t ignored = write(wake_fd, &one, sizeof(one));
+  (void)ignored;
+}
+
+void EventLoop::acceptAll(ServerSocket& listener) {
+  while (true) {
+    ClientSocket sock = listener.accept(SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (not sock) {
+      //EAGAIN means the backlog is empty. Other errors (such as running
+      //out of descriptors) were already reported by accept.
+      return;
+    }
+    add(std::move(sock));
+  }
+}
+
+bool EventLoop::forwardFull() const {
+  return nullptr != forward_queue and max_forward_backlog <= forward_backlog.size();
+}
+
+bool EventLoop::dispatchFrames(Connection& conn) {
+  FrameView frame;
+  while (not conn.closing) {
+    //Leave the rest in the buffer until the worker catches up
+    if (forwardFull()) {
+      return false;
+    }
+    //Never buffer a message that is too large, the close handler is
+    //called for the connection as for any other close
+    if (max_frame_size < conn.frames.frameSize()) {
+      close(conn.id);
+      return true;
+    }
+    if (not conn.frames.nextFrame(frame)) {
+      return true;
+    }
+    OWL_METRIC_ADD(frames_in, 1);
+    if (nullptr != forward_queue) {
+      forwardFrame(conn.id, frame);
+    }
+    else {
+      frame_handler(conn, frame);
+    }
+  }
+  return true;
+}
+
+bool EventLoop::readConnection(Connection& conn) {
+  //Frames left over when the forward backlog filled up go first
+  if (not dispatchFrames(conn)) {
+    return true;
+  }
+  for (int reads = 0; reads < read_budget and not conn.closing; ++reads) {
+    //Packet sockets need room for an entire record
+    conn.frames.reserve(conn.frames.receiveNeed(std::max(min_receive, conn.sock.receiveSize())));
+    ssize_t length = conn.sock.receive(conn.frames.writePtr(), conn.frames.writable());
+    if (-1 == length) {
+      if (EAGAIN == errno or EWOULDBLOCK == errno) {
+        //Drained, epoll will report the next data that arrives.
+        return false;
+      }
+      else if (EINTR == errno) {
+        continue;
+      }
+      std::cerr<<"Error receiving from "<<conn.sock.ip_address()<<": "<<strerror(errno)<<'\n';
+      close(conn.id);
+      return false;
+    }
+    else if (0 == length) {
+      //The other side closed the connection
+      close(conn.id);
+      return false;
+    }
+    conn.frames.commit(length);
+    OWL_METRIC_HIGH_WATER(conn.frames.buffered());
+    //Dispatch every complete message before the next reserve call can
+    //move the buffered data.
+    if (not dispatchFrames(conn)) {
+      return true;
+    }
+  }
+  return not conn.closing;
+}
+
+void EventLoop::reapClosed() {
+  //Close handlers may close other connections so keep going until the
+  //list stays empty.
+  while (not closed.empty()) {
+    std::vector<uint64_t> to_close;
+    to_close.swap(closed);
+    for (uint64_t id : to_close) {
+      auto I = connections.find(id);
+      if (I == connections.end()) {
+        continue;
+      }
+      std::unique_ptr<Connection> conn = std::move(I->second);
+      connections.erase(I);
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->sock.fd(), nullptr);
+      //Make a last attempt to send anything that is still waiting, such as
+      //an error message sent just before closing.
+      if (not conn->output.empty() and conn->sock) {
+        try {
+          conn->output.flush(conn->sock);
+        }
+        catch (std::runtime_error&) {
+        }
+      }
+      if (close_handler) {
+        close_handler(*conn);
+      }
+    }
+  }
+}
+
+void EventLoop::forwardFrame(uint64_t id, const FrameView& frame) {
+  QueuedFrame queued{id, frame.toVector()};
+  //Messages must stay in order so nothing skips ahead of the backlog
+  if (not forward_backlog.empty() or not forward_queue->tryPush(std::move(queued))) {
+    forward_backlog.push_back(std::move(queued));
+  }
+}
+
+void EventLoop::drainBacklog() {
+  while (nullptr != forward_queue and not forward_backlog.empty()) {
+    QueuedFrame& front = forward_backlog.front();
+    if (not forward_queue->tryPush(std::move(front))) {
+      return;
+    }
+    forward_backlog.pop_front();
+  }
+}
+
+void EventLoop::drainSendQueues() {
+  std::vector<QueuedFrame> batch;
+  for (MPSCQueue<QueuedFrame>* queue : send_queues) {
+    //Only take what is already there so that a busy producer cannot keep
+    //the loop from getting back to its sockets.
+    size_t waiting = queue->size();
+    while (0 < waiting) {
+      batch.clear();
+      size_t popped = queue->popBatch(batch, waiting < queue_batch ? waiting : queue_batch);
+      if (0 == popped) {
+        break;
+      }
+      waiting -= popped;
+      for (QueuedFrame& queued : batch) {
+        send(queued.connection, std::move(queued.data));
+      }
+    }
+  }
+}
+
+void EventLoop::forwardTo(SPSCQueue<QueuedFrame>* queue, size_t max_backlog) {
+  forward_queue = queue;
+  max_forward_backlog = max_backlog;
+  if (nullptr == queue) {
+    forward_backlog.clear();
+  }
+}
+
+size_t EventLoop::forwardBacklog() const {
+  return forward_backlog.size();
+}
+
+void EventLoop::sendFrom(MPSCQueue<QueuedFrame>* queue) {
+  send_queues.push_back(queue);
+}
+
+size_t EventLoop::runOnce(int msec_timeout) {
+  //Connections that still have unread data should not wait.
+  std::vector<uint64_t> unfinished;
+  unfinished.swap(pending);
+  //A connection may have been added once for its events and again as
+  //unfinished, so only read it once.
+  std::sort(unfinished.begin(), unfinished.end());
+  unfinished.erase(std::unique(unfinished.begin(), unfinished.end()), unfinished.end());
+  drainBacklog();
+  //Unfinished connections cannot be read while the backlog is full, so
+  //waiting for the worker then is better than spinning.
+  if (not unfinished.empty() and not forwardFull()) {
+    msec_timeout = 0;
+  }
+  if (not forward_backlog.empty() and
+      (msec_timeout < 0 or backlog_retry_msec < msec_timeout)) {
+    msec_timeout = backlog_retry_msec;
+  }
+
+  epoll_event events[max_events];
+  int num_events = epoll_wait(epoll_fd, events, max_events, msec_timeout);
+  if (-1 == num_events) {
+    if (EINTR != errno) {
+      std::string err_str(strerror(errno));
+      throw std::runtime_error("Error waiting for socket events: "+err_str);
+    }
+    num_events = 0;
+  }
+
+  for (int i = 0; i < num_events; ++i) {
+    uint64_t key = events[i].data.u64;
+    if (wake_key == key) {
+      uint64_t count;
+      ssize_t ignored = read(wake_fd, &count, sizeof(count));
+      (void)ignored;
+    }
+    else if (key & listener_tag) {
+      acceptAll(*listeners[key & ~listener_tag]);
+    }
+    else {
+      Connection* conn = find(key);
+      if (nullptr != conn and not conn->closing and (events[i].events & EPOLLOUT)) {
+        flushOutput(*conn);
+      }
+      if (nullptr != conn and not conn->closing) {
+        //Read even on a hang up so that data sent before the close is
+        //still delivered. The read will see the end of the stream.
+        if (readConnection(*conn)) {
+          pending.push_back(key);
+        }
+        else if ((events[i].events & EPOLLERR) and not conn->closing) {
+          close(key);
+        }
+      }
+    }
+  }
+
+  for (uint64_t id : unfinished) {
+    Connection* conn = find(id);
+    if (nullptr != conn and not conn->closing and readConnection(*conn)) {
+      pending.push_back(id);
+    }
+  }
+
+  drainSendQueues();
+  drainBacklog();
+  reapClosed();
+  return num_events + unfinished.size();
+}
+
+void EventLoop::run(bool& interrupted) {
+  //Use a short timeout so that interrupted is checked regularly even if
+  //wakeup is never called.
+  while (not interrupted) {
+    runOnce(100);
+  }
+}
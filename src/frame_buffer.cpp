@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file frame_buffer.cpp
+ * Implements the FrameBuffer class that splits a stream of bytes into
+ * length prefixed owl/grail messages without copying them.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "frame_buffer.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include "netbuffer.hpp"
+
+FrameBuffer::FrameBuffer(size_t capacity) : storage(capacity), head(0), tail(0) {}
+
+size_t FrameBuffer::buffered() const {
+  return tail - head;
+}
+
+size_t FrameBuffer::writable() const {
+  return storage.size() - tail;
+}
+
+size_t FrameBuffer::capacity() const {
+  return storage.size();
+}
+
+void FrameBuffer::reserve(size_t bytes) {
+  if (writable() >= bytes) {
+    return;
+  }
+  //Move unread data to the front of the buffer to reclaim the space of
+  //frames that were already handed out.
+  if (0 < head) {
+    size_t unread = buffered();
+    if (0 < unread) {
+      std::memmove(storage.data(), storage.data() + head, unread);
+    }
+    head = 0;
+    tail = unread;
+  }
+  //Grow if there still is not enough space, at least doubling the size so
+  //that growth is amortized.
+  if (writable() < bytes) {
+    size_t new_size = storage.size() * 2;
+    if (new_size < tail + bytes) {
+      new_size = tail + bytes;
+    }
+    storage.resize(new_size);
+  }
+}
+
+unsigned char* FrameBuffer::writePtr() {
+  return storage.data() + tail;
+}
+
+void FrameBuffer::commit(size_t bytes) {
+  tail += bytes;
+  if (tail > storage.size()) {
+    tail = storage.size();
+  }
+}
+
+void FrameBuffer::append(const unsigned char* data, size_t bytes) {
+  reserve(bytes);
+  std::memcpy(writePtr(), data, bytes);
+  commit(bytes);
+}
+
+size_t FrameBuffer::frameNeed() const {
+  size_t unread = buffered();
+  //The size of a piece is stored in its first four bytes.
+  if (unread < sizeof(uint32_t)) {
+    return sizeof(uint32_t) - unread;
+  }
+  //The length bytes themselves take 4 bytes
+  size_t piece_length = (size_t)loadNetworkValue<uint32_t>(storage.data() + head) + sizeof(uint32_t);
+  return piece_length > unread ? piece_length - unread : 0;
+}
+
+size_t FrameBuffer::frameSize() const {
+  if (buffered() < sizeof(uint32_t)) {
+    return 0;
+  }
+  return (size_t)loadNetworkValue<uint32_t>(storage.data() + head) + sizeof(uint32_t);
+}
+
+//Smallest growth step allowed while a large message is arriving
+static const size_t min_growth = 65536;
+
+size_t FrameBuffer::receiveNeed(size_t minimum) const {
+  size_t limit = 2 * storage.size() > min_growth ? 2 * storage.size() : min_growth;
+  size_t need = frameNeed() < limit ? frameNeed() : limit;
+  return need > minimum ? need : minimum;
+}
+
+bool FrameBuffer::frameAvailable() const {
+  return buffered() >= sizeof(uint32_t) and 0 == frameNeed();
+}
+
+bool FrameBuffer::peekFrame(FrameView& frame) const {
+  if (not frameAvailable()) {
+    return false;
+  }
+  frame.data = storage.data() + head;
+  frame.size = (size_t)loadNetworkValue<uint32_t>(storage.data() + head) + sizeof(uint32_t);
+  return true;
+}
+
+bool FrameBuffer::nextFrame(FrameView& frame) {
+  if (not peekFrame(frame)) {
+    return false;
+  }
+  head += frame.size;
+  //If everything was handed out the next write can start at the beginning
+  //and no data ever needs to be moved.
+  if (head == tail) {
+    head = 0;
+    tail = 0;
+  }
+  return true;
+}
+
+void FrameBuffer::clear() {
+  head = 0;
+  tail = 0;
+}
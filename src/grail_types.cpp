@@ -21,14 +21,19 @@ grail_types::transmitter grail_types::readTransmitterFromBuffer(BuffReader& read
   return t;
 }
 
-grail_types::transmitter grail_types::readTransmitter(const std::vector<unsigned char>& buff) {
+grail_types::transmitter grail_types::readTransmitterFromBuffer(BuffView& reader) {
   transmitter t;
-  t.phy = readPrimitive<unsigned char>(buff, 0);
-  t.id.upper = readPrimitive<uint64_t>(buff, 1);
-  t.id.lower = readPrimitive<uint64_t>(buff, 1+sizeof(uint64_t));
+  reader.convertPrimitive(t.phy);
+  t.id.upper = reader.readPrimitive<uint64_t>();
+  t.id.lower = reader.readPrimitive<uint64_t>();
   return t;
 }
 
+grail_types::transmitter grail_types::readTransmitter(const std::vector<unsigned char>& buff) {
+  BuffView reader(buff);
+  return readTransmitterFromBuffer(reader);
+}
+
 uint32_t grail_types::writeTransmitter(transmitter t, std::vector<unsigned char>& buff) {
   return pushBackVal<uint8_t>(t.phy, buff) +
     pushBackVal<uint64_t>(t.id.upper, buff) + pushBackVal<uint64_t>(t.id.lower, buff);
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file handshake.cpp
+ * Implementation of handshake encoding, decoding, and negotiation.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "handshake.hpp"
+#include "compression.hpp"
+
+#include <algorithm>
+
+using namespace handshake;
+
+size_t handshake::encodedSize(const std::string& protocol) {
+  return sizeof(uint32_t) + protocol.size() + 2;
+}
+
+std::vector<unsigned char> handshake::encode(const std::string& protocol, uint8_t version, Capabilities capabilities) {
+  std::vector<unsigned char> buff(encodedSize(protocol));
+  BuffWriter writer(buff);
+  //Insert the length of the protocol string into the buffer
+  writer.writePrimitive<uint32_t>(protocol.size());
+  writer.writeBytes((const unsigned char*)protocol.data(), protocol.size());
+  writer.writePrimitive(version);
+  writer.writePrimitive(capabilities);
+  return buff;
+}
+
+Handshake handshake::decode(BuffView reader, const std::string& expected_protocol) {
+  Handshake hs{"", 0, 0, false};
+  uint32_t length = reader.readPrimitive<uint32_t>();
+  //The string must be followed by exactly the version and extension bytes
+  if (reader.outOfRange() or reader.remaining() < 2 or
+      length != reader.remaining() - 2) {
+    return hs;
+  }
+  ByteSpan name = reader.readSpan(length);
+  hs.protocol.assign(name.begin(), name.end());
+  hs.version = reader.readPrimitive<uint8_t>();
+  hs.capabilities = reader.readPrimitive<Capabilities>();
+  hs.valid = expected_protocol.empty() or expected_protocol == hs.protocol;
+  return hs;
+}
+
+Capabilities handshake::supported() {
+  return sample_batching | compression::supported();
+}
+
+Capabilities handshake::negotiate(Capabilities ours, const Handshake& theirs) {
+  if (not theirs.valid) {
+    return 0;
+  }
+  return ours & theirs.capabilities;
+}
@@ -28,7 +28,9 @@
 
 #include "message_receiver.hpp"
 
+#include <algorithm>
 #include <stdexcept>
+#include <string>
 #include <vector>
 #include <cstring>
 #include <unistd.h>
@@ -36,131 +38,173 @@
 #include <poll.h>
 #include <sys/poll.h>
 
+#include "compression.hpp"
+#include "metrics.hpp"
 #include "netbuffer.hpp"
 
-MessageReceiver::MessageReceiver(ClientSocket& s) : sock(s), raw_messages(10000) {
-  previous_unfinished = std::vector<unsigned char>(0);
-}
+//Read at least this many bytes per receive call, even if the message at
+//the front of the buffer only needs a few more bytes.
+static const size_t min_receive = 4096;
 
-bool MessageReceiver::messageAvailable(bool& interrupted) {
-  //Try to process data from the previously unfinished buffer, but
-  //if there is not enough data available receive from the network.
-  //There must be at least 4 bytes to try to process a packet and
-  //the size of a piece is stored in its first four bytes.
-  uint32_t piece_length = 0;
-  if (previous_unfinished.size() >= 4) {
-    piece_length = readPrimitive<uint32_t>(previous_unfinished, 0) + 4;
+//Time to wait for data to arrive when the socket is nonblocking.
+static const int poll_msec = 10;
+
+//Throw if the message at the front of @frames declares more than @max bytes
+static void checkFrameSize(const FrameBuffer& frames, size_t max) {
+  if (max < frames.frameSize()) {
+    throw std::runtime_error("Received a message of "+std::to_string(frames.frameSize())+
+        " bytes, more than the maximum of "+std::to_string(max)+".");
   }
-  std::unique_lock<std::mutex> lck(sock_mutex);
-  //See if we need more data to complete the current packet
-  //True if we do not have enough data to determine a packet size
-  //or we do not have enough data for a complete packet.
-  if (not interrupted and 
-         (previous_unfinished.size() < 4 or
-          previous_unfinished.size() < piece_length)) {
-    //Wait 10ms for data on the socket.
-    if (not sock.inputReady(10)) {
+}
+
+MessageReceiver::MessageReceiver(ClientSocket& s) : frames(10000), unpacked(0),
+  max_frame_size(default_max_frame_size), sock(s) {
+}
+
+void MessageReceiver::setMaxFrameSize(size_t bytes) {
+  max_frame_size = bytes;
+}
+
+bool MessageReceiver::nextMessage(FrameView& frame, bool open_envelope) {
+  //Messages from an envelope come before anything received after it
+  while (not unpacked.nextFrame(frame)) {
+    FrameView next;
+    checkFrameSize(frames, max_frame_size);
+    if (not frames.peekFrame(next)) {
       return false;
     }
-
-    //Receive a message from the network to get more data.
-    ssize_t length = sock.receive(raw_messages);
-    if ( -1 == length ) {
-      //Check for a nonblocking socket
-      if (EAGAIN == errno or
-          EWOULDBLOCK == errno) {
-        //No message available
-        return false;
-      }
-      else {
-        //Check the error value to give a more explicit error message.
-        std::string err_str(strerror(errno));
-        throw std::runtime_error("Error receiving message or the connection was closed: "+err_str);
-      }
+    //Envelopes are only opened if the peer was allowed to send them
+    if (not compression::isEnvelope(next) or
+        0 == (sock.capabilities() & compression::supported())) {
+      //The peek above means that a whole frame is buffered
+      frames.nextFrame(frame);
+      OWL_METRIC_ADD(frames_in, 1);
+      return true;
+    }
+    if (not open_envelope) {
+      return false;
     }
-    else if (0 == length) {
-      //0 length indicates end of file (a closed connection)
-      throw std::runtime_error("Connection was closed.");
+    frames.nextFrame(next);
+    unpacked.clear();
+    if (not compression::openEnvelope(next, unpacked)) {
+      throw std::runtime_error("Received a corrupt or nested compressed envelope.");
     }
-    //Append the message data into the previous_unfinished buffer.
-    previous_unfinished.insert(previous_unfinished.end(),
-        raw_messages.begin(), raw_messages.begin()+length);
   }
+  OWL_METRIC_ADD(frames_in, 1);
+  return true;
+}
 
-  //Return true if there is enough data to form a packet.
-  piece_length = readPrimitive<uint32_t>(previous_unfinished, 0) + 4;
-  return piece_length <= previous_unfinished.size();
+bool MessageReceiver::messageBuffered() const {
+  return unpacked.frameAvailable() or frames.frameAvailable();
 }
 
-std::vector<unsigned char> MessageReceiver::getNextMessage(bool& interrupted) {
+bool MessageReceiver::receiveMore() {
+  checkFrameSize(frames, max_frame_size);
+  //Make room for more of the current message, or a reasonable amount of
+  //data, and receive directly into the buffer's free space. Packet sockets
+  //drop whatever part of a record does not fit so they ask for more.
+  frames.reserve(frames.receiveNeed(std::max(min_receive, sock.receiveSize())));
+  ssize_t length = sock.receive(frames.writePtr(), frames.writable());
+  if ( -1 == length ) {
+    //Check for a nonblocking socket
+    if (EAGAIN == errno or
+        EWOULDBLOCK == errno) {
+      //No message available
+      return false;
+    }
+    else {
+      //Check the error value to give a more explicit error message.
+      std::string err_str(strerror(errno));
+      throw std::runtime_error("Error receiving message or the connection was closed: "+err_str);
+    }
+  }
+  else if (0 == length) {
+    //0 length indicates end of file (a closed connection)
+    throw std::runtime_error("Connection was closed.");
+  }
+  frames.commit(length);
+  OWL_METRIC_HIGH_WATER(frames.buffered());
+  return true;
+}
+
+bool MessageReceiver::messageAvailable(bool& interrupted) {
+  std::unique_lock<std::mutex> lck(sock_mutex);
   //Try to process data from the previously unfinished buffer, but
   //if there is not enough data available receive from the network.
-  //There must be at least 4 bytes to try to process a packet and
-  //the size of a piece is stored in its first four bytes.
-  uint32_t piece_length = 0;
-  if (previous_unfinished.size() >= 4) {
-    piece_length = readPrimitive<uint32_t>(previous_unfinished, 0) + 4;
-    //std::cerr<<"Getting piece with length "<<piece_length<<'\n';
+  if (not interrupted and not messageBuffered()) {
+    //Wait 10ms for data on the socket.
+    if (not sock.inputReady(poll_msec)) {
+      return false;
+    }
+    //Receive a message from the network to get more data.
+    receiveMore();
   }
-  std::unique_lock<std::mutex> lck(sock_mutex);
-  //Get the next packet - keep going while the size can't be read or the
-  //size was read but the buffer does not have the whole packet
-  while (not interrupted and 
-         (previous_unfinished.size() < 4 or
-          previous_unfinished.size() < piece_length)) {
 
-    //Receive a message from the network to get more data.
-    ssize_t length = sock.receive(raw_messages);
-    if ( -1 == length ) {
-      //Check for a nonblocking socket
-      if (EAGAIN == errno or
-          EWOULDBLOCK == errno) {
-        //Sleep for one millisecond and try again
-        usleep(1000);
-        continue;
-      }
-      else {
-        //Check the error value to give a more explicit error message.
-        std::string err_str(strerror(errno));
-        throw std::runtime_error("Error receiving message or the connection was closed: "+err_str);
-      }
-    }
-    else if (0 == length) {
-      //0 length indicates end of file (a closed connection)
-      throw std::runtime_error("Connection was closed.");
+  //Return true if there is enough data to form a packet.
+  return messageBuffered();
+}
+
+FrameView MessageReceiver::waitForFrame(bool& interrupted) {
+  //Get the next packet - keep receiving while the buffer does not have the
+  //whole packet.
+  FrameView frame{nullptr, 0};
+  while (not interrupted) {
+    if (nextMessage(frame)) {
+      return frame;
     }
-    //Append the message data into the previous_unfinished buffer.
-    previous_unfinished.insert(previous_unfinished.end(),
-        raw_messages.begin(), raw_messages.begin()+length);
-
-    //Read in the piece length and continue receiving packets until at least
-    //that much data has been received. The length bytes themselves take 4 bytes
-    if (previous_unfinished.size() >= 4) {
-      piece_length = readPrimitive<uint32_t>(previous_unfinished, 0) + 4;
-      //std::cerr<<"Continuing next piece with length "<<piece_length<<'\n';
+    //If a nonblocking socket has no data then wait for data to arrive
+    //rather than spinning on the socket.
+    if (not receiveMore()) {
+      sock.inputReady(poll_msec);
     }
   }
   //If the receive function is interrupted just leave.
+  return FrameView{nullptr, 0};
+}
+
+FrameView MessageReceiver::getNextFrame(bool& interrupted) {
+  std::unique_lock<std::mutex> lck(sock_mutex);
+  return waitForFrame(interrupted);
+}
+
+std::vector<unsigned char> MessageReceiver::getNextMessage(bool& interrupted) {
+  std::unique_lock<std::mutex> lck(sock_mutex);
+  //Copy the message out before another caller can reuse the buffer.
+  return waitForFrame(interrupted).toVector();
+}
+
+void MessageReceiver::receiveAvailable(bool& interrupted) {
   if (interrupted) {
-    return std::vector<unsigned char>(0);
+    return;
   }
-
-  piece_length = readPrimitive<uint32_t>(previous_unfinished, 0) + 4;
-  std::vector<unsigned char> new_packet(previous_unfinished.begin(),
-      previous_unfinished.begin()+piece_length);
-  //Save the unused portion of the buffer. Otherwise there is no more data left over
-  //so zero the buffer.
-  if ( piece_length < previous_unfinished.size() ) {
-    previous_unfinished = std::vector<unsigned char>(previous_unfinished.begin() + piece_length, previous_unfinished.end());
-    //std::cerr<<"Saving data for next call:\n";
-    //std::for_each(previous_unfinished.begin(), previous_unfinished.end(), [&](unsigned char c) {
-        //std::cerr<<c;
-        //});
-    //std::cerr<<'\n';
+  //If messages are already buffered only receive if it will not block,
+  //otherwise wait a short time for data to arrive.
+  int wait_msec = messageBuffered() ? 0 : poll_msec;
+  if (sock.inputReady(wait_msec)) {
+    receiveMore();
   }
-  else {
-    previous_unfinished.clear();
+}
+
+size_t MessageReceiver::getAvailableMessages(std::vector<FrameView>& out, size_t max, bool& interrupted) {
+  std::unique_lock<std::mutex> lck(sock_mutex);
+  out.clear();
+  receiveAvailable(interrupted);
+  FrameView frame;
+  //Only open an envelope if that will not invalidate views in out
+  while (out.size() < max and nextMessage(frame, out.empty())) {
+    out.push_back(frame);
   }
-  return new_packet;
+  return out.size();
 }
 
+size_t MessageReceiver::forEachMessage(const std::function<void (const FrameView&)>& handler, size_t max, bool& interrupted) {
+  std::unique_lock<std::mutex> lck(sock_mutex);
+  receiveAvailable(interrupted);
+  size_t handled = 0;
+  FrameView frame;
+  while (handled < max and nextMessage(frame)) {
+    handler(frame);
+    ++handled;
+  }
+  return handled;
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file metrics.cpp
+ * Per thread collection and aggregation of the library's metrics.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "metrics.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace metrics;
+
+namespace {
+  //Counters written by a single thread and read by snapshot. The owner
+  //updates them with a relaxed load and store, which costs the same as a
+  //plain increment, and readers never see a torn value.
+  struct ThreadMetrics {
+    std::atomic<uint64_t> counters[num_counters];
+    std::atomic<uint64_t> high_water;
+    std::atomic<uint64_t> latency[2][num_protocols][max_message_types][histogram_buckets];
+
+    ThreadMetrics() {
+      clear();
+    }
+
+    void clear() {
+      for (auto& counter : counters) {
+        counter.store(0, std::memory_order_relaxed);
+      }
+      high_water.store(0, std::memory_order_relaxed);
+      for (auto& op : latency) {
+        for (auto& protocol : op) {
+          for (auto& type : protocol) {
+            for (auto& bucket : type) {
+              bucket.store(0, std::memory_order_relaxed);
+            }
+          }
+        }
+      }
+    }
+
+    //Add this thread's values into a snapshot
+    void addTo(Snapshot& snap) const {
+      for (size_t i = 0; i < num_counters; ++i) {
+        snap.counters[i] += counters[i].load(std::memory_order_relaxed);
+      }
+      uint64_t hw = high_water.load(std::memory_order_relaxed);
+      if (snap.receive_buffer_high_water < hw) {
+        snap.receive_buffer_high_water = hw;
+      }
+      for (size_t op = 0; op < 2; ++op) {
+        for (size_t protocol = 0; protocol < num_protocols; ++protocol) {
+          for (size_t type = 0; type < max_message_types; ++type) {
+            for (size_t bucket = 0; bucket < histogram_buckets; ++bucket) {
+              snap.latency[op][protocol][type].buckets[bucket] +=
+                latency[op][protocol][type][bucket].load(std::memory_order_relaxed);
+            }
+          }
+        }
+      }
+    }
+  };
+
+  inline void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+  }
+
+  //Every live thread's metrics and the totals of threads that have exited
+  struct Registry {
+    std::mutex lock;
+    std::vector<ThreadMetrics*> threads;
+    Snapshot retired;
+
+    Registry() {
+      memset(&retired, 0, sizeof(retired));
+    }
+  };
+
+  Registry& registry() {
+    //Never destroyed so that threads exiting after main still find it
+    static Registry* reg = new Registry();
+    return *reg;
+  }
+
+  //Registers the calling thread's metrics on first use and folds them into
+  //the retired totals when the thread exits.
+  struct ThreadHandle {
+    ThreadMetrics* metrics;
+
+    ThreadHandle() : metrics(new ThreadMetrics()) {
+      Registry& reg = registry();
+      std::unique_lock<std::mutex> lck(reg.lock);
+      reg.threads.push_back(metrics);
+    }
+
+    ~ThreadHandle() {
+      Registry& reg = registry();
+      std::unique_lock<std::mutex> lck(reg.lock);
+      metrics->addTo(reg.retired);
+      for (size_t i = 0; i < reg.threads.size(); ++i) {
+        if (reg.threads[i] == metrics) {
+          reg.threads[i] = reg.threads.back();
+          reg.threads.pop_back();
+          break;
+        }
+      }
+      delete metrics;
+    }
+  };
+
+  ThreadMetrics& local() {
+    static thread_local ThreadHandle handle;
+    return *handle.metrics;
+  }
+
+  size_t bucketFor(uint64_t nsec) {
+    size_t bucket = 0;
+    while (1 < nsec and bucket + 1 < histogram_buckets) {
+      nsec >>= 1;
+      ++bucket;
+    }
+    return bucket;
+  }
+}
+
+uint64_t Histogram::count() const {
+  uint64_t total = 0;
+  for (uint64_t bucket : buckets) {
+    total += bucket;
+  }
+  return total;
+}
+
+uint64_t Histogram::percentile(double fraction) const {
+  uint64_t total = count();
+  if (0 == total) {
+    return 0;
+  }
+  uint64_t target = fraction * total;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < histogram_buckets; ++i) {
+    seen += buckets[i];
+    if (target < seen) {
+      return (uint64_t(2) << i) - 1;
+    }
+  }
+  return (uint64_t(2) << (histogram_buckets - 1)) - 1;
+}
+
+uint64_t Snapshot::operator[](Counter counter) const {
+  return counters[counter];
+}
+
+double Snapshot::syscallsPerFrame() const {
+  uint64_t frames = counters[frames_in] + counters[frames_out];
+  if (0 == frames) {
+    return 0.0;
+  }
+  return (counters[receive_calls] + counters[send_calls]) / (double)frames;
+}
+
+static size_t typeIndex(uint8_t message_type) {
+  return message_type < max_message_types ? message_type : max_message_types - 1;
+}
+
+const Histogram& Snapshot::encodeLatency(Protocol protocol, uint8_t message_type) const {
+  return latency[encode][size_t(protocol)][typeIndex(message_type)];
+}
+
+const Histogram& Snapshot::decodeLatency(Protocol protocol, uint8_t message_type) const {
+  return latency[decode][size_t(protocol)][typeIndex(message_type)];
+}
+
+bool metrics::enabled() {
+#ifdef OWL_METRICS
+  return true;
+#else
+  return false;
+#endif
+}
+
+Snapshot metrics::snapshot() {
+  Snapshot snap;
+  Registry& reg = registry();
+  std::unique_lock<std::mutex> lck(reg.lock);
+  snap = reg.retired;
+  for (ThreadMetrics* thread : reg.threads) {
+    thread->addTo(snap);
+  }
+  return snap;
+}
+
+void metrics::reset() {
+  Registry& reg = registry();
+  std::unique_lock<std::mutex> lck(reg.lock);
+  memset(&reg.retired, 0, sizeof(reg.retired));
+  for (ThreadMetrics* thread : reg.threads) {
+    thread->clear();
+  }
+}
+
+void metrics::add(Counter counter, uint64_t amount) {
+  bump(local().counters[counter], amount);
+}
+
+void metrics::highWater(uint64_t receive_buffered) {
+  std::atomic<uint64_t>& hw = local().high_water;
+  if (hw.load(std::memory_order_relaxed) < receive_buffered) {
+    hw.store(receive_buffered, std::memory_order_relaxed);
+  }
+}
+
+void metrics::recordLatency(Operation op, Protocol protocol, uint8_t message_type, uint64_t nsec) {
+  bump(local().latency[op][size_t(protocol)][typeIndex(message_type)][bucketFor(nsec)], 1);
+}
@@ -38,6 +38,13 @@
 //and htonll functions.
 #include <endian.h>
 
+#if defined(__x86_64__) or defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 bool littleEndian() {
   uint32_t endian_test = 1;
   return ( *(unsigned char*)(&endian_test) == 1 );
@@ -148,16 +155,99 @@ void fromNetworkEndian(unsigned char* in, int size) {
   }
 }
 
+/*******************************************************************************
+ * UTF16 byte swapping kernels. Every kernel swaps the two bytes of each
+ * character and finishes any leftover characters with the scalar loop.
+ ******************************************************************************/
+typedef void (*UTF16SwapFn)(const unsigned char* in, unsigned char* out, size_t count);
+
+static void swapUTF16Scalar(const unsigned char* in, unsigned char* out, size_t count) {
+  for (size_t index = 0; index < count; ++index) {
+    out[2*index] = in[2*index+1];
+    out[2*index+1] = in[2*index];
+  }
+}
+
+#if defined(__SSE2__)
+static void swapUTF16SSE2(const unsigned char* in, unsigned char* out, size_t count) {
+  size_t index = 0;
+  //Eight characters per 128 bit register
+  for (; index + 8 <= count; index += 8) {
+    __m128i chars = _mm_loadu_si128((const __m128i*)(in + 2*index));
+    chars = _mm_or_si128(_mm_slli_epi16(chars, 8), _mm_srli_epi16(chars, 8));
+    _mm_storeu_si128((__m128i*)(out + 2*index), chars);
+  }
+  swapUTF16Scalar(in + 2*index, out + 2*index, count - index);
+}
+#endif
+
+#if defined(__x86_64__) or defined(__i386__)
+__attribute__((target("avx2")))
+static void swapUTF16AVX2(const unsigned char* in, unsigned char* out, size_t count) {
+  size_t index = 0;
+  //Sixteen characters per 256 bit register
+  for (; index + 16 <= count; index += 16) {
+    __m256i chars = _mm256_loadu_si256((const __m256i*)(in + 2*index));
+    chars = _mm256_or_si256(_mm256_slli_epi16(chars, 8), _mm256_srli_epi16(chars, 8));
+    _mm256_storeu_si256((__m256i*)(out + 2*index), chars);
+  }
+  swapUTF16Scalar(in + 2*index, out + 2*index, count - index);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static void swapUTF16NEON(const unsigned char* in, unsigned char* out, size_t count) {
+  size_t index = 0;
+  //Eight characters per 128 bit register
+  for (; index + 8 <= count; index += 8) {
+    vst1q_u8(out + 2*index, vrev16q_u8(vld1q_u8(in + 2*index)));
+  }
+  swapUTF16Scalar(in + 2*index, out + 2*index, count - index);
+}
+#endif
+
+static UTF16SwapFn chooseUTF16Swap() {
+#if defined(__x86_64__) or defined(__i386__)
+  if (__builtin_cpu_supports("avx2")) {
+    return swapUTF16AVX2;
+  }
+#endif
+#if defined(__SSE2__)
+  return swapUTF16SSE2;
+#elif defined(__ARM_NEON)
+  return swapUTF16NEON;
+#else
+  return swapUTF16Scalar;
+#endif
+}
+
+static void swapUTF16(const unsigned char* in, unsigned char* out, size_t count) {
+#if defined(__BYTE_ORDER__) and __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  //Host order is already network order
+  std::memcpy(out, in, count * sizeof(char16_t));
+#else
+  static const UTF16SwapFn swap_fn = chooseUTF16Swap();
+  swap_fn(in, out, count);
+#endif
+}
+
+void utf16FromNetwork(const unsigned char* in, char16_t* out, size_t count) {
+  swapUTF16(in, (unsigned char*)out, count);
+}
+
+void utf16ToNetwork(const char16_t* in, unsigned char* out, size_t count) {
+  swapUTF16((const unsigned char*)in, out, count);
+}
+
 //Reassemble a utf16 string
 std::u16string readUTF16(std::vector<unsigned char>& buff, size_t start, size_t size) {
   std::u16string str;
   //Return an empty string if the specified size is larger than the buffer
-  if ( (buff.size() - start) < size*sizeof(char16_t)) {
+  if ( start > buff.size() or (buff.size() - start) < size*sizeof(char16_t)) {
     return str;
   }
-  for (size_t index = 0; index*sizeof(char16_t) < size and start + index*sizeof(char16_t) <= buff.size(); ++index) {
-    str.push_back( readPrimitive<char16_t>(buff, start + (index*sizeof(char16_t))) );
-  }
+  str.resize(size);
+  utf16FromNetwork(buff.data() + start, &str[0], size);
   return str;
 }
 
@@ -194,18 +284,23 @@ void BuffReader::discard(size_t bytes) {
 //Reassemble a utf16 string
 std::u16string BuffReader::readUTF16(size_t size) {
   std::u16string str;
-  for (size_t index = 0; index < size; ++index) {
-    str.push_back( this->readPrimitive<char16_t>() );
+  if ( cur_index > buff.size() or size > (buff.size() - cur_index) / sizeof(char16_t) ) {
+    //Read everything that is available and remember that we went too far
+    size = cur_index > buff.size() ? 0 : (buff.size() - cur_index) / sizeof(char16_t);
+    _out_of_range = true;
+  }
+  str.resize(size);
+  if ( 0 < size ) {
+    utf16FromNetwork(buff.data() + cur_index, &str[0], size);
+    cur_index += size * sizeof(char16_t);
+    std::advance(buff_i, size * sizeof(char16_t));
   }
   return str;
 }
+
 std::u16string BuffReader::readSizedUTF16() {
   uint32_t size = this->readPrimitive<uint32_t>() / sizeof(char16_t);
-  std::u16string str;
-  for (size_t index = 0; index < size; ++index) {
-    str.push_back( this->readPrimitive<char16_t>() );
-  }
-  return str;
+  return readUTF16(size);
 }
 
 /**
@@ -213,22 +308,156 @@ std::u16string BuffReader::readSizedUTF16() {
  * Return the total number of bytes pushed back.
  */
 uint32_t pushBackUTF16(std::vector<unsigned char>& buff, const std::u16string& str) {
-  uint32_t size = 0;
-  //Push back each character in the string individually
-  for (auto I = str.begin(); I != str.end(); ++I ) {
-    size += pushBackVal(*I, buff);
-  }
-  return size;
+  //Grow the buffer once and then write the characters into it
+  size_t index = buff.size();
+  buff.resize(index + str.length() * sizeof(char16_t));
+  BuffWriter writer(buff, index);
+  return writer.writeUTF16(str);
 }
 
 uint32_t pushBackSizedUTF16(std::vector<unsigned char>& buff, const std::u16string& str) {
-  uint32_t size = 0;
-  uint32_t string_len = str.length() * sizeof(char16_t);
-  size += pushBackVal(string_len, buff);
-  //Push back each character in the string individually
-  for (auto I = str.begin(); I != str.end(); ++I ) {
-    size += pushBackVal(*I, buff);
+  size_t index = buff.size();
+  buff.resize(index + sizeof(uint32_t) + str.length() * sizeof(char16_t));
+  BuffWriter writer(buff, index);
+  return writer.writeSizedUTF16(str);
+}
+
+
+BuffView::BuffView(const unsigned char* data, size_t size) :
+  _data(data), _size(size), _out_of_range(false), cur_index(0) {}
+
+BuffView::BuffView(const std::vector<unsigned char>& buffer) :
+  _data(buffer.data()), _size(buffer.size()), _out_of_range(false), cur_index(0) {}
+
+BuffView::BuffView(const ByteSpan& span) :
+  _data(span.data), _size(span.size), _out_of_range(false), cur_index(0) {}
+
+bool BuffView::outOfRange() const {
+  return _out_of_range;
+}
+
+size_t BuffView::size() const {
+  return _size;
+}
+
+size_t BuffView::remaining() const {
+  return _size - cur_index;
+}
+
+const unsigned char* BuffView::data() const {
+  return _data;
+}
+
+void BuffView::discard(size_t bytes) {
+  if ( bytes > remaining() ) {
+    cur_index = _size;
+  }
+  else {
+    cur_index += bytes;
+  }
+}
+
+ByteSpan BuffView::readSpan(size_t bytes) {
+  ByteSpan span{_data + cur_index, 0};
+  if ( bytes <= remaining() ) {
+    span.size = bytes;
+    cur_index += bytes;
+  }
+  else {
+    _out_of_range = true;
+  }
+  return span;
+}
+
+ByteSpan BuffView::readSizedSpan() {
+  uint32_t size = this->readPrimitive<uint32_t>();
+  return readSpan(size);
+}
+
+ByteSpan BuffView::readRemaining() {
+  return readSpan(remaining());
+}
+
+std::u16string BuffView::readUTF16(size_t size) {
+  std::u16string str;
+  if ( size > remaining() / sizeof(char16_t) ) {
+    _out_of_range = true;
+    return str;
+  }
+  str.resize(size);
+  if ( 0 < size ) {
+    utf16FromNetwork(_data + cur_index, &str[0], size);
+    cur_index += size * sizeof(char16_t);
+  }
+  return str;
+}
+
+std::u16string BuffView::readSizedUTF16() {
+  uint32_t size = this->readPrimitive<uint32_t>() / sizeof(char16_t);
+  return readUTF16(size);
+}
+
+BuffWriter::BuffWriter(std::vector<unsigned char>& buffer, size_t start) :
+  _data(buffer.data()), _size(buffer.size()), _out_of_range(false), cur_index(start) {
+  if ( cur_index > _size ) {
+    cur_index = _size;
+    _out_of_range = true;
+  }
+}
+
+BuffWriter::BuffWriter(unsigned char* data, size_t size) :
+  _data(data), _size(size), _out_of_range(false), cur_index(0) {}
+
+BuffWriter appendWriter(std::vector<unsigned char>& buffer, size_t length) {
+  size_t start = buffer.size();
+  buffer.resize(start + length);
+  return BuffWriter(buffer, start);
+}
+
+bool BuffWriter::outOfRange() const {
+  return _out_of_range;
+}
+
+size_t BuffWriter::remaining() const {
+  return _size - cur_index;
+}
+
+uint32_t BuffWriter::writeBytes(const unsigned char* bytes, size_t length) {
+  if ( length > remaining() ) {
+    _out_of_range = true;
+    return 0;
+  }
+  if ( 0 < length ) {
+    std::memcpy(_data + cur_index, bytes, length);
+  }
+  cur_index += length;
+  return length;
+}
+
+uint32_t BuffWriter::writeSizedBytes(const unsigned char* bytes, size_t length) {
+  if ( sizeof(uint32_t) + length > remaining() ) {
+    _out_of_range = true;
+    return 0;
+  }
+  return writePrimitive<uint32_t>(length) + writeBytes(bytes, length);
+}
+
+uint32_t BuffWriter::writeUTF16(const std::u16string& str) {
+  size_t length = str.length() * sizeof(char16_t);
+  if ( length > remaining() ) {
+    _out_of_range = true;
+    return 0;
   }
-  return size;
+  utf16ToNetwork(str.data(), _data + cur_index, str.length());
+  cur_index += length;
+  return length;
 }
 
+uint32_t BuffWriter::writeSizedUTF16(const std::u16string& str) {
+  if ( sizeof(uint32_t) + str.length() * sizeof(char16_t) > remaining() ) {
+    _out_of_range = true;
+    return 0;
+  }
+  uint32_t size = writePrimitive<uint32_t>(str.length() * sizeof(char16_t));
+  return size + writeUTF16(str);
+}
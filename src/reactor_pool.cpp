@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file reactor_pool.cpp
+ * Implementation of the ReactorPool class.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "reactor_pool.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+ReactorPool::ReactorPool(int domain, uint32_t port, size_t num_workers,
+    EventLoop::FrameHandler handler, bool pin_cpus) : stopping(false), pin_cpus(pin_cpus) {
+  if (0 == num_workers) {
+    num_workers = std::thread::hardware_concurrency();
+    if (0 == num_workers) {
+      num_workers = 1;
+    }
+  }
+  workers.resize(num_workers);
+  for (Worker& worker : workers) {
+    worker.listener = std::unique_ptr<ServerSocket>(
+        new ServerSocket(domain, SOCK_STREAM, SOCK_CLOEXEC, port, true));
+    if (not *worker.listener) {
+      throw std::runtime_error("Could not open a listening socket on port "+std::to_string(port));
+    }
+    worker.loop = std::unique_ptr<EventLoop>(new EventLoop(handler));
+    worker.loop->listen(*worker.listener);
+  }
+}
+
+ReactorPool::~ReactorPool() {
+  stop();
+}
+
+size_t ReactorPool::size() const {
+  return workers.size();
+}
+
+EventLoop& ReactorPool::loop(size_t index) {
+  return *workers.at(index).loop;
+}
+
+void ReactorPool::runWorker(size_t index) {
+  if (pin_cpus) {
+    size_t cpus = std::thread::hardware_concurrency();
+    if (0 < cpus) {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(index % cpus, &cpu_set);
+      int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+      if (0 != err) {
+        std::cerr<<"Error pinning worker "<<index<<" to a cpu: "<<strerror(err)<<'\n';
+      }
+    }
+  }
+  EventLoop& loop = *workers[index].loop;
+  try {
+    while (not stopping) {
+      loop.runOnce(-1);
+    }
+  }
+  catch (std::runtime_error& err) {
+    std::cerr<<"Worker "<<index<<" stopped: "<<err.what()<<'\n';
+  }
+}
+
+void ReactorPool::start() {
+  stopping = false;
+  for (size_t i = 0; i < workers.size(); ++i) {
+    if (not workers[i].thread.joinable()) {
+      workers[i].thread = std::thread(&ReactorPool::runWorker, this, i);
+    }
+  }
+}
+
+void ReactorPool::stop() {
+  stopping = true;
+  for (Worker& worker : workers) {
+    //Interrupt the blocking wait so the worker sees the stop flag.
+    worker.loop->wakeup();
+  }
+  for (Worker& worker : workers) {
+    if (worker.thread.joinable()) {
+      worker.thread.join();
+    }
+  }
+}
@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file sample_batch.cpp
+ * Implementation of the SampleBatch class.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "sample_batch.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+SampleBatch::SampleBatch() {
+}
+
+size_t SampleBatch::size() const {
+  return phy.size();
+}
+
+bool SampleBatch::empty() const {
+  return phy.empty();
+}
+
+void SampleBatch::reserve(size_t samples) {
+  phy.reserve(samples);
+  tx.reserve(samples);
+  rx.reserve(samples);
+  time.reserve(samples);
+  rss.reserve(samples);
+  sense.reserve(samples);
+}
+
+void SampleBatch::clear() {
+  phy.clear();
+  tx.clear();
+  rx.clear();
+  time.clear();
+  rss.clear();
+  sense.clear();
+  sense_arena.reset();
+}
+
+void SampleBatch::truncate(size_t samples) {
+  if (samples < phy.size()) {
+    phy.resize(samples);
+    tx.resize(samples);
+    rx.resize(samples);
+    time.resize(samples);
+    rss.resize(samples);
+    sense.resize(samples);
+  }
+}
+
+void SampleBatch::push_back(const SampleData& sample) {
+  if (sample.valid) {
+    push_back(sample.physical_layer, sample.tx_id, sample.rx_id, sample.rx_timestamp, sample.rss,
+        ByteSpan{sample.sense_data.data(), sample.sense_data.size()});
+  }
+}
+
+void SampleBatch::push_back(unsigned char physical_layer, const TransmitterID& tx_id, const ReceiverID& rx_id,
+    Timestamp rx_timestamp, float sample_rss, ByteSpan sense_data) {
+  phy.push_back(physical_layer);
+  tx.push_back(tx_id);
+  rx.push_back(rx_id);
+  time.push_back(rx_timestamp);
+  rss.push_back(sample_rss);
+  if (sense_data.empty()) {
+    sense.push_back(ByteSpan{nullptr, 0});
+  }
+  else {
+    unsigned char* copy = static_cast<unsigned char*>(sense_arena.allocate(sense_data.size, 1));
+    memcpy(copy, sense_data.data, sense_data.size);
+    sense.push_back(ByteSpan{copy, sense_data.size});
+  }
+}
+
+SampleData SampleBatch::sample(size_t index) const {
+  SampleData sample;
+  sample.physical_layer = phy[index];
+  sample.tx_id = tx[index];
+  sample.rx_id = rx[index];
+  sample.rx_timestamp = time[index];
+  sample.rss = rss[index];
+  sample.sense_data.assign(sense[index].begin(), sense[index].end());
+  sample.valid = true;
+  return sample;
+}
+
+const SampleBatch::Column<unsigned char>& SampleBatch::physicalLayers() const {
+  return phy;
+}
+
+const SampleBatch::Column<TransmitterID>& SampleBatch::transmitters() const {
+  return tx;
+}
+
+const SampleBatch::Column<ReceiverID>& SampleBatch::receivers() const {
+  return rx;
+}
+
+const SampleBatch::Column<Timestamp>& SampleBatch::timestamps() const {
+  return time;
+}
+
+const SampleBatch::Column<float>& SampleBatch::rssValues() const {
+  return rss;
+}
+
+const SampleBatch::Column<ByteSpan>& SampleBatch::senseData() const {
+  return sense;
+}
+
+size_t SampleBatch::compact() {
+  //Every sample is written to the next free row and the row only advances
+  //for kept samples, so there are no branches in the loop.
+  size_t kept = 0;
+  for (size_t i = 0; i < phy.size(); ++i) {
+    phy[kept] = phy[i];
+    tx[kept] = tx[i];
+    rx[kept] = rx[i];
+    time[kept] = time[i];
+    rss[kept] = rss[i];
+    sense[kept] = sense[i];
+    kept += keep[i];
+  }
+  phy.resize(kept);
+  tx.resize(kept);
+  rx.resize(kept);
+  time.resize(kept);
+  rss.resize(kept);
+  sense.resize(kept);
+  return kept;
+}
+
+/*******************************************************************************
+ * Filter kernels. Each one sets a keep flag (0 or 1) for every sample and
+ * compact then removes the samples that were not kept. As with the UTF16
+ * kernels in netbuffer.cpp the kernel is chosen on first use: AVX2 when the
+ * CPU has it, otherwise SSE2 or NEON when the build targets them, and the
+ * scalar loop everywhere else. Every vector kernel finishes leftover
+ * samples with the scalar loop.
+ ******************************************************************************/
+typedef void (*TransmitterFlagsFn)(const unsigned char* phys, const TransmitterID* ids, size_t count,
+    unsigned char physical_layer, const TransmitterID& masked_base, const TransmitterID& mask,
+    unsigned char* flags);
+typedef void (*WindowFlagsFn)(const Timestamp* times, size_t count, Timestamp begin, Timestamp end,
+    unsigned char* flags);
+
+static void transmitterFlagsScalar(const unsigned char* phys, const TransmitterID* ids, size_t count,
+    unsigned char physical_layer, const TransmitterID& masked_base, const TransmitterID& mask,
+    unsigned char* flags) {
+  for (size_t i = 0; i < count; ++i) {
+    flags[i] = (phys[i] == physical_layer) & ((ids[i].upper & mask.upper) == masked_base.upper) &
+      ((ids[i].lower & mask.lower) == masked_base.lower);
+  }
+}
+
+static void windowFlagsScalar(const Timestamp* times, size_t count, Timestamp begin, Timestamp end,
+    unsigned char* flags) {
+  for (size_t i = 0; i < count; ++i) {
+    flags[i] = (begin <= times[i]) & (times[i] < end);
+  }
+}
+
+#if defined(__x86_64__) or defined(__i386__)
+//Keep flags for four samples from the low four bits of a movemask, stored
+//with one write. x86 is little endian so bit k becomes byte k.
+static const uint32_t flag_bytes[16] = {
+  0x00000000, 0x00000001, 0x00000100, 0x00000101,
+  0x00010000, 0x00010001, 0x00010100, 0x00010101,
+  0x01000000, 0x01000001, 0x01000100, 0x01000101,
+  0x01010000, 0x01010001, 0x01010100, 0x01010101};
+
+static inline void storeFlags(unsigned char* flags, int bits) {
+  std::memcpy(flags, &flag_bytes[bits & 0xF], sizeof(uint32_t));
+}
+#endif
+
+/*
+ * begin <= t < end is the same as the unsigned t - begin < end - begin when
+ * begin < end, which needs one comparison instead of two. Flipping the sign
+ * bit of both sides turns the unsigned comparison into a signed one.
+ */
+static uint64_t windowWidth(Timestamp begin, Timestamp end) {
+  return (uint64_t)end - (uint64_t)begin;
+}
+
+#if defined(__SSE2__)
+static void transmitterFlagsSSE2(const unsigned char* phys, const TransmitterID* ids, size_t count,
+    unsigned char physical_layer, const TransmitterID& masked_base, const TransmitterID& mask,
+    unsigned char* flags) {
+  const __m128i base_v = _mm_loadu_si128((const __m128i*)&masked_base);
+  const __m128i mask_v = _mm_loadu_si128((const __m128i*)&mask);
+  const __m128i phy_v = _mm_set1_epi8(physical_layer);
+  size_t i = 0;
+  //Sixteen samples per block, one transmitter id per 128 bit register
+  for (; i + 16 <= count; i += 16) {
+    int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(phys + i)), phy_v));
+    for (size_t j = 0; j < 16; j += 4) {
+      __m128i eq[4];
+      for (size_t k = 0; k < 4; ++k) {
+        __m128i id = _mm_loadu_si128((const __m128i*)(ids + i + j + k));
+        eq[k] = _mm_cmpeq_epi32(_mm_and_si128(id, mask_v), base_v);
+      }
+      //Narrow the four comparisons to one byte per 32 bit word so that a
+      //single movemask has a nibble for each id. An id matches when its
+      //whole nibble is set.
+      __m128i packed = _mm_packs_epi16(_mm_packs_epi32(eq[0], eq[1]), _mm_packs_epi32(eq[2], eq[3]));
+      int words = _mm_movemask_epi8(packed);
+      int all = words & (words >> 1) & (words >> 2) & (words >> 3);
+      int bits = (all & 1) | ((all >> 3) & 2) | ((all >> 6) & 4) | ((all >> 9) & 8);
+      storeFlags(flags + i + j, bits & (matches >> j));
+    }
+  }
+  transmitterFlagsScalar(phys + i, ids + i, count - i, physical_layer, masked_base, mask, flags + i);
+}
+
+//Signed 64 bit a > b, which SSE2 does not have. When the upper halves are
+//equal the sign of b - a decides, otherwise the upper halves do.
+static inline __m128i greaterThan64SSE2(__m128i a, __m128i b) {
+  __m128i result = _mm_and_si128(_mm_cmpeq_epi32(a, b), _mm_sub_epi64(b, a));
+  result = _mm_or_si128(result, _mm_cmpgt_epi32(a, b));
+  //Copy each upper half over its lower half
+  return _mm_shuffle_epi32(result, _MM_SHUFFLE(3, 3, 1, 1));
+}
+
+static void windowFlagsSSE2(const Timestamp* times, size_t count, Timestamp begin, Timestamp end,
+    unsigned char* flags) {
+  if (end <= begin) {
+    std::memset(flags, 0, count);
+    return;
+  }
+  const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+  const __m128i begin_v = _mm_set1_epi64x(begin);
+  const __m128i width_v = _mm_xor_si128(_mm_set1_epi64x(windowWidth(begin, end)), sign);
+  size_t i = 0;
+  //Four timestamps per block, two per 128 bit register
+  for (; i + 4 <= count; i += 4) {
+    __m128i t0 = _mm_xor_si128(_mm_sub_epi64(_mm_loadu_si128((const __m128i*)(times + i)), begin_v), sign);
+    __m128i t1 = _mm_xor_si128(_mm_sub_epi64(_mm_loadu_si128((const __m128i*)(times + i + 2)), begin_v), sign);
+    int bits = _mm_movemask_pd(_mm_castsi128_pd(greaterThan64SSE2(width_v, t0))) |
+      (_mm_movemask_pd(_mm_castsi128_pd(greaterThan64SSE2(width_v, t1))) << 2);
+    storeFlags(flags + i, bits);
+  }
+  windowFlagsScalar(times + i, count - i, begin, end, flags + i);
+}
+#endif
+
+#if defined(__x86_64__) or defined(__i386__)
+__attribute__((target("avx2")))
+static void transmitterFlagsAVX2(const unsigned char* phys, const TransmitterID* ids, size_t count,
+    unsigned char physical_layer, const TransmitterID& masked_base, const TransmitterID& mask,
+    unsigned char* flags) {
+  const __m256i base_v = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)&masked_base));
+  const __m256i mask_v = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)&mask));
+  const __m128i phy_v = _mm_set1_epi8(physical_layer);
+  size_t i = 0;
+  //Sixteen samples per block, two transmitter ids per 256 bit register
+  for (; i + 16 <= count; i += 16) {
+    int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(phys + i)), phy_v));
+    for (size_t j = 0; j < 16; j += 4) {
+      __m256i eq0 = _mm256_cmpeq_epi64(_mm256_and_si256(
+            _mm256_loadu_si256((const __m256i*)(ids + i + j)), mask_v), base_v);
+      __m256i eq1 = _mm256_cmpeq_epi64(_mm256_and_si256(
+            _mm256_loadu_si256((const __m256i*)(ids + i + j + 2)), mask_v), base_v);
+      //Eight bits, one for each 64 bit half. An id matches when both of
+      //its halves do.
+      int halves = _mm256_movemask_pd(_mm256_castsi256_pd(eq0)) |
+        (_mm256_movemask_pd(_mm256_castsi256_pd(eq1)) << 4);
+      int both = halves & (halves >> 1);
+      int bits = (both & 1) | ((both >> 1) & 2) | ((both >> 2) & 4) | ((both >> 3) & 8);
+      storeFlags(flags + i + j, bits & (matches >> j));
+    }
+  }
+  transmitterFlagsScalar(phys + i, ids + i, count - i, physical_layer, masked_base, mask, flags + i);
+}
+
+__attribute__((target("avx2")))
+static void windowFlagsAVX2(const Timestamp* times, size_t count, Timestamp begin, Timestamp end,
+    unsigned char* flags) {
+  if (end <= begin) {
+    std::memset(flags, 0, count);
+    return;
+  }
+  const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+  const __m256i begin_v = _mm256_set1_epi64x(begin);
+  const __m256i width_v = _mm256_xor_si256(_mm256_set1_epi64x(windowWidth(begin, end)), sign);
+  size_t i = 0;
+  //Eight timestamps per block, four per 256 bit register
+  for (; i + 8 <= count; i += 8) {
+    __m256i t0 = _mm256_xor_si256(_mm256_sub_epi64(_mm256_loadu_si256((const __m256i*)(times + i)), begin_v), sign);
+    __m256i t1 = _mm256_xor_si256(_mm256_sub_epi64(_mm256_loadu_si256((const __m256i*)(times + i + 4)), begin_v), sign);
+    storeFlags(flags + i, _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(width_v, t0))));
+    storeFlags(flags + i + 4, _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(width_v, t1))));
+  }
+  windowFlagsScalar(times + i, count - i, begin, end, flags + i);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static void transmitterFlagsNEON(const unsigned char* phys, const TransmitterID* ids, size_t count,
+    unsigned char physical_layer, const TransmitterID& masked_base, const TransmitterID& mask,
+    unsigned char* flags) {
+  const uint32x4_t base_v = vld1q_u32((const uint32_t*)&masked_base);
+  const uint32x4_t mask_v = vld1q_u32((const uint32_t*)&mask);
+  //One transmitter id per 128 bit register
+  for (size_t i = 0; i < count; ++i) {
+    uint32x4_t eq = vceqq_u32(vandq_u32(vld1q_u32((const uint32_t*)(ids + i)), mask_v), base_v);
+    uint32x2_t both = vand_u32(vget_low_u32(eq), vget_high_u32(eq));
+    flags[i] = (phys[i] == physical_layer) &
+      (0xFFFFFFFFu == (vget_lane_u32(both, 0) & vget_lane_u32(both, 1)));
+  }
+}
+#endif
+
+//64 bit lane comparisons are only in the AArch64 version of NEON
+#if defined(__ARM_NEON) and defined(__aarch64__)
+static void windowFlagsNEON(const Timestamp* times, size_t count, Timestamp begin, Timestamp end,
+    unsigned char* flags) {
+  const int64x2_t begin_v = vdupq_n_s64(begin);
+  const int64x2_t end_v = vdupq_n_s64(end);
+  size_t i = 0;
+  //Two timestamps per 128 bit register
+  for (; i + 2 <= count; i += 2) {
+    int64x2_t t = vld1q_s64(times + i);
+    uint64x2_t kept = vandq_u64(vcgeq_s64(t, begin_v), vcltq_s64(t, end_v));
+    flags[i] = vgetq_lane_u64(kept, 0) & 1;
+    flags[i + 1] = vgetq_lane_u64(kept, 1) & 1;
+  }
+  windowFlagsScalar(times + i, count - i, begin, end, flags + i);
+}
+#endif
+
+static TransmitterFlagsFn chooseTransmitterFlags() {
+#if defined(__x86_64__) or defined(__i386__)
+  if (__builtin_cpu_supports("avx2")) {
+    return transmitterFlagsAVX2;
+  }
+#endif
+#if defined(__SSE2__)
+  return transmitterFlagsSSE2;
+#elif defined(__ARM_NEON)
+  return transmitterFlagsNEON;
+#else
+  return transmitterFlagsScalar;
+#endif
+}
+
+static WindowFlagsFn chooseWindowFlags() {
+#if defined(__x86_64__) or defined(__i386__)
+  if (__builtin_cpu_supports("avx2")) {
+    return windowFlagsAVX2;
+  }
+#endif
+#if defined(__SSE2__)
+  return windowFlagsSSE2;
+#elif defined(__ARM_NEON) and defined(__aarch64__)
+  return windowFlagsNEON;
+#else
+  return windowFlagsScalar;
+#endif
+}
+
+size_t SampleBatch::filterTransmitters(unsigned char physical_layer, const TransmitterID& tx_base,
+    const TransmitterID& tx_mask) {
+  static const TransmitterFlagsFn flags_fn = chooseTransmitterFlags();
+  keep.resize(phy.size());
+  const TransmitterID masked_base(tx_base.upper & tx_mask.upper, tx_base.lower & tx_mask.lower);
+  flags_fn(phy.data(), tx.data(), phy.size(), physical_layer, masked_base, tx_mask, keep.data());
+  return compact();
+}
+
+size_t SampleBatch::filterWindow(Timestamp begin, Timestamp end) {
+  static const WindowFlagsFn flags_fn = chooseWindowFlags();
+  keep.resize(phy.size());
+  flags_fn(time.data(), time.size(), begin, end, keep.data());
+  return compact();
+}
+
+namespace {
+  struct LinkKey {
+    unsigned char physical_layer;
+    TransmitterID tx_id;
+    ReceiverID rx_id;
+
+    bool operator==(const LinkKey& other) const {
+      return physical_layer == other.physical_layer and tx_id == other.tx_id and rx_id == other.rx_id;
+    }
+  };
+
+  struct LinkKeyHash {
+    size_t operator()(const LinkKey& key) const {
+      return mixHash64(hash128(key.tx_id) ^ (hash128(key.rx_id) * 0x9e3779b97f4a7c15ULL) ^
+          key.physical_layer);
+    }
+  };
+}
+
+std::vector<SampleBatch::LinkRSS> SampleBatch::averageRSS() const {
+  std::vector<LinkRSS> links;
+  //Sums are kept in double precision so long batches do not lose accuracy
+  std::vector<double> sums;
+  std::unordered_map<LinkKey, size_t, LinkKeyHash> positions;
+  //Samples from the same link tend to arrive together, as they do in a
+  //sample_batch message, so check the previous link before hashing.
+  LinkKey last{0, 0, 0};
+  size_t position = 0;
+  for (size_t i = 0; i < phy.size(); ++i) {
+    LinkKey key{phy[i], tx[i], rx[i]};
+    if (0 < i and key == last) {
+      sums[position] += rss[i];
+      ++links[position].count;
+      continue;
+    }
+    last = key;
+    auto found = positions.find(key);
+    if (found == positions.end()) {
+      position = links.size();
+      positions[key] = position;
+      links.push_back(LinkRSS{phy[i], tx[i], rx[i], 0.0, 0});
+      sums.push_back(0.0);
+    }
+    else {
+      position = found->second;
+    }
+    sums[position] += rss[i];
+    ++links[position].count;
+  }
+  for (size_t i = 0; i < links.size(); ++i) {
+    links[i].average = sums[i] / links[i].count;
+  }
+  return links;
+}
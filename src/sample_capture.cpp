@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file sample_capture.cpp
+ * Implementation of the CaptureWriter and CaptureReader classes.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "sample_capture.hpp"
+#include "sensor_aggregator_protocol.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace sensor_aggregator;
+
+const char sensor_aggregator::capture_magic[8] = {'O', 'W', 'L', 'S', 'C', 'A', 'P', '1'};
+
+static const size_t header_size = sizeof(capture_magic);
+
+//The rx_timestamp follows the length, physical layer, and two ids.
+static const size_t timestamp_offset = 4 + 1 + 16 + 16;
+
+static std::string errorString() {
+  return std::string(strerror(errno));
+}
+
+//Length of the whole frame starting at offset, or 0 if it is cut short.
+static size_t wholeFrame(const unsigned char* data, size_t size, size_t offset) {
+  if (size - offset < 4) {
+    return 0;
+  }
+  BuffView view(data + offset, 4);
+  size_t length = view.readPrimitive<uint32_t>() + size_t(4);
+  return size - offset < length ? 0 : length;
+}
+
+static bool readAll(int fd, unsigned char* buff, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t got = read(fd, buff + total, size - total);
+    if (got < 0 and EINTR == errno) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    total += got;
+  }
+  return true;
+}
+
+CaptureWriter::CaptureWriter(const std::string& path, size_t buffer_size) :
+  buffer_size(buffer_size), discarded(0) {
+  fd = open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (-1 == fd) {
+    throw std::runtime_error("Error opening capture file "+path+": "+errorString());
+  }
+  struct stat info;
+  if (-1 == fstat(fd, &info)) {
+    std::string err_str = errorString();
+    ::close(fd);
+    throw std::runtime_error("Error reading capture file "+path+": "+err_str);
+  }
+  size_t size = info.st_size;
+  if (0 == size) {
+    pending.assign(capture_magic, capture_magic + header_size);
+    return;
+  }
+  unsigned char header[header_size];
+  if (size < header_size or not readAll(fd, header, header_size) or
+      0 != memcmp(header, capture_magic, header_size)) {
+    ::close(fd);
+    throw std::runtime_error(path+" is not a capture file");
+  }
+  //Drop a frame left incomplete by an earlier writer so that new frames do
+  //not end up inside of it.
+  void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (MAP_FAILED == mapped) {
+    std::string err_str = errorString();
+    ::close(fd);
+    throw std::runtime_error("Error mapping capture file "+path+": "+err_str);
+  }
+  const unsigned char* data = (const unsigned char*)mapped;
+  size_t end = header_size;
+  for (size_t length = wholeFrame(data, size, end); 0 != length; length = wholeFrame(data, size, end)) {
+    end += length;
+  }
+  munmap(mapped, size);
+  if (end != size) {
+    discarded = size - end;
+    if (-1 == ftruncate(fd, end)) {
+      std::string err_str = errorString();
+      ::close(fd);
+      throw std::runtime_error("Error truncating capture file "+path+": "+err_str);
+    }
+  }
+}
+
+CaptureWriter::~CaptureWriter() {
+  try {
+    flush();
+  }
+  catch (std::runtime_error& err) {
+    std::cerr<<err.what()<<'\n';
+  }
+  ::close(fd);
+}
+
+bool CaptureWriter::append(const unsigned char* frame, size_t length) {
+  if (wholeFrame(frame, length, 0) != length) {
+    return false;
+  }
+  pending.insert(pending.end(), frame, frame + length);
+  if (buffer_size <= pending.size()) {
+    flush();
+  }
+  return true;
+}
+
+bool CaptureWriter::append(const std::vector<unsigned char>& frame) {
+  return append(frame.data(), frame.size());
+}
+
+void CaptureWriter::append(const SampleData& sample) {
+  makeSampleMsg(sample, pending);
+  if (buffer_size <= pending.size()) {
+    flush();
+  }
+}
+
+void CaptureWriter::flush() {
+  size_t total = 0;
+  while (total < pending.size()) {
+    ssize_t written = write(fd, pending.data() + total, pending.size() - total);
+    if (written < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      //Keep whatever was not written so a later flush can try again
+      pending.erase(pending.begin(), pending.begin() + total);
+      throw std::runtime_error("Error writing capture file: "+errorString());
+    }
+    total += written;
+  }
+  pending.clear();
+}
+
+size_t CaptureWriter::discardedBytes() const {
+  return discarded;
+}
+
+CaptureReader::CaptureReader(const std::string& path) : map(nullptr), map_size(0),
+  data_end(header_size), cursor(header_size), frames(0) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (-1 == fd) {
+    throw std::runtime_error("Error opening capture file "+path+": "+errorString());
+  }
+  struct stat info;
+  if (-1 == fstat(fd, &info)) {
+    std::string err_str = errorString();
+    ::close(fd);
+    throw std::runtime_error("Error reading capture file "+path+": "+err_str);
+  }
+  map_size = info.st_size;
+  if (map_size < header_size) {
+    ::close(fd);
+    throw std::runtime_error(path+" is not a capture file");
+  }
+  void* mapped = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  std::string err_str = errorString();
+  //The mapping stays valid after the descriptor is closed
+  ::close(fd);
+  if (MAP_FAILED == mapped) {
+    throw std::runtime_error("Error mapping capture file "+path+": "+err_str);
+  }
+  map = (const unsigned char*)mapped;
+  if (0 != memcmp(map, capture_magic, header_size)) {
+    munmap(mapped, map_size);
+    throw std::runtime_error(path+" is not a capture file");
+  }
+  //Replay reads straight through the file
+  madvise(mapped, map_size, MADV_SEQUENTIAL);
+
+  Timestamp max_time = 0;
+  for (size_t length = frameLength(data_end); 0 != length; length = frameLength(data_end)) {
+    Timestamp time = frameTimestamp(FrameView{map + data_end, length});
+    if (0 == frames or max_time < time) {
+      max_time = time;
+    }
+    if (0 == frames % index_interval) {
+      index.push_back(IndexEntry{max_time, data_end});
+    }
+    else {
+      index.back().max_time = max_time;
+    }
+    data_end += length;
+    ++frames;
+  }
+}
+
+CaptureReader::~CaptureReader() {
+  munmap((void*)map, map_size);
+}
+
+size_t CaptureReader::frameLength(size_t offset) const {
+  return wholeFrame(map, map_size, offset);
+}
+
+size_t CaptureReader::size() const {
+  return frames;
+}
+
+size_t CaptureReader::bytes() const {
+  return data_end - header_size;
+}
+
+bool CaptureReader::next(FrameView& frame) {
+  if (cursor >= data_end) {
+    return false;
+  }
+  //Every frame before data_end was checked when the index was built
+  size_t length = frameLength(cursor);
+  frame = FrameView{map + cursor, length};
+  cursor += length;
+  return true;
+}
+
+bool CaptureReader::nextSample(SampleData& sample) {
+  FrameView frame;
+  if (not next(frame)) {
+    return false;
+  }
+  sample = decodeSampleMsg(BuffView(frame));
+  return true;
+}
+
+bool CaptureReader::nextSample(ArenaSampleData& sample, Arena& arena) {
+  FrameView frame;
+  if (not next(frame)) {
+    return false;
+  }
+  sample = decodeSampleMsg(BuffView(frame), arena);
+  return true;
+}
+
+void CaptureReader::rewind() {
+  cursor = header_size;
+}
+
+bool CaptureReader::seek(Timestamp time) {
+  //Find the first block that holds a time at least this large
+  auto entry = std::lower_bound(index.begin(), index.end(), time,
+      [](const IndexEntry& entry, Timestamp time) { return entry.max_time < time; });
+  if (entry == index.end()) {
+    cursor = data_end;
+    return false;
+  }
+  cursor = entry->offset;
+  size_t end = entry + 1 == index.end() ? data_end : (entry + 1)->offset;
+  while (cursor < end) {
+    size_t length = frameLength(cursor);
+    if (time <= frameTimestamp(FrameView{map + cursor, length})) {
+      return true;
+    }
+    cursor += length;
+  }
+  //Not reached since the block's maximum is at least time
+  return cursor < data_end;
+}
+
+Timestamp CaptureReader::frameTimestamp(const FrameView& frame) {
+  if (frame.size < timestamp_offset + sizeof(Timestamp)) {
+    return 0;
+  }
+  BuffView view(frame.data + timestamp_offset, sizeof(Timestamp));
+  return view.readPrimitive<Timestamp>();
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file sample_coalescer.cpp
+ * Implementation of the SampleCoalescer class.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "sample_coalescer.hpp"
+
+using namespace aggregator_solver;
+
+bool SampleCoalescer::Key::operator==(const Key& other) const {
+  return subscriber == other.subscriber and physical_layer == other.physical_layer and
+    tx_id == other.tx_id and rx_id == other.rx_id;
+}
+
+size_t SampleCoalescer::KeyHash::operator()(const Key& key) const {
+  return mixHash64(hash128(key.tx_id) ^ (hash128(key.rx_id) * 0x9e3779b97f4a7c15ULL) ^
+      (key.subscriber * 0xc2b2ae3d27d4eb4fULL) ^ key.physical_layer);
+}
+
+SampleCoalescer::SampleCoalescer(Mode mode, uint64_t tick_msec, size_t slots) :
+  mode(mode), tick_msec(0 == tick_msec ? 1 : tick_msec), wheel(0 == slots ? 1 : slots),
+  current_tick(0) {
+}
+
+void SampleCoalescer::schedule(const Key& key, uint64_t deadline) {
+  uint64_t tick = (deadline + tick_msec - 1) / tick_msec;
+  //Anything already due is handled by the next call to advance
+  if (tick <= current_tick) {
+    tick = current_tick + 1;
+  }
+  wheel[tick % wheel.size()].push_back(key);
+}
+
+bool SampleCoalescer::offer(SubscriberID subscriber, uint64_t interval, const SampleData& sample, uint64_t now) {
+  if (0 == interval) {
+    return true;
+  }
+  //The first call starts the wheel at the current time
+  if (0 == current_tick) {
+    current_tick = now / tick_msec;
+  }
+  Key key{subscriber, sample.physical_layer, sample.tx_id, sample.rx_id};
+  auto state = states.find(key);
+  if (state == states.end()) {
+    //First sample for this key, forward it and start an interval.
+    State& fresh = states[key];
+    fresh.deadline = now + interval;
+    fresh.interval = interval;
+    fresh.seen = true;
+    fresh.has_pending = false;
+    schedule(key, fresh.deadline);
+    return true;
+  }
+  State& st = state->second;
+  st.interval = interval;
+  st.seen = true;
+  if (st.deadline <= now) {
+    //The interval ended but advance has not run yet. The key is still in
+    //the wheel and advance will move it to the new deadline.
+    st.deadline = now + interval;
+    st.has_pending = false;
+    return true;
+  }
+  if (keep_latest == mode) {
+    st.pending = sample;
+    st.has_pending = true;
+  }
+  return false;
+}
+
+bool SampleCoalescer::offer(const SubscriptionIndex::Match& match, const SampleData& sample, uint64_t now) {
+  return offer(match.subscriber, match.update_interval, sample, now);
+}
+
+void SampleCoalescer::advance(uint64_t now, const ForwardHandler& forward) {
+  uint64_t target = now / tick_msec;
+  if (0 == current_tick or target <= current_tick) {
+    return;
+  }
+  //Each slot only needs to be visited once, even after a long pause,
+  //because keys that are not due yet are put back.
+  uint64_t first = current_tick + 1;
+  if (target - current_tick > wheel.size()) {
+    first = target - wheel.size() + 1;
+  }
+  current_tick = target;
+  std::vector<Key> due;
+  for (uint64_t tick = first; tick <= target; ++tick) {
+    due.clear();
+    due.swap(wheel[tick % wheel.size()]);
+    for (const Key& key : due) {
+      auto state = states.find(key);
+      if (state == states.end()) {
+        continue;
+      }
+      State& st = state->second;
+      if (now < st.deadline) {
+        //Not due yet, either because the interval is longer than the wheel
+        //or because a new interval was started in offer.
+        schedule(key, st.deadline);
+      }
+      else if (st.has_pending) {
+        //Release the latest sample and start a new interval with it
+        st.has_pending = false;
+        st.seen = false;
+        st.deadline = now + st.interval;
+        schedule(key, st.deadline);
+        if (forward) {
+          forward(key.subscriber, st.pending);
+        }
+      }
+      else if (st.seen) {
+        //Samples arrived (and were dropped in forward_first mode) so the
+        //key is still busy. The deadline stays in the past so that the next
+        //sample is forwarded, and the key is checked again an interval later.
+        st.seen = false;
+        schedule(key, now + st.interval);
+      }
+      else {
+        //Nothing arrived since the last check so the key can be forgotten.
+        states.erase(state);
+      }
+    }
+  }
+}
+
+void SampleCoalescer::remove(SubscriberID subscriber) {
+  for (auto I = states.begin(); I != states.end();) {
+    if (I->first.subscriber == subscriber) {
+      I = states.erase(I);
+    }
+    else {
+      ++I;
+    }
+  }
+  //Also clear the wheel so that a key is never scheduled twice if the
+  //subscriber comes back.
+  for (std::vector<Key>& slot : wheel) {
+    size_t kept = 0;
+    for (size_t i = 0; i < slot.size(); ++i) {
+      if (slot[i].subscriber != subscriber) {
+        slot[kept++] = slot[i];
+      }
+    }
+    slot.resize(kept);
+  }
+}
+
+size_t SampleCoalescer::size() const {
+  return states.size();
+}
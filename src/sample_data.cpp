@@ -5,6 +5,8 @@
 #include "sys/time.h"
 #include "sample_data.hpp"
 
+#include <iomanip>
+
 //Get the time in milliseconds
 uint64_t msecTime() {
   //Set this to the real timestamp, milliseconds since 1970
@@ -14,63 +16,140 @@ uint64_t msecTime() {
   return (uint64_t)tval.tv_sec*(uint64_t)1000 + tval.tv_usec/1000;
 }
 
-bool operator==(const uint128_t& a, const uint128_t& b) {
-  return a.upper == b.upper and a.lower == b.lower;
+//Split a 128 bit value into 32 bit pieces, most significant first, so that
+//it can be divided and multiplied with 64 bit arithmetic.
+static void toLimbs(const uint128_t& val, uint32_t limbs[4]) {
+  limbs[0] = val.upper >> 32;
+  limbs[1] = (uint32_t)val.upper;
+  limbs[2] = val.lower >> 32;
+  limbs[3] = (uint32_t)val.lower;
+}
+
+static uint128_t fromLimbs(const uint32_t limbs[4]) {
+  return uint128_t(((uint64_t)limbs[0] << 32) | limbs[1], ((uint64_t)limbs[2] << 32) | limbs[3]);
+}
+
+//Set val to val * mul + add. Returns false if the result overflows.
+static bool mulAdd(uint128_t& val, uint32_t mul, uint32_t add) {
+  uint32_t limbs[4];
+  toLimbs(val, limbs);
+  uint64_t carry = add;
+  for (int i = 3; i >= 0; --i) {
+    uint64_t cur = (uint64_t)limbs[i] * mul + carry;
+    limbs[i] = (uint32_t)cur;
+    carry = cur >> 32;
+  }
+  val = fromLimbs(limbs);
+  return 0 == carry;
 }
 
 std::ostream& operator<<(std::ostream& os, const uint128_t& val) {
-  //The packed struct seems to have problems with the stream operators
-  //so pull out the upper and lower values into temporary variables before
-  //applying the << operator.
-  uint64_t upper = val.upper;
-  uint64_t lower = val.lower;
   //Save current format flags
   std::ios_base::fmtflags flags = os.flags();
-  return os<<"0x"<<std::hex<<upper<<lower<<std::dec;
+  char fill = os.fill();
+  os<<"0x"<<std::hex<<val.upper;
+  //The lower half needs its leading zeros if the upper half was printed
+  if (0 != val.upper) {
+    os<<std::setw(16)<<std::setfill('0');
+  }
+  os<<val.lower;
   //Reset format flags
   os.flags(flags);
-  //TODO FIXME This assumes that the number is actually only 64 bits long.
-  //return os<<lower<<std::dec;
-}
-
-//TODO FIXME This assumes that the input number is actually only 64 bits long.
-std::istream& operator>>(std::istream& is, uint128_t& val) {
-  //The packed nature of the structure seems to cause errors with the
-  //stream operator so make a temporary variable to read data into.
-  uint64_t newval;
-  is >> newval;
-  val.lower = newval;
-  return is;
-  //return is>>val.lower;
-}
-
-uint128_t operator&(const uint128_t& a, const uint128_t& b) {
-  uint128_t c;
-  c.upper = a.upper & b.upper;
-  c.lower = a.lower & b.lower;
-  return c;
-}
-
-bool operator<(const uint128_t& a, const uint128_t& b) {
-  return (a.upper < b.upper or (a.upper == b.upper and a.lower < b.lower));
+  os.fill(fill);
+  return os;
 }
 
-uint128_t::uint128_t(const uint128_t& val) {
-  this->upper = val.upper;
-  this->lower = val.lower;
+//Value of the digit character c, or 16 for anything that is not a digit
+static uint32_t digitValue(int c) {
+  if ('0' <= c and c <= '9') {
+    return c - '0';
+  }
+  else if ('a' <= c and c <= 'f') {
+    return c - 'a' + 10;
+  }
+  else if ('A' <= c and c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return 16;
 }
 
-uint128_t::uint128_t(uint64_t val) {
-  this->upper = 0;
-  this->lower = val;
+std::istream& operator>>(std::istream& is, uint128_t& val) {
+  //Skips leading whitespace unless skipws is off
+  std::istream::sentry sentry(is);
+  if (not sentry) {
+    return is;
+  }
+  //Read in the stream's base like the built in integers, or guess it from
+  //a 0 or 0x prefix if no base is set. A 0x prefix is also accepted for
+  //decimal so that the output of operator<< reads back.
+  std::ios_base::fmtflags basefield = is.flags() & std::ios_base::basefield;
+  //Read from the buffer like the built in extractors, since peeking at the
+  //end of the stream through the istream would set failbit
+  std::streambuf* buf = is.rdbuf();
+  uint32_t base = 10;
+  if (std::ios_base::hex == basefield) {
+    base = 16;
+  }
+  else if (std::ios_base::oct == basefield) {
+    base = 8;
+  }
+  bool digits = false;
+  if ('0' == buf->sgetc()) {
+    buf->sbumpc();
+    digits = true;
+    int next = buf->sgetc();
+    if (std::ios_base::oct != basefield and ('x' == next or 'X' == next)) {
+      buf->sbumpc();
+      base = 16;
+      //The prefix alone is not a number
+      digits = false;
+    }
+    else if (0 == basefield) {
+      base = 8;
+    }
+  }
+  //Stop at the first character that is not a digit, leaving it in the stream
+  uint128_t result(0);
+  bool overflow = false;
+  int c = buf->sgetc();
+  for (uint32_t digit = digitValue(c); digit < base; digit = digitValue(c)) {
+    digits = true;
+    overflow = overflow or not mulAdd(result, base, digit);
+    c = buf->snextc();
+  }
+  if (std::char_traits<char>::eof() == c) {
+    is.setstate(std::ios_base::eofbit);
+  }
+  if (digits and not overflow) {
+    val = result;
+  }
+  else {
+    is.setstate(std::ios_base::failbit);
+  }
+  return is;
 }
 
 std::string to_string(uint128_t val) {
-  return std::to_string(val.lower);
+  if (0 == val.upper) {
+    return std::to_string(val.lower);
+  }
+  //Long division by 10, producing the digits in reverse order
+  uint32_t limbs[4];
+  toLimbs(val, limbs);
+  std::string digits;
+  while (limbs[0] or limbs[1] or limbs[2] or limbs[3]) {
+    uint64_t remainder = 0;
+    for (int i = 0; i < 4; ++i) {
+      uint64_t cur = (remainder << 32) | limbs[i];
+      limbs[i] = cur / 10;
+      remainder = cur % 10;
+    }
+    digits.push_back('0' + remainder);
+  }
+  return std::string(digits.rbegin(), digits.rend());
 }
 
 std::u16string to_u16string(uint128_t val) {
   std::string str = to_string(val);
   return std::u16string(str.begin(), str.end());
 }
-
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file send_buffer.cpp
+ * Implementation of the SendBuffer class.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "send_buffer.hpp"
+
+#include <climits>
+#include <sys/uio.h>
+
+SendBuffer::SendBuffer(size_t high_water, size_t low_water, size_t limit) :
+  head_offset(0), bytes(0), high_water(high_water), low_water(low_water),
+  limit(limit), above_high(false) {
+}
+
+void SendBuffer::onHighWater(WatermarkHandler handler) {
+  high_handler = handler;
+}
+
+void SendBuffer::onLowWater(WatermarkHandler handler) {
+  low_handler = handler;
+}
+
+void SendBuffer::checkWatermarks() {
+  if (not above_high and high_water <= bytes) {
+    above_high = true;
+    if (high_handler) {
+      high_handler();
+    }
+  }
+  else if (above_high and bytes <= low_water) {
+    above_high = false;
+    if (low_handler) {
+      low_handler();
+    }
+  }
+}
+
+bool SendBuffer::write(ClientSocket& sock, std::vector<unsigned char> buff) {
+  if (0 < limit and limit < bytes + buff.size()) {
+    return false;
+  }
+  size_t sent = 0;
+  //Only send directly if nothing is waiting, otherwise the message would
+  //be sent ahead of earlier ones.
+  if (pending.empty()) {
+    iovec iov;
+    iov.iov_base = buff.data();
+    iov.iov_len = buff.size();
+    sent = sock.trySend(&iov, 1);
+    if (sent == buff.size()) {
+      return true;
+    }
+    head_offset = sent;
+  }
+  bytes += buff.size() - sent;
+  pending.push_back(std::move(buff));
+  checkWatermarks();
+  return true;
+}
+
+bool SendBuffer::flush(ClientSocket& sock) {
+  while (not pending.empty()) {
+    //Offer as many buffers as possible in one call
+    size_t count = pending.size() < IOV_MAX ? pending.size() : IOV_MAX;
+    std::vector<iovec> iovs(count);
+    size_t offered = 0;
+    for (size_t i = 0; i < count; ++i) {
+      size_t offset = 0 == i ? head_offset : 0;
+      iovs[i].iov_base = pending[i].data() + offset;
+      iovs[i].iov_len = pending[i].size() - offset;
+      offered += iovs[i].iov_len;
+    }
+    size_t sent = sock.trySend(iovs.data(), iovs.size());
+    bytes -= sent;
+    //Remove the buffers that were completely sent
+    size_t consumed = head_offset + sent;
+    while (not pending.empty() and pending.front().size() <= consumed) {
+      consumed -= pending.front().size();
+      pending.pop_front();
+    }
+    head_offset = consumed;
+    //Stop once the socket is full
+    if (sent < offered) {
+      break;
+    }
+  }
+  checkWatermarks();
+  return pending.empty();
+}
+
+size_t SendBuffer::size() const {
+  return bytes;
+}
+
+bool SendBuffer::empty() const {
+  return pending.empty();
+}
+
+bool SendBuffer::congested() const {
+  return above_high;
+}
+
+void SendBuffer::clear() {
+  pending.clear();
+  head_offset = 0;
+  bytes = 0;
+  above_high = false;
+}
@@ -1,4 +1,5 @@
 #include "sensor_aggregator_protocol.hpp"
+#include "metrics.hpp"
 #include "netbuffer.hpp"
 #include "sample_data.hpp"
 
@@ -6,47 +7,90 @@
 #include <algorithm>
 #include <string>
 
+static const std::string protocol_string = "GRAIL sensor protocol";
+
+size_t sensor_aggregator::handshakeMsgSize() {
+  return handshake::encodedSize(protocol_string);
+}
+
 std::vector<unsigned char> sensor_aggregator::makeHandshakeMsg() {
-  std::vector<unsigned char> buff(4);
-  std::string protocol_string = "GRAIL sensor protocol";
-  buff.insert(buff.end(), protocol_string.begin(), protocol_string.end());
-  //Version number and extension are both currently zero
-  buff.push_back(0);
-  buff.push_back(0);
-  //Insert the length of the protocol string into the buffer
-  pushBackVal<uint32_t>(protocol_string.length(), buff, 0);
-  return buff;
+  return makeHandshakeMsg(0);
 }
 
-std::vector<unsigned char> sensor_aggregator::makeSampleMsg(SampleData& sample) {
-  //Keep track of the total length of the message.
-  uint32_t total_length = 0;
+std::vector<unsigned char> sensor_aggregator::makeHandshakeMsg(handshake::Capabilities capabilities) {
+  //The version number is currently zero
+  return handshake::encode(protocol_string, 0, capabilities);
+}
 
-  std::vector<unsigned char> buff;
+handshake::Handshake sensor_aggregator::decodeHandshakeMsg(BuffView buff) {
+  return handshake::decode(buff, protocol_string);
+}
+
+//The size and encoding of a sample does not depend on its allocator
+template<typename Sample>
+static size_t sampleSize(const Sample& sample) {
+  //The length field followed by the sample
+  return sizeof(uint32_t) + sizeof(sample.physical_layer) +
+    sizeof(sample.tx_id) + sizeof(sample.rx_id) + sizeof(sample.rx_timestamp) +
+    sizeof(sample.rss) + sample.sense_data.size();
+}
+
+template<typename Sample>
+static size_t makeSample(const Sample& sample, std::vector<unsigned char>& out) {
+  OWL_METRIC_LATENCY(encode, sensor_aggregator, 0);
+  size_t size = sampleSize(sample);
+  BuffWriter writer = appendWriter(out, size);
 
   //Don't count the first four bytes (the message size field) in the total length.
-  buff.push_back(0);
-  buff.push_back(0);
-  buff.push_back(0);
-  buff.push_back(0);
-
-  total_length += pushBackVal(sample.physical_layer, buff);
-  total_length += pushBackVal(sample.tx_id, buff);
-  total_length += pushBackVal(sample.rx_id, buff);
-  total_length += pushBackVal(sample.rx_timestamp, buff);
-  total_length += pushBackVal(sample.rss, buff);
-  if (sample.sense_data.size() > 0) {
-    total_length += pushContainer(sample.sense_data, buff);
-  }
+  writer.writePrimitive<uint32_t>(size - sizeof(uint32_t));
+
+  writer.writePrimitive(sample.physical_layer);
+  writer.writePrimitive(sample.tx_id);
+  writer.writePrimitive(sample.rx_id);
+  writer.writePrimitive(sample.rx_timestamp);
+  writer.writePrimitive(sample.rss);
+  writer.writeBytes(sample.sense_data.data(), sample.sense_data.size());
+
+  return size;
+}
+
+size_t sensor_aggregator::sampleMsgSize(const SampleData& sample) {
+  return sampleSize(sample);
+}
+
+size_t sensor_aggregator::sampleMsgSize(const ArenaSampleData& sample) {
+  return sampleSize(sample);
+}
 
-  //Now go back and insert the message length.
-  pushBackVal<uint32_t>(total_length, buff, 0);
-  
+std::vector<unsigned char> sensor_aggregator::makeSampleMsg(SampleData& sample) {
+  std::vector<unsigned char> buff;
+  makeSample(sample, buff);
   return buff;
 }
 
+std::vector<unsigned char> sensor_aggregator::makeSampleMsg(const ArenaSampleData& sample) {
+  std::vector<unsigned char> buff;
+  makeSample(sample, buff);
+  return buff;
+}
+
+size_t sensor_aggregator::makeSampleMsg(const SampleData& sample, std::vector<unsigned char>& out) {
+  return makeSample(sample, out);
+}
+
+size_t sensor_aggregator::makeSampleMsg(const ArenaSampleData& sample, std::vector<unsigned char>& out) {
+  return makeSample(sample, out);
+}
+
 SampleData sensor_aggregator::decodeSampleMsg(std::vector<unsigned char>& buff, unsigned int length) {
-  SampleData sample;
+  return decodeSampleMsg(BuffView(buff.data(), std::min<size_t>(length, buff.size())));
+}
+
+//Decode into a sample whose sense data already has its allocator
+template<typename Sample>
+static void decodeSampleInto(BuffView& reader, Sample& sample) {
+  OWL_METRIC_LATENCY(decode, sensor_aggregator, 0);
+  size_t length = reader.size();
   //Assume that the sample is invalid until we manage to get data out of buff
   sample.valid = false;
 
@@ -54,9 +98,7 @@ SampleData sensor_aggregator::decodeSampleMsg(std::vector<unsigned char>& buff,
   //and the length is sane.
   if ( length > 4 ) {
 
-    //Make a new buffer reader for this message and put the data into the
-    //sample structure.
-    BuffReader reader(buff);
+    //Put the data from the message into the sample structure.
     uint32_t entire_length = reader.readPrimitive<uint32_t>();
     if (entire_length + 4 == length) {
       //Since we found data to read into the sample, mark it as valid.
@@ -66,12 +108,23 @@ SampleData sensor_aggregator::decodeSampleMsg(std::vector<unsigned char>& buff,
       sample.rx_id = reader.readPrimitive<decltype(sample.rx_id)>();
       sample.rx_timestamp = reader.readPrimitive<decltype(sample.rx_timestamp)>();
       sample.rss = reader.readPrimitive<decltype(sample.rss)>();
-      //Get the size of the sense data
-      unsigned int left = length - reader.cur_index;
-      sample.sense_data = std::vector<unsigned char>(left);
-      reader.readPrimitiveContainer(sample.sense_data);
+      //The sense data is everything left in the message
+      ByteSpan sense_data = reader.readRemaining();
+      sample.sense_data.assign(sense_data.begin(), sense_data.end());
+      sample.valid = not reader.outOfRange();
     }
   }
+}
+
+SampleData sensor_aggregator::decodeSampleMsg(BuffView reader) {
+  SampleData sample;
+  decodeSampleInto(reader, sample);
+  return sample;
+}
 
+ArenaSampleData sensor_aggregator::decodeSampleMsg(BuffView reader, Arena& arena) {
+  ArenaSampleData sample;
+  sample.sense_data = decltype(sample.sense_data)(ArenaAllocator<unsigned char>(arena));
+  decodeSampleInto(reader, sample);
   return sample;
 }
@@ -14,8 +14,13 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <climits>
 
 #include "simple_sockets.hpp"
+#include "metrics.hpp"
 #include "temporarily_unavailable.hpp"
 
 //Ignore broken pipe errors so that we can just check the return code of write
@@ -26,19 +31,58 @@ void socketCleanup(int& sock_fd) {
   if (sock_fd >= 0) {
     //Shut down sending and receiving on this socket
     shutdown(sock_fd, SHUT_RDWR);
-    //Block until read returns 0 or the socket locks up
+    //Discard unread data until read returns 0, the socket would block, or
+    //any other error occurs.
     char buff[100];
-    //TODO FIXME Not actually blocking here
-    while (0 != read(sock_fd, buff, sizeof(buff)) and
-           EWOULDBLOCK != errno);
-    //TODO FIXME Should check error codes here
+    ssize_t result;
+    do {
+      result = read(sock_fd, buff, sizeof(buff));
+    } while (0 < result or (-1 == result and EINTR == errno));
     close(sock_fd);
     sock_fd = -1;
   }
 }
 
+//Largest record sent on a packet socket. Larger sends are split into several
+//records, which the receiver joins again through the length prefix of each
+//message, and receives are always given at least this much space.
+static const size_t max_record = 65536;
+
+Endpoint Endpoint::parse(const std::string& endpoint) {
+  Endpoint result{tcp, "", 0, "", false};
+  if (0 == endpoint.compare(0, 11, "unixpacket:")) {
+    result.transport = unix_packet;
+    result.path = endpoint.substr(11);
+    result.valid = not result.path.empty();
+    return result;
+  }
+  if (0 == endpoint.compare(0, 5, "unix:")) {
+    result.transport = unix_stream;
+    result.path = endpoint.substr(5);
+    result.valid = not result.path.empty();
+    return result;
+  }
+  std::string address = endpoint;
+  if (0 == address.compare(0, 4, "tcp:")) {
+    address = address.substr(4);
+  }
+  size_t colon = address.find(':');
+  if (std::string::npos == colon or std::string::npos != address.find(':', colon + 1)) {
+    return result;
+  }
+  result.host = address.substr(0, colon);
+  std::string port = address.substr(colon + 1);
+  if (port.empty() or 5 < port.size() or
+      std::string::npos != port.find_first_not_of("0123456789")) {
+    return result;
+  }
+  result.port = std::stoul(port);
+  result.valid = result.port <= 65535;
+  return result;
+}
+
 ClientSocket::ClientSocket(int domain, int type, int protocol, uint32_t port, const std::string& ip_address, int sock_flags) :
-  _port(port), _ip_address(ip_address) {
+  _port(port), _ip_address(ip_address), queued_bytes(0), _capabilities(0), _packet(false) {
   //Set up an interrupt handler to ignore broken pipes.
   signal(SIGPIPE, SIG_IGN);
   sock_fd = socket(domain, type | sock_flags, protocol);
@@ -119,8 +163,51 @@ ClientSocket::ClientSocket(int domain, int type, int protocol, uint32_t port, co
   }
 }
 
-ClientSocket::ClientSocket(uint32_t port, const std::string& ip_address, int sock) :
-  _port(port), _ip_address(ip_address), sock_fd(sock) {
+ClientSocket::ClientSocket(const std::string& endpoint, int sock_flags) :
+  _port(0), _ip_address(endpoint), sock_fd(-1), queued_bytes(0), _capabilities(0), _packet(false) {
+  Endpoint ep = Endpoint::parse(endpoint);
+  if (not ep.valid) {
+    std::cerr<<"Invalid endpoint "<<endpoint<<'\n';
+  }
+  else if (Endpoint::tcp == ep.transport) {
+    *this = ClientSocket(AF_INET, SOCK_STREAM, 0, ep.port, ep.host, sock_flags);
+  }
+  else {
+    connectUnix(ep.path, Endpoint::unix_packet == ep.transport ? SOCK_SEQPACKET : SOCK_STREAM, sock_flags);
+  }
+}
+
+void ClientSocket::connectUnix(const std::string& path, int type, int sock_flags) {
+  //Set up an interrupt handler to ignore broken pipes.
+  signal(SIGPIPE, SIG_IGN);
+  _ip_address = path;
+  _packet = SOCK_SEQPACKET == type;
+  sockaddr_un s_addr;
+  memset(&s_addr, 0, sizeof(s_addr));
+  s_addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(s_addr.sun_path)) {
+    std::cerr<<"Unix socket path is too long: "<<path<<'\n';
+    return;
+  }
+  memcpy(s_addr.sun_path, path.c_str(), path.size() + 1);
+  sock_fd = socket(AF_UNIX, type | sock_flags, 0);
+  if (-1 == sock_fd) {
+    std::string err_str(strerror(errno));
+    std::cerr<<"Error making socket: "<<err_str<<'\n';
+    return;
+  }
+  //Unix domain sockets connect right away, even when nonblocking, unless
+  //the listener's backlog is full.
+  if (-1 == connect(sock_fd, (sockaddr*)&s_addr, sizeof(s_addr))) {
+    std::string err_str(strerror(errno));
+    std::cerr<<"Error connecting to "<<path<<": "<<err_str<<'\n';
+    close(sock_fd);
+    sock_fd = -1;
+  }
+}
+
+ClientSocket::ClientSocket(uint32_t port, const std::string& ip_address, int sock, bool packet) :
+  _port(port), _ip_address(ip_address), sock_fd(sock), queued_bytes(0), _capabilities(0), _packet(packet) {
   //Set up an interrupt handler to ignore broken pipes.
   signal(SIGPIPE, SIG_IGN);
 }
@@ -154,41 +241,191 @@ bool ClientSocket::inputReady(int msec_timeout) {
 }
 
 ssize_t ClientSocket::receive(std::vector<unsigned char>& buff) {
-  //std::array or std::val_array might be more efficient here
-  ssize_t bytes_read = read(sock_fd, buff.data(), buff.size());
+  return receive(buff.data(), buff.size());
+}
+
+size_t ClientSocket::receiveSize() const {
+  return _packet ? max_record : 1;
+}
+
+bool ClientSocket::packet() const {
+  return _packet;
+}
+
+ssize_t ClientSocket::receive(unsigned char* buff, size_t size) {
+  ssize_t bytes_read = recv(sock_fd, buff, size, 0);
+  OWL_METRIC_ADD(receive_calls, 1);
+  if (0 < bytes_read) {
+    OWL_METRIC_ADD(bytes_in, bytes_read);
+  }
   return bytes_read;
 }
 
-void ClientSocket::send(const std::vector<unsigned char>& buff) {
-  uint64_t written = 0;
-  std::string arr(buff.begin(), buff.end());
-  while (written < arr.length()) {
-    //Wait for the socket to become ready (we will block on sends for 1 second)
-    pollfd fds;
-    fds.fd = sock_fd;
-    fds.events = POLLOUT;
-    poll(&fds, 1, 1000);
-    if ( (fds.revents & POLLOUT) != POLLOUT) {
-      throw temporarily_unavailable();
+//Flush the outgoing queue once this many bytes are waiting
+static const size_t max_queued = 65536;
+
+//Close the socket and throw an exception describing the current errno
+static void throwSendError(int& sock_fd) {
+  std::string err_str(strerror(errno));
+  if (err_str == "Broken pipe") {
+    err_str = "Connection closed by receiver (broken pipe)";
+  }
+  err_str = "Error sending data over socket: " + err_str;
+  //Clean up the socket (close connection and file descriptor)
+  socketCleanup(sock_fd);
+  throw std::runtime_error(err_str);
+}
+
+//Each sendmsg on a packet socket is one record, which is sent entirely or
+//not at all. Fill record with up to max_record bytes from the buffers,
+//skipping empty ones since an empty record reads like a closed connection.
+static void packetRecord(const struct iovec* iov, size_t count, std::vector<iovec>& record) {
+  record.clear();
+  size_t total = 0;
+  for (size_t i = 0; i < count and total < max_record and record.size() < IOV_MAX; ++i) {
+    if (0 < iov[i].iov_len) {
+      record.push_back(iov[i]);
+      size_t room = max_record - total;
+      if (room < record.back().iov_len) {
+        record.back().iov_len = room;
+      }
+      total += record.back().iov_len;
     }
+  }
+}
 
-    //Send the previously unsent portions of the message.
-    int result = ::send(sock_fd, arr.c_str()+written, arr.length() - written, MSG_NOSIGNAL);
+void ClientSocket::sendAll(struct iovec* iov, size_t count) {
+  std::vector<iovec> record;
+  while (0 < count) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count < IOV_MAX ? count : IOV_MAX;
+    if (_packet) {
+      packetRecord(iov, count, record);
+      if (record.empty()) {
+        return;
+      }
+      msg.msg_iov = record.data();
+      msg.msg_iovlen = record.size();
+    }
+    //Send the previously unsent portions of the message. Blocking sockets
+    //are also sent to without blocking so that a full socket times out
+    //after one second instead of waiting forever in the kernel.
+    ssize_t result = sendmsg(sock_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    OWL_METRIC_ADD(send_calls, 1);
     if (-1 == result) {
-      std::string err_str(strerror(errno));
-      if (err_str == "Broken pipe") {
-        err_str = "Connection closed by receiver (broken pipe)";
+      if (EAGAIN == errno or EWOULDBLOCK == errno) {
+        //Wait for the socket to become ready (we will block on sends for 1 second)
+        pollfd fds;
+        fds.fd = sock_fd;
+        fds.events = POLLOUT;
+        {
+          OWL_METRIC_TIME(send_blocked_usec);
+          poll(&fds, 1, 1000);
+        }
+        if ( (fds.revents & POLLOUT) != POLLOUT) {
+          OWL_METRIC_ADD(send_unavailable, 1);
+          throw temporarily_unavailable();
+        }
+        continue;
       }
-      err_str = "Error sending data over socket: " + err_str;
-      //Clean up the socket (close connection and file descriptor)
-      socketCleanup(sock_fd);
-      throw std::runtime_error(err_str);
+      else if (EINTR == errno) {
+        continue;
+      }
+      throwSendError(sock_fd);
     }
-    else {
-      written += result;
+    OWL_METRIC_ADD(bytes_out, result);
+    //Skip past the buffers that were completely sent and move the start of
+    //a partially sent buffer forward.
+    size_t sent = result;
+    while (0 < count and iov->iov_len <= sent) {
+      sent -= iov->iov_len;
+      ++iov;
+      --count;
     }
+    if (0 < count) {
+      iov->iov_base = (char*)iov->iov_base + sent;
+      iov->iov_len -= sent;
+    }
+  }
+}
+
+size_t ClientSocket::trySend(const struct iovec* iov, size_t count) {
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = (iovec*)iov;
+  msg.msg_iovlen = count < IOV_MAX ? count : IOV_MAX;
+  std::vector<iovec> record;
+  if (_packet) {
+    packetRecord(iov, count, record);
+    if (record.empty()) {
+      return 0;
+    }
+    msg.msg_iov = record.data();
+    msg.msg_iovlen = record.size();
+  }
+  while (true) {
+    ssize_t result = sendmsg(sock_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    OWL_METRIC_ADD(send_calls, 1);
+    if (0 <= result) {
+      OWL_METRIC_ADD(bytes_out, result);
+      return result;
+    }
+    else if (EAGAIN == errno or EWOULDBLOCK == errno) {
+      return 0;
+    }
+    else if (EINTR != errno) {
+      throwSendError(sock_fd);
+    }
+  }
+}
+
+void ClientSocket::send(const std::vector<unsigned char>& buff) {
+  send(buff.data(), buff.size());
+}
+
+void ClientSocket::send(const unsigned char* data, size_t length) {
+  iovec iov;
+  iov.iov_base = (void*)data;
+  iov.iov_len = length;
+  OWL_METRIC_ADD(frames_out, 1);
+  sendAll(&iov, 1);
+}
+
+void ClientSocket::send(const std::vector<std::vector<unsigned char>>& buffs) {
+  std::vector<iovec> iovs(buffs.size());
+  for (size_t i = 0; i < buffs.size(); ++i) {
+    iovs[i].iov_base = (void*)buffs[i].data();
+    iovs[i].iov_len = buffs[i].size();
+  }
+  OWL_METRIC_ADD(frames_out, buffs.size());
+  sendAll(iovs.data(), iovs.size());
+}
+
+void ClientSocket::queue(std::vector<unsigned char>&& buff) {
+  queued_bytes += buff.size();
+  send_queue.push_back(std::move(buff));
+  if (max_queued <= queued_bytes) {
+    flush();
+  }
+}
+
+void ClientSocket::queue(const std::vector<unsigned char>& buff) {
+  queue(std::vector<unsigned char>(buff));
+}
+
+size_t ClientSocket::queued() const {
+  return queued_bytes;
+}
+
+void ClientSocket::flush() {
+  std::vector<std::vector<unsigned char>> to_send;
+  to_send.swap(send_queue);
+  queued_bytes = 0;
+  if (not to_send.empty()) {
+    send(to_send);
   }
-  return;
 }
 
 //Evalute to true if socket is open, false otherwise
@@ -203,31 +440,32 @@ ClientSocket::~ClientSocket() {
 
 ClientSocket& ClientSocket::operator=(ClientSocket&& other) {
   //Close the existing socket if we are assigning over it
-  if (sock_fd >= 0) {
-    //Shut down sending and receiving on this socket
-    shutdown(sock_fd, SHUT_RDWR);
-    //Block until read returns 0 or the socket locks up
-    char buff[100];
-    while (0 != read(sock_fd, buff, sizeof(buff)) and
-           EWOULDBLOCK != errno);
-    close(sock_fd);
-    sock_fd = -1;
-  }
+  socketCleanup(sock_fd);
   _port = other._port;
   _ip_address = other._ip_address;
   sock_fd = other.sock_fd;
   other.sock_fd = -1;
+  send_queue = std::move(other.send_queue);
+  queued_bytes = other.queued_bytes;
+  _capabilities = other._capabilities;
+  _packet = other._packet;
+  other.send_queue.clear();
+  other.queued_bytes = 0;
   return *this;
 }
 
 /**
  * Allow copy from an rvalue as with the assignment operator.
  */
-ClientSocket::ClientSocket(ClientSocket&& other) {
+ClientSocket::ClientSocket(ClientSocket&& other) :
+  send_queue(std::move(other.send_queue)), queued_bytes(other.queued_bytes),
+  _capabilities(other._capabilities), _packet(other._packet) {
   _port = other._port;
   _ip_address = other._ip_address;
   sock_fd = other.sock_fd;
   other.sock_fd = -1;
+  other.send_queue.clear();
+  other.queued_bytes = 0;
 }
 
 uint32_t ClientSocket::port() {
@@ -238,21 +476,94 @@ std::string ClientSocket::ip_address() {
   return _ip_address;
 }
 
+int ClientSocket::fd() const {
+  return sock_fd;
+}
+
+void ClientSocket::setCapabilities(handshake::Capabilities capabilities) {
+  _capabilities = capabilities;
+}
+
+handshake::Capabilities ClientSocket::capabilities() const {
+  return _capabilities;
+}
+
+bool ClientSocket::hasCapability(handshake::Capability capability) const {
+  return capability == (_capabilities & capability);
+}
+
 //Close the connection in the destructor
 ServerSocket::~ServerSocket() {
   if (sock_fd >= 0) {
-    //Shut down sending and receiving on this socket
-    shutdown(sock_fd, SHUT_RDWR);
-    //Block until read returns 0 or the socket locks up
-    char buff[100];
-    while (0 != read(sock_fd, buff, sizeof(buff)) and
-           EWOULDBLOCK != errno);
+    //A listening socket has no data to drain (read would only fail with
+    //ENOTCONN) so it is simply closed.
+    close(sock_fd);
+    sock_fd = -1;
+  }
+  if (not _path.empty()) {
+    unlink(_path.c_str());
+  }
+}
+
+ServerSocket::ServerSocket(int domain, int type, int sock_flags, uint32_t port, bool reuse_port) :
+  _port(port), sock_fd(-1), _packet(false) {
+  listenTCP(domain, type, sock_flags, reuse_port);
+}
+
+ServerSocket::ServerSocket(const std::string& endpoint, int sock_flags, bool reuse_port) :
+  _port(0), sock_fd(-1), _packet(false) {
+  Endpoint ep = Endpoint::parse(endpoint);
+  if (not ep.valid) {
+    std::cerr<<"Invalid endpoint "<<endpoint<<'\n';
+  }
+  else if (Endpoint::tcp == ep.transport) {
+    _port = ep.port;
+    listenTCP(AF_INET, SOCK_STREAM, sock_flags, reuse_port);
+  }
+  else {
+    listenUnix(ep.path, Endpoint::unix_packet == ep.transport ? SOCK_SEQPACKET : SOCK_STREAM, sock_flags);
+  }
+}
+
+void ServerSocket::listenUnix(const std::string& path, int type, int sock_flags) {
+  //Set up an interrupt handler to ignore broken pipes.
+  signal(SIGPIPE, SIG_IGN);
+  _packet = SOCK_SEQPACKET == type;
+  sockaddr_un s_addr;
+  memset(&s_addr, 0, sizeof(s_addr));
+  s_addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(s_addr.sun_path)) {
+    std::cerr<<"Unix socket path is too long: "<<path<<'\n';
+    return;
+  }
+  memcpy(s_addr.sun_path, path.c_str(), path.size() + 1);
+  //A socket file left behind by a server that did not shut down cleanly
+  //would make bind fail. Other kinds of files are left alone.
+  struct stat info;
+  if (0 == lstat(path.c_str(), &info) and S_ISSOCK(info.st_mode)) {
+    unlink(path.c_str());
+  }
+  sock_fd = socket(AF_UNIX, type | sock_flags, 0);
+  if (-1 == sock_fd) {
+    std::cerr<<"Error making socket: "<<strerror(errno)<<'\n';
+    return;
+  }
+  if (-1 == bind(sock_fd, (sockaddr*)&s_addr, sizeof(s_addr))) {
+    std::cerr<<"Error binding to "<<path<<": "<<strerror(errno)<<'\n';
+    close(sock_fd);
+    sock_fd = -1;
+    return;
+  }
+  _path = path;
+  if (-1 == listen(sock_fd, SOMAXCONN)) {
+    std::string err_str(strerror(errno));
+    std::cerr<<"Error listening: "<<err_str<<'\n';
     close(sock_fd);
     sock_fd = -1;
   }
 }
 
-ServerSocket::ServerSocket(int domain, int type, int sock_flags, uint32_t port) : _port(port) {
+void ServerSocket::listenTCP(int domain, int type, int sock_flags, bool reuse_port) {
   //Set up an interrupt handler to ignore broken pipes.
   signal(SIGPIPE, SIG_IGN);
   sockaddr_in s_addr;
@@ -279,6 +590,14 @@ ServerSocket::ServerSocket(int domain, int type, int sock_flags, uint32_t port)
         //Make the socket ignore address in use errors.
         //int opt = 1;
         //setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, (const void*)&opt, sizeof(opt));
+        if (0 <= sock_fd and reuse_port) {
+          //Let several sockets listen on this port. The kernel spreads
+          //new connections across them.
+          int opt = 1;
+          if (-1 == setsockopt(sock_fd, SOL_SOCKET, SO_REUSEPORT, (const void*)&opt, sizeof(opt))) {
+            std::cerr<<"Error setting SO_REUSEPORT: "<<strerror(errno)<<'\n';
+          }
+        }
         if (0 <= sock_fd) {
           //Now try to bind with the socket.
           int succ = bind(sock_fd, addr->ai_addr, addr->ai_addrlen);
@@ -308,7 +627,9 @@ ServerSocket::ServerSocket(int domain, int type, int sock_flags, uint32_t port)
     }
   }
   if (sock_fd >= 0) {
-    int result = listen(sock_fd, 10);
+    //Use the largest backlog allowed so that bursts of new connections are
+    //not refused before they can be accepted.
+    int result = listen(sock_fd, SOMAXCONN);
     if (-1 == result) {
       std::string err_str(strerror(errno));
       std::cerr<<"Error listening: "<<err_str<<'\n';
@@ -319,10 +640,6 @@ ServerSocket::ServerSocket(int domain, int type, int sock_flags, uint32_t port)
 }
 
 ClientSocket ServerSocket::next(int flags) {
-  struct sockaddr_storage peer_addr;
-  socklen_t peer_addr_size = sizeof(sockaddr_storage);
-  memset(&peer_addr, 0, sizeof(peer_addr));
-
   //Poll the socket to see if a new connection has arrived
   //Wait until data is ready
   pollfd ufd;
@@ -332,35 +649,54 @@ ClientSocket ServerSocket::next(int flags) {
   int result = poll(&ufd, 1, 10);
   //Accept a new socket is an input event is polled
   if (result == 1 and (ufd.revents & (POLLERR | POLLHUP | POLLNVAL)) == 0) {
-    int in_sock = accept4(sock_fd, (struct sockaddr*)&peer_addr, &peer_addr_size, flags);
+    ClientSocket sock = accept(flags);
+    if (sock) {
+      std::cerr<<"Found ip address "<<sock.ip_address()<<'\n';
+    }
+    return sock;
+  }
+  else {
+    //Return an invalid socket
+    return ClientSocket(_port, "", -1);
+  }
+}
 
-    std::string ip = "";
+ClientSocket ServerSocket::accept(int flags) {
+  struct sockaddr_storage peer_addr;
+  socklen_t peer_addr_size = sizeof(sockaddr_storage);
+  memset(&peer_addr, 0, sizeof(peer_addr));
 
-    if (0 <= in_sock) {
-      //Get the ip address of this new connection
-      char addr_buf[1000] = {0};
-      int err = getnameinfo((struct sockaddr*)&peer_addr, peer_addr_size,
-          addr_buf, sizeof(addr_buf) - 1, NULL, 0, NI_NUMERICHOST);
-      if (err != 0) {
-        std::cerr<<"Error getting client address: "<<gai_strerror(errno)<<'\n';
-      }
+  int in_sock = accept4(sock_fd, (struct sockaddr*)&peer_addr, &peer_addr_size, flags);
 
-      ip = std::string(addr_buf);
-      std::cerr<<"Found ip address "<<addr_buf<<'\n';
-    }
-    //Don't print an error if the socket is simply non-blocking
-    else if (errno != EAGAIN and errno != EWOULDBLOCK) {
-      std::cerr<<"Socket failure: "<<strerror(errno)<<"\n";
+  std::string ip = "";
+
+  if (0 <= in_sock and AF_UNIX == peer_addr.ss_family) {
+    //Unix domain peers are usually unnamed so use the listening path
+    ip = _path;
+  }
+  else if (0 <= in_sock) {
+    //Get the ip address of this new connection
+    char addr_buf[1000] = {0};
+    int err = getnameinfo((struct sockaddr*)&peer_addr, peer_addr_size,
+        addr_buf, sizeof(addr_buf) - 1, NULL, 0, NI_NUMERICHOST);
+    if (err != 0) {
+      std::cerr<<"Error getting client address: "<<gai_strerror(errno)<<'\n';
     }
 
-    //Control of the socket is handed over to the ClientSocket class.
-    //The socket may be invalid if no new connection was available
-    return ClientSocket(_port, ip, in_sock);
+    ip = std::string(addr_buf);
   }
-  else {
-    //Return an invalid socket
-    return ClientSocket(_port, "", -1);
+  //Don't print an error if the socket is simply non-blocking
+  else if (errno != EAGAIN and errno != EWOULDBLOCK) {
+    std::cerr<<"Socket failure: "<<strerror(errno)<<"\n";
   }
+
+  //Control of the socket is handed over to the ClientSocket class.
+  //The socket may be invalid if no new connection was available
+  return ClientSocket(_port, ip, in_sock, _packet);
+}
+
+int ServerSocket::fd() const {
+  return sock_fd;
 }
 
 ServerSocket::operator bool() const {
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file stream_decoder.cpp
+ * Implementation of the StreamDecoder class.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "stream_decoder.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+using namespace world_model;
+
+//Bytes to receive at once in receive
+static const size_t receive_size = 65536;
+
+//The length field and message type
+static const size_t frame_header = sizeof(uint32_t) + 1;
+
+StreamDecoder::StreamDecoder(Source source) : source(source), state(frame_start),
+  msg_type(0), frame_left(0), head(0), tail(0) {
+}
+
+void StreamDecoder::onMessage(MessageHandler handler) {
+  message_handler = handler;
+}
+
+void StreamDecoder::onURI(URIHandler handler) {
+  uri_handler = handler;
+}
+
+void StreamDecoder::onDataStart(DataStartHandler handler) {
+  data_start_handler = handler;
+}
+
+void StreamDecoder::onAttribute(AttributeHandler handler) {
+  attribute_handler = handler;
+}
+
+void StreamDecoder::onSolutionStart(SolutionStartHandler handler) {
+  solution_start_handler = handler;
+}
+
+void StreamDecoder::onSolution(SolutionHandler handler) {
+  solution_handler = handler;
+}
+
+void StreamDecoder::onEnd(EndHandler handler) {
+  end_handler = handler;
+}
+
+bool StreamDecoder::streamed(uint8_t type) const {
+  if (from_world_model == source) {
+    return uint8_t(client::MessageID::uri_response) == type or
+      uint8_t(client::MessageID::data_response) == type;
+  }
+  return uint8_t(solver::MessageID::solver_data) == type;
+}
+
+bool StreamDecoder::decodeHeader(BuffView& view) {
+  if (uint8_t(client::MessageID::data_response) == msg_type and from_world_model == source) {
+    view.readSizedUTF16(uri);
+    uint32_t ticket = view.readPrimitive<uint32_t>();
+    uint32_t num_attributes = view.readPrimitive<uint32_t>();
+    if (view.outOfRange()) {
+      return false;
+    }
+    if (data_start_handler) {
+      data_start_handler(uri, ticket, num_attributes);
+    }
+  }
+  else if (from_solver == source) {
+    bool create_uris = view.readPrimitive<uint8_t>() == 1;
+    uint32_t num_solutions = view.readPrimitive<uint32_t>();
+    if (view.outOfRange()) {
+      return false;
+    }
+    if (solution_start_handler) {
+      solution_start_handler(create_uris, num_solutions);
+    }
+  }
+  //URI search responses have no header
+  return true;
+}
+
+bool StreamDecoder::decodeElement(BuffView& view) {
+  if (from_solver == source) {
+    solution.type_alias = view.readPrimitive<uint32_t>();
+    solution.time = view.readPrimitive<grail_time>();
+    view.readSizedUTF16(solution.target);
+    ByteSpan data = view.readSizedSpan();
+    if (view.outOfRange()) {
+      return false;
+    }
+    solution.data.assign(data.begin(), data.end());
+    if (solution_handler) {
+      solution_handler(solution);
+    }
+  }
+  else if (uint8_t(client::MessageID::uri_response) == msg_type) {
+    view.readSizedUTF16(uri);
+    if (view.outOfRange()) {
+      return false;
+    }
+    if (uri_handler) {
+      uri_handler(uri);
+    }
+  }
+  else {
+    attribute.name_alias = view.readPrimitive<uint32_t>();
+    attribute.creation_date = view.readPrimitive<grail_time>();
+    attribute.expiration_date = view.readPrimitive<grail_time>();
+    attribute.origin_alias = view.readPrimitive<uint32_t>();
+    ByteSpan data = view.readSizedSpan();
+    if (view.outOfRange()) {
+      return false;
+    }
+    attribute.data.assign(data.begin(), data.end());
+    if (attribute_handler) {
+      attribute_handler(attribute);
+    }
+  }
+  return true;
+}
+
+bool StreamDecoder::process() {
+  bool well_formed = true;
+  while (true) {
+    size_t available = tail - head;
+    if (frame_start == state) {
+      if (available < sizeof(uint32_t)) {
+        break;
+      }
+      size_t length = loadNetworkValue<uint32_t>(buffer.data() + head);
+      uint8_t type = available > sizeof(uint32_t) ? buffer[head + sizeof(uint32_t)] : 0;
+      if (0 < length and available >= frame_header and streamed(type)) {
+        msg_type = type;
+        frame_left = length - 1;
+        head += frame_header;
+        state = message_header;
+      }
+      else if (available - sizeof(uint32_t) >= length) {
+        //Everything else is handed out whole
+        if (message_handler) {
+          message_handler(FrameView{buffer.data() + head, length + sizeof(uint32_t)});
+        }
+        head += length + sizeof(uint32_t);
+      }
+      else {
+        break;
+      }
+    }
+    else if (skipping == state) {
+      size_t skip = available < frame_left ? available : frame_left;
+      head += skip;
+      frame_left -= skip;
+      if (0 < frame_left) {
+        break;
+      }
+      state = frame_start;
+    }
+    else if (elements == state and 0 == frame_left) {
+      state = frame_start;
+      if (end_handler) {
+        end_handler(msg_type);
+      }
+    }
+    else {
+      //Elements never extend past the end of their frame
+      BuffView view(buffer.data() + head, available < frame_left ? available : frame_left);
+      bool decoded = message_header == state ? decodeHeader(view) : decodeElement(view);
+      if (decoded) {
+        head += view.cur_index;
+        frame_left -= view.cur_index;
+        state = elements;
+      }
+      else if (available >= frame_left) {
+        //The whole rest of the frame is here and it still did not decode
+        well_formed = false;
+        state = skipping;
+      }
+      else {
+        break;
+      }
+    }
+  }
+  //Move the unfinished element to the front of the buffer
+  if (head == tail) {
+    head = 0;
+    tail = 0;
+  }
+  else if (head > tail / 2) {
+    std::memmove(buffer.data(), buffer.data() + head, tail - head);
+    tail -= head;
+    head = 0;
+  }
+  return well_formed;
+}
+
+void StreamDecoder::makeRoom(size_t length) {
+  if (buffer.size() - tail < length) {
+    buffer.resize(tail + length);
+  }
+}
+
+bool StreamDecoder::feed(const unsigned char* data, size_t length) {
+  makeRoom(length);
+  std::memcpy(buffer.data() + tail, data, length);
+  tail += length;
+  return process();
+}
+
+StreamDecoder::Received StreamDecoder::receive(ClientSocket& sock) {
+  makeRoom(receive_size);
+  ssize_t length = sock.receive(buffer.data() + tail, receive_size);
+  if (-1 == length) {
+    if (EAGAIN == errno or EWOULDBLOCK == errno) {
+      return nothing;
+    }
+    std::string err_str(strerror(errno));
+    throw std::runtime_error("Error receiving message or the connection was closed: "+err_str);
+  }
+  else if (0 == length) {
+    throw std::runtime_error("Connection was closed.");
+  }
+  tail += length;
+  return process() ? decoded : skipped_malformed;
+}
+
+size_t StreamDecoder::buffered() const {
+  return tail - head;
+}
+
+void StreamDecoder::reset() {
+  head = 0;
+  tail = 0;
+  state = frame_start;
+  frame_left = 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file string_interner.cpp
+ * Implementation of the StringInterner class.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "string_interner.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+bool StringInterner::Key::operator==(const Key& other) const {
+  return size == other.size and std::equal(data, data + size, other.data);
+}
+
+size_t StringInterner::KeyHash::operator()(const Key& key) const {
+  //FNV-1a over the UTF16 code units
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < key.size; ++i) {
+    hash = (hash ^ key.data[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+StringInterner::StringInterner() {
+  //ID 0 is always the empty string so that default handles are valid
+  intern(u"", 0);
+}
+
+InternedString StringInterner::intern(const char16_t* data, size_t size) {
+  std::unique_lock<std::mutex> lck(lock);
+  auto found = ids.find(Key{data, size});
+  if (found != ids.end()) {
+    return InternedString(found->second, found->first.data, size);
+  }
+  strings.push_back(std::u16string(data, size));
+  const std::u16string& stored = strings.back();
+  uint32_t id = strings.size() - 1;
+  ids.insert(std::make_pair(Key{stored.data(), stored.size()}, id));
+  return InternedString(id, stored.data(), stored.size());
+}
+
+InternedString StringInterner::intern(const std::u16string& str) {
+  return intern(str.data(), str.size());
+}
+
+bool StringInterner::find(const std::u16string& str, InternedString& found) const {
+  std::unique_lock<std::mutex> lck(lock);
+  auto entry = ids.find(Key{str.data(), str.size()});
+  if (entry == ids.end()) {
+    return false;
+  }
+  found = InternedString(entry->second, entry->first.data, entry->first.size);
+  return true;
+}
+
+InternedString StringInterner::lookup(uint32_t id) const {
+  std::unique_lock<std::mutex> lck(lock);
+  if (id >= strings.size()) {
+    throw std::out_of_range("Unknown interned string ID.");
+  }
+  const std::u16string& stored = strings[id];
+  return InternedString(id, stored.data(), stored.size());
+}
+
+size_t StringInterner::size() const {
+  std::unique_lock<std::mutex> lck(lock);
+  return strings.size();
+}
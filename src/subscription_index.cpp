@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file subscription_index.cpp
+ * Implementation of the SubscriptionIndex class.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "subscription_index.hpp"
+
+#include <algorithm>
+
+using namespace aggregator_solver;
+
+void SubscriptionIndex::add(SubscriberID subscriber, const Subscription& rules) {
+  //A rule without transmitters matches nothing, so it is not stored and a
+  //subscriber with only such rules is not counted by size.
+  if (std::none_of(rules.begin(), rules.end(), [](const Rule& r) { return not r.txers.empty(); })) {
+    return;
+  }
+  Subscription& existing = subscriptions[subscriber];
+  for (const Rule& rule : rules) {
+    if (rule.txers.empty()) {
+      continue;
+    }
+    std::vector<MaskGroup>& phy_groups = groups[rule.physical_layer];
+    for (const Transmitter& tx : rule.txers) {
+      auto group = std::find_if(phy_groups.begin(), phy_groups.end(),
+          [&](const MaskGroup& g) { return g.mask == tx.mask; });
+      if (group == phy_groups.end()) {
+        phy_groups.push_back(MaskGroup{tx.mask, {}});
+        group = phy_groups.end() - 1;
+      }
+      group->ids[tx.base_id & tx.mask].push_back(Entry{subscriber, rule.update_interval});
+    }
+    existing.push_back(rule);
+  }
+}
+
+void SubscriptionIndex::remove(SubscriberID subscriber) {
+  auto sub = subscriptions.find(subscriber);
+  if (sub == subscriptions.end()) {
+    return;
+  }
+  for (const Rule& rule : sub->second) {
+    std::vector<MaskGroup>& phy_groups = groups[rule.physical_layer];
+    for (const Transmitter& tx : rule.txers) {
+      auto group = std::find_if(phy_groups.begin(), phy_groups.end(),
+          [&](const MaskGroup& g) { return g.mask == tx.mask; });
+      if (group == phy_groups.end()) {
+        continue;
+      }
+      auto id = group->ids.find(tx.base_id & tx.mask);
+      if (id == group->ids.end()) {
+        continue;
+      }
+      std::vector<Entry>& entries = id->second;
+      entries.erase(std::remove_if(entries.begin(), entries.end(),
+            [&](const Entry& e) { return e.subscriber == subscriber; }), entries.end());
+      if (entries.empty()) {
+        group->ids.erase(id);
+      }
+      //Drop unused masks so they are not checked during matching
+      if (group->ids.empty()) {
+        phy_groups.erase(group);
+      }
+    }
+  }
+  subscriptions.erase(sub);
+}
+
+void SubscriptionIndex::clear() {
+  for (std::vector<MaskGroup>& phy_groups : groups) {
+    phy_groups.clear();
+  }
+  subscriptions.clear();
+}
+
+size_t SubscriptionIndex::size() const {
+  return subscriptions.size();
+}
+
+size_t SubscriptionIndex::match(unsigned char physical_layer, const uint128_t& tx_id, std::vector<Match>& out) const {
+  out.clear();
+  for (const MaskGroup& group : groups[physical_layer]) {
+    auto id = group.ids.find(tx_id & group.mask);
+    if (id != group.ids.end()) {
+      for (const Entry& entry : id->second) {
+        out.push_back(Match{entry.subscriber, entry.update_interval});
+      }
+    }
+  }
+  //A subscriber can match through several rules. Keep one match for each,
+  //with the smallest interval.
+  if (1 < out.size()) {
+    std::sort(out.begin(), out.end(), [](const Match& a, const Match& b) {
+        return a.subscriber < b.subscriber or
+          (a.subscriber == b.subscriber and a.update_interval < b.update_interval); });
+    out.erase(std::unique(out.begin(), out.end(), [](const Match& a, const Match& b) {
+        return a.subscriber == b.subscriber; }), out.end());
+  }
+  return out.size();
+}
+
+std::vector<SubscriptionIndex::Match> SubscriptionIndex::match(const SampleData& sample) const {
+  std::vector<Match> out;
+  match(sample.physical_layer, sample.tx_id, out);
+  return out;
+}
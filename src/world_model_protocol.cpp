@@ -12,6 +12,8 @@
 #include <chrono>
 
 #include "world_model_protocol.hpp"
+#include "message_schema.hpp"
+#include "metrics.hpp"
 #include "netbuffer.hpp"
 
 using namespace world_model;
@@ -32,74 +34,142 @@ grail_time world_model::getGRAILTime() {
 /******************************************************************************
  * The following functions comprise the client <-> world model interface.
  *****************************************************************************/
+static const std::string client_protocol_string = "GRAIL client protocol";
+static const std::string solver_protocol_string = "GRAIL world model protocol";
+
+//Read a sized UTF16 string into an owned string, or into an interned handle
+//with the overload below.
+template<typename String>
+static void readString(BuffView& reader, String& str, StringInterner*) {
+  reader.readSizedUTF16(str);
+}
+
+static void readString(BuffView& reader, InternedString& str, StringInterner* interner) {
+  //Reuse one conversion buffer per thread so that strings which were
+  //already interned cost no allocations.
+  static thread_local u16string scratch;
+  reader.readSizedUTF16(scratch);
+  str = interner->intern(scratch);
+}
+
+//The length of a message after its four byte length field.
+static uint32_t messageLength(const Buffer& buff) {
+  return buff.size() - sizeof(uint32_t);
+}
+
+//Bytes taken by a UTF16 string on the wire, without and with its size field.
+static size_t utf16Size(const u16string& str) {
+  return str.size() * sizeof(char16_t);
+}
+
+static size_t sizedUTF16Size(const u16string& str) {
+  return sizeof(uint32_t) + utf16Size(str);
+}
+
+//Messages that are a flat list of fields are described by schemas, which
+//generate their size functions, encoders, and decoders.
+typedef schema::Message<client::MessageID, client::MessageID::keep_alive> ClientKeepAlive;
+typedef schema::Message<client::MessageID, client::MessageID::request_complete, uint32_t> RequestComplete;
+typedef schema::Message<client::MessageID, client::MessageID::cancel_request, uint32_t> CancelRequest;
+typedef schema::Message<client::MessageID, client::MessageID::uri_search, schema::UTF16Rest> URISearch;
+typedef schema::Message<solver::MessageID, solver::MessageID::keep_alive> SolverKeepAlive;
+typedef schema::Message<solver::MessageID, solver::MessageID::create_uri,
+        schema::SizedUTF16, grail_time, schema::UTF16Rest> CreateURI;
+typedef schema::Message<solver::MessageID, solver::MessageID::expire_uri,
+        schema::SizedUTF16, grail_time, schema::UTF16Rest> ExpireURI;
+typedef schema::Message<solver::MessageID, solver::MessageID::expire_attribute,
+        schema::SizedUTF16, schema::SizedUTF16, grail_time, schema::UTF16Rest> ExpireAttribute;
+typedef schema::Message<solver::MessageID, solver::MessageID::delete_uri,
+        schema::SizedUTF16, schema::UTF16Rest> DeleteURI;
+typedef schema::Message<solver::MessageID, solver::MessageID::delete_attribute,
+        schema::SizedUTF16, schema::SizedUTF16, schema::UTF16Rest> DeleteAttribute;
+
+size_t client::handshakeMsgSize() {
+  return handshake::encodedSize(client_protocol_string);
+}
+
 std::vector<unsigned char> client::makeHandshakeMsg() {
-  std::vector<unsigned char> buff(4);
-  std::string protocol_string = "GRAIL client protocol";
-  buff.insert(buff.end(), protocol_string.begin(), protocol_string.end());
-  //Version number and extension are both currently zero
-  buff.push_back(0);
-  buff.push_back(0);
-  //Insert the length of the protocol string into the buffer
-  pushBackVal<uint32_t>(protocol_string.size(), buff, 0);
-  return buff;
+  return makeHandshakeMsg(0);
+}
+
+std::vector<unsigned char> client::makeHandshakeMsg(handshake::Capabilities capabilities) {
+  //The version number is currently zero
+  return handshake::encode(client_protocol_string, 0, capabilities);
+}
+
+handshake::Handshake client::decodeHandshakeMsg(BuffView buff) {
+  return handshake::decode(buff, client_protocol_string);
+}
+
+size_t client::keepAliveSize() {
+  return ClientKeepAlive::min_size;
 }
 
 Buffer client::makeKeepAlive() {
-  Buffer buff;
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 1;
-  //Push back space in the buffer for the total length.
-  pushBackVal(total_length, buff);
-  //Push back the message type.
-  total_length += pushBackVal(MessageID::keep_alive, buff);
-  return buff;
+  return ClientKeepAlive::encode();
 }
 
-Buffer client::makeSnapshotRequest(const client::Request& request, uint32_t ticket) {
-  Buffer buff;
+size_t client::snapshotRequestSize(const client::Request& request) {
+  size_t size = sizeof(uint32_t) + sizeof(MessageID) + sizeof(uint32_t) +
+    sizedUTF16Size(request.object_uri) + sizeof(uint32_t);
+  for (auto attr = request.attributes.begin(); attr != request.attributes.end(); ++attr) {
+    size += sizedUTF16Size(*attr);
+  }
+  return size + sizeof(request.start) + sizeof(request.stop_period);
+}
+
+size_t client::rangeRequestSize(const client::Request& request) {
+  return snapshotRequestSize(request);
+}
+
+size_t client::streamRequestSize(const client::Request& request) {
+  return snapshotRequestSize(request);
+}
 
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-  //Push back space in the buffer for the total length.
-  pushBackVal(total_length, buff);
-  //Push back the message type.
-  total_length += pushBackVal(MessageID::snapshot_request, buff);
+//Snapshot, range, and stream requests only differ in their message type.
+static Buffer makeRequest(const client::Request& request, uint32_t ticket, client::MessageID request_type) {
+  OWL_METRIC_LATENCY(encode, client, request_type);
+  Buffer buff(client::snapshotRequestSize(request));
+  BuffWriter writer(buff);
+
+  //Push back the total length and message type.
+  writer.writePrimitive<uint32_t>(messageLength(buff));
+  writer.writePrimitive(request_type);
 
   //Push back the ticket number
-  total_length += pushBackVal(ticket, buff);
+  writer.writePrimitive(ticket);
 
   //Push back the length and content of the query URI
-  total_length += pushBackSizedUTF16(buff, request.object_uri);
+  writer.writeSizedUTF16(request.object_uri);
 
   //Push back the number of attribute strings
-  total_length += pushBackVal((uint32_t)request.attributes.size(), buff);
+  writer.writePrimitive((uint32_t)request.attributes.size());
 
   //Push back each attribute string
   for (auto attr = request.attributes.begin(); attr != request.attributes.end(); ++attr) {
-    total_length += pushBackSizedUTF16(buff, *attr);
+    writer.writeSizedUTF16(*attr);
   }
-  total_length += pushBackVal(request.start, buff);
-  total_length += pushBackVal(request.stop_period, buff);
-
-  //Push back the actual length into the buffer.
-  pushBackVal(total_length, buff, 0);
+  writer.writePrimitive(request.start);
+  writer.writePrimitive(request.stop_period);
   return buff;
 }
 
+Buffer client::makeSnapshotRequest(const client::Request& request, uint32_t ticket) {
+  return makeRequest(request, ticket, MessageID::snapshot_request);
+}
+
 Buffer client::makeRangeRequest(const client::Request& request, uint32_t ticket) {
-  Buffer buff = makeSnapshotRequest(request, ticket);
-  buff[4] = (uint8_t)MessageID::range_request;
-  return buff;
+  return makeRequest(request, ticket, MessageID::range_request);
 }
 
 Buffer client::makeStreamRequest(const client::Request& request, uint32_t ticket) {
-  Buffer buff = makeSnapshotRequest(request, ticket);
-  buff[4] = (uint8_t)MessageID::stream_request;
-  return buff;
+  return makeRequest(request, ticket, MessageID::stream_request);
 }
 
-std::tuple<client::Request, uint32_t> client::decodeSnapshotRequest(Buffer& buff) {
-  BuffReader reader(buff);
+//Snapshot, range, and stream requests only differ in their message type.
+static std::tuple<client::Request, uint32_t> decodeRequest(BuffView reader, client::MessageID request_type) {
+  OWL_METRIC_LATENCY(decode, client, request_type);
+  using client::MessageID;
   client::Request request;
   uint32_t ticket = 0;
 
@@ -107,8 +177,8 @@ std::tuple<client::Request, uint32_t> client::decodeSnapshotRequest(Buffer& buff
   MessageID msg_type = reader.readPrimitive<MessageID>();
 
   //Check to make sure this is a valid type specification message.
-  if ( buff.size() == (total_length + 4) and
-       msg_type == MessageID::snapshot_request) {
+  if ( reader.size() == (total_length + 4) and
+       msg_type == request_type) {
     //Read in the ticket number, object URI, and object attributes
     ticket = reader.readPrimitive<uint32_t>();
     request.object_uri = reader.readSizedUTF16();
@@ -128,297 +198,343 @@ std::tuple<client::Request, uint32_t> client::decodeSnapshotRequest(Buffer& buff
   return std::make_tuple(request, ticket);
 }
 
+std::tuple<client::Request, uint32_t> client::decodeSnapshotRequest(BuffView buff) {
+  return decodeRequest(buff, MessageID::snapshot_request);
+}
+
+std::tuple<client::Request, uint32_t> client::decodeSnapshotRequest(Buffer& buff) {
+  return decodeSnapshotRequest(BuffView(buff));
+}
+
+std::tuple<client::Request, uint32_t> client::decodeRangeRequest(BuffView buff) {
+  //Reuse the snapshot request message code
+  return decodeRequest(buff, MessageID::range_request);
+}
+
 std::tuple<client::Request, uint32_t> client::decodeRangeRequest(Buffer& buff) {
+  return decodeRangeRequest(BuffView(buff));
+}
+
+std::tuple<client::Request, uint32_t> client::decodeStreamRequest(BuffView buff) {
   //Reuse the snapshot request message code
-  if (buff.size() >= 5 and
-      MessageID::range_request == MessageID(buff[4])) {
-    buff[4] = (uint8_t)MessageID::snapshot_request;
-    return decodeSnapshotRequest(buff);
-  }
-  //Otherwise fail
-  Request empty;
-  return std::make_tuple(empty, (uint32_t)0);
+  return decodeRequest(buff, MessageID::stream_request);
 }
 
 std::tuple<client::Request, uint32_t> client::decodeStreamRequest(Buffer& buff) {
-  //Reuse the snapshot request message code
-  if (buff.size() >= 5 and
-      MessageID::stream_request == MessageID(buff[4])) {
-    buff[4] = (uint8_t)MessageID::snapshot_request;
-    return decodeSnapshotRequest(buff);
+  return decodeStreamRequest(BuffView(buff));
+}
+
+size_t client::attrAliasMsgSize(const vector<client::AliasType>& attribute_aliases) {
+  size_t size = sizeof(uint32_t) + sizeof(MessageID) + sizeof(uint32_t);
+  for (auto alias = attribute_aliases.begin(); alias != attribute_aliases.end(); ++alias) {
+    size += sizeof(alias->alias) + sizedUTF16Size(alias->type);
   }
-  //Otherwise fail
-  Request empty;
-  return std::make_tuple(empty, (uint32_t)0);
+  return size;
 }
 
-Buffer client::makeAttrAliasMsg(const vector<client::AliasType>& attribute_aliases) {
-  Buffer buff;
+size_t client::originAliasMsgSize(const vector<client::AliasType>& origin_aliases) {
+  return attrAliasMsgSize(origin_aliases);
+}
 
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-  //Push back space in the buffer for the total length.
-  pushBackVal(total_length, buff);
-  //Push back the message type.
-  total_length += pushBackVal(MessageID::attribute_alias, buff);
+//Attribute and origin alias messages only differ in their message type.
+static Buffer makeAliasMsg(const vector<client::AliasType>& aliases, client::MessageID alias_type) {
+  OWL_METRIC_LATENCY(encode, client, alias_type);
+  Buffer buff(client::attrAliasMsgSize(aliases));
+  BuffWriter writer(buff);
+
+  //Push back the total length and message type.
+  writer.writePrimitive<uint32_t>(messageLength(buff));
+  writer.writePrimitive(alias_type);
 
   //Push back the number of aliases
-  total_length += pushBackVal<uint32_t>((uint32_t)attribute_aliases.size(), buff);
+  writer.writePrimitive<uint32_t>(aliases.size());
 
   //Push back each alias string
-  for (auto alias = attribute_aliases.begin(); alias != attribute_aliases.end(); ++alias) {
-    total_length += pushBackVal<uint32_t>(alias->alias, buff);
-    total_length += pushBackSizedUTF16(buff, alias->type);
+  for (auto alias = aliases.begin(); alias != aliases.end(); ++alias) {
+    writer.writePrimitive<uint32_t>(alias->alias);
+    writer.writeSizedUTF16(alias->type);
   }
-
-  //Push back the actual length into the buffer.
-  pushBackVal(total_length, buff, 0);
   return buff;
 }
 
+Buffer client::makeAttrAliasMsg(const vector<client::AliasType>& attribute_aliases) {
+  return makeAliasMsg(attribute_aliases, MessageID::attribute_alias);
+}
+
 Buffer client::makeOriginAliasMsg(const vector<client::AliasType>& origin_aliases) {
   //Reuse the attribute alias message code
-  Buffer buff = makeAttrAliasMsg(origin_aliases);
-  //Change the message type
-  buff[4] = (uint8_t)MessageID::origin_alias;
-  return buff;
+  return makeAliasMsg(origin_aliases, MessageID::origin_alias);
 }
 
-vector<client::AliasType> client::decodeAttrAliasMsg(Buffer& buff) {
-  BuffReader reader(buff);
-  vector<client::AliasType> aliases;
+//Attribute and origin alias messages only differ in their message type.
+template<typename Alias>
+static vector<Alias> decodeAliasMsg(BuffView reader, client::MessageID alias_type, StringInterner* interner = nullptr) {
+  OWL_METRIC_LATENCY(decode, client, alias_type);
+  using client::MessageID;
+  vector<Alias> aliases;
 
   uint32_t total_length = reader.readPrimitive<uint32_t>();
   MessageID msg_type = reader.readPrimitive<MessageID>();
 
   //Check to make sure this is a valid message.
-  if ( buff.size() == (total_length + 4) and
-       msg_type == MessageID::attribute_alias) {
+  if ( reader.size() == (total_length + 4) and
+       msg_type == alias_type) {
     uint32_t total_attributes = reader.readPrimitive<uint32_t>();
 
-    for (size_t i = 0; i < total_attributes; ++i) {
-      uint32_t alias = reader.readPrimitive<uint32_t>();
-      u16string type = reader.readSizedUTF16();
-      aliases.push_back(client::AliasType{alias, type});
+    for (size_t i = 0; i < total_attributes and not reader.outOfRange(); ++i) {
+      aliases.push_back(Alias());
+      aliases.back().alias = reader.readPrimitive<uint32_t>();
+      readString(reader, aliases.back().type, interner);
     }
   }
   if (reader.outOfRange()) {
-    return vector<client::AliasType>();
+    return vector<Alias>();
   }
 
   return aliases;
 }
 
-vector<client::AliasType> client::decodeOriginAliasMsg(Buffer& buff) {
-  //Reuse the attribute alias message code
-  if (buff.size() > 5 and
-      MessageID::origin_alias == MessageID(buff[4])) {
-    buff[4] = (uint8_t)MessageID::attribute_alias;
-    return decodeAttrAliasMsg(buff);
-  }
-  //Otherwise fail
-  return vector<client::AliasType>();
+vector<client::AliasType> client::decodeAttrAliasMsg(BuffView buff) {
+  return decodeAliasMsg<AliasType>(buff, MessageID::attribute_alias);
 }
 
-Buffer client::makeRequestComplete(uint32_t ticket_number) {
-  Buffer buff;
+vector<client::InternedAliasType> client::decodeAttrAliasMsg(BuffView buff, StringInterner& interner) {
+  return decodeAliasMsg<InternedAliasType>(buff, MessageID::attribute_alias, &interner);
+}
 
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 5;
-  //Push back space for the total length.
-  pushBackVal(total_length, buff);
+vector<client::AliasType> client::decodeAttrAliasMsg(Buffer& buff) {
+  return decodeAttrAliasMsg(BuffView(buff));
+}
 
-  //Push back the message type.
-  pushBackVal(MessageID::request_complete, buff);
+vector<client::AliasType> client::decodeOriginAliasMsg(BuffView buff) {
+  //Reuse the attribute alias message code
+  return decodeAliasMsg<AliasType>(buff, MessageID::origin_alias);
+}
 
-  //Push back the ticket number
-  pushBackVal(ticket_number, buff);
+vector<client::InternedAliasType> client::decodeOriginAliasMsg(BuffView buff, StringInterner& interner) {
+  return decodeAliasMsg<InternedAliasType>(buff, MessageID::origin_alias, &interner);
+}
 
-  return buff;
+vector<client::AliasType> client::decodeOriginAliasMsg(Buffer& buff) {
+  return decodeOriginAliasMsg(BuffView(buff));
 }
 
-uint32_t client::decodeRequestComplete(Buffer& buff) {
-  BuffReader reader(buff);
+size_t client::requestCompleteSize() {
+  return RequestComplete::min_size;
+}
 
-  uint32_t total_length = reader.readPrimitive<uint32_t>();
-  MessageID msg_type = reader.readPrimitive<MessageID>();
+Buffer client::makeRequestComplete(uint32_t ticket_number) {
+  return RequestComplete::encode(ticket_number);
+}
 
-  if (buff.size() == total_length + 4 and
-      MessageID::request_complete == msg_type) {
-    //Return the ticket number
-    return reader.readPrimitive<uint32_t>();
+uint32_t client::decodeRequestComplete(BuffView reader) {
+  uint32_t ticket_number;
+  if (RequestComplete::decode(reader, ticket_number)) {
+    return ticket_number;
   }
-
   //Return 0 on failure
   return 0;
 }
 
-Buffer client::makeCancelRequest(uint32_t ticket_number) {
-  Buffer buff;
-
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 5;
-  //Push back space for the total length.
-  pushBackVal(total_length, buff);
+uint32_t client::decodeRequestComplete(Buffer& buff) {
+  return decodeRequestComplete(BuffView(buff));
+}
 
-  //Push back the message type.
-  pushBackVal(MessageID::cancel_request, buff);
+size_t client::cancelRequestSize() {
+  return CancelRequest::min_size;
+}
 
-  //Push back the ticket number
-  pushBackVal(ticket_number, buff);
+Buffer client::makeCancelRequest(uint32_t ticket_number) {
+  return CancelRequest::encode(ticket_number);
+}
 
-  return buff;
+uint32_t client::decodeCancelRequest(BuffView reader) {
+  uint32_t ticket_number;
+  if (CancelRequest::decode(reader, ticket_number)) {
+    return ticket_number;
+  }
+  //Return 0 on failure
+  return 0;
 }
 
 uint32_t client::decodeCancelRequest(Buffer& buff) {
-  BuffReader reader(buff);
-
-  uint32_t total_length = reader.readPrimitive<uint32_t>();
-  MessageID msg_type = reader.readPrimitive<MessageID>();
+  return decodeCancelRequest(BuffView(buff));
+}
 
-  if (buff.size() == total_length + 4 and
-      MessageID::cancel_request == msg_type) {
-    //Return the ticket number
-    return reader.readPrimitive<uint32_t>();
+size_t client::dataMessageSize(const AliasedWorldData& wd) {
+  size_t size = sizeof(uint32_t) + sizeof(MessageID) +
+    sizedUTF16Size(wd.object_uri) + sizeof(uint32_t) + sizeof(uint32_t);
+  for (auto attr = wd.attributes.begin(); attr != wd.attributes.end(); ++attr) {
+    size += sizeof(attr->name_alias) + sizeof(attr->creation_date) +
+      sizeof(attr->expiration_date) + sizeof(attr->origin_alias) +
+      sizeof(uint32_t) + attr->data.size();
   }
-
-  //Return 0 on failure
-  return 0;
+  return size;
 }
 
 Buffer client::makeDataMessage(const AliasedWorldData& wd, uint32_t ticket) {
   Buffer buff;
+  makeDataMessage(wd, ticket, buff);
+  return buff;
+}
 
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-  //Push back space in the buffer for the total length.
-  pushBackVal(total_length, buff);
-  //Push back the message type.
-  total_length += pushBackVal(MessageID::data_response, buff);
+size_t client::makeDataMessage(const AliasedWorldData& wd, uint32_t ticket, Buffer& out) {
+  OWL_METRIC_LATENCY(encode, client, MessageID::data_response);
+  size_t size = dataMessageSize(wd);
+  BuffWriter writer = appendWriter(out, size);
+
+  //Push back the total length and message type.
+  writer.writePrimitive<uint32_t>(size - sizeof(uint32_t));
+  writer.writePrimitive(MessageID::data_response);
 
   //Push back the length and content of the world object's URI
-  total_length += pushBackSizedUTF16(buff, wd.object_uri);
+  writer.writeSizedUTF16(wd.object_uri);
 
-  //Push back the number of attributes
-  total_length += pushBackVal<uint32_t>(ticket, buff);
+  //Push back the ticket number
+  writer.writePrimitive<uint32_t>(ticket);
 
   //Push back the number of attributes
-  total_length += pushBackVal<uint32_t>((uint32_t)wd.attributes.size(), buff);
+  writer.writePrimitive<uint32_t>(wd.attributes.size());
 
   //Push back each attribute
   for (auto attr = wd.attributes.begin(); attr != wd.attributes.end(); ++attr) {
-    total_length += pushBackVal<uint32_t>(attr->name_alias, buff);
-    total_length += pushBackVal<grail_time>(attr->creation_date, buff);
-    total_length += pushBackVal<grail_time>(attr->expiration_date, buff);
-    total_length += pushBackVal<uint32_t>(attr->origin_alias, buff);
-    total_length += pushSizedContainer(attr->data, buff);
-  }
-
-  //Push back the actual length into the buffer.
-  pushBackVal(total_length, buff, 0);
-  return buff;
-}
-
-std::tuple<AliasedWorldData, uint32_t> client::decodeDataMessage(Buffer& buff) {
-  BuffReader reader(buff);
-  AliasedWorldData wd;
-  uint32_t ticket_number = 0;
-
+    writer.writePrimitive<uint32_t>(attr->name_alias);
+    writer.writePrimitive<grail_time>(attr->creation_date);
+    writer.writePrimitive<grail_time>(attr->expiration_date);
+    writer.writePrimitive<uint32_t>(attr->origin_alias);
+    writer.writeSizedBytes(attr->data.data(), attr->data.size());
+  }
+  return size;
+}
+
+//Decode a data message into a world data structure whose members were
+//already given their allocators. Returns false if the message is invalid.
+//The interner is only used if the URI is an InternedString.
+template<typename WorldData>
+static bool decodeDataInto(BuffView& reader, WorldData& wd, uint32_t& ticket_number, StringInterner* interner = nullptr) {
+  OWL_METRIC_LATENCY(decode, client, client::MessageID::data_response);
+  typedef typename decltype(wd.attributes)::value_type AttributeType;
   uint32_t total_length = reader.readPrimitive<uint32_t>();
-  MessageID msg_type = reader.readPrimitive<MessageID>();
+  client::MessageID msg_type = reader.readPrimitive<client::MessageID>();
 
-  if (buff.size() == total_length + 4 and
-      MessageID::data_response == msg_type) {
-    wd.object_uri = reader.readSizedUTF16();
+  if (reader.size() == total_length + 4 and
+      client::MessageID::data_response == msg_type) {
+    readString(reader, wd.object_uri, interner);
     ticket_number = reader.readPrimitive<uint32_t>();
 
     uint32_t total_attributes = reader.readPrimitive<uint32_t>();
+    //Every attribute takes at least 28 bytes so a bad count cannot cause
+    //a huge allocation.
+    if (total_attributes <= reader.remaining() / 28) {
+      wd.attributes.reserve(total_attributes);
+    }
 
-    for (; total_attributes > 0; --total_attributes) {
-      AliasedAttribute aa;
+    for (; total_attributes > 0 and not reader.outOfRange(); --total_attributes) {
+      wd.attributes.push_back(AttributeType{0, 0, 0, 0,
+          decltype(AttributeType::data)(wd.attributes.get_allocator())});
+      AttributeType& aa = wd.attributes.back();
       aa.name_alias = reader.readPrimitive<uint32_t>();
       aa.creation_date = reader.readPrimitive<grail_time>();
       aa.expiration_date = reader.readPrimitive<grail_time>();
       aa.origin_alias = reader.readPrimitive<uint32_t>();
-      aa.data = reader.readSizedVector<uint8_t>();
-      wd.attributes.push_back(aa);
+      //Copy the attribute data out of the message in a single allocation
+      ByteSpan data = reader.readSizedSpan();
+      aa.data.assign(data.begin(), data.end());
     }
   }
   //If we went out of range then the attribute count was wrong
-  if (reader.outOfRange()) {
+  return not reader.outOfRange();
+}
+
+std::tuple<AliasedWorldData, uint32_t> client::decodeDataMessage(BuffView reader) {
+  AliasedWorldData wd;
+  uint32_t ticket_number = 0;
+  if (not decodeDataInto(reader, wd, ticket_number)) {
     return std::make_tuple(AliasedWorldData(), (uint32_t)0);
   }
-
-
-  return std::make_tuple(wd, ticket_number);
+  return std::make_tuple(std::move(wd), ticket_number);
 }
 
-Buffer client::makeURISearch(const URI& uri) {
-  Buffer buff;
-
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-
-  //Push back the total length and message type
-  pushBackVal(total_length, buff);
-  total_length += pushBackVal(MessageID::uri_search, buff);
+std::tuple<ArenaAliasedWorldData, uint32_t> client::decodeDataMessage(BuffView reader, Arena& arena) {
+  ArenaAllocator<uint8_t> alloc(arena);
+  ArenaAliasedWorldData wd{decltype(wd.object_uri)(alloc), decltype(wd.attributes)(alloc)};
+  uint32_t ticket_number = 0;
+  if (not decodeDataInto(reader, wd, ticket_number)) {
+    return std::make_tuple(ArenaAliasedWorldData(), (uint32_t)0);
+  }
+  return std::make_tuple(std::move(wd), ticket_number);
+}
 
-  //Push back the query string
-  total_length += pushBackUTF16(buff, uri);
+std::tuple<InternedAliasedWorldData, uint32_t> client::decodeDataMessage(BuffView reader, StringInterner& interner) {
+  InternedAliasedWorldData wd;
+  uint32_t ticket_number = 0;
+  if (not decodeDataInto(reader, wd, ticket_number, &interner)) {
+    return std::make_tuple(InternedAliasedWorldData(), (uint32_t)0);
+  }
+  return std::make_tuple(std::move(wd), ticket_number);
+}
 
-  pushBackVal(total_length, buff, 0);
-  return buff;
+std::tuple<AliasedWorldData, uint32_t> client::decodeDataMessage(Buffer& buff) {
+  return decodeDataMessage(BuffView(buff));
 }
 
-URI client::decodeURISearch(Buffer& buff) {
-  BuffReader reader(buff);
+size_t client::uriSearchSize(const URI& uri) {
+  return URISearch::size(uri);
+}
 
-  uint32_t total_length = reader.readPrimitive<uint32_t>();
-  MessageID msg_type = reader.readPrimitive<MessageID>();
+Buffer client::makeURISearch(const URI& uri) {
+  return URISearch::encode(uri);
+}
 
-  if (buff.size() == total_length + 4 and
-      MessageID::uri_search == msg_type) {
-    u16string uri = reader.readUTF16((buff.size() - reader.cur_index)/2);
+URI client::decodeURISearch(BuffView reader) {
+  URI uri;
+  if (URISearch::decode(reader, uri)) {
     return uri;
   }
-
   //Return on empty string upon failure.
   return u"";
 }
 
-Buffer client::makeURISearchResponse(const std::vector<URI>& uris) {
-  Buffer buff;
+URI client::decodeURISearch(Buffer& buff) {
+  return decodeURISearch(BuffView(buff));
+}
+
+size_t client::uriSearchResponseSize(const std::vector<URI>& uris) {
+  size_t size = sizeof(uint32_t) + sizeof(MessageID);
+  for (auto uri = uris.begin(); uri != uris.end(); ++uri) {
+    size += sizedUTF16Size(*uri);
+  }
+  return size;
+}
 
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
+Buffer client::makeURISearchResponse(const std::vector<URI>& uris) {
+  Buffer buff(uriSearchResponseSize(uris));
+  BuffWriter writer(buff);
 
   //Push back the total length and message type
-  pushBackVal(total_length, buff);
-  total_length += pushBackVal(MessageID::uri_response, buff);
+  writer.writePrimitive<uint32_t>(messageLength(buff));
+  writer.writePrimitive(MessageID::uri_response);
   for (auto uri = uris.begin(); uri != uris.end(); ++uri) {
-    total_length += pushBackSizedUTF16(buff, *uri);
+    writer.writeSizedUTF16(*uri);
   }
-
-  pushBackVal(total_length, buff, 0);
   return buff;
 }
 
-std::vector<URI> client::decodeURISearchResponse(Buffer& buff) {
-  BuffReader reader(buff);
+std::vector<URI> client::decodeURISearchResponse(BuffView reader) {
   std::vector<URI> uris;
 
   uint32_t total_length = reader.readPrimitive<uint32_t>();
   MessageID msg_type = reader.readPrimitive<MessageID>();
 
-  if (buff.size() == total_length + 4 and
+  if (reader.size() == total_length + 4 and
       MessageID::uri_response == msg_type) {
-    uint32_t total_uris = reader.readPrimitive<uint32_t>();
-    for (; total_uris > 0; --total_uris) {
+    //There is no count, the URIs fill the rest of the message
+    while (reader.remaining() > 0 and not reader.outOfRange()) {
       URI uri = reader.readSizedUTF16();
       uris.push_back(uri);
     }
   }
-  //If we went out of range then the total URI count was invalid
+  //If we went out of range then a URI size was invalid
   if (reader.outOfRange()) {
     return std::vector<URI>();
   }
@@ -426,34 +542,44 @@ std::vector<URI> client::decodeURISearchResponse(Buffer& buff) {
   return uris;
 }
 
-Buffer client::makeOriginPreference(const std::vector<pair<std::u16string, int32_t>>& weights) {
-  Buffer buff;
+std::vector<URI> client::decodeURISearchResponse(Buffer& buff) {
+  return decodeURISearchResponse(BuffView(buff));
+}
 
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
+size_t client::originPreferenceSize(const std::vector<pair<std::u16string, int32_t>>& weights) {
+  size_t size = sizeof(uint32_t) + sizeof(MessageID);
+  for (auto w = weights.begin(); w != weights.end(); ++w) {
+    size += sizedUTF16Size(w->first) + sizeof(int32_t);
+  }
+  return size;
+}
+
+Buffer client::makeOriginPreference(const std::vector<pair<std::u16string, int32_t>>& weights) {
+  Buffer buff(originPreferenceSize(weights));
+  BuffWriter writer(buff);
 
   //Push back the total length and message type
-  pushBackVal(total_length, buff);
-  total_length += pushBackVal(MessageID::origin_preference, buff);
+  writer.writePrimitive<uint32_t>(messageLength(buff));
+  writer.writePrimitive(MessageID::origin_preference);
   for (auto w = weights.begin(); w != weights.end(); ++w) {
-    total_length += pushBackSizedUTF16(buff, w->first);
-    total_length += pushBackVal<int32_t>(w->second, buff);
+    writer.writeSizedUTF16(w->first);
+    writer.writePrimitive<int32_t>(w->second);
   }
-
-  pushBackVal(total_length, buff, 0);
   return buff;
 }
 
-std::vector<pair<std::u16string, int32_t>> client::decodeOriginPreference(Buffer& buff) {
-  BuffReader reader(buff);
+std::vector<pair<std::u16string, int32_t>> client::decodeOriginPreference(BuffView reader) {
   std::vector<pair<std::u16string, int32_t>> weights;
 
   uint32_t total_length = reader.readPrimitive<uint32_t>();
   MessageID msg_type = reader.readPrimitive<MessageID>();
-  if (buff.size() == total_length + 4 and
+  if (reader.size() == total_length + 4 and
       MessageID::origin_preference == msg_type) {
-    while (reader.cur_index < buff.size()) {
-      weights.push_back(std::make_pair(reader.readSizedUTF16(), reader.readPrimitive<int32_t>()));
+    while (reader.remaining() > 0 and not reader.outOfRange()) {
+      //Read the origin before its weight, argument evaluation order is unspecified
+      u16string origin = reader.readSizedUTF16();
+      int32_t weight = reader.readPrimitive<int32_t>();
+      weights.push_back(std::make_pair(origin, weight));
     }
   }
   //If we went out of range then the string sizes were invalid
@@ -464,73 +590,81 @@ std::vector<pair<std::u16string, int32_t>> client::decodeOriginPreference(Buffer
   return weights;
 }
 
+std::vector<pair<std::u16string, int32_t>> client::decodeOriginPreference(Buffer& buff) {
+  return decodeOriginPreference(BuffView(buff));
+}
+
 /******************************************************************************
  * The following functions comprise the solver <-> world model interface.
  *****************************************************************************/
 
+size_t solver::handshakeMsgSize() {
+  return handshake::encodedSize(solver_protocol_string);
+}
+
 std::vector<unsigned char> solver::makeHandshakeMsg() {
-  std::vector<unsigned char> buff(4);
-  std::string protocol_string = "GRAIL world model protocol";
-  buff.insert(buff.end(), protocol_string.begin(), protocol_string.end());
-  //Version number and extension are both currently zero
-  buff.push_back(0);
-  buff.push_back(0);
-  //Insert the length of the protocol string into the buffer
-  pushBackVal<uint32_t>(protocol_string.size(), buff, 0);
-  return buff;
+  return makeHandshakeMsg(0);
+}
+
+std::vector<unsigned char> solver::makeHandshakeMsg(handshake::Capabilities capabilities) {
+  //The version number is currently zero
+  return handshake::encode(solver_protocol_string, 0, capabilities);
+}
+
+handshake::Handshake solver::decodeHandshakeMsg(BuffView buff) {
+  return handshake::decode(buff, solver_protocol_string);
+}
+
+size_t solver::keepAliveSize() {
+  return SolverKeepAlive::min_size;
 }
 
 Buffer solver::makeKeepAlive() {
-  Buffer buff;
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 1;
-  //Push back space in the buffer for the total length.
-  pushBackVal(total_length, buff);
-  //Push back the message type.
-  total_length += pushBackVal(MessageID::keep_alive, buff);
-  return buff;
+  return SolverKeepAlive::encode();
 }
 
 /**
  * Before a solver submits new kinds of data to the world model it must first
  * identify itself and the types of data it can create.
  */
+size_t solver::typeAnnounceMsgSize(const vector<solver::AliasType>& type_alias, const u16string& origin) {
+  size_t size = sizeof(uint32_t) + sizeof(MessageID) + sizeof(uint32_t);
+  for (auto alias = type_alias.begin(); alias != type_alias.end(); ++alias) {
+    size += sizeof(alias->alias) + sizedUTF16Size(alias->type) + sizeof(uint8_t);
+  }
+  return size + utf16Size(origin);
+}
+
 Buffer solver::makeTypeAnnounceMsg(const vector<solver::AliasType>& type_alias, const u16string& origin) {
-  Buffer buff;
+  Buffer buff(typeAnnounceMsgSize(type_alias, origin));
+  BuffWriter writer(buff);
 
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-  //Push back space in the buffer for the total length.
-  pushBackVal(total_length, buff);
-  //Push back the message type.
-  total_length += pushBackVal(MessageID::type_announce, buff);
+  //Push back the total length and message type.
+  writer.writePrimitive<uint32_t>(messageLength(buff));
+  writer.writePrimitive(MessageID::type_announce);
 
   //Push back the number of aliases
-  total_length += pushBackVal((uint32_t)type_alias.size(), buff);
+  writer.writePrimitive((uint32_t)type_alias.size());
 
   //Push back each alias string
   for (auto alias = type_alias.begin(); alias != type_alias.end(); ++alias) {
-    total_length += pushBackVal(alias->alias, buff);
-    total_length += pushBackSizedUTF16(buff, alias->type);
-    total_length += pushBackVal((uint8_t)(alias->on_demand ? 1 : 0), buff);
+    writer.writePrimitive(alias->alias);
+    writer.writeSizedUTF16(alias->type);
+    writer.writePrimitive((uint8_t)(alias->on_demand ? 1 : 0));
   }
 
-  total_length += pushBackUTF16(buff, origin);
-
-  //Push back the actual length into the buffer.
-  pushBackVal(total_length, buff, 0);
+  writer.writeUTF16(origin);
   return buff;
 }
 
-pair<std::vector<solver::AliasType>, u16string> solver::decodeTypeAnnounceMsg(Buffer& buff) {
-  BuffReader reader(buff);
+pair<std::vector<solver::AliasType>, u16string> solver::decodeTypeAnnounceMsg(BuffView reader) {
   vector<AliasType> aliases;
 
   uint32_t total_length = reader.readPrimitive<uint32_t>();
   MessageID msg_type = reader.readPrimitive<MessageID>();
 
   //Check to make sure this is a valid message.
-  if ( buff.size() == (total_length + 4) and
+  if ( reader.size() == (total_length + 4) and
        msg_type == MessageID::type_announce) {
     uint32_t total_aliases = reader.readPrimitive<uint32_t>();
 
@@ -541,7 +675,7 @@ pair<std::vector<solver::AliasType>, u16string> solver::decodeTypeAnnounceMsg(Bu
       aliases.push_back(AliasType{alias, type, on_demand != 0});
     }
   }
-  u16string origin = reader.readUTF16((buff.size() - reader.cur_index)/2);
+  u16string origin = reader.readUTF16(reader.remaining()/2);
 
   //If we went out of range then alias count was incorrect
   if (reader.outOfRange()) {
@@ -551,42 +685,63 @@ pair<std::vector<solver::AliasType>, u16string> solver::decodeTypeAnnounceMsg(Bu
   return std::make_pair(aliases, origin);
 }
 
-Buffer solver::makeStartOnDemand(const std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>& aliases) {
-  Buffer buff;
+pair<std::vector<solver::AliasType>, u16string> solver::decodeTypeAnnounceMsg(Buffer& buff) {
+  return decodeTypeAnnounceMsg(BuffView(buff));
+}
+
+size_t solver::startOnDemandSize(const std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>& aliases) {
+  size_t size = sizeof(uint32_t) + sizeof(MessageID) + sizeof(uint32_t);
+  for (auto alias = aliases.begin(); alias != aliases.end(); ++alias) {
+    size += sizeof(uint32_t) + sizeof(uint32_t);
+    for (auto attr = std::get<1>(*alias).begin(); attr != std::get<1>(*alias).end(); ++attr) {
+      size += sizedUTF16Size(*attr);
+    }
+  }
+  return size;
+}
+
+size_t solver::stopOnDemandSize(const std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>& aliases) {
+  return startOnDemandSize(aliases);
+}
+
+//Start and stop on demand messages only differ in their message type.
+static Buffer makeOnDemand(const std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>& aliases, solver::MessageID on_demand_type) {
+  Buffer buff(solver::startOnDemandSize(aliases));
+  BuffWriter writer(buff);
 
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-  //Push back space in the buffer for the total length.
-  pushBackVal(total_length, buff);
-  //Push back the message type.
-  total_length += pushBackVal(MessageID::start_on_demand, buff);
+  //Push back the total length and message type.
+  writer.writePrimitive<uint32_t>(messageLength(buff));
+  writer.writePrimitive(on_demand_type);
 
   //Push back the total number of aliases
-  total_length += pushBackVal<uint32_t>(aliases.size(), buff);
+  writer.writePrimitive<uint32_t>(aliases.size());
   //Push back the aliases
   for (auto alias = aliases.begin(); alias != aliases.end(); ++alias) {
-    total_length += pushBackVal<uint32_t>(std::get<0>(*alias), buff);
+    writer.writePrimitive<uint32_t>(std::get<0>(*alias));
     //Push back the total number of requests for this type.
-    total_length += pushBackVal<uint32_t>(std::get<1>(*alias).size(), buff);
+    writer.writePrimitive<uint32_t>(std::get<1>(*alias).size());
     for (auto attr = std::get<1>(*alias).begin(); attr != std::get<1>(*alias).end(); ++attr) {
-      total_length += pushBackSizedUTF16(buff, *attr);
+      writer.writeSizedUTF16(*attr);
     }
   }
-
-  pushBackVal(total_length, buff, 0);
   return buff;
 }
 
-std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> solver::decodeStartOnDemand(Buffer& buff) {
-  BuffReader reader(buff);
+Buffer solver::makeStartOnDemand(const std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>& aliases) {
+  return makeOnDemand(aliases, MessageID::start_on_demand);
+}
+
+//Start and stop on demand messages only differ in their message type.
+static std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> decodeOnDemand(BuffView reader, solver::MessageID on_demand_type) {
+  using solver::MessageID;
   std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> aliases;
 
   uint32_t total_length = reader.readPrimitive<uint32_t>();
   MessageID msg_type = reader.readPrimitive<MessageID>();
 
   //Check to make sure this is a valid message.
-  if ( buff.size() == (total_length + 4) and
-       msg_type == MessageID::start_on_demand) {
+  if ( reader.size() == (total_length + 4) and
+       msg_type == on_demand_type) {
 
     uint32_t total_aliases = reader.readPrimitive<uint32_t>();
     for (uint32_t alias = 0; alias < total_aliases; ++alias) {
@@ -608,24 +763,24 @@ std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> solver::decodeSta
 }
 
 Buffer solver::makeStopOnDemand(const std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>& aliases) {
-  Buffer buff = makeStartOnDemand(aliases);
-  buff[4] = (uint8_t)MessageID::stop_on_demand;
-  return buff;
+  return makeOnDemand(aliases, MessageID::stop_on_demand);
 }
 
-std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> solver::decodeStopOnDemand(Buffer& buff) {
-  //Check to make sure this is a valid message.
-  BuffReader reader(buff);
-  uint32_t total_length = reader.readPrimitive<uint32_t>();
-  MessageID msg_type = reader.readPrimitive<MessageID>();
-  if ( buff.size() == (total_length + 4) and
-       msg_type == MessageID::stop_on_demand) {
+std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> solver::decodeStartOnDemand(BuffView buff) {
+  return decodeOnDemand(buff, MessageID::start_on_demand);
+}
 
-    buff[4] = (uint8_t)MessageID::start_on_demand;
-    return decodeStartOnDemand(buff);
-  }
-  //Otherwise return an empty vector
-  return std::vector<std::tuple<uint32_t, std::vector<std::u16string>>>();
+std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> solver::decodeStartOnDemand(Buffer& buff) {
+  return decodeStartOnDemand(BuffView(buff));
+}
+
+std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> solver::decodeStopOnDemand(BuffView buff) {
+  //Reuse the start on demand message code
+  return decodeOnDemand(buff, MessageID::stop_on_demand);
+}
+
+std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> solver::decodeStopOnDemand(Buffer& buff) {
+  return decodeStopOnDemand(BuffView(buff));
 }
 
 /**
@@ -633,272 +788,205 @@ std::vector<std::tuple<uint32_t, std::vector<std::u16string>>> solver::decodeSto
  * The world model uses the previously announced origin and type aliases
  * when decoding this message.
  */
+size_t solver::solutionMsgSize(const std::vector<SolutionData>& solutions) {
+  size_t size = sizeof(uint32_t) + sizeof(MessageID) + sizeof(uint8_t) + sizeof(uint32_t);
+  for (auto soln = solutions.begin(); soln != solutions.end(); ++soln) {
+    size += sizeof(soln->type_alias) + sizeof(soln->time) +
+      sizedUTF16Size(soln->target) + sizeof(uint32_t) + soln->data.size();
+  }
+  return size;
+}
+
 Buffer solver::makeSolutionMsg(bool create_uris, const std::vector<SolutionData>& solutions) {
   Buffer buff;
+  makeSolutionMsg(create_uris, solutions, buff);
+  return buff;
+}
+
+size_t solver::makeSolutionMsg(bool create_uris, const std::vector<SolutionData>& solutions, Buffer& out) {
+  OWL_METRIC_LATENCY(encode, solver, MessageID::solver_data);
+  size_t size = solutionMsgSize(solutions);
+  BuffWriter writer = appendWriter(out, size);
 
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-  //Push back space in the buffer for the total length.
-  pushBackVal(total_length, buff);
-  //Push back the message type.
-  total_length += pushBackVal(MessageID::solver_data, buff);
+  //Push back the total length and message type.
+  writer.writePrimitive<uint32_t>(size - sizeof(uint32_t));
+  writer.writePrimitive(MessageID::solver_data);
 
-  total_length += pushBackVal<uint8_t>(create_uris ? 1 : 0, buff);
+  writer.writePrimitive<uint8_t>(create_uris ? 1 : 0);
   //Push back the number of solutions
-  total_length += pushBackVal<uint32_t>(solutions.size(), buff);
+  writer.writePrimitive<uint32_t>(solutions.size());
 
   //Push back each solution
   for (auto soln = solutions.begin(); soln != solutions.end(); ++soln) {
-    total_length += pushBackVal(soln->type_alias, buff);
-    total_length += pushBackVal(soln->time, buff);
-    total_length += pushBackSizedUTF16(buff, soln->target);
-    total_length += pushSizedContainer(soln->data, buff);
+    writer.writePrimitive(soln->type_alias);
+    writer.writePrimitive(soln->time);
+    writer.writeSizedUTF16(soln->target);
+    writer.writeSizedBytes(soln->data.data(), soln->data.size());
   }
-
-  pushBackVal(total_length, buff, 0);
-  return buff;
+  return size;
 }
 
-std::tuple<bool, std::vector<solver::SolutionData>> solver::decodeSolutionMsg(Buffer& buff) {
-  BuffReader reader(buff);
+//Solutions with owned or interned targets are decoded the same way
+template<typename Solution>
+static std::tuple<bool, std::vector<Solution>> decodeSolutions(BuffView reader, StringInterner* interner = nullptr) {
+  OWL_METRIC_LATENCY(decode, solver, solver::MessageID::solver_data);
+  using solver::MessageID;
   bool create_uris = false;
-  vector<solver::SolutionData> solutions;
+  vector<Solution> solutions;
 
   uint32_t total_length = reader.readPrimitive<uint32_t>();
   MessageID msg_type = reader.readPrimitive<MessageID>();
 
   //Check to make sure this is a valid message.
-  if ( buff.size() == (total_length + 4) and
+  if ( reader.size() == (total_length + 4) and
        msg_type == MessageID::solver_data) {
     create_uris = reader.readPrimitive<uint8_t>() == 1;
     uint32_t num_solns = reader.readPrimitive<uint32_t>();
-    for (; num_solns > 0; --num_solns) {
-      SolutionData sd;
+    for (; num_solns > 0 and not reader.outOfRange(); --num_solns) {
+      solutions.push_back(Solution());
+      Solution& sd = solutions.back();
       reader.convertPrimitive(sd.type_alias);
       reader.convertPrimitive(sd.time);
-      sd.target = reader.readSizedUTF16();
-      sd.data = reader.readSizedVector<uint8_t>();
-
-      solutions.push_back(sd);
+      readString(reader, sd.target, interner);
+      ByteSpan data = reader.readSizedSpan();
+      sd.data.assign(data.begin(), data.end());
     }
   }
   //If we went out of range then the number of solutions is incorrect
   if (reader.outOfRange()) {
-    return std::make_pair(false, vector<solver::SolutionData>());
+    return std::make_tuple(false, vector<Solution>());
   }
-  return std::make_pair(create_uris, solutions);
+  return std::make_tuple(create_uris, std::move(solutions));
 }
 
-/**
- * Solvers may also create new URIs in the world model.
- */
-Buffer solver::makeCreateURI(const URI& new_uri, grail_time creation, std::u16string origin) {
-  Buffer buff;
-
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-
-  //Push back the total length and message type
-  pushBackVal(total_length, buff);
-  total_length += pushBackVal(MessageID::create_uri, buff);
+std::tuple<bool, std::vector<solver::SolutionData>> solver::decodeSolutionMsg(BuffView reader) {
+  return decodeSolutions<SolutionData>(reader);
+}
 
-  //Push back the query string
-  total_length += pushBackSizedUTF16(buff, new_uri);
-  total_length += pushBackVal(creation, buff);
-  total_length += pushBackUTF16(buff, origin);
+std::tuple<bool, std::vector<solver::InternedSolutionData>> solver::decodeSolutionMsg(BuffView reader, StringInterner& interner) {
+  return decodeSolutions<InternedSolutionData>(reader, &interner);
+}
 
-  pushBackVal(total_length, buff, 0);
-  return buff;
+std::tuple<bool, std::vector<solver::SolutionData>> solver::decodeSolutionMsg(Buffer& buff) {
+  return decodeSolutionMsg(BuffView(buff));
 }
 
-std::tuple<URI, grail_time, std::u16string> solver::decodeCreateURI(Buffer& buff) {
-  BuffReader reader(buff);
+/**
+ * Solvers may also create new URIs in the world model.
+ */
+size_t solver::createURISize(const URI& new_uri, const std::u16string& origin) {
+  return CreateURI::size(new_uri, 0, origin);
+}
 
-  uint32_t total_length = reader.readPrimitive<uint32_t>();
-  MessageID msg_type = reader.readPrimitive<MessageID>();
+Buffer solver::makeCreateURI(const URI& new_uri, grail_time creation, std::u16string origin) {
+  return CreateURI::encode(new_uri, creation, origin);
+}
 
-  if (buff.size() == total_length + 4 and
-      MessageID::create_uri == msg_type) {
-    //Return the new URI and its origin
-    u16string new_uri = reader.readSizedUTF16();
-    grail_time created = reader.readPrimitive<grail_time>();
-    u16string origin = reader.readUTF16((buff.size() - reader.cur_index)/2);
-    //If we went out of range then the URI is invalid
-    if (reader.outOfRange()) {
-      return std::make_tuple(u"", 0, u"");
-    }
+std::tuple<URI, grail_time, std::u16string> solver::decodeCreateURI(BuffView reader) {
+  u16string new_uri;
+  grail_time created;
+  u16string origin;
+  //Return the new URI and its origin
+  if (CreateURI::decode(reader, new_uri, created, origin)) {
     return std::make_tuple(new_uri, created, origin);
   }
-
   //Return empty strings on failure.
   return std::make_tuple(u"", 0, u"");
 }
 
-Buffer solver::makeExpireURI(const URI& uri, grail_time expiration, std::u16string origin) {
-  Buffer buff;
-
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-
-  //Push back the total length and message type
-  pushBackVal(total_length, buff);
-  total_length += pushBackVal(MessageID::expire_uri, buff);
-
-  //Push back the URI, expiration time, and origin
-  total_length += pushBackSizedUTF16(buff, uri);
-  total_length += pushBackVal(expiration, buff);
-  total_length += pushBackUTF16(buff, origin);
-
-  pushBackVal(total_length, buff, 0);
-  return buff;
+std::tuple<URI, grail_time, std::u16string> solver::decodeCreateURI(Buffer& buff) {
+  return decodeCreateURI(BuffView(buff));
 }
 
-std::tuple<URI, grail_time, std::u16string> solver::decodeExpireURI(Buffer& buff) {
-  BuffReader reader(buff);
+size_t solver::expireURISize(const URI& uri, const std::u16string& origin) {
+  return ExpireURI::size(uri, 0, origin);
+}
 
-  uint32_t total_length = reader.readPrimitive<uint32_t>();
-  MessageID msg_type = reader.readPrimitive<MessageID>();
+Buffer solver::makeExpireURI(const URI& uri, grail_time expiration, std::u16string origin) {
+  return ExpireURI::encode(uri, expiration, origin);
+}
 
-  if (buff.size() == total_length + 4 and
-      MessageID::expire_uri == msg_type) {
-    //Return the new URI and its origin
-    u16string uri = reader.readSizedUTF16();
-    grail_time expired = reader.readPrimitive<grail_time>();
-    u16string origin = reader.readUTF16((buff.size() - reader.cur_index)/2);
-    //If we went out of range then the URI is invalid
-    if (reader.outOfRange()) {
-      return std::make_tuple(u"", 0, u"");
-    }
+std::tuple<URI, grail_time, std::u16string> solver::decodeExpireURI(BuffView reader) {
+  u16string uri;
+  grail_time expired;
+  u16string origin;
+  if (ExpireURI::decode(reader, uri, expired, origin)) {
     return std::make_tuple(uri, expired, origin);
   }
-
   //Return empty strings on failure.
   return std::make_tuple(u"", 0, u"");
 }
 
-Buffer solver::makeExpireAttribute(const URI& uri, std::u16string attribute, std::u16string origin, grail_time expiration) {
-  Buffer buff;
-
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-
-  //Push back the total length and message type
-  pushBackVal(total_length, buff);
-  total_length += pushBackVal(MessageID::expire_attribute, buff);
-
-  //Push back the URI, expiration time, and origin
-  total_length += pushBackSizedUTF16(buff, uri);
-  total_length += pushBackSizedUTF16(buff, attribute);
-  total_length += pushBackVal(expiration, buff);
-  total_length += pushBackUTF16(buff, origin);
-
-  pushBackVal(total_length, buff, 0);
-  return buff;
+std::tuple<URI, grail_time, std::u16string> solver::decodeExpireURI(Buffer& buff) {
+  return decodeExpireURI(BuffView(buff));
 }
 
-std::tuple<URI, std::u16string, grail_time, std::u16string> solver::decodeExpireAttribute(Buffer& buff) {
-  BuffReader reader(buff);
+size_t solver::expireAttributeSize(const URI& uri, const std::u16string& attribute, const std::u16string& origin) {
+  return ExpireAttribute::size(uri, attribute, 0, origin);
+}
 
-  uint32_t total_length = reader.readPrimitive<uint32_t>();
-  MessageID msg_type = reader.readPrimitive<MessageID>();
+Buffer solver::makeExpireAttribute(const URI& uri, std::u16string attribute, std::u16string origin, grail_time expiration) {
+  return ExpireAttribute::encode(uri, attribute, expiration, origin);
+}
 
-  if (buff.size() == total_length + 4 and
-      MessageID::expire_attribute == msg_type) {
-    //Return the new URI and its origin
-    u16string uri = reader.readSizedUTF16();
-    u16string attribute = reader.readSizedUTF16();
-    grail_time expired = reader.readPrimitive<grail_time>();
-    u16string origin = reader.readUTF16((buff.size() - reader.cur_index)/2);
-    //If we went out of range then the URI is invalid
-    if (reader.outOfRange()) {
-      return std::make_tuple(u"", u"", 0, u"");
-    }
+std::tuple<URI, std::u16string, grail_time, std::u16string> solver::decodeExpireAttribute(BuffView reader) {
+  u16string uri;
+  u16string attribute;
+  grail_time expired;
+  u16string origin;
+  if (ExpireAttribute::decode(reader, uri, attribute, expired, origin)) {
     return std::make_tuple(uri, attribute, expired, origin);
   }
-
   //Return empty strings on failure.
   return std::make_tuple(u"", u"", 0, u"");
 }
 
-Buffer solver::makeDeleteURI(const URI& uri, std::u16string origin) {
-  Buffer buff;
-
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-
-  //Push back the total length and message type
-  pushBackVal(total_length, buff);
-  total_length += pushBackVal(MessageID::delete_uri, buff);
-
-  //Push back the query string
-  total_length += pushBackSizedUTF16(buff, uri);
-  total_length += pushBackUTF16(buff, origin);
-
-  pushBackVal(total_length, buff, 0);
-  return buff;
+std::tuple<URI, std::u16string, grail_time, std::u16string> solver::decodeExpireAttribute(Buffer& buff) {
+  return decodeExpireAttribute(BuffView(buff));
 }
 
-std::pair<URI, std::u16string> solver::decodeDeleteURI(Buffer& buff) {
-  BuffReader reader(buff);
+size_t solver::deleteURISize(const URI& uri, const std::u16string& origin) {
+  return DeleteURI::size(uri, origin);
+}
 
-  uint32_t total_length = reader.readPrimitive<uint32_t>();
-  MessageID msg_type = reader.readPrimitive<MessageID>();
+Buffer solver::makeDeleteURI(const URI& uri, std::u16string origin) {
+  return DeleteURI::encode(uri, origin);
+}
 
-  if (buff.size() == total_length + 4 and
-      MessageID::delete_uri == msg_type) {
-    //Return the new URI and its origin
-    u16string uri = reader.readSizedUTF16();
-    u16string origin = reader.readUTF16((buff.size() - reader.cur_index)/2);
-    //If we went out of range then the URI is invalid
-    if (reader.outOfRange()) {
-      return std::make_pair(u"", u"");
-    }
+std::pair<URI, std::u16string> solver::decodeDeleteURI(BuffView reader) {
+  u16string uri;
+  u16string origin;
+  if (DeleteURI::decode(reader, uri, origin)) {
     return std::make_pair(uri, origin);
   }
-
   //Return empty strings on failure.
   return std::make_pair(u"", u"");
 }
 
-Buffer solver::makeDeleteAttribute(const URI& uri, std::u16string attribute, std::u16string origin) {
-  Buffer buff;
-
-  //Keep track of the total length of the message (in bytes)
-  uint32_t total_length = 0;
-
-  //Push back the total length and message type
-  pushBackVal(total_length, buff);
-  total_length += pushBackVal(MessageID::delete_attribute, buff);
-
-  //Push back the query string
-  total_length += pushBackSizedUTF16(buff, uri);
-  total_length += pushBackSizedUTF16(buff, attribute);
-  total_length += pushBackUTF16(buff, origin);
-
-  pushBackVal(total_length, buff, 0);
-  return buff;
+std::pair<URI, std::u16string> solver::decodeDeleteURI(Buffer& buff) {
+  return decodeDeleteURI(BuffView(buff));
 }
 
-std::tuple<URI, std::u16string, std::u16string> solver::decodeDeleteAttribute(Buffer& buff) {
-  BuffReader reader(buff);
+size_t solver::deleteAttributeSize(const URI& uri, const std::u16string& attribute, const std::u16string& origin) {
+  return DeleteAttribute::size(uri, attribute, origin);
+}
 
-  uint32_t total_length = reader.readPrimitive<uint32_t>();
-  MessageID msg_type = reader.readPrimitive<MessageID>();
+Buffer solver::makeDeleteAttribute(const URI& uri, std::u16string attribute, std::u16string origin) {
+  return DeleteAttribute::encode(uri, attribute, origin);
+}
 
-  if (buff.size() == total_length + 4 and
-      MessageID::delete_attribute == msg_type) {
-    //Return the new URI and its origin
-    u16string uri = reader.readSizedUTF16();
-    u16string attribute = reader.readSizedUTF16();
-    u16string origin = reader.readUTF16((buff.size() - reader.cur_index)/2);
-    //If we went out of range then the strings are invalid
-    if (reader.outOfRange()) {
-      return std::make_tuple(u"", u"", u"");
-    }
+std::tuple<URI, std::u16string, std::u16string> solver::decodeDeleteAttribute(BuffView reader) {
+  u16string uri;
+  u16string attribute;
+  u16string origin;
+  if (DeleteAttribute::decode(reader, uri, attribute, origin)) {
     return std::make_tuple(uri, attribute, origin);
   }
-
   //Return empty strings on failure.
   return std::make_tuple(u"", u"", u"");
 }
 
+std::tuple<URI, std::u16string, std::u16string> solver::decodeDeleteAttribute(Buffer& buff) {
+  return decodeDeleteAttribute(BuffView(buff));
+}
+
@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file world_store.cpp
+ * Implementation of the WorldStore class.
+ *
+ * @author Bernhard Firner
+ */
+
+#include "world_store.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <regex>
+
+using namespace world_model;
+
+//Aliases start at 1, as in AliasRegistry where 0 means no alias
+static uint32_t alias(uint32_t id) {
+  return id + 1;
+}
+
+//std::regex has no char16_t version so patterns and URIs are widened.
+static std::wstring widen(const std::u16string& str) {
+  return std::wstring(str.begin(), str.end());
+}
+
+static bool isSpecial(char16_t c) {
+  return std::u16string(u".[]{}()*+?^$\\|").find(c) != std::u16string::npos;
+}
+
+/*
+ * The characters that every full match of a pattern starts with. This
+ * stops at the first special character and gives up on patterns with
+ * alternation since either side could match. @exact is set if the whole
+ * pattern is literal.
+ */
+static URI literalPrefix(const URI& pattern, bool& exact) {
+  exact = false;
+  URI prefix;
+  if (std::u16string::npos != pattern.find(u'|')) {
+    return prefix;
+  }
+  size_t i = (0 < pattern.size() and u'^' == pattern[0]) ? 1 : 0;
+  for (; i < pattern.size(); ++i) {
+    char16_t c = pattern[i];
+    if (u'\\' == c) {
+      //Only escaped punctuation is literal, \d and the like are classes
+      if (i + 1 == pattern.size() or not isSpecial(pattern[i + 1])) {
+        return prefix;
+      }
+      c = pattern[++i];
+    }
+    else if (isSpecial(c)) {
+      return prefix;
+    }
+    //A quantifier may repeat the character or leave it out
+    if (i + 1 < pattern.size()) {
+      char16_t next = pattern[i + 1];
+      if (u'*' == next or u'?' == next or u'{' == next) {
+        return prefix;
+      }
+      if (u'+' == next) {
+        prefix.push_back(c);
+        return prefix;
+      }
+    }
+    prefix.push_back(c);
+  }
+  exact = true;
+  return prefix;
+}
+
+//Compile a pattern, printing an error and returning false if it is invalid.
+static bool compile(const URI& pattern, std::wregex& regex) {
+  try {
+    regex.assign(widen(pattern), std::regex::ECMAScript | std::regex::optimize);
+    return true;
+  }
+  catch (std::regex_error& err) {
+    std::cerr<<"Invalid regular expression in world model request: "<<err.what()<<'\n';
+    return false;
+  }
+}
+
+uint32_t WorldStore::intern(const std::u16string& str,
+                            std::vector<std::u16string>& strings,
+                            std::map<std::u16string, uint32_t>& ids) {
+  auto id = ids.find(str);
+  if (id != ids.end()) {
+    return id->second;
+  }
+  uint32_t next = strings.size();
+  strings.push_back(str);
+  ids[str] = next;
+  return next;
+}
+
+std::vector<WorldStore::Track>::iterator WorldStore::findTrack(Object& object, uint32_t name, uint32_t origin) {
+  return std::lower_bound(object.tracks.begin(), object.tracks.end(), std::make_pair(name, origin),
+      [](const Track& track, const std::pair<uint32_t, uint32_t>& key) {
+        return std::make_pair(track.name, track.origin) < key;
+      });
+}
+
+void WorldStore::forMatches(const URI& pattern, const std::function<void(const URI&, const Object&)>& visit) const {
+  bool exact = false;
+  URI prefix = literalPrefix(pattern, exact);
+  if (exact) {
+    auto object = objects.find(prefix);
+    if (object != objects.end()) {
+      visit(object->first, object->second);
+    }
+    return;
+  }
+  std::wregex regex;
+  if (not compile(pattern, regex)) {
+    return;
+  }
+  //Only URIs that start with the literal prefix can match
+  for (auto object = objects.lower_bound(prefix); object != objects.end() and
+        0 == object->first.compare(0, prefix.size(), prefix); ++object) {
+    if (std::regex_match(widen(object->first), regex)) {
+      visit(object->first, object->second);
+    }
+  }
+}
+
+std::vector<bool> WorldStore::matchNames(const std::vector<URI>& patterns) const {
+  //An empty list of attributes asks for all of them
+  std::vector<bool> matches(names.size(), patterns.empty());
+  for (const URI& pattern : patterns) {
+    std::wregex regex;
+    if (compile(pattern, regex)) {
+      for (size_t name = 0; name < names.size(); ++name) {
+        if (not matches[name] and std::regex_match(widen(names[name]), regex)) {
+          matches[name] = true;
+        }
+      }
+    }
+  }
+  return matches;
+}
+
+void WorldStore::createURI(const URI& uri, grail_time creation) {
+  objects.insert(std::make_pair(uri, Object{creation, std::vector<Track>()}));
+}
+
+void WorldStore::insert(const URI& uri, const Attribute& attribute) {
+  //The expiration belongs to this value only, expiring the attribute would
+  //also expire newer values that are already stored.
+  insertValue(uri, attribute.name, attribute.origin,
+              Value{attribute.creation_date, attribute.expiration_date, attribute.data});
+}
+
+void WorldStore::insert(const URI& uri, const std::u16string& name, const std::u16string& origin,
+                        grail_time creation, const Buffer& data) {
+  insertValue(uri, name, origin, Value{creation, 0, data});
+}
+
+void WorldStore::insertValue(const URI& uri, const std::u16string& name, const std::u16string& origin,
+                             Value&& value) {
+  grail_time creation = value.creation;
+  Object& object = objects.insert(std::make_pair(uri, Object{creation, std::vector<Track>()})).first->second;
+  uint32_t name_id = intern(name, names, name_ids);
+  uint32_t origin_id = intern(origin, origins, origin_ids);
+  auto track = findTrack(object, name_id, origin_id);
+  if (track == object.tracks.end() or track->name != name_id or track->origin != origin_id) {
+    track = object.tracks.insert(track, Track{name_id, origin_id, std::vector<Value>()});
+  }
+  std::vector<Value>& values = track->values;
+  if (values.empty() or values.back().creation <= creation) {
+    values.push_back(std::move(value));
+  }
+  else {
+    auto later = std::upper_bound(values.begin(), values.end(), creation,
+        [](grail_time time, const Value& value) { return time < value.creation; });
+    values.insert(later, std::move(value));
+  }
+}
+
+void WorldStore::expireAttribute(const URI& uri, const std::u16string& name,
+                                 const std::u16string& origin, grail_time expiration) {
+  auto object = objects.find(uri);
+  auto name_id = name_ids.find(name);
+  auto origin_id = origin_ids.find(origin);
+  if (object == objects.end() or name_id == name_ids.end() or origin_id == origin_ids.end()) {
+    return;
+  }
+  auto track = findTrack(object->second, name_id->second, origin_id->second);
+  if (track == object->second.tracks.end() or track->name != name_id->second or
+      track->origin != origin_id->second) {
+    return;
+  }
+  for (Value& value : track->values) {
+    if (expiration < value.creation) {
+      break;
+    }
+    if (0 == value.expiration) {
+      value.expiration = expiration;
+    }
+  }
+}
+
+void WorldStore::expireURI(const URI& uri, grail_time expiration) {
+  auto object = objects.find(uri);
+  if (object == objects.end()) {
+    return;
+  }
+  for (Track& track : object->second.tracks) {
+    expireAttribute(uri, names[track.name], origins[track.origin], expiration);
+  }
+}
+
+void WorldStore::deleteURI(const URI& uri) {
+  objects.erase(uri);
+}
+
+void WorldStore::deleteAttribute(const URI& uri, const std::u16string& name, const std::u16string& origin) {
+  auto object = objects.find(uri);
+  auto name_id = name_ids.find(name);
+  auto origin_id = origin_ids.find(origin);
+  if (object == objects.end() or name_id == name_ids.end() or origin_id == origin_ids.end()) {
+    return;
+  }
+  auto track = findTrack(object->second, name_id->second, origin_id->second);
+  if (track != object->second.tracks.end() and track->name == name_id->second and
+      track->origin == origin_id->second) {
+    object->second.tracks.erase(track);
+  }
+}
+
+size_t WorldStore::size() const {
+  return objects.size();
+}
+
+std::vector<URI> WorldStore::searchURIs(const URI& pattern) const {
+  std::vector<URI> uris;
+  forMatches(pattern, [&](const URI& uri, const Object&) { uris.push_back(uri); });
+  return uris;
+}
+
+void WorldStore::snapshot(const client::Request& request, const OriginWeights& weights,
+                          const ResultHandler& handler) const {
+  grail_time stop = 0 == request.stop_period ? MAX_GRAIL_TIME : request.stop_period;
+  std::vector<bool> wanted = matchNames(request.attributes);
+  //Origins default to a preference of 1
+  std::vector<int32_t> preference(origins.size(), 1);
+  for (const std::pair<std::u16string, int32_t>& weight : weights) {
+    auto origin = origin_ids.find(weight.first);
+    if (origin != origin_ids.end()) {
+      preference[origin->second] = weight.second;
+    }
+  }
+  AliasedWorldData wd;
+  std::vector<std::pair<const Track*, const Value*>> candidates;
+  forMatches(request.object_uri, [&](const URI& uri, const Object& object) {
+    wd.attributes.clear();
+    //Tracks of the same attribute are next to each other
+    for (auto first = object.tracks.begin(); first != object.tracks.end();) {
+      auto last = first;
+      while (last != object.tracks.end() and last->name == first->name) {
+        ++last;
+      }
+      if (not wanted[first->name]) {
+        first = last;
+        continue;
+      }
+      candidates.clear();
+      int32_t best = -1;
+      for (; first != last; ++first) {
+        int32_t weight = preference[first->origin];
+        if (weight < 0 or weight < best) {
+          continue;
+        }
+        //The newest value created by the stop time
+        auto value = std::upper_bound(first->values.begin(), first->values.end(), stop,
+            [](grail_time time, const Value& value) { return time < value.creation; });
+        if (value == first->values.begin()) {
+          continue;
+        }
+        --value;
+        if (value->creation < request.start or
+            (0 != value->expiration and value->expiration <= stop)) {
+          continue;
+        }
+        if (best < weight) {
+          best = weight;
+          candidates.clear();
+        }
+        candidates.push_back(std::make_pair(&*first, &*value));
+      }
+      for (const std::pair<const Track*, const Value*>& candidate : candidates) {
+        const Value& value = *candidate.second;
+        wd.attributes.push_back(AliasedAttribute{alias(candidate.first->name), value.creation,
+            value.expiration, alias(candidate.first->origin), value.data});
+      }
+    }
+    if (not wd.attributes.empty()) {
+      wd.object_uri = uri;
+      handler(wd);
+    }
+  });
+}
+
+void WorldStore::range(const client::Request& request, const ResultHandler& handler) const {
+  grail_time stop = 0 == request.stop_period ? MAX_GRAIL_TIME : request.stop_period;
+  std::vector<bool> wanted = matchNames(request.attributes);
+  AliasedWorldData wd;
+  forMatches(request.object_uri, [&](const URI& uri, const Object& object) {
+    wd.attributes.clear();
+    for (const Track& track : object.tracks) {
+      if (not wanted[track.name]) {
+        continue;
+      }
+      auto earlier = [](const Value& value, grail_time time) { return value.creation < time; };
+      auto value = std::lower_bound(track.values.begin(), track.values.end(), request.start, earlier);
+      auto end = std::lower_bound(value, track.values.end(), stop, earlier);
+      for (; value != end; ++value) {
+        wd.attributes.push_back(AliasedAttribute{alias(track.name), value->creation,
+            value->expiration, alias(track.origin), value->data});
+      }
+    }
+    if (not wd.attributes.empty()) {
+      //Interleave the attributes in the order that they were created
+      std::stable_sort(wd.attributes.begin(), wd.attributes.end(),
+          [](const AliasedAttribute& a, const AliasedAttribute& b) {
+            return a.creation_date < b.creation_date;
+          });
+      wd.object_uri = uri;
+      handler(wd);
+    }
+  });
+}
+
+size_t WorldStore::snapshotMessages(const client::Request& request, const OriginWeights& weights,
+                                    uint32_t ticket, Buffer& out) const {
+  size_t messages = 0;
+  snapshot(request, weights, [&](const AliasedWorldData& wd) {
+      client::makeDataMessage(wd, ticket, out);
+      ++messages;
+    });
+  return messages;
+}
+
+size_t WorldStore::rangeMessages(const client::Request& request, uint32_t ticket, Buffer& out) const {
+  size_t messages = 0;
+  range(request, [&](const AliasedWorldData& wd) {
+      client::makeDataMessage(wd, ticket, out);
+      ++messages;
+    });
+  return messages;
+}
+
+static std::vector<client::AliasType> makeAliases(const std::vector<std::u16string>& strings) {
+  std::vector<client::AliasType> aliases;
+  for (size_t i = 0; i < strings.size(); ++i) {
+    aliases.push_back(client::AliasType{alias(i), strings[i]});
+  }
+  return aliases;
+}
+
+std::vector<client::AliasType> WorldStore::attributeAliases() const {
+  return makeAliases(names);
+}
+
+std::vector<client::AliasType> WorldStore::originAliases() const {
+  return makeAliases(origins);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file compression_test.cpp
+ * Envelopes open to the messages they were made from, and an envelope that
+ * holds another envelope is rejected with both kinds of output buffer.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <vector>
+
+#include "compression.hpp"
+#include "test_check.hpp"
+
+using namespace compression;
+
+int main() {
+  for (Codec codec : {compression::deflate, lz4, zstd}) {
+    if (not available(codec)) {
+      continue;
+    }
+    std::vector<unsigned char> message{0, 0, 0, 3, 7, 1, 2};
+    std::vector<unsigned char> envelope = makeEnvelope({message, message}, codec);
+    CHECK(isEnvelope(FrameView{envelope.data(), envelope.size()}));
+
+    std::vector<unsigned char> opened;
+    CHECK(openEnvelope(FrameView{envelope.data(), envelope.size()}, opened));
+    CHECK(2 * message.size() == opened.size());
+    CHECK(std::vector<unsigned char>(opened.begin(), opened.begin() + message.size()) == message);
+
+    //An envelope around that envelope and another message
+    std::vector<unsigned char> nested = makeEnvelope({message, envelope}, codec);
+    FrameView nested_view{nested.data(), nested.size()};
+    opened.clear();
+    CHECK(not openEnvelope(nested_view, opened));
+    CHECK(opened.empty());
+    FrameBuffer frames(0);
+    CHECK(not openEnvelope(nested_view, frames));
+    CHECK(0 == frames.buffered());
+  }
+  return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file event_loop_test.cpp
+ * A connection that declares a message over the maximum frame size is
+ * closed without buffering it, whether only the length field or the whole
+ * message has arrived, while other connections keep working.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <set>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "event_loop.hpp"
+#include "test_check.hpp"
+
+//A message with a @length byte body
+static std::vector<unsigned char> message(size_t length) {
+  std::vector<unsigned char> buff(length + 4, 0);
+  buff[0] = length >> 24;
+  buff[1] = length >> 16;
+  buff[2] = length >> 8;
+  buff[3] = length;
+  return buff;
+}
+
+static bool writeAll(int fd, const std::vector<unsigned char>& buff) {
+  return buff.size() == (size_t)write(fd, buff.data(), buff.size());
+}
+
+int main() {
+  size_t frames = 0;
+  std::set<uint64_t> closed;
+  EventLoop loop([&](EventLoop::Connection&, const FrameView&) { ++frames; });
+  loop.onClose([&](EventLoop::Connection& conn) { closed.insert(conn.id); });
+  loop.setMaxFrameSize(1000);
+
+  int good[2];
+  int header_only[2];
+  int whole[2];
+  CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, good));
+  CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, header_only));
+  CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, whole));
+  uint64_t good_id = loop.add(ClientSocket(0, "", good[1]));
+  uint64_t header_id = loop.add(ClientSocket(0, "", header_only[1]));
+  uint64_t whole_id = loop.add(ClientSocket(0, "", whole[1]));
+
+  //Only the length field of a 4 GiB message
+  CHECK(writeAll(header_only[0], std::vector<unsigned char>{0xFF, 0xFF, 0xFF, 0xFF}));
+  //A whole message that is over the limit, followed by one that is not
+  std::vector<unsigned char> stream = message(2000);
+  std::vector<unsigned char> small = message(10);
+  stream.insert(stream.end(), small.begin(), small.end());
+  CHECK(writeAll(whole[0], stream));
+  CHECK(writeAll(good[0], message(996)));
+  CHECK(writeAll(good[0], small));
+
+  for (int i = 0; i < 10; ++i) {
+    loop.runOnce(10);
+  }
+  CHECK(2 == frames);
+  CHECK(1 == closed.count(header_id));
+  CHECK(1 == closed.count(whole_id));
+  CHECK(0 == closed.count(good_id));
+  CHECK(1 == loop.size());
+  close(good[0]);
+  close(header_only[0]);
+  close(whole[0]);
+  return 0;
+}
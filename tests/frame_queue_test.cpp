@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file frame_queue_test.cpp
+ * Consumers sleeping in waitForItems are woken by every push and time out
+ * on an empty queue, and an EventLoop stops reading once its forward
+ * backlog is full and delivers everything, in order, once the worker
+ * catches up.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "event_loop.hpp"
+#include "frame_queue.hpp"
+#include "test_check.hpp"
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+static const size_t num_items = 200000;
+
+//Pop num_items from the queue, sleeping whenever it is empty. Returns
+//false if they were not 0, 1, 2... in order.
+template<typename Queue>
+static bool consume(Queue& queue, size_t producers) {
+  std::vector<size_t> next(producers, 0);
+  size_t item;
+  for (size_t popped = 0; popped < num_items * producers; ++popped) {
+    while (not queue.tryPop(item)) {
+      queue.waitForItems(-1);
+    }
+    size_t producer = item % producers;
+    if (item / producers != next[producer]++) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//Push num_items tagged with the producer, pausing now and then so that the
+//consumer falls asleep.
+template<typename Queue>
+static void produce(Queue& queue, size_t producer, size_t producers) {
+  for (size_t i = 0; i < num_items; ++i) {
+    size_t item = i * producers + producer;
+    while (not queue.tryPush(std::move(item))) {
+      std::this_thread::yield();
+    }
+    if (0 == i % 10000) {
+      std::this_thread::sleep_for(milliseconds(1));
+    }
+  }
+}
+
+static int testWaits() {
+  SPSCQueue<size_t> spsc(64);
+  steady_clock::time_point start = steady_clock::now();
+  CHECK(not spsc.waitForItems(50));
+  CHECK(45 <= duration_cast<milliseconds>(steady_clock::now() - start).count());
+  std::thread spsc_producer([&]() { produce(spsc, 0, 1); });
+  CHECK(consume(spsc, 1));
+  spsc_producer.join();
+
+  MPSCQueue<size_t> mpsc(64);
+  CHECK(not mpsc.waitForItems(0));
+  std::thread first([&]() { produce(mpsc, 0, 2); });
+  std::thread second([&]() { produce(mpsc, 1, 2); });
+  CHECK(consume(mpsc, 2));
+  first.join();
+  second.join();
+  return 0;
+}
+
+static int testBacklogBound() {
+  const size_t num_frames = 5000;
+  const size_t max_backlog = 8;
+  int sv[2];
+  CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+  EventLoop loop([](EventLoop::Connection&, const FrameView&) {});
+  SPSCQueue<QueuedFrame> queue(4);
+  loop.forwardTo(&queue, max_backlog);
+  loop.add(ClientSocket(0, "", sv[1]));
+
+  //Frames with a four byte payload counting up from 0
+  std::vector<unsigned char> stream;
+  for (uint32_t i = 0; i < num_frames; ++i) {
+    unsigned char frame[8] = {0, 0, 0, 4, uint8_t(i >> 24), uint8_t(i >> 16), uint8_t(i >> 8), uint8_t(i)};
+    stream.insert(stream.end(), frame, frame + 8);
+  }
+  CHECK(stream.size() == (size_t)write(sv[0], stream.data(), stream.size()));
+
+  //Without a worker the loop fills the queue and the backlog, then stops
+  for (int i = 0; i < 20; ++i) {
+    loop.runOnce(0);
+  }
+  CHECK(queue.capacity() == queue.size());
+  CHECK(max_backlog == loop.forwardBacklog());
+
+  bool in_order = true;
+  std::atomic<bool> done(false);
+  std::thread worker([&]() {
+      QueuedFrame frame;
+      for (uint32_t i = 0; i < num_frames; ++i) {
+        while (not queue.tryPop(frame)) {
+          queue.waitForItems(-1);
+        }
+        in_order = in_order and 8 == frame.data.size() and
+          i == loadNetworkValue<uint32_t>(frame.data.data() + 4);
+      }
+      done = true;});
+  while (not done) {
+    CHECK(loop.forwardBacklog() <= max_backlog);
+    loop.runOnce(10);
+  }
+  worker.join();
+  CHECK(in_order);
+  loop.forwardTo(nullptr);
+  close(sv[0]);
+  return 0;
+}
+
+int main() {
+  if (0 != testWaits()) {
+    return 1;
+  }
+  return testBacklogBound();
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file message_receiver_test.cpp
+ * Sample messages written to a socketpair in chunks that split messages
+ * are all returned, whole and in order, by getAvailableMessages and
+ * forEachMessage, which hand out many messages per call. A length field
+ * alone does not make the receive buffer grow to the declared size, and
+ * messages over the maximum frame size are rejected.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "message_receiver.hpp"
+#include "sample_data.hpp"
+#include "sensor_aggregator_protocol.hpp"
+#include "test_check.hpp"
+
+static const size_t num_samples = 5000;
+static const size_t chunk_size = 7777;
+
+//Write num_samples sample messages to @fd in chunks of chunk_size bytes
+static void writeSamples(int fd) {
+  std::vector<unsigned char> stream;
+  SampleData sample;
+  sample.physical_layer = 1;
+  sample.rx_id = 7;
+  sample.rss = -50;
+  sample.sense_data = std::vector<unsigned char>(8, 0);
+  sample.valid = true;
+  for (size_t i = 0; i < num_samples; ++i) {
+    sample.tx_id = i;
+    sample.rx_timestamp = i;
+    sensor_aggregator::makeSampleMsg(sample, stream);
+  }
+  for (size_t sent = 0; sent < stream.size();) {
+    size_t chunk = std::min(chunk_size, stream.size() - sent);
+    ssize_t length = write(fd, stream.data() + sent, chunk);
+    if (0 >= length) {
+      return;
+    }
+    sent += length;
+  }
+}
+
+//Returns false if @frame is not the sample with id @expected
+static bool isSample(const FrameView& frame, size_t expected) {
+  SampleData sample = sensor_aggregator::decodeSampleMsg(BuffView(frame));
+  return sample.valid and uint128_t(expected) == sample.tx_id and
+    Timestamp(expected) == sample.rx_timestamp;
+}
+
+static int testDrain(bool with_handler) {
+  int sv[2];
+  CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+  ClientSocket sock(0, "", sv[1]);
+  MessageReceiver receiver(sock);
+  std::thread writer([&]() { writeSamples(sv[0]); });
+
+  bool interrupted = false;
+  bool in_order = true;
+  size_t received = 0;
+  size_t calls = 0;
+  std::vector<FrameView> frames;
+  while (received < num_samples and calls < num_samples) {
+    ++calls;
+    if (with_handler) {
+      receiver.forEachMessage([&](const FrameView& frame) {
+          in_order = in_order and isSample(frame, received++);}, num_samples, interrupted);
+    }
+    else {
+      receiver.getAvailableMessages(frames, num_samples, interrupted);
+      for (const FrameView& frame : frames) {
+        in_order = in_order and isSample(frame, received++);
+      }
+    }
+  }
+  writer.join();
+  CHECK(num_samples == received);
+  CHECK(in_order);
+  //Every call drains whatever arrived, not one message at a time
+  CHECK(calls * 20 < num_samples);
+  std::cout<<(with_handler ? "forEachMessage" : "getAvailableMessages")<<" took "<<calls<<" calls\n";
+  close(sv[0]);
+  return 0;
+}
+
+//Returns true if receiving the next frame throws a std::runtime_error
+static bool rejected(MessageReceiver& receiver) {
+  bool interrupted = false;
+  try {
+    receiver.getNextFrame(interrupted);
+  }
+  catch (std::runtime_error& err) {
+    return true;
+  }
+  return false;
+}
+
+static int testLimits() {
+  //A claimed length of 4 GiB only grows the buffer in steps
+  FrameBuffer buffer(10000);
+  const unsigned char huge[] = {0xFF, 0xFF, 0xFF, 0xFF, 1, 2, 3};
+  buffer.append(huge, sizeof(huge));
+  CHECK(0xFFFFFFFFull + 4 == buffer.frameSize());
+  CHECK(65536 == buffer.receiveNeed(4096));
+  CHECK(100000 == buffer.receiveNeed(100000));
+
+  int sv[2];
+  CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+  {
+    ClientSocket sock(0, "", sv[1]);
+    MessageReceiver receiver(sock);
+    CHECK(sizeof(huge) == (size_t)write(sv[0], huge, sizeof(huge)));
+    CHECK(rejected(receiver));
+  }
+  close(sv[0]);
+
+  //A lower limit rejects a whole message that arrives in one piece
+  CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+  {
+    ClientSocket sock(0, "", sv[1]);
+    MessageReceiver receiver(sock);
+    receiver.setMaxFrameSize(1000);
+    std::vector<unsigned char> message(2000, 0);
+    message[2] = (message.size() - 4) >> 8;
+    message[3] = (message.size() - 4) & 0xFF;
+    CHECK(message.size() == (size_t)write(sv[0], message.data(), message.size()));
+    CHECK(rejected(receiver));
+  }
+  close(sv[0]);
+  return 0;
+}
+
+int main() {
+  if (0 != testDrain(false) or 0 != testDrain(true)) {
+    return 1;
+  }
+  return testLimits();
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file sample_batch_test.cpp
+ * The transmitter and window filters keep the same samples, in the same
+ * order, as a plain loop over the samples, including at batch sizes that
+ * leave a partial block for the vector kernels and at extreme timestamps.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "sample_batch.hpp"
+#include "test_check.hpp"
+
+static const Timestamp edges[] = {INT64_MIN, INT64_MIN + 1, -0x100000000LL, -1, 0, 1,
+  0xFFFFFFFFLL, 0x100000000LL, INT64_MAX - 1, INT64_MAX};
+static const size_t num_edges = sizeof(edges) / sizeof(edges[0]);
+
+static Timestamp randomTime(std::mt19937_64& rng) {
+  if (rng() & 1) {
+    return edges[rng() % num_edges];
+  }
+  return (Timestamp)rng();
+}
+
+static void fill(SampleBatch& batch, std::mt19937_64& rng, size_t count) {
+  batch.clear();
+  for (size_t i = 0; i < count; ++i) {
+    unsigned char sense = i;
+    batch.push_back(rng() % 3, TransmitterID(rng() % 4, rng() % 4), ReceiverID(0, i),
+        randomTime(rng), -50.0, ByteSpan{&sense, 1});
+  }
+}
+
+static std::vector<uint64_t> receivers(const SampleBatch& batch) {
+  std::vector<uint64_t> ids;
+  for (const ReceiverID& rx : batch.receivers()) {
+    ids.push_back(rx.lower);
+  }
+  return ids;
+}
+
+int main() {
+  std::mt19937_64 rng(1);
+  SampleBatch batch;
+  for (int round = 0; round < 1000; ++round) {
+    size_t count = rng() % 80;
+    unsigned char phy = rng() % 3;
+    TransmitterID base(rng() % 4, rng() % 4);
+    TransmitterID mask(rng() % 4, rng() % 4);
+
+    fill(batch, rng, count);
+    std::vector<uint64_t> expected;
+    for (size_t i = 0; i < batch.size(); ++i) {
+      const TransmitterID& tx = batch.transmitters()[i];
+      if (batch.physicalLayers()[i] == phy and
+          (tx.upper & mask.upper) == (base.upper & mask.upper) and
+          (tx.lower & mask.lower) == (base.lower & mask.lower)) {
+        expected.push_back(i);
+      }
+    }
+    CHECK(batch.filterTransmitters(phy, base, mask) == expected.size());
+    CHECK(receivers(batch) == expected);
+
+    Timestamp begin = randomTime(rng);
+    Timestamp end = randomTime(rng);
+    fill(batch, rng, count);
+    expected.clear();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      if (begin <= batch.timestamps()[i] and batch.timestamps()[i] < end) {
+        expected.push_back(i);
+      }
+    }
+    CHECK(batch.filterWindow(begin, end) == expected.size());
+    CHECK(receivers(batch) == expected);
+    //Sense data moves with its sample
+    for (size_t i = 0; i < batch.size(); ++i) {
+      CHECK(batch.senseData()[i].size == 1);
+      CHECK(batch.senseData()[i].data[0] == (unsigned char)expected[i]);
+    }
+  }
+  return 0;
+}
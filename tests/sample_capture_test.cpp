@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file sample_capture_test.cpp
+ * A capture left with a partial frame at its end is truncated back to its
+ * last whole frame when it is reopened and the discarded bytes are counted,
+ * and samples appended directly read back unchanged.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sample_capture.hpp"
+#include "sensor_aggregator_protocol.hpp"
+#include "test_check.hpp"
+
+using namespace sensor_aggregator;
+
+static SampleData sample(float rss) {
+  SampleData s;
+  s.physical_layer = 1;
+  s.tx_id = 5;
+  s.rx_id = 9;
+  s.rx_timestamp = 1000 + rss;
+  s.rss = rss;
+  s.sense_data = {1, 2, 3};
+  s.valid = true;
+  return s;
+}
+
+static int testDiscard(const std::string& path) {
+  std::vector<unsigned char> frame;
+  makeSampleMsg(sample(1), frame);
+  {
+    CaptureWriter writer(path);
+    CHECK(0 == writer.discardedBytes());
+    CHECK(writer.append(frame));
+    CHECK(writer.append(frame));
+  }
+  //Leave part of a third frame behind as a crashed writer would
+  int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+  CHECK(-1 != fd);
+  CHECK(5 == write(fd, frame.data(), 5));
+  close(fd);
+
+  {
+    CaptureWriter writer(path);
+    CHECK(5 == writer.discardedBytes());
+    CHECK(writer.append(frame));
+  }
+  //The reopened file ends cleanly and the new frame follows the old ones
+  CaptureWriter again(path);
+  CHECK(0 == again.discardedBytes());
+  CaptureReader reader(path);
+  SampleData got;
+  size_t frames = 0;
+  while (reader.nextSample(got)) {
+    CHECK(got.valid and 1 == got.rss);
+    ++frames;
+  }
+  CHECK(3 == frames);
+  return 0;
+}
+
+static int testAppendSample(const std::string& path) {
+  {
+    CaptureWriter writer(path);
+    for (int i = 0; i < 4; ++i) {
+      writer.append(sample(i));
+    }
+  }
+  CaptureReader reader(path);
+  SampleData got;
+  for (int i = 0; i < 4; ++i) {
+    SampleData expected = sample(i);
+    CHECK(reader.nextSample(got));
+    CHECK(got.valid);
+    CHECK(expected.physical_layer == got.physical_layer);
+    CHECK(expected.tx_id == got.tx_id and expected.rx_id == got.rx_id);
+    CHECK(expected.rx_timestamp == got.rx_timestamp and expected.rss == got.rss);
+    CHECK(expected.sense_data == got.sense_data);
+  }
+  CHECK(not reader.nextSample(got));
+  return 0;
+}
+
+int main() {
+  std::string path = "sample_capture_test.cap";
+  std::remove(path.c_str());
+  int result = testDiscard(path);
+  std::remove(path.c_str());
+  if (0 == result) {
+    result = testAppendSample(path);
+    std::remove(path.c_str());
+  }
+  return result;
+}
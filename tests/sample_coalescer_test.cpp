@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file sample_coalescer_test.cpp
+ * In both modes one sample per interval reaches the subscriber, a key that
+ * keeps receiving samples stays tracked across its deadlines, and a key
+ * that is quiet for a whole interval is forgotten.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <vector>
+
+#include "sample_coalescer.hpp"
+#include "test_check.hpp"
+
+using namespace aggregator_solver;
+
+static SampleData sample(float rss) {
+  SampleData s;
+  s.physical_layer = 1;
+  s.tx_id = 5;
+  s.rx_id = 9;
+  s.rx_timestamp = 0;
+  s.rss = rss;
+  s.valid = true;
+  return s;
+}
+
+static int testForwardFirst() {
+  SampleCoalescer coalescer(SampleCoalescer::forward_first, 10);
+  std::vector<float> released;
+  SampleCoalescer::ForwardHandler forward = [&](SubscriptionIndex::SubscriberID, const SampleData& s) {
+    released.push_back(s.rss);};
+
+  //A sample every 10ms for one second with a 100ms interval
+  size_t forwarded = 0;
+  for (uint64_t now = 1000; now < 2000; now += 10) {
+    coalescer.advance(now, forward);
+    //The key is busy the whole time so no deadline forgets it
+    CHECK(1000 == now or 1 == coalescer.size());
+    forwarded += coalescer.offer(1, 100, sample(now), now);
+  }
+  CHECK(10 == forwarded);
+  CHECK(released.empty());
+
+  //Once the samples stop the key is forgotten after a quiet interval
+  coalescer.advance(2100, forward);
+  coalescer.advance(2200, forward);
+  CHECK(0 == coalescer.size());
+  //A new sample after that is forwarded right away
+  CHECK(coalescer.offer(1, 100, sample(0), 2210));
+  return 0;
+}
+
+static int testKeepLatest() {
+  SampleCoalescer coalescer(SampleCoalescer::keep_latest, 10);
+  std::vector<float> released;
+  SampleCoalescer::ForwardHandler forward = [&](SubscriptionIndex::SubscriberID subscriber, const SampleData& s) {
+    if (1 == subscriber) {
+      released.push_back(s.rss);
+    }};
+
+  CHECK(coalescer.offer(1, 100, sample(1), 1000));
+  CHECK(not coalescer.offer(1, 100, sample(2), 1050));
+  CHECK(not coalescer.offer(1, 100, sample(3), 1060));
+  coalescer.advance(1100, forward);
+  //The latest sample is released when the interval ends
+  CHECK(1 == released.size() and 3 == released[0]);
+  CHECK(1 == coalescer.size());
+
+  //A sample in the next interval is held and released again
+  CHECK(not coalescer.offer(1, 100, sample(4), 1150));
+  coalescer.advance(1200, forward);
+  CHECK(2 == released.size() and 4 == released[1]);
+  CHECK(1 == coalescer.size());
+
+  //Nothing arrives for a whole interval so the key is forgotten
+  coalescer.advance(1300, forward);
+  CHECK(0 == coalescer.size());
+  CHECK(2 == released.size());
+  return 0;
+}
+
+int main() {
+  if (0 != testForwardFirst()) {
+    return 1;
+  }
+  return testKeepLatest();
+}
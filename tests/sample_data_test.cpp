@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file sample_data_test.cpp
+ * Reading a uint128_t follows the stream's base, stops at the first
+ * character that is not a digit, reads back what operator<< writes, and
+ * only fails without digits or on overflow.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <sstream>
+#include <string>
+
+#include "sample_data.hpp"
+#include "test_check.hpp"
+
+//Read one value from @text with the stream's base set by @base, which may
+//be 0 for no base. Returns false if the read failed.
+static bool read(const std::string& text, std::ios_base::fmtflags base, uint128_t& val,
+                 std::string& rest) {
+  std::istringstream is(text);
+  is.setf(base, std::ios_base::basefield);
+  bool good = bool(is >> val);
+  is.clear();
+  std::getline(is, rest);
+  return good;
+}
+
+int main() {
+  uint128_t val;
+  std::string rest;
+
+  CHECK(read("1234", std::ios_base::dec, val, rest) and uint128_t(1234) == val);
+  //Delimiters are left in the stream
+  CHECK(read("  1234, 5", std::ios_base::dec, val, rest) and uint128_t(1234) == val and ", 5" == rest);
+  CHECK(read("ff", std::ios_base::hex, val, rest) and uint128_t(255) == val);
+  CHECK(read("0xFF;", std::ios_base::hex, val, rest) and uint128_t(255) == val and ";" == rest);
+  CHECK(read("17", std::ios_base::oct, val, rest) and uint128_t(15) == val);
+  CHECK(read("0x10", std::ios_base::dec, val, rest) and uint128_t(16) == val);
+  //With no base a prefix chooses it
+  CHECK(read("010", std::ios_base::fmtflags(0), val, rest) and uint128_t(8) == val);
+  CHECK(read("0x10", std::ios_base::fmtflags(0), val, rest) and uint128_t(16) == val);
+  CHECK(read("10", std::ios_base::fmtflags(0), val, rest) and uint128_t(10) == val);
+  CHECK(read("0", std::ios_base::dec, val, rest) and uint128_t(0) == val);
+  //Digits past the base end the number
+  CHECK(read("129", std::ios_base::oct, val, rest) and uint128_t(10) == val and "9" == rest);
+
+  //The largest value in decimal and one more than that
+  CHECK(read("340282366920938463463374607431768211455", std::ios_base::dec, val, rest));
+  CHECK(uint128_t(~0ull, ~0ull) == val);
+  val = uint128_t(5);
+  CHECK(not read("340282366920938463463374607431768211456", std::ios_base::dec, val, rest));
+  CHECK(uint128_t(5) == val);
+  CHECK(not read("x12", std::ios_base::dec, val, rest));
+  CHECK(not read("0x", std::ios_base::dec, val, rest));
+  CHECK(not read("", std::ios_base::dec, val, rest));
+
+  //What operator<< writes reads back
+  uint128_t id(0x12345, 0xabcdef0123456789ull);
+  std::ostringstream os;
+  os<<id<<' '<<uint128_t(7);
+  std::istringstream is(os.str());
+  uint128_t first;
+  uint128_t second;
+  CHECK(is >> first >> second);
+  CHECK(id == first and uint128_t(7) == second);
+  return 0;
+}
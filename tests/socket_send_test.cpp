@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file socket_send_test.cpp
+ * A blocking send to a socket that stays full must give up after one
+ * second with temporarily_unavailable instead of blocking in the kernel.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <chrono>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "metrics.hpp"
+#include "simple_sockets.hpp"
+#include "temporarily_unavailable.hpp"
+#include "test_check.hpp"
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+int main() {
+  int sv[2];
+  CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+  //Nothing ever reads from sv[1] so the pair fills up
+  ClientSocket sender(0, "", sv[0]);
+  std::vector<unsigned char> buff(8 * 1024 * 1024, 1);
+  bool unavailable = false;
+  steady_clock::time_point start = steady_clock::now();
+  try {
+    sender.send(buff);
+  }
+  catch (temporarily_unavailable& err) {
+    unavailable = true;
+  }
+  double msec = duration_cast<milliseconds>(steady_clock::now() - start).count();
+  CHECK(unavailable);
+  CHECK(900 <= msec);
+  if (metrics::enabled()) {
+    metrics::Snapshot snap = metrics::snapshot();
+    CHECK(1 <= snap[metrics::send_unavailable]);
+    CHECK(900000 <= snap[metrics::send_blocked_usec]);
+  }
+  close(sv[1]);
+  return 0;
+}
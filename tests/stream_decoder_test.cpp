@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file stream_decoder_test.cpp
+ * A URI search response larger than the socket buffer is decoded across
+ * several receives, and receive reports a malformed message that it
+ * skipped and a socket with no data.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <cerrno>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "stream_decoder.hpp"
+#include "test_check.hpp"
+
+using namespace world_model;
+
+//Write as much of @buff after @sent as the socket takes
+static bool writeSome(int fd, const std::vector<unsigned char>& buff, size_t& sent) {
+  ssize_t length = write(fd, buff.data() + sent, buff.size() - sent);
+  if (0 < length) {
+    sent += length;
+  }
+  return 0 < length or EAGAIN == errno;
+}
+
+//Write all of a small @buff to the socket
+static bool writeAll(int fd, const std::vector<unsigned char>& buff) {
+  size_t sent = 0;
+  return writeSome(fd, buff, sent) and buff.size() == sent;
+}
+
+int main() {
+  int sv[2];
+  CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv));
+  ClientSocket receiver(0, "", sv[1]);
+
+  std::vector<URI> uris;
+  for (int i = 0; i < 4000; ++i) {
+    uris.push_back(u"building.room." + URI(std::to_string(i).begin(), std::to_string(i).end()));
+  }
+  size_t num_uris = 0;
+  size_t num_ends = 0;
+  bool in_order = true;
+  StreamDecoder decoder(StreamDecoder::from_world_model);
+  decoder.onURI([&](const URI& uri) {
+      in_order = in_order and num_uris < uris.size() and uri == uris[num_uris];
+      ++num_uris;});
+  decoder.onEnd([&](uint8_t) { ++num_ends; });
+
+  CHECK(StreamDecoder::nothing == decoder.receive(receiver));
+
+  //Larger than one receive, so this takes several
+  std::vector<unsigned char> response = client::makeURISearchResponse(uris);
+  CHECK(65536 < response.size());
+  size_t sent = 0;
+  size_t receives = 0;
+  while (num_ends == 0) {
+    if (sent < response.size()) {
+      CHECK(writeSome(sv[0], response, sent));
+    }
+    CHECK(StreamDecoder::decoded == decoder.receive(receiver));
+    ++receives;
+  }
+  CHECK(1 < receives);
+  CHECK(uris.size() == num_uris);
+  CHECK(in_order);
+  CHECK(0 == decoder.buffered());
+  CHECK(StreamDecoder::nothing == decoder.receive(receiver));
+
+  //A data response whose frame ends inside its header
+  std::vector<unsigned char> malformed{0, 0, 0, 3, uint8_t(client::MessageID::data_response), 0, 0};
+  CHECK(writeAll(sv[0], malformed));
+  CHECK(StreamDecoder::skipped_malformed == decoder.receive(receiver));
+  CHECK(0 == decoder.buffered());
+
+  //The stream is still in sync afterwards
+  CHECK(writeAll(sv[0], client::makeURISearchResponse({u"after"})));
+  CHECK(StreamDecoder::decoded == decoder.receive(receiver));
+  CHECK(2 == num_ends);
+  CHECK(uris.size() + 1 == num_uris);
+  close(sv[0]);
+  return 0;
+}
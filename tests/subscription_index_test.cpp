@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file subscription_index_test.cpp
+ * Rules without transmitters are ignored and do not make a subscriber
+ * count toward the size of the index, while rules with transmitters match
+ * by mask.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <vector>
+
+#include "subscription_index.hpp"
+#include "test_check.hpp"
+
+using namespace aggregator_solver;
+
+int main() {
+  SubscriptionIndex index;
+  std::vector<SubscriptionIndex::Match> matches;
+
+  Rule empty{1, {}, 100};
+  index.add(1, Subscription{empty});
+  CHECK(0 == index.size());
+  CHECK(0 == index.match(1, 5, matches));
+
+  //An empty rule next to a real one is dropped but the real one is kept
+  Rule range{1, {Transmitter{0, 0}}, 50};
+  index.add(2, Subscription{empty, range});
+  CHECK(1 == index.size());
+  CHECK(1 == index.match(1, 5, matches));
+  CHECK(2 == matches[0].subscriber);
+  CHECK(50 == matches[0].update_interval);
+
+  Rule exact{1, {Transmitter{7, ~uint128_t(0)}}, 10};
+  index.add(3, Subscription{exact});
+  CHECK(2 == index.size());
+  CHECK(1 == index.match(1, 5, matches));
+  CHECK(2 == index.match(1, 7, matches));
+  CHECK(0 == index.match(2, 7, matches));
+
+  index.remove(2);
+  CHECK(1 == index.size());
+  CHECK(0 == index.match(1, 5, matches));
+  CHECK(1 == index.match(1, 7, matches));
+  CHECK(3 == matches[0].subscriber);
+  return 0;
+}
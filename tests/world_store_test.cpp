@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/**
+ * @file world_store_test.cpp
+ * Values inserted out of order keep their own expiration dates and do not
+ * change the values around them, and result aliases start at 1.
+ *
+ * @author Bernhard Firner
+ */
+
+#include <vector>
+
+#include "test_check.hpp"
+#include "world_store.hpp"
+
+using namespace world_model;
+
+static std::vector<AliasedWorldData> snapshot(const WorldStore& store, grail_time stop) {
+  std::vector<AliasedWorldData> results;
+  store.snapshot(client::Request{u"room\\.1", {u"location"}, 0, stop}, WorldStore::OriginWeights(),
+      [&](const AliasedWorldData& wd) { results.push_back(wd); });
+  return results;
+}
+
+int main() {
+  WorldStore store;
+  //The current value, which never expires
+  store.insert(u"room.1", Attribute{u"location", 10, 0, u"solver", Buffer(1, 1)});
+  //An older value that arrives late and was already expired
+  store.insert(u"room.1", Attribute{u"location", 5, 10, u"solver", Buffer(1, 0)});
+
+  std::vector<AliasedWorldData> now = snapshot(store, 0);
+  CHECK(1 == now.size());
+  CHECK(1 == now[0].attributes.size());
+  CHECK(10 == now[0].attributes[0].creation_date);
+  CHECK(0 == now[0].attributes[0].expiration_date);
+
+  //Before the current value was created the older one was current
+  std::vector<AliasedWorldData> before = snapshot(store, 7);
+  CHECK(1 == before.size());
+  CHECK(5 == before[0].attributes[0].creation_date);
+  CHECK(10 == before[0].attributes[0].expiration_date);
+
+  //The range gives both values in order of creation
+  std::vector<AliasedWorldData> range;
+  store.range(client::Request{u"room\\.1", {}, 0, 0},
+      [&](const AliasedWorldData& wd) { range.push_back(wd); });
+  CHECK(1 == range.size());
+  CHECK(2 == range[0].attributes.size());
+  CHECK(5 == range[0].attributes[0].creation_date);
+  CHECK(10 == range[0].attributes[1].creation_date);
+
+  //Aliases start at 1 and match the alias tables
+  CHECK(1 == now[0].attributes[0].name_alias);
+  CHECK(1 == now[0].attributes[0].origin_alias);
+  std::vector<client::AliasType> names = store.attributeAliases();
+  CHECK(1 == names.size());
+  CHECK(1 == names[0].alias);
+  CHECK(u"location" == names[0].type);
+  CHECK(1 == store.originAliases()[0].alias);
+  return 0;
+}